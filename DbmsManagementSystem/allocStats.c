@@ -0,0 +1,85 @@
+#include "allocStats.h"
+#include "memoryPool.h"
+#include "slabAllocator.h"
+#include "slabMalloc.h"
+
+// Periodic report
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t report_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t report_thread;
+static bool report_running;
+static bool report_stopping;
+static unsigned int report_interval_ms;
+static FILE *report_out;
+
+// Every pool, every slab cache in use and slab_malloc's large allocations
+void alloc_stats_dump(FILE *out)
+{
+    pool_stats_dump_all(out);
+    slab_stats_dump_all(out);
+
+    alloc_stats_t large;
+    slab_malloc_large_stats(&large);
+    if (large.allocations || large.failed)
+        alloc_stats_print(out, "slab_malloc large", &large);
+    fflush(out);
+}
+
+static void *report_main(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&report_lock);
+    while (!report_stopping)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += report_interval_ms / 1000;
+        deadline.tv_nsec += (long)(report_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if (pthread_cond_timedwait(&report_wake, &report_lock, &deadline) != 0 && !report_stopping)
+        {
+            pthread_mutex_unlock(&report_lock);
+            alloc_stats_dump(report_out);
+            pthread_mutex_lock(&report_lock);
+        }
+    }
+    pthread_mutex_unlock(&report_lock);
+    return NULL;
+}
+
+// Background report: alloc_stats_dump to `out` every interval_ms until
+// alloc_report_stop
+int alloc_report_start(unsigned int interval_ms, FILE *out)
+{
+    pthread_mutex_lock(&report_lock);
+    if (report_running || interval_ms == 0)
+    {
+        pthread_mutex_unlock(&report_lock);
+        return -1;
+    }
+    report_interval_ms = interval_ms;
+    report_out = out;
+    report_stopping = false;
+    report_running = pthread_create(&report_thread, NULL, report_main, NULL) == 0;
+    pthread_mutex_unlock(&report_lock);
+    return report_running ? 0 : -1;
+}
+
+void alloc_report_stop()
+{
+    pthread_mutex_lock(&report_lock);
+    if (!report_running)
+    {
+        pthread_mutex_unlock(&report_lock);
+        return;
+    }
+    report_stopping = true;
+    pthread_cond_signal(&report_wake);
+    pthread_mutex_unlock(&report_lock);
+    pthread_join(report_thread, NULL);
+    report_running = false;
+}
@@ -0,0 +1,87 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include "main.h"
+
+// Allocation counters for the pool and the slab caches. The fast paths count
+// into the calling thread's cache with plain single-writer stores - no lock,
+// no atomic read-modify-write, no cache line shared with another thread - and
+// a stats call adds the threads up. The locked paths count under the lock
+// they already hold, and only rare events (failures, exiting threads) pay
+// for an atomic add.
+//
+// Build with -DALLOC_STATS=0 to compile the per-call counters out. The
+// figures the allocators keep under their locks anyway (high-water mark,
+// slab count and utilization) are reported either way.
+#ifndef ALLOC_STATS
+#define ALLOC_STATS 1
+#endif
+
+#if ALLOC_STATS
+#define STAT_ADD(counter, n) __atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)   // one writer at a time
+#define STAT_ADD_SHARED(counter, n) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#define STAT_READ(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#else
+#define STAT_ADD(counter, n) ((void)(n))
+#define STAT_ADD_SHARED(counter, n) ((void)(n))
+#define STAT_READ(counter) ((void)(counter), (uint64_t)0)
+#endif
+
+typedef struct alloc_counters
+{
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t requested_bytes;   // what the callers asked for, summed over allocations
+    uint64_t allocated_bytes;   // what they were given
+} alloc_counters_t;
+
+// What an allocator reports
+typedef struct alloc_stats
+{
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t failed;
+    size_t in_use;              // objects allocated and not freed
+    size_t bytes_in_use;
+    size_t high_water_bytes;    // most bytes out at once, objects held in thread caches included
+    size_t reserved_bytes;      // taken from the system
+    double fragmentation;       // share of the allocated bytes the callers did not ask for
+} alloc_stats_t;
+
+// Adding `part` to `total`; `part` may be another thread's and still counting
+static inline void alloc_counters_add(alloc_counters_t *total, alloc_counters_t *part)
+{
+    total->allocations += STAT_READ(part->allocations);
+    total->frees += STAT_READ(part->frees);
+    total->requested_bytes += STAT_READ(part->requested_bytes);
+    total->allocated_bytes += STAT_READ(part->allocated_bytes);
+}
+
+// The figures that follow from the counters. A free may be counted before
+// the allocation it undoes when the two happened on different threads, so
+// the difference is clamped at zero.
+static inline void alloc_stats_fill(alloc_stats_t *stats, const alloc_counters_t *counters, size_t object_size)
+{
+    memset(stats, 0, sizeof(alloc_stats_t));
+    stats->allocations = counters->allocations;
+    stats->frees = counters->frees;
+    stats->in_use = counters->allocations > counters->frees ? (size_t)(counters->allocations - counters->frees) : 0;
+    stats->bytes_in_use = stats->in_use * object_size;
+    if (counters->allocated_bytes)
+        stats->fragmentation = 1.0 - (double)counters->requested_bytes / counters->allocated_bytes;
+}
+
+static inline void alloc_stats_print(FILE *out, const char *name, const alloc_stats_t *stats)
+{
+    fprintf(out, "%s: %llu allocs, %llu frees, %llu failed; %zu in use (%.1f KB), high water %.1f KB, "
+                 "reserved %.1f KB, internal fragmentation %.1f%%\n",
+            name, (unsigned long long)stats->allocations, (unsigned long long)stats->frees,
+            (unsigned long long)stats->failed, stats->in_use, stats->bytes_in_use / 1024.0,
+            stats->high_water_bytes / 1024.0, stats->reserved_bytes / 1024.0, stats->fragmentation * 100);
+}
+
+void alloc_stats_dump(FILE *out);
+int alloc_report_start(unsigned int interval_ms, FILE *out);
+void alloc_report_stop();
+
+#endif
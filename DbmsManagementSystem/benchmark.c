@@ -0,0 +1,1239 @@
+#include "benchmark.h"
+#include "memoryPool.h"
+#include "slabAllocator.h"
+#include "slabMalloc.h"
+#include "operations.h"
+#include "query.h"
+#include "bulkLoad.h"
+#include "heapFile.h"
+#include <errno.h>
+
+#define BENCH_MAX_THREADS 64
+#define BENCH_BLOCK_SIZE 64
+#define BENCH_BATCH 64              // blocks allocated then freed per round
+#define BENCH_HELD 4096             // live slots per thread in the random workload
+#define BENCH_RING 1024             // blocks in flight between a producer and its consumer
+
+// An allocator under test: the pool, a slab cache, slab_malloc or plain
+// malloc. Run under LD_PRELOAD=libjemalloc.so (or tcmalloc) to put a
+// per-thread-arena malloc in the "malloc" column.
+typedef struct bench_allocator {
+    const char *name;
+    void *(*alloc)(void *ctx, size_t size);
+    void (*release)(void *ctx, void *block);
+    void *ctx;
+    size_t size;                    // bytes per block, 0 for a mix of sizes
+} bench_allocator_t;
+
+// Single-producer single-consumer queue carrying blocks from the thread that
+// allocates them to the thread that frees them
+typedef struct bench_ring {
+    size_t head;                    // advanced by the producer
+    char pad[64 - sizeof(size_t)];
+    size_t tail;                    // advanced by the consumer
+    void *slots[BENCH_RING];
+} bench_ring_t;
+
+typedef struct bench_thread {
+    pthread_t thread;
+    const bench_allocator_t *allocator;
+    int workload;
+    long operations;
+    unsigned int seed;
+    bench_ring_t *ring;
+    int producer;
+    int failed;
+} bench_thread_t;
+
+enum { WORKLOAD_BATCH, WORKLOAD_RANDOM, WORKLOAD_CROSS, WORKLOAD_COUNT };
+static const char *workload_names[] = { "batch alloc/free", "random hold", "cross-thread free" };
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *pool_bench_alloc(void *ctx, size_t size) { (void)size; return pool_alloc(ctx); }
+static void pool_bench_free(void *ctx, void *block) { pool_free(ctx, block); }
+static void *slab_bench_alloc(void *ctx, size_t size) { (void)size; return slab_cache_alloc(ctx); }
+static void slab_bench_free(void *ctx, void *block) { slab_cache_free(ctx, block); }
+static void *slab_malloc_bench_alloc(void *ctx, size_t size) { (void)ctx; return slab_malloc(size); }
+static void slab_malloc_bench_free(void *ctx, void *block) { (void)ctx; slab_free(block); }
+static void *malloc_bench_alloc(void *ctx, size_t size) { (void)ctx; return malloc(size); }
+static void malloc_bench_free(void *ctx, void *block) { (void)ctx; free(block); }
+
+// Mostly small blocks, some medium ones and the odd large one
+static size_t bench_size(bench_thread_t *self)
+{
+    if (self->allocator->size)
+        return self->allocator->size;
+    unsigned int pick = (unsigned int)rand_r(&self->seed);
+    if (pick % 256 == 0)
+        return 32768 + pick % 229376;
+    if (pick % 8 == 0)
+        return 512 + pick % 7680;
+    return 8 + pick % 504;
+}
+
+static void *bench_thread_main(void *arg)
+{
+    bench_thread_t *self = arg;
+    const bench_allocator_t *allocator = self->allocator;
+    void **blocks = calloc(BENCH_HELD, sizeof(void *));
+    if (!blocks)
+    {
+        self->failed = 1;
+        return NULL;
+    }
+
+    if (self->workload == WORKLOAD_BATCH)
+    {
+        for (long done = 0; done < self->operations; done += 2 * BENCH_BATCH)
+        {
+            for (int i = 0; i < BENCH_BATCH; i++)
+            {
+                blocks[i] = allocator->alloc(allocator->ctx, bench_size(self));
+                if (!blocks[i])
+                    self->failed = 1;
+                else
+                    *(long *)blocks[i] = done;
+            }
+            for (int i = BENCH_BATCH - 1; i >= 0; i--)
+                allocator->release(allocator->ctx, blocks[i]);
+        }
+    }
+    else if (self->workload == WORKLOAD_CROSS)
+    {
+        // Pairs of threads: one allocates every block, the other frees them
+        bench_ring_t *ring = self->ring;
+        for (long done = 0; done < self->operations; done++)
+        {
+            if (self->producer)
+            {
+                void *block = allocator->alloc(allocator->ctx, bench_size(self));
+                if (!block)
+                {
+                    self->failed = 1;
+                    break;
+                }
+                *(long *)block = done;
+                while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == BENCH_RING)
+                    sched_yield();
+                ring->slots[ring->head % BENCH_RING] = block;
+                __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+            }
+            else
+            {
+                while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+                    sched_yield();
+                allocator->release(allocator->ctx, ring->slots[ring->tail % BENCH_RING]);
+                __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+            }
+        }
+    }
+    else
+    {
+        // Each step frees a random live block and allocates its replacement,
+        // so the free lists are shuffled the way a long-running server's are
+        for (long done = 0; done < self->operations; done += 2)
+        {
+            int slot = rand_r(&self->seed) % BENCH_HELD;
+            if (blocks[slot])
+                allocator->release(allocator->ctx, blocks[slot]);
+            blocks[slot] = allocator->alloc(allocator->ctx, bench_size(self));
+            if (!blocks[slot])
+                self->failed = 1;
+        }
+        for (int i = 0; i < BENCH_HELD; i++)
+        {
+            if (blocks[i])
+                allocator->release(allocator->ctx, blocks[i]);
+        }
+    }
+
+    free(blocks);
+    return NULL;
+}
+
+// Million operations (an alloc or a free) per second over all threads. The
+// cross-thread workload pairs thread 2k (allocating) with 2k+1 (freeing).
+static double bench_run(const bench_allocator_t *allocator, int workload, int threads, long operations)
+{
+    bench_thread_t workers[BENCH_MAX_THREADS];
+    bench_ring_t *rings = NULL;
+    if (workload == WORKLOAD_CROSS && !(rings = calloc(threads / 2, sizeof(bench_ring_t))))
+    {
+        fprintf(stderr, "%s: allocation failed\n", allocator->name);
+        exit(1);
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i] = (bench_thread_t){ .allocator = allocator, .workload = workload,
+                                       .operations = operations, .seed = (unsigned int)i + 1,
+                                       .ring = rings ? &rings[i / 2] : NULL, .producer = i % 2 == 0 };
+        pthread_create(&workers[i].thread, NULL, bench_thread_main, &workers[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        failed |= workers[i].failed;
+    }
+    double elapsed = now_seconds() - start;
+    free(rings);
+
+    if (failed)
+    {
+        fprintf(stderr, "%s: allocation failed\n", allocator->name);
+        exit(1);
+    }
+    return (double)operations * threads / elapsed / 1e6;
+}
+
+// Each allocator on every workload with 1, 2, 4 ... max_threads threads,
+// each thread doing `operations` allocs or frees. The cross-thread workload
+// needs a pair of threads, so it starts at 2.
+static void bench_compare(const bench_allocator_t *allocators, int count, int max_threads, long operations)
+{
+    printf("\n%-18s %8s", "workload", "threads");
+    for (int i = 0; i < count; i++)
+        printf(" %8s Mops/s", allocators[i].name);
+    printf("\n");
+
+    for (int workload = 0; workload < WORKLOAD_COUNT; workload++)
+    {
+        for (int threads = workload == WORKLOAD_CROSS ? 2 : 1; threads <= max_threads; threads *= 2)
+        {
+            printf("%-18s %8d", workload_names[workload], threads);
+            for (int i = 0; i < count; i++)
+                printf(" %15.1f", bench_run(&allocators[i], workload, threads, operations));
+            printf("\n");
+        }
+    }
+}
+
+// Pool against malloc on BENCH_BLOCK_SIZE-byte blocks
+static int bench_pool(int max_threads, long operations)
+{
+    memory_pool_t *pool = pool_create(1024 * 1024, BENCH_BLOCK_SIZE);
+    if (!pool)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    bench_allocator_t allocators[] = {
+        { "pool", pool_bench_alloc, pool_bench_free, pool, BENCH_BLOCK_SIZE },
+        { "malloc", malloc_bench_alloc, malloc_bench_free, NULL, BENCH_BLOCK_SIZE },
+    };
+
+    bench_compare(allocators, 2, max_threads, operations);
+    printf("pool reserved %zu bytes for %zu-byte blocks\n", pool->size, pool->block_size);
+
+    pool_destroy(pool);
+    return 0;
+}
+
+// db_tuple_t through the magazine layer, through the slab layer under its
+// single lock, and through malloc
+static int bench_slab_threads(int max_threads, long operations)
+{
+    slab_cache_t *magazine_cache = slab_cache_create("db_tuples", sizeof(db_tuple_t));
+    slab_cache_t *locked_cache = slab_cache_create("db_tuples_locked", sizeof(db_tuple_t));
+    if (!magazine_cache || !locked_cache)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    locked_cache->magazines = false;
+    bench_allocator_t allocators[] = {
+        { "magazine", slab_bench_alloc, slab_bench_free, magazine_cache, sizeof(db_tuple_t) },
+        { "locked", slab_bench_alloc, slab_bench_free, locked_cache, sizeof(db_tuple_t) },
+        { "malloc", malloc_bench_alloc, malloc_bench_free, NULL, sizeof(db_tuple_t) },
+    };
+
+    bench_compare(allocators, 3, max_threads, operations);
+    printf("magazine cache: %zu slabs, depot %zu full / %zu empty magazines\n", magazine_cache->slab_count,
+           magazine_cache->depot_full_count, magazine_cache->depot_empty_count);
+
+    slab_cache_destroy(magazine_cache);
+    slab_cache_destroy(locked_cache);
+    return 0;
+}
+
+// slab_malloc against malloc on a mix of sizes from 8 bytes to 256 KB
+static int bench_malloc(int max_threads, long operations)
+{
+    bench_allocator_t allocators[] = {
+        { "slab", slab_malloc_bench_alloc, slab_malloc_bench_free, NULL, 0 },
+        { "malloc", malloc_bench_alloc, malloc_bench_free, NULL, 0 },
+    };
+
+    bench_compare(allocators, 2, max_threads, operations);
+    return 0;
+}
+
+// `cycles` alloc/free pairs of db_tuple_t against `live` tuples held in
+// random order, so frees land all over a large number of slabs
+static int bench_slab(long cycles, long live)
+{
+    slab_cache_t *cache = slab_cache_create("db_tuples", sizeof(db_tuple_t));
+    db_tuple_t **tuples = malloc(live * sizeof(db_tuple_t *));
+    if (!cache || !tuples)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    unsigned int seed = 1;
+
+    for (int allocator = 0; allocator < 2; allocator++)
+    {
+        const char *name = allocator == 0 ? "slab" : "malloc";
+        double start = now_seconds();
+        for (long i = 0; i < live; i++)
+        {
+            tuples[i] = allocator == 0 ? slab_cache_alloc(cache) : malloc(sizeof(db_tuple_t));
+            if (!tuples[i])
+            {
+                printf("Error: memory allocation failed!\n");
+                return 1;
+            }
+            tuples[i]->id = (int)i;
+        }
+        double filled = now_seconds();
+
+        for (long i = 0; i < cycles; i++)
+        {
+            long slot = (long)(((uint64_t)rand_r(&seed) << 16 ^ (uint64_t)rand_r(&seed)) % (uint64_t)live);
+            if (allocator == 0)
+            {
+                slab_cache_free(cache, tuples[slot]);
+                tuples[slot] = slab_cache_alloc(cache);
+            }
+            else
+            {
+                free(tuples[slot]);
+                tuples[slot] = malloc(sizeof(db_tuple_t));
+            }
+            tuples[slot]->id = (int)i;
+        }
+        double cycled = now_seconds();
+
+        for (long i = 0; i < live; i++)
+        {
+            if (allocator == 0)
+                slab_cache_free(cache, tuples[i]);
+            else
+                free(tuples[i]);
+        }
+        double drained = now_seconds();
+
+        printf("%-7s fill %ld: %6.1f Mops/s  random free+alloc %ld: %6.1f Mcycles/s  free all: %6.1f Mops/s\n",
+               name, live, live / (filled - start) / 1e6, cycles, cycles / (cycled - filled) / 1e6,
+               live / (drained - cycled) / 1e6);
+        if (allocator == 0)
+            printf("%-7s %zu slabs of %zu bytes, %zu tuples each\n", name, cache->slab_count, cache->slab_size,
+                   cache->objects_per_slab);
+    }
+
+    free(tuples);
+    slab_cache_destroy(cache);
+    return 0;
+}
+
+static void shrink_report(const char *when, slab_cache_t *cache)
+{
+    slab_shrink_stats_t stats;
+    slab_shrink_stats(&stats);
+    printf("%-28s RSS %7.1f MB  slabs %7zu  empty %7zu  reclaimed %7.1f MB\n", when,
+           stats.resident_bytes / 1048576.0, cache->slab_count, cache->empty_count, stats.reclaimed_bytes / 1048576.0);
+}
+
+// A burst of `live` tuples, freed again, then shrunk; then `rounds` smaller
+// bursts with a reap after each (keeps the pages it will need again) against
+// a full shrink after each (gives them back and faults them in again)
+static int bench_shrink(long live, int rounds)
+{
+    slab_cache_t *cache = slab_cache_create("db_tuples", sizeof(db_tuple_t));
+    db_tuple_t **tuples = malloc(live * sizeof(db_tuple_t *));
+    if (!cache || !tuples)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+
+    shrink_report("start", cache);
+    for (long i = 0; i < live; i++)
+    {
+        tuples[i] = slab_cache_alloc(cache);
+        if (!tuples[i])
+        {
+            printf("Error: memory allocation failed!\n");
+            return 1;
+        }
+        tuples[i]->id = (int)i;
+        memset(tuples[i]->data, 'x', sizeof(tuples[i]->data));
+    }
+    shrink_report("after burst", cache);
+    for (long i = 0; i < live; i++)
+        slab_cache_free(cache, tuples[i]);
+    shrink_report("after free", cache);
+    double start = now_seconds();
+    size_t reclaimed = slab_cache_shrink(cache);
+    printf("shrink returned %.1f MB in %.1f ms\n", reclaimed / 1048576.0, (now_seconds() - start) * 1e3);
+    shrink_report("after shrink", cache);
+
+    long burst = live / 4;
+    for (int mode = 0; mode < 2; mode++)
+    {
+        reclaimed = 0;
+        start = now_seconds();
+        for (int round = 0; round < rounds; round++)
+        {
+            for (long i = 0; i < burst; i++)
+            {
+                tuples[i] = slab_cache_alloc(cache);
+                tuples[i]->id = (int)i;
+            }
+            for (long i = 0; i < burst; i++)
+                slab_cache_free(cache, tuples[i]);
+            reclaimed += mode == 0 ? slab_reap() : slab_cache_shrink(cache);
+        }
+        printf("%d bursts of %ld, %-7s after each: %7.1f ms, %7.1f MB returned\n", rounds, burst,
+               mode == 0 ? "reap" : "shrink", (now_seconds() - start) * 1e3, reclaimed / 1048576.0);
+        shrink_report(mode == 0 ? "after bursts with reap" : "after bursts with shrink", cache);
+        if (mode == 0)
+        {
+            // Idle now: the first reap resets the low-water marks, the second releases
+            reclaimed = slab_reap();
+            reclaimed += slab_reap();
+            printf("two idle reaps returned %.1f MB\n", reclaimed / 1048576.0);
+            shrink_report("after idle reaps", cache);
+        }
+    }
+
+    free(tuples);
+    slab_cache_destroy(cache);
+    return 0;
+}
+
+// Student records in 256-byte pool blocks, tuples in a slab cache and a
+// mix of slab_malloc sizes, half of each freed again, with the periodic
+// report running; then the final counters
+static int bench_stats(long records)
+{
+    memory_pool_t *pool = pool_create(1024 * 1024, 256);
+    slab_cache_t *cache = slab_cache_create("db_tuples", sizeof(db_tuple_t));
+    void **blocks = malloc(3 * records * sizeof(void *));
+    if (!pool || !cache || !blocks)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    alloc_report_start(100, stdout);
+
+    unsigned int seed = 1;
+    double start = now_seconds();
+    for (long i = 0; i < records; i++)
+    {
+        blocks[i] = pool_alloc_sized(pool, sizeof(student_t));
+        blocks[records + i] = slab_cache_alloc(cache);
+        blocks[2 * records + i] = slab_malloc(8 + rand_r(&seed) % 2040);
+    }
+    for (long i = 0; i < records; i += 2)
+    {
+        pool_free(pool, blocks[i]);
+        slab_cache_free(cache, blocks[records + i]);
+        slab_free(blocks[2 * records + i]);
+    }
+    double elapsed = now_seconds() - start;
+
+    alloc_report_stop();
+    printf("%ld records of each kind in %.1f ms\n", records, elapsed * 1e3);
+    alloc_stats_dump(stdout);
+
+    for (long i = 1; i < records; i += 2)
+    {
+        pool_free(pool, blocks[i]);
+        slab_cache_free(cache, blocks[records + i]);
+        slab_free(blocks[2 * records + i]);
+    }
+    free(blocks);
+    slab_cache_destroy(cache);
+    pool_destroy(pool);
+    return 0;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// `rows` students with unique names and ages 18..67 in the packed table, then
+// `lookups` lookups through each index. Averages are timed over the whole
+// batch; percentiles time each call on its own, clock read included.
+static int bench_table(long rows, long lookups)
+{
+    student_table_t *table = student_table_create();
+    char (*names)[20] = malloc(lookups * sizeof(*names));
+    double *latency = malloc(lookups * sizeof(double));
+    if (!table || !names || !latency)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    unsigned int seed = 1;
+    char name[32];                  // fits any "student%ld"; student_insert keeps the first 19 characters
+
+    double start = now_seconds();
+    for (long i = 0; i < rows; i++)
+    {
+        snprintf(name, sizeof(name), "student%ld", i);
+        if (student_insert(table, name, 18 + rand_r(&seed) % 50) < 0)
+        {
+            printf("Error: memory allocation failed!\n");
+            return 1;
+        }
+    }
+    double elapsed = now_seconds() - start;
+    student_table_stats_t stats;
+    student_table_stats(table, &stats);
+    printf("insert %ld rows: %.2f s (%.2f Mrows/s)\n", rows, elapsed, rows / elapsed / 1e6);
+    printf("bytes/row: %.1f (rows %.1f, age column %.1f, name index %.1f, age index %.1f, depth %u); "
+           "one pool block per row: %zu\n",
+           stats.bytes_per_row, (double)stats.row_bytes / rows, (double)stats.column_bytes / rows,
+           (double)stats.name_index_bytes / rows, (double)stats.age_index_bytes / rows, stats.age_depth,
+           256 + sizeof(student_t *));
+
+    // Name: hits, then misses
+    for (int miss = 0; miss < 2; miss++)
+    {
+        for (long i = 0; i < lookups; i++)
+            snprintf(names[i], sizeof(names[i]), miss ? "nobody%ld" : "student%ld",
+                     (long)(((uint64_t)rand_r(&seed) << 16 ^ (uint64_t)rand_r(&seed)) % (uint64_t)rows));
+        uint32_t row;
+        size_t found = 0;
+        start = now_seconds();
+        for (long i = 0; i < lookups; i++)
+            found += student_find_name(table, names[i], &row, 1);
+        elapsed = now_seconds() - start;
+        for (long i = 0; i < lookups; i++)
+        {
+            double before = now_seconds();
+            student_find_name(table, names[i], &row, 1);
+            latency[i] = now_seconds() - before;
+        }
+        qsort(latency, lookups, sizeof(double), compare_doubles);
+        printf("name %-4s %ld lookups: avg %6.0f ns  p50 %6.0f ns  p99 %6.0f ns  (%zu found)\n", miss ? "miss" : "hit",
+               lookups, elapsed / lookups * 1e9, latency[lookups / 2] * 1e9, latency[lookups * 99 / 100] * 1e9, found);
+    }
+
+    // Age: the first row of a range, then whole ranges
+    student_cursor_t cursor;
+    uint32_t row;
+    long first_rows = 0;
+    start = now_seconds();
+    for (long i = 0; i < lookups; i++)
+    {
+        student_find_age(table, 18 + rand_r(&seed) % 50, 67, &cursor);
+        first_rows += student_cursor_next(&cursor, &row);
+    }
+    elapsed = now_seconds() - start;
+    printf("age first row   %ld lookups: avg %6.0f ns  (%ld found)\n", lookups, elapsed / lookups * 1e9, first_rows);
+
+    for (int width = 1; width <= 10; width += 9)
+    {
+        long queries = 20, matched = 0, ages = 0;
+        start = now_seconds();
+        for (long q = 0; q < queries; q++)
+        {
+            int low = 18 + (int)(q * 7 % (50 - width + 1));
+            student_find_age(table, low, low + width - 1, &cursor);
+            while (student_cursor_next(&cursor, &row))
+            {
+                ages += student_row(table, row)->age;
+                matched++;
+            }
+        }
+        elapsed = now_seconds() - start;
+        printf("age BETWEEN x AND x+%d: %ld rows/query, %6.2f ms/query, %.1f ns/row (age sum %ld)\n", width - 1,
+               matched / queries, elapsed / queries * 1e3, elapsed * 1e9 / matched, ages);
+    }
+
+    // What a lookup cost before: a scan of every row
+    start = now_seconds();
+    size_t found = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        for (uint32_t r = 0; r < table->rows; r++)
+            found += strncmp(student_row(table, r)->name, names[i], sizeof(name)) == 0;
+    }
+    printf("name by full scan: %.1f ms/lookup (%zu found)\n", (now_seconds() - start) / 3 * 1e3, found);
+
+    free(latency);
+    free(names);
+    student_table_destroy(table);
+    return 0;
+}
+
+static double query_time(const query_column_t *column, const query_t *query, query_result_t *result)
+{
+    double start = now_seconds();
+    if (query_run(column, query, result) < 0)
+    {
+        printf("Error: memory allocation failed!\n");
+        exit(1);
+    }
+    return now_seconds() - start;
+}
+
+// Three queries over a column of `rows` random ages (18..67): a 20% range,
+// every row, and a GROUP BY decade; each scalar on one thread, then with
+// AVX2 on 1, 2, 4 ... max_threads threads. Then the same range over the ids
+// of a million tuples from a slab cache.
+static int bench_query(long rows, int max_threads)
+{
+    query_column_t ages;
+    if (query_column_create(&ages, rows) < 0)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    unsigned int seed = 1;
+    for (long i = 0; i < rows; i++)
+        ages.chunks[i / QUERY_CHUNK_ROWS][i % QUERY_CHUNK_ROWS] = 18 + rand_r(&seed) % 50;
+
+    const query_t queries[] = {
+        { .low = 20, .high = 29 },
+        { .low = INT32_MIN, .high = INT32_MAX },
+        { .low = 18, .high = 67, .bucket_width = 10, .bucket_count = 7 },
+    };
+    const char *names[] = { "age BETWEEN 20 AND 29", "all rows", "GROUP BY age / 10" };
+
+    printf("%ld rows, %.0f MB column\n", rows, rows * 4 / 1048576.0);
+    printf("%-22s %-8s %7s %10s %10s %14s\n", "query", "mode", "threads", "ms", "Mrows/s", "COUNT / AVG");
+    for (int q = 0; q < 3; q++)
+    {
+        query_t query = queries[q];
+        query_result_t scalar, result;
+        query.threads = 1;
+        query.scalar = true;
+        double elapsed = query_time(&ages, &query, &scalar);
+        printf("%-22s %-8s %7d %10.1f %10.0f %8llu / %.2f\n", names[q], "scalar", 1, elapsed * 1e3,
+               rows / elapsed / 1e6, (unsigned long long)scalar.count, scalar.average);
+
+        query.scalar = false;
+        for (int threads = 1; threads <= max_threads; threads *= 2)
+        {
+            query.threads = threads;
+            elapsed = query_time(&ages, &query, &result);
+            bool same = result.count == scalar.count && result.sum == scalar.sum &&
+                        memcmp(result.buckets, scalar.buckets, sizeof(result.buckets)) == 0;
+            printf("%-22s %-8s %7d %10.1f %10.0f %8llu / %.2f%s\n", names[q], "simd", threads, elapsed * 1e3,
+                   rows / elapsed / 1e6, (unsigned long long)result.count, result.average, same ? "" : "  MISMATCH");
+        }
+    }
+    query_column_release(&ages);
+
+    long tuple_count = 1000000;
+    slab_cache_t *cache = slab_cache_create("db_tuples", sizeof(db_tuple_t));
+    db_tuple_t **tuples = malloc(tuple_count * sizeof(db_tuple_t *));
+    if (!cache || !tuples)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    for (long i = 0; i < tuple_count; i++)
+    {
+        tuples[i] = slab_cache_alloc(cache);
+        tuples[i]->id = (int)i;
+    }
+    query_column_t ids;
+    double start = now_seconds();
+    if (query_tuple_ids(&ids, tuples, tuple_count) < 0)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    double copied = now_seconds() - start;
+    query_t query = { .low = 1000, .high = 250999, .threads = 1 };
+    query_result_t result;
+    double elapsed = query_time(&ids, &query, &result);
+    printf("tuple ids: copy %.1f ms, id BETWEEN 1000 AND 250999: %.2f ms, COUNT %llu\n", copied * 1e3,
+           elapsed * 1e3, (unsigned long long)result.count);
+
+    query_column_release(&ids);
+    for (long i = 0; i < tuple_count; i++)
+        slab_cache_free(cache, tuples[i]);
+    free(tuples);
+    slab_cache_destroy(cache);
+    return 0;
+}
+
+static void load_report(const bulk_load_stats_t *stats)
+{
+    printf("%zu rows, %.1f MB %s: %.1f ms (count %.1f, parse %.1f, index %.1f), %.2f Mrows/s, %.0f MB/s\n",
+           stats->rows, stats->bytes / 1048576.0, stats->binary ? "binary" : "CSV", stats->seconds * 1e3,
+           stats->count_seconds * 1e3, stats->parse_seconds * 1e3, stats->index_seconds * 1e3,
+           stats->rows_per_second / 1e6, stats->seconds > 0 ? stats->bytes / 1048576.0 / stats->seconds : 0);
+}
+
+// Loading `path` into a new table, and writing it out in the binary format
+// to `save` if given
+static int load_command(const char *path, int threads, const char *save)
+{
+    student_table_t *table = student_table_create();
+    bulk_load_stats_t stats;
+    if (!table)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    int status = bulk_load(table, path, threads, &stats);
+    if (status == BULK_LOAD_FORMAT && stats.line)
+        printf("Error: %s: line %zu is not name,age\n", path, stats.line);
+    else if (status != BULK_LOAD_OK)
+        printf("Error: %s: %s\n", path, bulk_load_error(status));
+    else
+    {
+        load_report(&stats);
+        student_table_stats_t table_stats;
+        student_table_stats(table, &table_stats);
+        printf("%.1f bytes/row, age index depth %u\n", table_stats.bytes_per_row, table_stats.age_depth);
+        if (save && (status = bulk_save(table, save)) != BULK_LOAD_OK)
+            printf("Error: %s: %s\n", save, bulk_load_error(status));
+    }
+    student_table_destroy(table);
+    return status != BULK_LOAD_OK;
+}
+
+// Same rows, same ages in the age index in the same order, same name
+// lookups for a sample of names
+static bool tables_same(const student_table_t *a, const student_table_t *b)
+{
+    if (a->rows != b->rows)
+        return false;
+    for (uint32_t row = 0; row < a->rows; row++)
+    {
+        if (memcmp(student_row(a, row), student_row(b, row), sizeof(student_t)) != 0)
+            return false;
+    }
+    student_cursor_t cursor_a, cursor_b;
+    uint32_t row_a, row_b;
+    student_find_age(a, INT32_MIN, INT32_MAX, &cursor_a);
+    student_find_age(b, INT32_MIN, INT32_MAX, &cursor_b);
+    bool more;
+    while ((more = student_cursor_next(&cursor_a, &row_a)) == student_cursor_next(&cursor_b, &row_b) && more)
+    {
+        if (row_a != row_b)
+            return false;
+    }
+    if (more)
+        return false;
+    for (uint32_t row = 0; row < a->rows; row += 997)
+    {
+        const char *name = student_row(a, row)->name;
+        if (student_find_name(a, name, &row_a, 1) != student_find_name(b, name, &row_b, 1))
+            return false;
+    }
+    return true;
+}
+
+// `rows` students written to `path` as CSV, then loaded back: a line at a
+// time through student_insert as the menu does, then with bulk_load on 1,
+// 2, 4 ... max_threads threads, then from the binary format, then once
+// more into a table that holds them already
+static int bench_load(long rows, int max_threads, const char *path)
+{
+    char binary_path[4096], line[64];
+    snprintf(binary_path, sizeof(binary_path), "%s.bin", path);
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        printf("Error: cannot write %s\n", path);
+        return 1;
+    }
+    unsigned int seed = 1;
+    fprintf(file, "name,age\n");
+    for (long i = 0; i < rows; i++)
+        fprintf(file, "student%ld,%d\n", i, 18 + rand_r(&seed) % 50);
+    fclose(file);
+
+    student_table_t *reference = student_table_create();
+    if (!reference || !(file = fopen(path, "r")))
+    {
+        printf("Error: cannot read %s\n", path);
+        return 1;
+    }
+    double start = now_seconds();
+    fgets(line, sizeof(line), file);
+    while (fgets(line, sizeof(line), file))
+    {
+        char *comma = strrchr(line, ',');
+        *comma = '\0';
+        if (student_insert(reference, line, atoi(comma + 1)) < 0)
+        {
+            printf("Error: memory allocation failed!\n");
+            return 1;
+        }
+    }
+    double elapsed = now_seconds() - start;
+    fclose(file);
+    printf("%-28s %7s %10s %10s %10s %10s %10s\n", "load", "threads", "ms", "count ms", "parse ms", "index ms",
+           "Mrows/s");
+    printf("%-28s %7d %10.1f %10s %10s %10s %10.2f\n", "fgets + student_insert", 1, elapsed * 1e3, "", "", "",
+           rows / elapsed / 1e6);
+
+    bool same = true;
+    bulk_load_stats_t stats;
+    for (int pass = 0; pass < 3; pass++)
+    {
+        const char *name = pass == 0 ? "bulk_load CSV" : pass == 1 ? "bulk_load binary" : "bulk_load CSV, append";
+        for (int threads = pass ? max_threads : 1; threads <= max_threads; threads *= 2)
+        {
+            student_table_t *table = student_table_create();
+            if (!table)
+            {
+                printf("Error: memory allocation failed!\n");
+                return 1;
+            }
+            int status = bulk_load(table, pass == 1 ? binary_path : path, threads, &stats);
+            if (status == BULK_LOAD_OK && pass == 2)
+                status = bulk_load(table, path, threads, &stats);
+            if (status != BULK_LOAD_OK)
+            {
+                printf("Error: %s\n", bulk_load_error(status));
+                return 1;
+            }
+            bool matches = pass == 2 ? table->rows == 2 * reference->rows : tables_same(table, reference);
+            same = same && matches;
+            printf("%-28s %7d %10.1f %10.1f %10.1f %10.1f %10.2f%s\n", name, threads, stats.seconds * 1e3,
+                   stats.count_seconds * 1e3, stats.parse_seconds * 1e3, stats.index_seconds * 1e3,
+                   stats.rows_per_second / 1e6, matches ? "" : "  MISMATCH");
+            if (pass == 0 && threads == max_threads && bulk_save(table, binary_path) != BULK_LOAD_OK)
+            {
+                printf("Error: cannot write %s\n", binary_path);
+                return 1;
+            }
+            student_table_destroy(table);
+        }
+    }
+    student_table_destroy(reference);
+    unlink(path);
+    unlink(binary_path);
+    return !same;
+}
+
+// What the buffer manager did between `before` and `after`
+static void store_report(const char *what, long operations, double elapsed, const buffer_stats_t *before,
+                         const buffer_stats_t *after)
+{
+    uint64_t hits = after->hits - before->hits, misses = after->misses - before->misses;
+    uint64_t read = after->pages_read - before->pages_read, written = after->pages_written - before->pages_written;
+    printf("%-30s %9.0f ops/s %8llu pages read %8llu written %9.0f pages/s  hit rate %5.1f%%\n", what,
+           operations / elapsed, (unsigned long long)read, (unsigned long long)written, (read + written) / elapsed,
+           hits + misses ? 100.0 * hits / (hits + misses) : 0);
+}
+
+static heap_file_t *store_open(const char *path, long frames)
+{
+    heap_file_t *heap = heap_open(path, (size_t)frames);
+    if (!heap)
+        printf("Error: %s: %s\n", path, errno == EINVAL ? "not a data file" : strerror(errno));
+    return heap;
+}
+
+// Appending the students in a CSV file to a data file
+static int store_load(const char *csv, const char *path, long frames)
+{
+    FILE *file = fopen(csv, "r");
+    if (!file)
+    {
+        printf("Error: cannot read %s\n", csv);
+        return 1;
+    }
+    heap_file_t *heap = store_open(path, frames);
+    if (!heap)
+    {
+        fclose(file);
+        return 1;
+    }
+
+    buffer_stats_t before, after;
+    buffer_stats(heap->buffers, &before);
+    char line[256];
+    long rows = 0, line_number = 0;
+    int status = 0;
+    double start = now_seconds();
+    while (status == 0 && fgets(line, sizeof(line), file))
+    {
+        size_t length = strcspn(line, "\r\n"), name_length;
+        student_t student;
+        record_id_t id;
+        line_number++;
+        if (length == 0)
+            continue;
+        if (!bulk_parse_line(line, line + length, &name_length, &student.age))
+        {
+            if (line_number == 1)
+                continue;   // a header
+            printf("Error: %s: line %ld is not name,age\n", csv, line_number);
+            status = 1;
+            break;
+        }
+        name_length = name_length < sizeof(student.name) - 1 ? name_length : sizeof(student.name) - 1;
+        memset(student.name, 0, sizeof(student.name));
+        memcpy(student.name, line, name_length);
+        if (heap_insert(heap, &student, sizeof(student), &id) < 0)
+        {
+            printf("Error: %s: %s\n", path, strerror(errno));
+            status = 1;
+        }
+        rows++;
+    }
+    fclose(file);
+    double inserted = now_seconds();
+    buffer_stats(heap->buffers, &after);
+    store_report("insert", rows, inserted - start, &before, &after);
+    uint64_t records = heap->records;
+    uint32_t pages = heap->buffers->page_count;
+    if (heap_close(heap) < 0)
+    {
+        printf("Error: %s: %s\n", path, strerror(errno));
+        status = 1;
+    }
+    printf("%ld rows in %.2f s (%.0f rows/s, close %.1f ms); %llu records, %u pages (%.1f MB), %ld frames (%.1f MB)\n",
+           rows, now_seconds() - start, rows / (now_seconds() - start), (now_seconds() - inserted) * 1e3,
+           (unsigned long long)records, pages, pages * (double)BUFFER_PAGE_SIZE / 1048576, frames,
+           frames * (double)BUFFER_PAGE_SIZE / 1048576);
+    return status;
+}
+
+// COUNT and AVG(age) of the students in a data file aged low..high
+static int store_scan(const char *path, int low, int high, long frames)
+{
+    heap_file_t *heap = store_open(path, frames);
+    if (!heap)
+        return 1;
+    buffer_stats_t before, after;
+    buffer_stats(heap->buffers, &before);
+    heap_cursor_t cursor;
+    const void *record;
+    size_t length;
+    record_id_t id;
+    long rows = 0, count = 0, sum = 0;
+    int more;
+    double start = now_seconds();
+    heap_scan(heap, &cursor);
+    while ((more = heap_cursor_next(&cursor, &record, &length, &id)) > 0)
+    {
+        int age = ((const student_t *)record)->age;
+        rows++;
+        if (age >= low && age <= high)
+        {
+            count++;
+            sum += age;
+        }
+    }
+    double elapsed = now_seconds() - start;
+    buffer_stats(heap->buffers, &after);
+    if (more < 0)
+        printf("Error: %s: %s\n", path, strerror(errno));
+    store_report("scan", rows, elapsed, &before, &after);
+    printf("%ld rows, COUNT %ld, AVG(age) %.2f\n", rows, count, count ? (double)sum / count : 0);
+    heap_close(heap);
+    return more < 0;
+}
+
+static uint64_t bench_random(unsigned int *seed)
+{
+    return (uint64_t)rand_r(seed) << 31 ^ (uint64_t)rand_r(seed);
+}
+
+// `records` students in a data file of their own, through `frames` frames:
+// inserts, a scan after reopening, reads by (page, slot) spread evenly and
+// with 90% of them on a tenth of the records, then deletes and as many
+// inserts again, which the free-space map places in the freed room
+static int bench_store(long records, long frames, const char *path)
+{
+    record_id_t *ids = malloc(records * sizeof(record_id_t));
+    if (!ids)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
+    unlink(path);
+    heap_file_t *heap = store_open(path, frames);
+    if (!heap)
+        return 1;
+
+    buffer_stats_t before, after;
+    unsigned int seed = 1;
+    student_t student;
+    memset(&student, 0, sizeof(student));
+    buffer_stats(heap->buffers, &before);
+    double start = now_seconds();
+    for (long i = 0; i < records; i++)
+    {
+        snprintf(student.name, sizeof(student.name), "student%d", (int)i);
+        student.age = 18 + rand_r(&seed) % 50;
+        if (heap_insert(heap, &student, sizeof(student), &ids[i]) < 0)
+        {
+            printf("Error: %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+    }
+    double elapsed = now_seconds() - start;
+    buffer_stats(heap->buffers, &after);
+    uint32_t pages = heap->buffers->page_count;
+    printf("%ld records, %u pages (%.1f MB) through %ld frames (%.1f MB)\n", records, pages,
+           pages * (double)BUFFER_PAGE_SIZE / 1048576, frames, frames * (double)BUFFER_PAGE_SIZE / 1048576);
+    store_report("insert", records, elapsed, &before, &after);
+    start = now_seconds();
+    if (heap_close(heap) < 0)
+    {
+        printf("Error: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    printf("%-30s %9.1f ms\n", "close (write back, fdatasync)", (now_seconds() - start) * 1e3);
+
+    // Everything read back after reopening
+    if (!(heap = store_open(path, frames)))
+        return 1;
+    heap_cursor_t cursor;
+    const void *record;
+    size_t length;
+    record_id_t id;
+    long scanned = 0, mismatched = 0;
+    buffer_stats(heap->buffers, &before);
+    start = now_seconds();
+    heap_scan(heap, &cursor);
+    while (heap_cursor_next(&cursor, &record, &length, &id) > 0)
+    {
+        const student_t *row = record;
+        mismatched += ids[scanned].page != id.page || ids[scanned].slot != id.slot ||
+                      atol(row->name + strlen("student")) != scanned;
+        scanned++;
+    }
+    elapsed = now_seconds() - start;
+    buffer_stats(heap->buffers, &after);
+    store_report("scan after reopen", scanned, elapsed, &before, &after);
+
+    long reads = records < 1000000 ? records : 1000000;
+    for (int skewed = 0; skewed < 2; skewed++)
+    {
+        long hot = records / 10 ? records / 10 : 1;
+        buffer_stats(heap->buffers, &before);
+        start = now_seconds();
+        for (long i = 0; i < reads; i++)
+        {
+            uint64_t r = bench_random(&seed);
+            long index = skewed && r % 10 ? (long)(r / 10 % (uint64_t)hot) : (long)(r / 10 % (uint64_t)records);
+            if (heap_read(heap, ids[index], &student, sizeof(student)) != sizeof(student) ||
+                atol(student.name + strlen("student")) != index)
+                mismatched++;
+        }
+        elapsed = now_seconds() - start;
+        buffer_stats(heap->buffers, &after);
+        store_report(skewed ? "read by id, 90% on 10%" : "read by id, uniform", reads, elapsed, &before, &after);
+    }
+
+    // Every other record deleted, then as many inserted: the file does not grow
+    long deleted = 0;
+    buffer_stats(heap->buffers, &before);
+    start = now_seconds();
+    for (long i = 0; i < records; i += 2, deleted++)
+    {
+        if (heap_delete(heap, ids[i]) < 0)
+            mismatched++;
+    }
+    elapsed = now_seconds() - start;
+    buffer_stats(heap->buffers, &after);
+    store_report("delete every other", deleted, elapsed, &before, &after);
+    pages = heap->buffers->page_count;
+    buffer_stats(heap->buffers, &before);
+    start = now_seconds();
+    for (long i = 0; i < deleted; i++)
+    {
+        snprintf(student.name, sizeof(student.name), "again%d", (int)i);
+        if (heap_insert(heap, &student, sizeof(student), &id) < 0)
+            mismatched++;
+    }
+    elapsed = now_seconds() - start;
+    buffer_stats(heap->buffers, &after);
+    store_report("insert into freed room", deleted, elapsed, &before, &after);
+    printf("pages before %u, after %u; %llu records; %ld mismatches\n", pages, heap->buffers->page_count,
+           (unsigned long long)heap->records, mismatched + (scanned != records));
+
+    heap_close(heap);
+    free(ids);
+    unlink(path);
+    return mismatched != 0 || scanned != records;
+}
+
+int run_benchmark(int argc, char *argv[])
+{
+    if (strcmp(argv[0], "bench-pool") == 0)
+    {
+        int threads = argc > 1 ? atoi(argv[1]) : 16;
+        if (threads < 1 || threads > BENCH_MAX_THREADS)
+        {
+            printf("threads must be 1..%d\n", BENCH_MAX_THREADS);
+            return 1;
+        }
+        return bench_pool(threads, argc > 2 ? atol(argv[2]) : 2000000);
+    }
+
+    if (strcmp(argv[0], "bench-slab-threads") == 0)
+    {
+        int threads = argc > 1 ? atoi(argv[1]) : BENCH_MAX_THREADS;
+        if (threads < 1 || threads > BENCH_MAX_THREADS)
+        {
+            printf("threads must be 1..%d\n", BENCH_MAX_THREADS);
+            return 1;
+        }
+        return bench_slab_threads(threads, argc > 2 ? atol(argv[2]) : 2000000);
+    }
+    if (strcmp(argv[0], "bench-malloc") == 0)
+    {
+        int threads = argc > 1 ? atoi(argv[1]) : 16;
+        if (threads < 1 || threads > BENCH_MAX_THREADS)
+        {
+            printf("threads must be 1..%d\n", BENCH_MAX_THREADS);
+            return 1;
+        }
+        return bench_malloc(threads, argc > 2 ? atol(argv[2]) : 2000000);
+    }
+    if (strcmp(argv[0], "bench-shrink") == 0)
+    {
+        long live = argc > 1 ? atol(argv[1]) : 2000000;
+        int rounds = argc > 2 ? atoi(argv[2]) : 20;
+        if (live < 4 || rounds < 1)
+        {
+            printf("live must be >= 4 and rounds >= 1\n");
+            return 1;
+        }
+        return bench_shrink(live, rounds);
+    }
+    if (strcmp(argv[0], "bench-slab") == 0)
+    {
+        long cycles = argc > 1 ? atol(argv[1]) : 10000000;
+        long live = argc > 2 ? atol(argv[2]) : 1000000;
+        if (cycles < 0 || live < 1)
+        {
+            printf("cycles must be >= 0 and live >= 1\n");
+            return 1;
+        }
+        return bench_slab(cycles, live);
+    }
+    if (strcmp(argv[0], "bench-table") == 0)
+    {
+        long rows = argc > 1 ? atol(argv[1]) : 10000000;
+        long lookups = argc > 2 ? atol(argv[2]) : 1000000;
+        if (rows < 1 || rows >= STUDENT_NO_ROW || lookups < 3)
+        {
+            printf("rows must be 1..%u and lookups >= 3\n", STUDENT_NO_ROW - 1);
+            return 1;
+        }
+        return bench_table(rows, lookups);
+    }
+    if (strcmp(argv[0], "bench-query") == 0)
+    {
+        long rows = argc > 1 ? atol(argv[1]) : 100000000;
+        int threads = argc > 2 ? atoi(argv[2]) : 8;
+        if (rows < 1 || threads < 1 || threads > QUERY_MAX_THREADS)
+        {
+            printf("rows must be >= 1 and threads 1..%d\n", QUERY_MAX_THREADS);
+            return 1;
+        }
+        return bench_query(rows, threads);
+    }
+    if (strcmp(argv[0], "load") == 0 && argc > 1)
+    {
+        int threads = argc > 2 ? atoi(argv[2]) : 8;
+        if (threads < 1 || threads > BULK_LOAD_MAX_THREADS)
+        {
+            printf("threads must be 1..%d\n", BULK_LOAD_MAX_THREADS);
+            return 1;
+        }
+        return load_command(argv[1], threads, argc > 3 ? argv[3] : NULL);
+    }
+    if (strcmp(argv[0], "bench-load") == 0)
+    {
+        long rows = argc > 1 ? atol(argv[1]) : 10000000;
+        int threads = argc > 2 ? atoi(argv[2]) : 8;
+        if (rows < 1 || rows >= STUDENT_NO_ROW / 2 || threads < 1 || threads > BULK_LOAD_MAX_THREADS)
+        {
+            printf("rows must be 1..%u and threads 1..%d\n", STUDENT_NO_ROW / 2 - 1, BULK_LOAD_MAX_THREADS);
+            return 1;
+        }
+        return bench_load(rows, threads, argc > 3 ? argv[3] : "/tmp/students.csv");
+    }
+    if (strcmp(argv[0], "store-load") == 0 && argc > 2)
+    {
+        long frames = argc > 3 ? atol(argv[3]) : 1024;
+        if (frames < 1)
+        {
+            printf("frames must be >= 1\n");
+            return 1;
+        }
+        return store_load(argv[1], argv[2], frames);
+    }
+    if (strcmp(argv[0], "store-scan") == 0 && argc > 1)
+    {
+        int low = argc > 2 ? atoi(argv[2]) : INT32_MIN;
+        int high = argc > 3 ? atoi(argv[3]) : INT32_MAX;
+        long frames = argc > 4 ? atol(argv[4]) : 1024;
+        if (frames < 1)
+        {
+            printf("frames must be >= 1\n");
+            return 1;
+        }
+        return store_scan(argv[1], low, high, frames);
+    }
+    if (strcmp(argv[0], "bench-store") == 0)
+    {
+        long records = argc > 1 ? atol(argv[1]) : 2000000;
+        long frames = argc > 2 ? atol(argv[2]) : 1024;
+        if (records < 2 || records > INT32_MAX || frames < 1)
+        {
+            printf("records must be 2..%d and frames >= 1\n", INT32_MAX);
+            return 1;
+        }
+        return bench_store(records, frames, argc > 3 ? argv[3] : "/tmp/students.db");
+    }
+    if (strcmp(argv[0], "stats") == 0)
+    {
+        long records = argc > 1 ? atol(argv[1]) : 1000000;
+        if (records < 1)
+        {
+            printf("records must be >= 1\n");
+            return 1;
+        }
+        return bench_stats(records);
+    }
+
+    printf("Usage:\n");
+    printf("  run                                   interactive menu\n");
+    printf("  run bench-pool [threads] [ops/thread] pool vs malloc, 1..threads threads\n");
+    printf("  run bench-slab [cycles] [live]        db_tuple_t slab vs malloc, random frees\n");
+    printf("  run bench-slab-threads [threads] [ops/thread]\n");
+    printf("                                        slab magazines vs one lock vs malloc\n");
+    printf("  run bench-malloc [threads] [ops/thread] slab_malloc vs malloc, mixed sizes\n");
+    printf("  run bench-shrink [live] [rounds]      RSS after bursts, reap vs shrink\n");
+    printf("  run bench-table [rows] [lookups]      student table: bytes/row, index lookup latency\n");
+    printf("  run bench-query [rows] [threads]      column scans: range, COUNT/AVG, GROUP BY\n");
+    printf("  run load <file> [threads] [save.bin]  bulk load a CSV (name,age) or binary file\n");
+    printf("  run bench-load [rows] [threads] [file] per-row inserts vs bulk load, CSV and binary\n");
+    printf("  run store-load <csv> <data file> [frames]\n");
+    printf("                                        append students to a paged data file\n");
+    printf("  run store-scan <data file> [low] [high] [frames]\n");
+    printf("                                        COUNT/AVG(age) over a data file\n");
+    printf("  run bench-store [records] [frames] [file] data file through the buffer manager\n");
+    printf("  run stats [records]                   allocator counters, periodic report\n");
+    return 1;
+}
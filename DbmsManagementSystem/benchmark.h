@@ -0,0 +1,9 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "main.h"
+
+// Non-interactive entry points: ./run <command> [args]. Returns the exit status.
+int run_benchmark(int argc, char *argv[]);
+
+#endif
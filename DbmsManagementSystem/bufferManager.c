@@ -0,0 +1,347 @@
+#include "bufferManager.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+#define NO_FRAME (-1)
+
+static size_t home_slot(const buffer_manager_t *manager, uint32_t page)
+{
+    return (size_t)(((uint64_t)page * 0x9E3779B97F4A7C15ull) >> 32) & manager->slot_mask;
+}
+
+// The slot holding `page`'s frame, or the empty slot that ends its probe
+static size_t find_slot(const buffer_manager_t *manager, uint32_t page)
+{
+    size_t slot = home_slot(manager, page);
+    while (manager->slots[slot] != NO_FRAME && manager->frames[manager->slots[slot]].page != page)
+        slot = (slot + 1) & manager->slot_mask;
+    return slot;
+}
+
+static int32_t lookup(const buffer_manager_t *manager, uint32_t page)
+{
+    return manager->slots[find_slot(manager, page)];
+}
+
+// Giving frame `index` page `page`, and making it findable
+static void map_frame(buffer_manager_t *manager, int32_t index, uint32_t page)
+{
+    manager->frames[index].page = page;
+    manager->slots[find_slot(manager, page)] = index;
+}
+
+// Taking frame `index` out of the table. The entries after it in the probe
+// run move back into the gap unless that would put them before their home.
+static void unmap_frame(buffer_manager_t *manager, int32_t index)
+{
+    size_t gap = find_slot(manager, manager->frames[index].page);
+    size_t slot = gap;
+    manager->slots[gap] = NO_FRAME;
+    for (;;)
+    {
+        slot = (slot + 1) & manager->slot_mask;
+        if (manager->slots[slot] == NO_FRAME)
+            break;
+        size_t home = home_slot(manager, manager->frames[manager->slots[slot]].page);
+        if (((slot - home) & manager->slot_mask) >= ((slot - gap) & manager->slot_mask))
+        {
+            manager->slots[gap] = manager->slots[slot];
+            manager->slots[slot] = NO_FRAME;
+            gap = slot;
+        }
+    }
+    manager->frames[index].page = BUFFER_NO_PAGE;
+}
+
+// Opening (creating if need be) the data file at `path` with `frames`
+// frames. Returns NULL with errno set on failure.
+buffer_manager_t *buffer_open(const char *path, size_t frames)
+{
+    if (frames == 0 || frames > INT32_MAX)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    buffer_manager_t *manager = calloc(1, sizeof(buffer_manager_t));
+    if (!manager)
+        return NULL;
+
+    size_t slots = 1;
+    while (slots < frames * 2)
+        slots <<= 1;
+
+    struct stat st;
+    manager->fd = open(path, O_CREAT | O_RDWR, 0644);
+    manager->frames = calloc(frames, sizeof(buffer_frame_t));
+    manager->slots = malloc(slots * sizeof(int32_t));
+    if (manager->fd < 0 || !manager->frames || !manager->slots ||
+        posix_memalign((void **)&manager->memory, BUFFER_PAGE_SIZE, frames * BUFFER_PAGE_SIZE) != 0 ||
+        fstat(manager->fd, &st) < 0 || st.st_size / BUFFER_PAGE_SIZE >= BUFFER_NO_PAGE)
+    {
+        int saved = errno;
+        if (manager->fd >= 0)
+            close(manager->fd);
+        free(manager->memory);
+        free(manager->frames);
+        free(manager->slots);
+        free(manager);
+        errno = saved ? saved : ENOMEM;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < slots; i++)
+        manager->slots[i] = NO_FRAME;
+    for (size_t i = 0; i < frames; i++)
+    {
+        manager->frames[i].page = BUFFER_NO_PAGE;
+        manager->frames[i].data = manager->memory + i * BUFFER_PAGE_SIZE;
+    }
+    manager->capacity = frames;
+    manager->slot_mask = slots - 1;
+    manager->page_count = (uint32_t)((st.st_size + BUFFER_PAGE_SIZE - 1) / BUFFER_PAGE_SIZE);
+    return manager;
+}
+
+static int write_frame(buffer_manager_t *manager, buffer_frame_t *frame)
+{
+    off_t offset = (off_t)frame->page * BUFFER_PAGE_SIZE;
+    size_t done = 0;
+    while (done < BUFFER_PAGE_SIZE)
+    {
+        ssize_t written = pwrite(manager->fd, frame->data + done, BUFFER_PAGE_SIZE - done, offset + (off_t)done);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += (size_t)written;
+    }
+    frame->dirty = 0;
+    manager->pages_written++;
+    return 0;
+}
+
+// CLOCK over the unpinned frames. Two full turns without a victim means
+// every frame is pinned: EBUSY.
+static int32_t evict(buffer_manager_t *manager)
+{
+    for (size_t turns = 0; turns < 2 * manager->capacity; turns++)
+    {
+        buffer_frame_t *frame = &manager->frames[manager->clock_hand];
+        int32_t index = (int32_t)manager->clock_hand;
+        manager->clock_hand = (manager->clock_hand + 1) % manager->capacity;
+
+        if (frame->pins)
+            continue;
+        if (frame->page == BUFFER_NO_PAGE)
+            return index;
+        if (frame->referenced)
+        {
+            frame->referenced = 0;
+            continue;
+        }
+        if (frame->dirty && write_frame(manager, frame) < 0)
+            return NO_FRAME;
+        unmap_frame(manager, index);
+        manager->evictions++;
+        return index;
+    }
+    errno = EBUSY;
+    return NO_FRAME;
+}
+
+// The frame holding `page`, pinned; read in from the file unless `fresh`
+static buffer_frame_t *pin_page(buffer_manager_t *manager, uint32_t page, bool fresh)
+{
+    int32_t index = lookup(manager, page);
+    if (index != NO_FRAME)
+    {
+        manager->hits++;
+        buffer_frame_t *frame = &manager->frames[index];
+        frame->referenced = 1;
+        frame->pins++;
+        return frame;
+    }
+
+    manager->misses++;
+    index = evict(manager);
+    if (index == NO_FRAME)
+        return NULL;
+    buffer_frame_t *frame = &manager->frames[index];
+
+    size_t filled = 0;
+    off_t offset = (off_t)page * BUFFER_PAGE_SIZE;
+    while (!fresh && filled < BUFFER_PAGE_SIZE)
+    {
+        ssize_t got = pread(manager->fd, frame->data + filled, BUFFER_PAGE_SIZE - filled, offset + (off_t)filled);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return NULL;
+        }
+        if (got == 0)
+            break;      // a page allocated but never written reads as zeros
+        filled += (size_t)got;
+    }
+    memset(frame->data + filled, 0, BUFFER_PAGE_SIZE - filled);
+    if (!fresh)
+        manager->pages_read++;
+
+    map_frame(manager, index, page);
+    frame->dirty = 0;
+    frame->referenced = 1;
+    frame->pins = 1;
+    return frame;
+}
+
+// Page `page`, pinned. Returns NULL with errno set when the page is past
+// the end of the file (EINVAL), every frame is pinned (EBUSY) or the read
+// or a write-back fails.
+buffer_frame_t *buffer_pin(buffer_manager_t *manager, uint32_t page)
+{
+    if (page >= manager->page_count)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    return pin_page(manager, page, false);
+}
+
+// A new zeroed page at the end of the file, pinned and dirty
+buffer_frame_t *buffer_pin_new(buffer_manager_t *manager)
+{
+    if (manager->page_count == BUFFER_NO_PAGE)
+    {
+        errno = EFBIG;
+        return NULL;
+    }
+    buffer_frame_t *frame = pin_page(manager, manager->page_count, true);
+    if (frame)
+    {
+        manager->page_count++;
+        frame->dirty = 1;
+    }
+    return frame;
+}
+
+// Reading pages [first, first + count) that are not in memory, at most a
+// quarter of the frames' worth, so what comes in does not push out what is
+// being used. The pages stay unpinned.
+int buffer_prefetch(buffer_manager_t *manager, uint32_t first, uint32_t count)
+{
+    if (first >= manager->page_count)
+        return 0;
+    uint32_t end = manager->page_count - first < count ? manager->page_count : first + count;
+    if (end - first > BUFFER_MAX_RUN)
+        end = first + BUFFER_MAX_RUN;
+    if (end - first > manager->capacity / 4)
+        end = first + (uint32_t)(manager->capacity / 4);
+
+    int rc = 0;
+    for (uint32_t page = first; page < end && rc == 0;)
+    {
+        if (lookup(manager, page) != NO_FRAME)
+        {
+            page++;
+            continue;
+        }
+        // A run of pages not in memory, each given a frame, then one preadv
+        struct iovec iov[BUFFER_MAX_RUN];
+        int32_t taken[BUFFER_MAX_RUN];
+        uint32_t start = page;
+        int count_taken = 0;
+        for (; page < end && lookup(manager, page) == NO_FRAME; page++)
+        {
+            int32_t index = evict(manager);
+            if (index == NO_FRAME)
+                break;
+            manager->frames[index].pins = 1;        // kept from being chosen again in this run
+            taken[count_taken] = index;
+            iov[count_taken].iov_base = manager->frames[index].data;
+            iov[count_taken++].iov_len = BUFFER_PAGE_SIZE;
+        }
+        if (count_taken == 0)
+            break;
+
+        size_t bytes = (size_t)count_taken * BUFFER_PAGE_SIZE, filled = 0;
+        while (filled < bytes)
+        {
+            // Page-sized vectors: a short read stops on a page boundary or at the end of the file
+            int skip = (int)(filled / BUFFER_PAGE_SIZE);
+            ssize_t got = preadv(manager->fd, iov + skip, count_taken - skip, (off_t)start * BUFFER_PAGE_SIZE + (off_t)filled);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+            {
+                rc = got < 0 ? -1 : 0;
+                break;
+            }
+            filled += (size_t)got;
+            if (filled % BUFFER_PAGE_SIZE)
+            {
+                rc = -1;
+                errno = EIO;
+                break;
+            }
+        }
+        for (int i = 0; i < count_taken; i++)
+        {
+            buffer_frame_t *frame = &manager->frames[taken[i]];
+            frame->pins = 0;
+            if (rc < 0)
+                continue;
+            if ((size_t)i * BUFFER_PAGE_SIZE >= filled)
+                memset(frame->data, 0, BUFFER_PAGE_SIZE);
+            map_frame(manager, taken[i], start + (uint32_t)i);
+            frame->dirty = 0;
+            frame->referenced = 1;
+        }
+        if (rc == 0)
+            manager->pages_read += (uint64_t)count_taken;
+    }
+    return rc;
+}
+
+void buffer_unpin(buffer_manager_t *manager, buffer_frame_t *frame, bool dirty)
+{
+    (void)manager;
+    if (dirty)
+        frame->dirty = 1;
+    frame->pins--;
+}
+
+// Every dirty page to the file, then fdatasync
+int buffer_flush(buffer_manager_t *manager)
+{
+    for (size_t i = 0; i < manager->capacity; i++)
+    {
+        buffer_frame_t *frame = &manager->frames[i];
+        if (frame->dirty && write_frame(manager, frame) < 0)
+            return -1;
+    }
+    return fdatasync(manager->fd);
+}
+
+void buffer_stats(buffer_manager_t *manager, buffer_stats_t *stats)
+{
+    stats->hits = manager->hits;
+    stats->misses = manager->misses;
+    stats->pages_read = manager->pages_read;
+    stats->pages_written = manager->pages_written;
+    stats->evictions = manager->evictions;
+    stats->hit_rate = stats->hits + stats->misses ? (double)stats->hits / (stats->hits + stats->misses) : 0;
+}
+
+int buffer_close(buffer_manager_t *manager)
+{
+    int rc = buffer_flush(manager);
+    close(manager->fd);
+    free(manager->memory);
+    free(manager->frames);
+    free(manager->slots);
+    free(manager);
+    return rc;
+}
@@ -0,0 +1,72 @@
+#ifndef BUFFERMANAGER_H
+#define BUFFERMANAGER_H
+
+#include "main.h"
+#include <sys/uio.h>
+
+// Fixed-size pages of a data file, held in a fixed number of frames: the
+// memory a buffer manager uses is decided when it is opened, however big
+// the file grows. A caller pins a page to use it, and unpins it saying
+// whether it changed; a pinned page stays in its frame. When a page has to
+// come in and no frame is free, CLOCK picks an unpinned victim (a frame
+// used since the hand last passed gets a second chance), written back
+// first if dirty. Frames are found by page number through an open-addressed
+// table with twice as many slots as frames.
+//
+// A sequential reader can ask for the pages ahead of it with
+// buffer_prefetch, which reads the ones not in memory with one preadv per
+// run rather than one pread per page.
+//
+// Made for one heap file: not thread-safe, callers serialize.
+#define BUFFER_PAGE_SIZE 4096u
+#define BUFFER_MAX_RUN 256          // pages per preadv, at most IOV_MAX
+#define BUFFER_NO_PAGE UINT32_MAX
+
+typedef struct buffer_frame
+{
+    uint32_t page;                  // BUFFER_NO_PAGE when free
+    uint32_t pins;
+    uint8_t dirty;
+    uint8_t referenced;             // CLOCK second chance
+    char *data;
+} buffer_frame_t;
+
+typedef struct buffer_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t pages_read;
+    uint64_t pages_written;
+    uint64_t evictions;
+    double hit_rate;
+} buffer_stats_t;
+
+typedef struct buffer_manager
+{
+    int fd;
+
+    buffer_frame_t *frames;
+    char *memory;                   // capacity pages, page-aligned
+    size_t capacity;
+    int32_t *slots;                 // page table: frame index or -1, linear probing
+    size_t slot_mask;
+    size_t clock_hand;
+    uint32_t page_count;            // pages in the file, new pages not written yet included
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t pages_read;
+    uint64_t pages_written;
+    uint64_t evictions;
+} buffer_manager_t;
+
+buffer_manager_t *buffer_open(const char *path, size_t frames);
+buffer_frame_t *buffer_pin(buffer_manager_t *manager, uint32_t page);
+buffer_frame_t *buffer_pin_new(buffer_manager_t *manager);
+void buffer_unpin(buffer_manager_t *manager, buffer_frame_t *frame, bool dirty);
+int buffer_prefetch(buffer_manager_t *manager, uint32_t first, uint32_t count);
+int buffer_flush(buffer_manager_t *manager);
+void buffer_stats(buffer_manager_t *manager, buffer_stats_t *stats);
+int buffer_close(buffer_manager_t *manager);
+
+#endif
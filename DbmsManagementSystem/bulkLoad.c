@@ -0,0 +1,290 @@
+#include "bulkLoad.h"
+#include <sys/stat.h>
+
+#define MAGIC_LENGTH (sizeof(BULK_LOAD_MAGIC) - 1)
+
+typedef struct load_worker
+{
+    student_table_t *table;
+    const char *begin;              // CSV: this worker's lines; binary: its records
+    const char *end;
+    uint32_t first_row;
+    size_t rows;
+    const char *error;              // the first malformed line
+} load_worker_t;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// One CSV line, '\n' and '\r' already off: the name is what comes before
+// the last comma, the age the number after it, with spaces around it
+// allowed. Returns false when the line is not of that form.
+bool bulk_parse_line(const char *line, const char *end, size_t *name_length, int *age)
+{
+    const char *p = end;
+    while (p > line && p[-1] == ' ')
+        p--;
+    const char *digits_end = p;
+    while (p > line && p[-1] >= '0' && p[-1] <= '9')
+        p--;
+    const char *digits = p;
+    if (digits == digits_end || digits_end - digits > 10)
+        return false;
+    bool negative = p > line && p[-1] == '-';
+    if (p > line && (p[-1] == '-' || p[-1] == '+'))
+        p--;
+    while (p > line && p[-1] == ' ')
+        p--;
+    if (p == line || p[-1] != ',' || p - 1 == line)
+        return false;
+
+    int64_t value = 0;
+    for (const char *d = digits; d < digits_end; d++)
+        value = value * 10 + (*d - '0');
+    if (value > (negative ? -(int64_t)INT32_MIN : INT32_MAX))
+        return false;
+    *name_length = (size_t)(p - 1 - line);
+    *age = (int)(negative ? -value : value);
+    return true;
+}
+
+// The end of the line at `p` and where the next one starts, with a '\r'
+// before the '\n' left off the line
+static const char *line_end(const char *p, const char *end, const char **next)
+{
+    const char *newline = memchr(p, '\n', end - p);
+    const char *stop = newline ? newline : end;
+    *next = newline ? newline + 1 : end;
+    if (stop > p && stop[-1] == '\r')
+        stop--;
+    return stop;
+}
+
+static void *count_main(void *arg)
+{
+    load_worker_t *worker = arg;
+    const char *next;
+    for (const char *p = worker->begin; p < worker->end; p = next)
+        worker->rows += line_end(p, worker->end, &next) > p;
+    return NULL;
+}
+
+static void *parse_main(void *arg)
+{
+    load_worker_t *worker = arg;
+    uint32_t row = worker->first_row;
+    const char *next;
+    for (const char *p = worker->begin; p < worker->end; p = next)
+    {
+        const char *stop = line_end(p, worker->end, &next);
+        size_t name_length;
+        int age;
+        if (stop == p)
+            continue;
+        if (!bulk_parse_line(p, stop, &name_length, &age))
+        {
+            worker->error = p;
+            return NULL;
+        }
+        student_bulk_put(worker->table, row++, p, name_length, age);
+    }
+    return NULL;
+}
+
+static void *copy_main(void *arg)
+{
+    load_worker_t *worker = arg;
+    const student_t *records = (const student_t *)worker->begin;
+    for (size_t i = 0; i < worker->rows; i++)
+        student_bulk_put(worker->table, worker->first_row + (uint32_t)i, records[i].name,
+                         strnlen(records[i].name, sizeof(records[i].name) - 1), records[i].age);
+    return NULL;
+}
+
+// Chunks of about equal length that start at a line start
+static void split_lines(load_worker_t *workers, int count, const char *begin, const char *end)
+{
+    size_t length = end - begin;
+    for (int i = 0; i < count; i++)
+    {
+        const char *start = begin + length * i / count;
+        if (start > begin)
+        {
+            const char *newline = memchr(start - 1, '\n', end - start + 1);
+            start = newline ? newline + 1 : end;
+        }
+        workers[i].begin = start;
+        if (i > 0)
+            workers[i - 1].end = start;
+    }
+    workers[count - 1].end = end;
+}
+
+static int load_csv(student_table_t *table, load_worker_t *workers, int threads, const char *data, size_t length,
+                    bulk_load_stats_t *stats, double start)
+{
+    const char *file = data, *end = data + length, *next;
+    size_t name_length;
+    int age;
+    const char *stop = line_end(data, end, &next);
+    if (stop > data && !bulk_parse_line(data, stop, &name_length, &age))
+        data = next;    // a header
+
+    split_lines(workers, threads, data, end);
+    student_run_workers(workers, sizeof(load_worker_t), threads, count_main);
+    size_t rows = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].first_row = (uint32_t)(table->rows + rows);
+        rows += workers[i].rows;
+    }
+    if (student_bulk_reserve(table, rows) < 0)
+        return BULK_LOAD_MEMORY;
+    double counted = now_seconds();
+    stats->count_seconds = counted - start;
+
+    student_run_workers(workers, sizeof(load_worker_t), threads, parse_main);
+    stats->parse_seconds = now_seconds() - counted;
+    for (int i = 0; i < threads; i++)
+    {
+        if (workers[i].error)
+        {
+            stats->line = 1;
+            for (const char *p = file; p < workers[i].error; p++)
+                stats->line += *p == '\n';
+            return BULK_LOAD_FORMAT;
+        }
+    }
+    stats->rows = rows;
+    return BULK_LOAD_OK;
+}
+
+static int load_binary(student_table_t *table, load_worker_t *workers, int threads, const char *data, size_t length,
+                       bulk_load_stats_t *stats, double start)
+{
+    if ((length - MAGIC_LENGTH) % sizeof(student_t))
+        return BULK_LOAD_FORMAT;
+    size_t rows = (length - MAGIC_LENGTH) / sizeof(student_t);
+    if (student_bulk_reserve(table, rows) < 0)
+        return BULK_LOAD_MEMORY;
+    for (int i = 0; i < threads; i++)
+    {
+        size_t first = rows * i / threads;
+        workers[i].begin = data + MAGIC_LENGTH + first * sizeof(student_t);
+        workers[i].rows = rows * (i + 1) / threads - first;
+        workers[i].first_row = (uint32_t)(table->rows + first);
+    }
+    double counted = now_seconds();
+    stats->count_seconds = counted - start;
+
+    student_run_workers(workers, sizeof(load_worker_t), threads, copy_main);
+    stats->parse_seconds = now_seconds() - counted;
+    stats->rows = rows;
+    return BULK_LOAD_OK;
+}
+
+// Adding the students in the file at `path` to `table`, parsed on
+// `threads` threads. Returns BULK_LOAD_OK, or one of the errors in
+// bulkLoad.h with the table left as it was.
+int bulk_load(student_table_t *table, const char *path, int threads, bulk_load_stats_t *stats)
+{
+    memset(stats, 0, sizeof(bulk_load_stats_t));
+    if (threads < 1 || threads > BULK_LOAD_MAX_THREADS)
+        return BULK_LOAD_THREADS;
+    double start = now_seconds();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return BULK_LOAD_FILE;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return BULK_LOAD_FILE;
+    }
+    stats->bytes = (size_t)st.st_size;
+    if (stats->bytes == 0)
+    {
+        close(fd);
+        stats->seconds = now_seconds() - start;
+        return BULK_LOAD_OK;
+    }
+
+    // Populated up front: one pass of faults in the kernel rather than one
+    // per page on every thread
+    char *data = mmap(NULL, stats->bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return BULK_LOAD_FILE;
+    madvise(data, stats->bytes, MADV_SEQUENTIAL);
+
+    load_worker_t *workers = calloc(threads, sizeof(load_worker_t));
+    int status = BULK_LOAD_MEMORY;
+    if (workers)
+    {
+        for (int i = 0; i < threads; i++)
+            workers[i].table = table;
+        stats->binary = stats->bytes >= MAGIC_LENGTH && memcmp(data, BULK_LOAD_MAGIC, MAGIC_LENGTH) == 0;
+        if (stats->binary)
+            status = load_binary(table, workers, threads, data, stats->bytes, stats, start);
+        else
+            status = load_csv(table, workers, threads, data, stats->bytes, stats, start);
+    }
+    free(workers);
+    munmap(data, stats->bytes);
+    if (status != BULK_LOAD_OK)
+    {
+        stats->rows = 0;
+        return status;
+    }
+
+    double parsed = now_seconds();
+    if (student_bulk_commit(table, stats->rows, threads) < 0)
+    {
+        stats->rows = 0;
+        return BULK_LOAD_MEMORY;
+    }
+    stats->index_seconds = now_seconds() - parsed;
+    stats->seconds = now_seconds() - start;
+    stats->rows_per_second = stats->seconds > 0 ? stats->rows / stats->seconds : 0;
+    return BULK_LOAD_OK;
+}
+
+// The table in the binary format bulk_load reads
+int bulk_save(const student_table_t *table, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return BULK_LOAD_FILE;
+    bool written = fwrite(BULK_LOAD_MAGIC, 1, MAGIC_LENGTH, file) == MAGIC_LENGTH;
+    for (size_t s = 0; written && s * STUDENT_SEGMENT_ROWS < table->rows; s++)
+    {
+        size_t rows = table->rows - s * STUDENT_SEGMENT_ROWS;
+        rows = rows < STUDENT_SEGMENT_ROWS ? rows : STUDENT_SEGMENT_ROWS;
+        written = fwrite(table->segments[s], sizeof(student_t), rows, file) == rows;
+    }
+    if (fclose(file) != 0 || !written)
+        return BULK_LOAD_FILE;
+    return BULK_LOAD_OK;
+}
+
+const char *bulk_load_error(int status)
+{
+    switch (status)
+    {
+    case BULK_LOAD_OK:
+        return "no error";
+    case BULK_LOAD_FILE:
+        return "cannot read or write the file";
+    case BULK_LOAD_FORMAT:
+        return "malformed file";
+    case BULK_LOAD_MEMORY:
+        return "memory allocation failed";
+    case BULK_LOAD_THREADS:
+        return "bad thread count";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,54 @@
+#ifndef BULKLOAD_H
+#define BULKLOAD_H
+
+#include "studentTable.h"
+
+// Loading students from a file in one go. The file is mapped, not read,
+// and cut into one chunk per thread at line ends. Each thread counts the
+// rows in its chunk; the counts place every chunk's first row, so the table
+// makes room for all of them at once (student_bulk_reserve) and the threads
+// then parse their chunks straight into their rows. The indexes are built
+// once everything is in (student_bulk_commit).
+//
+// Two formats, told apart by the first bytes:
+//
+// - binary: BULK_LOAD_MAGIC, then one student_t per row as the table
+//   stores it (bulk_save writes this). The row count follows from the file
+//   length, so there is nothing to count.
+// - CSV: one "name,age" line per row. The name is everything before the
+//   last comma; a name longer than a row holds is cut short, as when added
+//   by hand. Blank lines are skipped, and so is the first line when its
+//   last field is not a number (a header).
+//
+// A load either adds every row of the file or none.
+#define BULK_LOAD_MAGIC "STUDENT1"
+#define BULK_LOAD_MAX_THREADS STUDENT_BULK_THREADS
+
+enum
+{
+    BULK_LOAD_OK = 0,
+    BULK_LOAD_FILE = -1,            // cannot open, map or write the file
+    BULK_LOAD_FORMAT = -2,          // a malformed line, or a binary file cut short
+    BULK_LOAD_MEMORY = -3,
+    BULK_LOAD_THREADS = -4,         // threads not in 1..BULK_LOAD_MAX_THREADS
+};
+
+typedef struct bulk_load_stats
+{
+    size_t rows;
+    size_t bytes;                   // the file's length
+    bool binary;
+    size_t line;                    // CSV: the first malformed line, counted from 1
+    double count_seconds;           // mapping the file, counting rows and making room for them
+    double parse_seconds;
+    double index_seconds;
+    double seconds;
+    double rows_per_second;
+} bulk_load_stats_t;
+
+bool bulk_parse_line(const char *line, const char *end, size_t *name_length, int *age);
+int bulk_load(student_table_t *table, const char *path, int threads, bulk_load_stats_t *stats);
+int bulk_save(const student_table_t *table, const char *path);
+const char *bulk_load_error(int status);
+
+#endif
@@ -0,0 +1,425 @@
+#include "heapFile.h"
+#include <errno.h>
+
+#define GROUP_PAGES (HEAP_FSM_SPAN + 1)     // a map page and its data pages
+
+static bool is_map_page(uint32_t page)
+{
+    return page >= 1 && (page - 1) % GROUP_PAGES == 0;
+}
+
+static uint32_t map_page(uint32_t group)
+{
+    return 1 + group * GROUP_PAGES;
+}
+
+static uint32_t group_of(uint32_t page)
+{
+    return (page - 1) / GROUP_PAGES;
+}
+
+// What a new record can take: the free bytes, deleted records' included,
+// less a slot unless a free one is there to reuse
+static size_t page_room(const heap_page_t *page)
+{
+    size_t used = sizeof(heap_page_t) + (page->slot_count + (page->free_slots ? 0 : 1)) * sizeof(heap_slot_t);
+    size_t free = (size_t)page->records_start + page->garbage;
+    return free > used ? free - used : 0;
+}
+
+static uint8_t room_byte(const heap_page_t *page)
+{
+    size_t units = page_room(page) / HEAP_FSM_UNIT;
+    return units > UINT8_MAX ? UINT8_MAX : (uint8_t)units;
+}
+
+// A data page that was added but never written reads as zeros
+static heap_page_t *page_of(buffer_frame_t *frame)
+{
+    heap_page_t *page = (heap_page_t *)frame->data;
+    if (page->records_start == 0)
+        page->records_start = BUFFER_PAGE_SIZE;
+    return page;
+}
+
+// Moving the records to the end of the page, over the deleted ones
+static void page_compact(heap_page_t *page)
+{
+    char copy[BUFFER_PAGE_SIZE];
+    uint16_t end = BUFFER_PAGE_SIZE;
+    memcpy(copy, page, BUFFER_PAGE_SIZE);
+    for (uint16_t i = 0; i < page->slot_count; i++)
+    {
+        heap_slot_t *slot = &page->slots[i];
+        if (!slot->offset)
+            continue;
+        end -= slot->length;
+        memcpy((char *)page + end, copy + slot->offset, slot->length);
+        slot->offset = end;
+    }
+    page->records_start = end;
+    page->garbage = 0;
+}
+
+// Storing a record the page has room for (page_room); returns its slot
+static uint16_t page_put(heap_page_t *page, const void *record, size_t length)
+{
+    size_t slots_end = sizeof(heap_page_t) + (page->slot_count + (page->free_slots ? 0 : 1)) * sizeof(heap_slot_t);
+    if (page->records_start < slots_end + length)
+        page_compact(page);
+
+    uint16_t slot = 0;
+    if (page->free_slots)
+    {
+        while (page->slots[slot].offset)
+            slot++;
+        page->free_slots--;
+    }
+    else
+        slot = page->slot_count++;
+    page->records_start -= (uint16_t)length;
+    memcpy((char *)page + page->records_start, record, length);
+    page->slots[slot] = (heap_slot_t){ page->records_start, (uint16_t)length };
+    return slot;
+}
+
+static int group_room_grow(heap_file_t *heap, uint32_t groups)
+{
+    if (groups > heap->group_capacity)
+    {
+        uint32_t capacity = heap->group_capacity ? heap->group_capacity : 64;
+        while (capacity < groups)
+            capacity *= 2;
+        uint8_t *room = realloc(heap->group_room, capacity);
+        if (!room)
+            return -1;
+        heap->group_room = room;
+        heap->group_capacity = capacity;
+    }
+    while (heap->group_count < groups)
+        heap->group_room[heap->group_count++] = 0;
+    return 0;
+}
+
+// Recording a data page's room in its map page
+static int map_set(heap_file_t *heap, uint32_t page, uint8_t room)
+{
+    uint32_t group = group_of(page);
+    buffer_frame_t *frame = buffer_pin(heap->buffers, map_page(group));
+    if (!frame)
+        return -1;
+    uint8_t *bytes = (uint8_t *)frame->data;
+    uint32_t index = page - map_page(group) - 1;
+    bool changed = bytes[index] != room;
+    bytes[index] = room;
+    buffer_unpin(heap->buffers, frame, changed);
+    if (room > heap->group_room[group])
+        heap->group_room[group] = room;
+    return 0;
+}
+
+// A data page with room for `length` bytes, from the map; 0 when there is
+// none, -1 (as a uint32_t, UINT32_MAX) when a map page cannot be read
+static uint32_t map_find(heap_file_t *heap, size_t length)
+{
+    uint8_t wanted = (uint8_t)((length + HEAP_FSM_UNIT - 1) / HEAP_FSM_UNIT);
+    uint32_t page_count = heap->buffers->page_count;
+    for (uint32_t group = 0; group < heap->group_count; group++)
+    {
+        if (heap->group_room[group] < wanted)
+            continue;
+        buffer_frame_t *frame = buffer_pin(heap->buffers, map_page(group));
+        if (!frame)
+            return UINT32_MAX;
+        const uint8_t *bytes = (const uint8_t *)frame->data;
+        uint32_t pages = page_count - map_page(group) - 1;
+        pages = pages < HEAP_FSM_SPAN ? pages : HEAP_FSM_SPAN;
+        uint8_t largest = 0;
+        for (uint32_t i = 0; i < pages; i++)
+        {
+            if (bytes[i] >= wanted)
+            {
+                buffer_unpin(heap->buffers, frame, false);
+                return map_page(group) + 1 + i;
+            }
+            largest = bytes[i] > largest ? bytes[i] : largest;
+        }
+        buffer_unpin(heap->buffers, frame, false);
+        heap->group_room[group] = largest;      // exact again
+    }
+    return 0;
+}
+
+// A new data page at the end of the file, with a new map page before it
+// when it starts a group
+static buffer_frame_t *page_add(heap_file_t *heap)
+{
+    if (is_map_page(heap->buffers->page_count))
+    {
+        if (group_room_grow(heap, group_of(heap->buffers->page_count) + 1) < 0)
+            return NULL;
+        buffer_frame_t *map = buffer_pin_new(heap->buffers);
+        if (!map)
+            return NULL;
+        buffer_unpin(heap->buffers, map, true);
+    }
+    buffer_frame_t *frame = buffer_pin_new(heap->buffers);
+    if (frame)
+        page_of(frame);
+    return frame;
+}
+
+// Opening (creating if need be) the data file at `path`, with `frames`
+// pages of memory. Returns NULL with errno set on failure, EINVAL for a
+// file that is not a heap file.
+heap_file_t *heap_open(const char *path, size_t frames)
+{
+    heap_file_t *heap = calloc(1, sizeof(heap_file_t));
+    if (!heap)
+        return NULL;
+    heap->buffers = buffer_open(path, frames);
+    if (!heap->buffers)
+    {
+        free(heap);
+        return NULL;
+    }
+
+    bool created = heap->buffers->page_count == 0;
+    buffer_frame_t *frame = created ? buffer_pin_new(heap->buffers) : buffer_pin(heap->buffers, 0);
+    if (!frame)
+        goto failed;
+    heap_header_t *header = (heap_header_t *)frame->data;
+    if (created)
+    {
+        memcpy(header->magic, HEAP_MAGIC, sizeof(header->magic));
+        header->page_size = BUFFER_PAGE_SIZE;
+        header->fsm_span = HEAP_FSM_SPAN;
+        buffer_unpin(heap->buffers, frame, true);
+    }
+    else
+    {
+        bool valid = memcmp(header->magic, HEAP_MAGIC, sizeof(header->magic)) == 0 &&
+                     header->page_size == BUFFER_PAGE_SIZE && header->fsm_span == HEAP_FSM_SPAN;
+        heap->records = header->records;
+        buffer_unpin(heap->buffers, frame, false);
+        if (!valid)
+        {
+            errno = EINVAL;
+            goto failed;
+        }
+    }
+
+    // Any group may have room until map_find has read its map page
+    uint32_t page_count = heap->buffers->page_count;
+    uint32_t groups = page_count > 1 ? group_of(page_count - 1) + 1 : 0;
+    if (group_room_grow(heap, groups) < 0)
+        goto failed;
+    if (groups)
+        memset(heap->group_room, UINT8_MAX, groups);
+    return heap;
+
+failed:
+    {
+        int saved = errno;
+        buffer_close(heap->buffers);
+        free(heap->group_room);
+        free(heap);
+        errno = saved;
+        return NULL;
+    }
+}
+
+// Storing `length` bytes (1..HEAP_MAX_RECORD) as a new record; its address
+// goes to *id. Returns -1 with errno set on failure.
+int heap_insert(heap_file_t *heap, const void *record, size_t length, record_id_t *id)
+{
+    if (length == 0 || length > HEAP_MAX_RECORD)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    buffer_frame_t *frame = NULL;
+    if (heap->insert_page)
+    {
+        if (!(frame = buffer_pin(heap->buffers, heap->insert_page)))
+            return -1;
+        if (page_room(page_of(frame)) < length)
+        {
+            buffer_unpin(heap->buffers, frame, false);
+            frame = NULL;
+        }
+    }
+    if (!frame)
+    {
+        uint32_t page = map_find(heap, length);
+        if (page == UINT32_MAX)
+            return -1;
+        if (page)
+        {
+            if (!(frame = buffer_pin(heap->buffers, page)))
+                return -1;
+            // Its map byte was left too high by an update that failed: put it right
+            if (page_room(page_of(frame)) < length)
+            {
+                uint8_t room = room_byte(page_of(frame));
+                buffer_unpin(heap->buffers, frame, false);
+                map_set(heap, page, room);
+                frame = NULL;
+            }
+        }
+        if (!frame && !(frame = page_add(heap)))
+            return -1;
+    }
+
+    heap_page_t *page = page_of(frame);
+    uint8_t before = room_byte(page);
+    id->page = frame->page;
+    id->slot = page_put(page, record, length);
+    uint8_t room = room_byte(page);
+    buffer_unpin(heap->buffers, frame, true);
+    heap->insert_page = id->page;
+    heap->records++;
+    // A new page's map byte is 0 until set; otherwise it is `before`. The
+    // record is in either way, so a failed map update is not the insert's
+    // failure: a byte left too high is caught above, one too low only
+    // leaves room unused.
+    if (room != before || id->page == heap->buffers->page_count - 1)
+        map_set(heap, id->page, room);
+    return 0;
+}
+
+static heap_page_t *record_page(heap_file_t *heap, record_id_t id, buffer_frame_t **frame)
+{
+    if (id.page == 0 || is_map_page(id.page) || id.page >= heap->buffers->page_count)
+    {
+        errno = ENOENT;
+        return NULL;
+    }
+    if (!(*frame = buffer_pin(heap->buffers, id.page)))
+        return NULL;
+    heap_page_t *page = page_of(*frame);
+    if (id.slot >= page->slot_count || !page->slots[id.slot].offset)
+    {
+        buffer_unpin(heap->buffers, *frame, false);
+        errno = ENOENT;
+        return NULL;
+    }
+    return page;
+}
+
+// Copying record `id` into `buffer`, as much of it as `size` allows.
+// Returns its length, or -1 with errno set (ENOENT: no such record).
+int heap_read(heap_file_t *heap, record_id_t id, void *buffer, size_t size)
+{
+    buffer_frame_t *frame;
+    heap_page_t *page = record_page(heap, id, &frame);
+    if (!page)
+        return -1;
+    heap_slot_t slot = page->slots[id.slot];
+    memcpy(buffer, (char *)page + slot.offset, slot.length < size ? slot.length : size);
+    buffer_unpin(heap->buffers, frame, false);
+    return slot.length;
+}
+
+int heap_delete(heap_file_t *heap, record_id_t id)
+{
+    buffer_frame_t *frame;
+    heap_page_t *page = record_page(heap, id, &frame);
+    if (!page)
+        return -1;
+    page->garbage += page->slots[id.slot].length;
+    page->slots[id.slot] = (heap_slot_t){ 0, 0 };
+    page->free_slots++;
+    // Free slots at the end of the array go back to the records
+    while (page->slot_count && !page->slots[page->slot_count - 1].offset)
+    {
+        page->slot_count--;
+        page->free_slots--;
+    }
+    if (!page->slot_count)
+    {
+        page->records_start = BUFFER_PAGE_SIZE;
+        page->garbage = 0;
+    }
+    uint8_t room = room_byte(page);
+    buffer_unpin(heap->buffers, frame, true);
+    heap->records--;
+    map_set(heap, id.page, room);      // as in heap_insert: the record is gone either way
+    return 0;
+}
+
+void heap_scan(heap_file_t *heap, heap_cursor_t *cursor)
+{
+    cursor->heap = heap;
+    cursor->page = 2;       // after the header and the first map page
+    cursor->slot = 0;
+    cursor->frame = NULL;
+    cursor->prefetched = 0;
+}
+
+// The next record: a pointer into its page, valid until the next call.
+// Returns 1, 0 at the end, or -1 with errno set when a page cannot be read.
+int heap_cursor_next(heap_cursor_t *cursor, const void **record, size_t *length, record_id_t *id)
+{
+    buffer_manager_t *buffers = cursor->heap->buffers;
+    for (;;)
+    {
+        if (!cursor->frame)
+        {
+            while (cursor->page < buffers->page_count && is_map_page(cursor->page))
+                cursor->page++;
+            if (cursor->page >= buffers->page_count)
+                return 0;
+            if (cursor->page >= cursor->prefetched)
+            {
+                buffer_prefetch(buffers, cursor->page, HEAP_PREFETCH);
+                cursor->prefetched = cursor->page + HEAP_PREFETCH;
+            }
+            if (!(cursor->frame = buffer_pin(buffers, cursor->page)))
+                return -1;
+            cursor->slot = 0;
+        }
+
+        const heap_page_t *page = page_of(cursor->frame);
+        while (cursor->slot < page->slot_count && !page->slots[cursor->slot].offset)
+            cursor->slot++;
+        if (cursor->slot < page->slot_count)
+        {
+            heap_slot_t slot = page->slots[cursor->slot];
+            *record = cursor->frame->data + slot.offset;
+            *length = slot.length;
+            *id = (record_id_t){ cursor->page, (uint16_t)cursor->slot++ };
+            return 1;
+        }
+        buffer_unpin(buffers, cursor->frame, false);
+        cursor->frame = NULL;
+        cursor->page++;
+    }
+}
+
+void heap_cursor_close(heap_cursor_t *cursor)
+{
+    if (cursor->frame)
+        buffer_unpin(cursor->heap->buffers, cursor->frame, false);
+    cursor->frame = NULL;
+}
+
+// Writing the record count to the header, every dirty page to the file,
+// and closing it
+int heap_close(heap_file_t *heap)
+{
+    int rc = -1;
+    buffer_frame_t *frame = buffer_pin(heap->buffers, 0);
+    if (frame)
+    {
+        ((heap_header_t *)frame->data)->records = heap->records;
+        buffer_unpin(heap->buffers, frame, true);
+        rc = 0;
+    }
+    if (buffer_close(heap->buffers) < 0)
+        rc = -1;
+    free(heap->group_room);
+    free(heap);
+    return rc;
+}
@@ -0,0 +1,91 @@
+#ifndef HEAPFILE_H
+#define HEAPFILE_H
+
+#include "bufferManager.h"
+
+// Records of up to HEAP_MAX_RECORD bytes kept in the pages of a data file,
+// read and written through a buffer manager, so a file can be much larger
+// than the memory given to it. A record is addressed by (page, slot) and
+// keeps that address until it is deleted.
+//
+// Page 0 is the file header. After it the pages come in groups: a
+// free-space map page, then the HEAP_FSM_SPAN data pages it describes, one
+// byte each - the bytes free in the page / HEAP_FSM_UNIT, rounded down.
+// The largest byte of each group is kept in memory too, one byte per 16 MB
+// of file. An insert tries the page the last insert went to, then the map
+// pages of the groups that may have room, and only then adds a page.
+// The map is a hint: an insert checks the page it names and, finding it
+// fuller than the map says, corrects the byte and looks elsewhere.
+//
+// A data page is slotted: an 8-byte header, then the slot array growing
+// up, and the records growing down from the end of the page. A slot holds
+// a record's offset and length; deleting a record frees its slot for the
+// next insert into that page, and its bytes for when the records are next
+// compacted.
+//
+// Not thread-safe; callers serialize.
+#define HEAP_MAGIC "DBHEAP01"
+#define HEAP_FSM_SPAN BUFFER_PAGE_SIZE
+#define HEAP_FSM_UNIT 16
+#define HEAP_MAX_RECORD (BUFFER_PAGE_SIZE - sizeof(heap_page_t) - sizeof(heap_slot_t))
+#define HEAP_PREFETCH 64            // pages a scan reads ahead
+
+typedef struct record_id
+{
+    uint32_t page;
+    uint16_t slot;
+} record_id_t;
+
+typedef struct heap_slot
+{
+    uint16_t offset;                // 0: no record
+    uint16_t length;
+} heap_slot_t;
+
+typedef struct heap_page
+{
+    uint16_t slot_count;
+    uint16_t free_slots;            // slots with no record
+    uint16_t records_start;         // records take [records_start, BUFFER_PAGE_SIZE)
+    uint16_t garbage;               // bytes of deleted records among them
+    heap_slot_t slots[];
+} heap_page_t;
+
+typedef struct heap_header
+{
+    char magic[8];
+    uint32_t page_size;
+    uint32_t fsm_span;
+    uint64_t records;
+} heap_header_t;
+
+typedef struct heap_file
+{
+    buffer_manager_t *buffers;
+    uint64_t records;
+    uint32_t insert_page;           // where the last insert went, 0 for none
+    uint8_t *group_room;            // per group, at least the largest byte in its map page
+    uint32_t group_count;
+    uint32_t group_capacity;
+} heap_file_t;
+
+// Records in page then slot order
+typedef struct heap_cursor
+{
+    heap_file_t *heap;
+    uint32_t page;
+    uint32_t slot;
+    buffer_frame_t *frame;          // the page being read, pinned
+    uint32_t prefetched;            // pages before this one have been asked for
+} heap_cursor_t;
+
+heap_file_t *heap_open(const char *path, size_t frames);
+int heap_insert(heap_file_t *heap, const void *record, size_t length, record_id_t *id);
+int heap_read(heap_file_t *heap, record_id_t id, void *buffer, size_t size);
+int heap_delete(heap_file_t *heap, record_id_t id);
+void heap_scan(heap_file_t *heap, heap_cursor_t *cursor);
+int heap_cursor_next(heap_cursor_t *cursor, const void **record, size_t *length, record_id_t *id);
+void heap_cursor_close(heap_cursor_t *cursor);
+int heap_close(heap_file_t *heap);
+
+#endif
@@ -1,32 +1,77 @@
-#include "memoryPool.h"
+// Build: gcc -O2 -pthread -o run main.c memoryPool.c operations.c slabAllocator.c slabMalloc.c allocStats.c studentTable.c query.c bulkLoad.c bufferManager.c heapFile.c benchmark.c
+
 #include "operations.h"
+#include "benchmark.h"
 
-int main()
+int main(int argc, char *argv[])
 {
+    if (argc > 1)
+        return run_benchmark(argc - 1, argv + 1);
+
     bool loopFlag = true, alreadyExited = false;
     int userChoice = 0, contChoice = 0;
-    memory_pool_t *recordPool = pool_create(1024 * 1024, 256);
+    student_table_t *studentTable = student_table_create();
+    if (!studentTable)
+    {
+        printf("Error: memory allocation failed!\n");
+        return 1;
+    }
     do
     {
         printf("----------Welcome to DBMS!----------\n");
         printf("1.Add Details\n");
         printf("2.Display Details\n");
-        printf("3.Exit\n");
+        printf("3.Find by Name\n");
+        printf("4.Find by Age Range\n");
+        printf("5.Age Statistics\n");
+        printf("6.Memory Statistics\n");
+        printf("7.Load File\n");
+        printf("8.Save Data File\n");
+        printf("9.Open Data File\n");
+        printf("10.Exit\n");
         printf("Enter your choice: ");
         scanf("%d", &userChoice);
 
         switch (userChoice)
         {
         case 1:
-            addDetails(recordPool);
+            addDetails(studentTable);
             break;
         case 2:
-            displayDetails(recordPool);
+            displayDetails(studentTable);
             break;
         case 3:
+            findByName(studentTable);
+            break;
+        case 4:
+            findByAge(studentTable);
+            break;
+        case 5:
+            ageStatistics(studentTable);
+            break;
+        case 6:
+        {
+            student_table_stats_t stats;
+            student_table_stats(studentTable, &stats);
+            printf("%u students: rows %zu bytes, age column %zu bytes, name index %zu bytes, age index %zu bytes "
+                   "(%.1f bytes/row)\n", stats.rows, stats.row_bytes, stats.column_bytes, stats.name_index_bytes,
+                   stats.age_index_bytes, stats.bytes_per_row);
+            alloc_stats_dump(stdout);   // the allocators underneath: pools, slab caches, large allocations
+            break;
+        }
+        case 7:
+            loadFile(studentTable);
+            break;
+        case 8:
+            saveDataFile(studentTable);
+            break;
+        case 9:
+            openDataFile(studentTable);
+            break;
+        case 10:
             loopFlag = false;
             alreadyExited = true;
-            pool_destroy(recordPool);
+            student_table_destroy(studentTable);
             printf("Exiting\n");
             break;
         default:
@@ -40,7 +85,7 @@ int main()
             if (contChoice == 0)
             {
                 loopFlag = false;
-                pool_destroy(recordPool);
+                student_table_destroy(studentTable);
                 printf("Exiting from DB!");
             }
         }
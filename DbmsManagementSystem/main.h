@@ -6,5 +6,11 @@
 #include<stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #endif
\ No newline at end of file
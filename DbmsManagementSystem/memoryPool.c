@@ -1,71 +1,337 @@
 #include "memoryPool.h"
 
-//Memory Pool Creation
+#define POOL_ALIGN 16
+
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static memory_pool_t *pools;
+
+static size_t round_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static char *chunk_data(pool_chunk_t *chunk)
+{
+    return (char *)chunk + round_up(sizeof(pool_chunk_t), POOL_ALIGN);
+}
+
+//Adding a chunk once the existing ones are fully carved (pool lock held)
+static int pool_grow(memory_pool_t *pool)
+{
+    if (pool->carve_chunk && pool->carve_chunk->next)
+    {
+        pool->carve_chunk = pool->carve_chunk->next;    // reuse a chunk kept by pool_reset
+    }
+    else
+    {
+        pool_chunk_t *chunk = malloc(round_up(sizeof(pool_chunk_t), POOL_ALIGN) + pool->chunk_size);
+        if (!chunk)
+            return -1;
+        chunk->next = NULL;
+        chunk->size = pool->chunk_size;
+        if (pool->carve_chunk)
+            pool->carve_chunk->next = chunk;
+        else
+            pool->chunks = chunk;
+        pool->carve_chunk = chunk;
+        pool->size += chunk->size;
+    }
+
+    pool->carve = chunk_data(pool->carve_chunk);
+    pool->carve_end = pool->carve + pool->carve_chunk->size;
+    return 0;
+}
+
+//Returning a thread's cached blocks to the depot (pool lock held)
+static void cache_drain(memory_pool_t *pool, pool_thread_cache_t *cache, size_t keep)
+{
+    while (cache->count > keep)
+    {
+        pool_block_t *block = cache->blocks;
+        cache->blocks = block->next;
+        cache->count--;
+        block->next = pool->depot;
+        pool->depot = block;
+        pool->depot_count++;
+        pool->blocks_out--;
+    }
+}
+
+//Thread exit: hand the cache back to the depot
+static void cache_release(void *arg)
+{
+    pool_thread_cache_t *cache = arg;
+    memory_pool_t *pool = cache->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    cache_drain(pool, cache, 0);
+    STAT_ADD(pool->counters.allocations, cache->counters.allocations);
+    STAT_ADD(pool->counters.frees, cache->counters.frees);
+    STAT_ADD(pool->counters.requested_bytes, cache->counters.requested_bytes);
+    STAT_ADD(pool->counters.allocated_bytes, cache->counters.allocated_bytes);
+    if (cache->prev)
+        cache->prev->next = cache->next;
+    else
+        pool->caches = cache->next;
+    if (cache->next)
+        cache->next->prev = cache->prev;
+    pthread_mutex_unlock(&pool->lock);
+    free(cache);
+}
+
+static pool_thread_cache_t *thread_cache(memory_pool_t *pool)
+{
+    pool_thread_cache_t *cache = pthread_getspecific(pool->cache_key);
+    if (cache)
+        return cache;
+
+    cache = calloc(1, sizeof(pool_thread_cache_t));
+    if (!cache)
+        return NULL;
+    cache->pool = pool;
+
+    pthread_mutex_lock(&pool->lock);
+    cache->next = pool->caches;
+    if (pool->caches)
+        pool->caches->prev = cache;
+    pool->caches = cache;
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_setspecific(pool->cache_key, cache);
+    return cache;
+}
+
+//Memory Pool Creation: total_size is now the size of each chunk the pool grows by
 memory_pool_t* pool_create(size_t total_size, size_t block_size){
 
-    memory_pool_t *pool = malloc(sizeof(memory_pool_t));
+    if (block_size < sizeof(pool_block_t))
+        block_size = sizeof(pool_block_t);
+    block_size = round_up(block_size, sizeof(void *));
+    if (total_size < block_size)
+        total_size = block_size;
+
+    memory_pool_t *pool = calloc(1, sizeof(memory_pool_t));
     if (!pool) return NULL;
 
-    pool->memory = malloc(total_size);
-    if(!pool->memory)
+    pool->block_size = block_size;
+    pool->chunk_size = total_size - total_size % block_size;
+    if (pthread_key_create(&pool->cache_key, cache_release) != 0)
     {
-       free(pool);
-       return NULL; 
+        free(pool);
+        return NULL;
     }
+    pthread_mutex_init(&pool->lock, NULL);
 
-    pool->size = total_size;
-    pool->used = 0;
-    pool->block_size = block_size;
+    if (pool_grow(pool) < 0)
+    {
+        pool_destroy(pool);
+        return NULL;
+    }
 
-    printf("Created memory pool : %zu bytes, block size : %zu \n", total_size, block_size);
+    pthread_mutex_lock(&pools_lock);
+    pool->next_pool = pools;
+    pools = pool;
+    pthread_mutex_unlock(&pools_lock);
     return pool;
 }
 
+//Refilling a thread cache with up to POOL_BATCH blocks: freed ones first, then fresh ones
+static int cache_refill(memory_pool_t *pool, pool_thread_cache_t *cache)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (cache->count < POOL_BATCH)
+    {
+        pool_block_t *block = pool->depot;
+        if (block)
+        {
+            pool->depot = block->next;
+            pool->depot_count--;
+        }
+        else
+        {
+            if (pool->carve + pool->block_size > pool->carve_end && pool_grow(pool) < 0)
+                break;
+            block = (pool_block_t *)pool->carve;
+            pool->carve += pool->block_size;
+        }
+        block->next = cache->blocks;
+        cache->blocks = block;
+        cache->count++;
+        if (++pool->blocks_out > pool->blocks_out_high)
+            pool->blocks_out_high = pool->blocks_out;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return cache->count ? 0 : -1;
+}
+
 //Memory Pool Allocation
 void* pool_alloc(memory_pool_t *pool) {
-    if (pool->used + pool->block_size > pool->size)
+    return pool_alloc_sized(pool, pool->block_size);
+}
+
+//Allocating a block for `size` bytes (at most block_size); the size only
+//feeds the fragmentation figure
+void* pool_alloc_sized(memory_pool_t *pool, size_t size) {
+    pool_thread_cache_t *cache = size <= pool->block_size ? thread_cache(pool) : NULL;
+    if (!cache || (cache->count == 0 && cache_refill(pool, cache) < 0))
     {
-        printf("Memory pool is exhausted! \n");
+        STAT_ADD_SHARED(pool->failed, 1);
         return NULL;
     }
 
-    void *ptr = pool->memory + pool->used;
-    pool->used += pool->block_size;
-    return ptr;
+    pool_block_t *block = cache->blocks;
+    cache->blocks = block->next;
+    cache->count--;
+    STAT_ADD(cache->counters.allocations, 1);
+    STAT_ADD(cache->counters.requested_bytes, size);
+    STAT_ADD(cache->counters.allocated_bytes, pool->block_size);
+    return block;
+}
+
+//Returning a block; any thread may free a block any other thread allocated
+void pool_free(memory_pool_t *pool, void *ptr)
+{
+    if (!ptr)
+        return;
+    pool_thread_cache_t *cache = thread_cache(pool);
+    pool_block_t *block = ptr;
+
+    if (!cache)
+    {
+        pthread_mutex_lock(&pool->lock);
+        block->next = pool->depot;
+        pool->depot = block;
+        pool->depot_count++;
+        pool->blocks_out--;
+        STAT_ADD(pool->counters.frees, 1);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    STAT_ADD(cache->counters.frees, 1);
+    block->next = cache->blocks;
+    cache->blocks = block;
+    if (++cache->count > POOL_CACHE_LIMIT)
+    {
+        pthread_mutex_lock(&pool->lock);
+        cache_drain(pool, cache, POOL_CACHE_LIMIT - POOL_BATCH);
+        pthread_mutex_unlock(&pool->lock);
+    }
 }
 
-//Resetting the memory pool
+//Resetting the memory pool: every block becomes free again and the chunks
+//are kept for reuse. The blocks still allocated count as freed. No other
+//thread may be using the pool meanwhile.
 void pool_reset(memory_pool_t *pool)
 {
-    pool->used = 0;
-    printf("Pool reset - All memory are free now");
+    pthread_mutex_lock(&pool->lock);
+    alloc_counters_t counters = { 0 };
+    alloc_counters_add(&counters, &pool->counters);
+    for (pool_thread_cache_t *cache = pool->caches; cache; cache = cache->next)
+    {
+        cache->blocks = NULL;
+        cache->count = 0;
+        alloc_counters_add(&counters, &cache->counters);
+    }
+    STAT_ADD(pool->counters.frees, counters.allocations - counters.frees);
+    pool->depot = NULL;
+    pool->depot_count = 0;
+    pool->blocks_out = 0;
+    pool->carve_chunk = pool->chunks;
+    pool->carve = chunk_data(pool->chunks);
+    pool->carve_end = pool->carve + pool->chunks->size;
+    pthread_mutex_unlock(&pool->lock);
 }
 
-//Destroying the memory pool
+//Destroying the memory pool; threads that used it must be done with it
 void pool_destroy(memory_pool_t *pool)
 {
     if (pool)
     {
-        free(pool->memory);
+        pthread_mutex_lock(&pools_lock);
+        memory_pool_t **link = &pools;
+        while (*link && *link != pool)
+            link = &(*link)->next_pool;
+        if (*link)
+            *link = pool->next_pool;
+        pthread_mutex_unlock(&pools_lock);
+
+        pthread_setspecific(pool->cache_key, NULL);
+        pthread_key_delete(pool->cache_key);    // no cache_release may run after this
+        while (pool->caches)
+        {
+            pool_thread_cache_t *cache = pool->caches;
+            pool->caches = cache->next;
+            free(cache);
+        }
+        while (pool->chunks)
+        {
+            pool_chunk_t *chunk = pool->chunks;
+            pool->chunks = chunk->next;
+            free(chunk);
+        }
+        pthread_mutex_destroy(&pool->lock);
         free(pool);
     }
 }
 
+//The pool's counters with every live thread's added in
+void pool_stats(memory_pool_t *pool, alloc_stats_t *stats)
+{
+    alloc_counters_t counters = { 0 };
+    pthread_mutex_lock(&pool->lock);
+    alloc_counters_add(&counters, &pool->counters);
+    for (pool_thread_cache_t *cache = pool->caches; cache; cache = cache->next)
+        alloc_counters_add(&counters, &cache->counters);
+    size_t high = pool->blocks_out_high;
+    size_t reserved = pool->size;
+    pthread_mutex_unlock(&pool->lock);
+
+    alloc_stats_fill(stats, &counters, pool->block_size);
+    stats->failed = STAT_READ(pool->failed);
+    stats->high_water_bytes = high * pool->block_size;
+    stats->reserved_bytes = reserved;
+}
+
+void pool_stats_print(FILE *out, memory_pool_t *pool)
+{
+    char name[64];
+    alloc_stats_t stats;
+    snprintf(name, sizeof(name), "pool of %zu-byte blocks", pool->block_size);
+    pool_stats(pool, &stats);
+    alloc_stats_print(out, name, &stats);
+}
+
+void pool_stats_dump_all(FILE *out)
+{
+    pthread_mutex_lock(&pools_lock);
+    for (memory_pool_t *pool = pools; pool; pool = pool->next_pool)
+        pool_stats_print(out, pool);
+    pthread_mutex_unlock(&pools_lock);
+}
+
 // A DBMS usecase scenario
 void dbms_scenario()
 {
-    memory_pool_t *record_pool = pool_create(1024 * 1024, 256);  //1MB memory pool (4096 records)
+    memory_pool_t *record_pool = pool_create(1024 * 1024, 256);  //1MB chunks (4096 records each)
+    void *records[100];
 
     for (int iterator = 0; iterator < 100; iterator++)
     {
-        void *record = pool_alloc(record_pool);
+        records[iterator] = pool_alloc(record_pool);
 
-        if (record)
+        if (records[iterator])
         {
-            snprintf((char*)record, 256, "Record %d data", iterator);
+            snprintf((char*)records[iterator], 256, "Record %d data", iterator);
         }
     }
 
+    for (int iterator = 0; iterator < 50; iterator++)
+    {
+        pool_free(record_pool, records[iterator]);
+    }
+
+    pool_stats_print(stdout, record_pool);
     pool_reset(record_pool);
 
     pool_destroy(record_pool);
@@ -73,8 +339,8 @@ void dbms_scenario()
 
 
 
-// It pre-allocates a chunk of memory and manages smaller allocations within them
+// It pre-allocates chunks of memory and manages smaller allocations within them
 // Predictive (performance) behaviour - no overkill like malloc
 // Reduced possibilites of Fragmentation
-// Bulk operations - reset the entire memory chunk
-// Sequential allocations - Caching
+// Bulk operations - reset the entire pool at once
+// O(1) free through the intrusive free list, per-thread caches for concurrency
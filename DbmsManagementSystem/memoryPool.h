@@ -2,19 +2,68 @@
 #define MEMORYPOOL_H
 
 #include "main.h"
+#include "allocStats.h"
+
+// Fixed-size block pool. Memory comes in chunks of chunk_size bytes, new
+// chunks are added when the pool runs dry, and freed blocks go on an
+// intrusive free list (the link lives in the free block itself), so
+// pool_alloc and pool_free are O(1). Each thread keeps its own cache of free
+// blocks and trades them with the shared depot POOL_BATCH at a time, so the
+// pool lock is taken once per batch rather than once per block. Each thread
+// also counts its own allocations and frees (see allocStats.h), and
+// pool_stats adds them up.
+#define POOL_BATCH 32               // blocks moved between a thread cache and the depot
+#define POOL_CACHE_LIMIT (2 * POOL_BATCH)
+
+typedef struct pool_block {
+    struct pool_block *next;
+} pool_block_t;
+
+typedef struct pool_chunk {
+    struct pool_chunk *next;
+    size_t size;                    // usable bytes after the header
+} pool_chunk_t;
+
+typedef struct pool_thread_cache {
+    struct memory_pool *pool;
+    pool_block_t *blocks;
+    size_t count;
+    struct pool_thread_cache *prev; // registry of live caches, under the pool lock
+    struct pool_thread_cache *next;
+    alloc_counters_t counters;      // written by the owning thread only
+} pool_thread_cache_t;
 
 //Type/Struct Definition
 typedef struct memory_pool {
-    char* memory;   // Primary memory block
-    size_t size;    // Size of the pool
-    size_t used;    // Allocated storage (bytes)
-    size_t block_size;   // Size of each allocation
+    size_t size;        // Bytes reserved across all chunks
+    size_t block_size;  // Size of each allocation
+    size_t chunk_size;  // Bytes requested per chunk
+
+    pthread_mutex_t lock;           // protects everything below
+    pool_chunk_t *chunks;           // oldest first
+    pool_chunk_t *carve_chunk;      // chunk new blocks are cut from
+    char *carve;                    // next uncut byte in carve_chunk
+    char *carve_end;
+    pool_block_t *depot;            // shared free list
+    size_t depot_count;
+    pthread_key_t cache_key;
+    pool_thread_cache_t *caches;
+    size_t blocks_out;              // blocks outside the depot, thread caches included
+    size_t blocks_out_high;
+    alloc_counters_t counters;      // locked-path frees and exited threads, under the lock
+    uint64_t failed;
+    struct memory_pool *next_pool;  // every live pool, for the stats dump
 } memory_pool_t;
 
 memory_pool_t* pool_create(size_t total_size, size_t block_size);
 void* pool_alloc(memory_pool_t *pool) ;
+void* pool_alloc_sized(memory_pool_t *pool, size_t size);
+void pool_free(memory_pool_t *pool, void *block);
 void pool_reset(memory_pool_t *pool);
 void pool_destroy(memory_pool_t *pool);
+void pool_stats(memory_pool_t *pool, alloc_stats_t *stats);
+void pool_stats_print(FILE *out, memory_pool_t *pool);
+void pool_stats_dump_all(FILE *out);
 void dbms_scenario();
 
-#endif
\ No newline at end of file
+#endif
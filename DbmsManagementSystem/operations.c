@@ -1,32 +1,186 @@
-#include "memoryPool.h"
 #include "operations.h"
+#include <errno.h>
+#include <sys/stat.h>
 
-int totalStudents = 0;
-void addDetails(memory_pool_t *recordPool){
+void addDetails(student_table_t *table){
     char name[20];
     int age = 0;
     printf("Enter Name: ");
-    scanf(" %[^\n]", name);
+    scanf(" %19[^\n]", name);
 
     printf("Enter Age: ");
     scanf("%d", &age);
 
-    student_t *record = (student_t *)pool_alloc(recordPool);
-    if(record){
-        totalStudents++;
-        strncpy(record->name, name, sizeof(record->name) - 1);
-        record->name[sizeof(record->name) - 1] = '\0';
-        record->age = age;
+    if(student_insert(table, name, age) >= 0)
         printf("Details added successfully!\n");
-    }
     else
         printf("Error: memory allocation failed!\n");
 }
 
-void displayDetails(memory_pool_t *recordPool){
-    student_t *s = (student_t *)recordPool->memory;
-    for(int i = 0; i < totalStudents; i++){
-        student_t *s = (student_t *)(recordPool->memory + i * recordPool->block_size);
+void displayDetails(student_table_t *table){
+    for(uint32_t i = 0; i < table->rows; i++){
+        student_t *s = student_row(table, i);
+        printf("NAME: %s    AGE: %d\n", s->name, s->age);
+    }
+}
+
+void findByName(student_table_t *table){
+    char name[20];
+    uint32_t rows[16];
+    printf("Enter Name: ");
+    scanf(" %19[^\n]", name);
+
+    size_t found = student_find_name(table, name, rows, 16);
+    for(size_t i = 0; i < found && i < 16; i++){
+        student_t *s = student_row(table, rows[i]);
+        printf("NAME: %s    AGE: %d\n", s->name, s->age);
+    }
+    if(found > 16)
+        printf("... and %zu more\n", found - 16);
+    else if(found == 0)
+        printf("No student named %s\n", name);
+}
+
+void findByAge(student_table_t *table){
+    int low = 0, high = 0;
+    printf("Enter lowest age: ");
+    scanf("%d", &low);
+    printf("Enter highest age: ");
+    scanf("%d", &high);
+
+    student_cursor_t cursor;
+    uint32_t row;
+    size_t found = 0;
+    student_find_age(table, low, high, &cursor);
+    while(student_cursor_next(&cursor, &row)){
+        student_t *s = student_row(table, row);
         printf("NAME: %s    AGE: %d\n", s->name, s->age);
+        found++;
+    }
+    printf("%zu students aged %d to %d\n", found, low, high);
+}
+
+void loadFile(student_table_t *table){
+    char path[256];
+    int threads = 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpus > 1)
+        threads = cpus < BULK_LOAD_MAX_THREADS ? (int)cpus : BULK_LOAD_MAX_THREADS;
+    printf("Enter File (CSV name,age or binary): ");
+    scanf(" %255[^\n]", path);
+
+    bulk_load_stats_t stats;
+    int status = bulk_load(table, path, threads, &stats);
+    if(status == BULK_LOAD_FORMAT && stats.line)
+        printf("Error: line %zu is not name,age; nothing loaded\n", stats.line);
+    else if(status != BULK_LOAD_OK)
+        printf("Error: %s; nothing loaded\n", bulk_load_error(status));
+    else
+        printf("%zu students loaded in %.1f ms (%.0f rows/s)\n", stats.rows, stats.seconds * 1e3,
+               stats.rows_per_second);
+}
+
+void ageStatistics(student_table_t *table){
+    query_t query = { .bucket_width = 10, .bucket_count = 20, .threads = 1 };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpus > 1)
+        query.threads = cpus < QUERY_MAX_THREADS ? (int)cpus : QUERY_MAX_THREADS;
+    printf("Enter lowest age: ");
+    scanf("%d", &query.low);
+    printf("Enter highest age: ");
+    scanf("%d", &query.high);
+
+    query_column_t ages;
+    query_result_t result;
+    query_student_ages(table, &ages);
+    if(query_run(&ages, &query, &result) < 0){
+        printf("Error: memory allocation failed!\n");
+        return;
+    }
+    printf("COUNT: %llu    AVG(age): %.2f\n", (unsigned long long)result.count, result.average);
+    for(size_t b = 0; b < query.bucket_count; b++){
+        if(result.buckets[b])
+            printf("AGE %zu-%zu: %llu\n", b * 10, b * 10 + 9, (unsigned long long)result.buckets[b]);
+    }
+}
+
+// Every row into a new data file, written next to the old one and renamed
+// over it once synced, so a failed save leaves the old file as it was
+void saveDataFile(student_table_t *table){
+    char path[256], tmp_path[300];
+    printf("Enter Data File: ");
+    scanf(" %255[^\n]", path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    unlink(tmp_path);
+    heap_file_t *heap = heap_open(tmp_path, STORE_FRAMES);
+    if(!heap){
+        printf("Error: %s: %s\n", tmp_path, strerror(errno));
+        return;
+    }
+    int rc = 0;
+    record_id_t id;
+    for(uint32_t i = 0; i < table->rows && rc == 0; i++)
+        rc = heap_insert(heap, student_row(table, i), sizeof(student_t), &id);
+    int saved = errno;
+    if(heap_close(heap) < 0)
+        rc = -1;
+    else if(rc < 0)
+        errno = saved;
+    if(rc < 0 || rename(tmp_path, path) < 0){
+        printf("Error: %s: %s; nothing saved\n", path, strerror(errno));
+        unlink(tmp_path);
+        return;
+    }
+    printf("%u students saved to %s\n", table->rows, path);
+}
+
+// The students in a data file, added to the table's rows
+void openDataFile(student_table_t *table){
+    char path[256];
+    printf("Enter Data File: ");
+    scanf(" %255[^\n]", path);
+
+    // heap_open would create a missing file
+    struct stat st;
+    heap_file_t *heap = stat(path, &st) == 0 ? heap_open(path, STORE_FRAMES) : NULL;
+    if(!heap){
+        printf("Error: %s: %s\n", path, errno == EINVAL ? "not a data file" : strerror(errno));
+        return;
+    }
+    size_t rows = 0;
+    int more = 0;
+    if(heap->records > UINT32_MAX || student_bulk_reserve(table, (size_t)heap->records) < 0){
+        printf("Error: memory allocation failed!\n");
+        heap_close(heap);
+        return;
+    }
+
+    heap_cursor_t cursor;
+    const void *record;
+    size_t length;
+    record_id_t id;
+    heap_scan(heap, &cursor);
+    while(rows < heap->records && (more = heap_cursor_next(&cursor, &record, &length, &id)) > 0){
+        if(length != sizeof(student_t)){
+            more = -1;
+            errno = EINVAL;
+            break;
+        }
+        const student_t *s = record;
+        student_bulk_put(table, table->rows + (uint32_t)rows, s->name, strnlen(s->name, sizeof(s->name)), s->age);
+        rows++;
     }
-}
\ No newline at end of file
+    int saved = errno;
+    heap_cursor_close(&cursor);
+    heap_close(heap);
+    errno = saved;
+
+    // The reserved rows stay invisible unless committed
+    if(more < 0)
+        printf("Error: %s: %s; nothing loaded\n", path, errno == EINVAL ? "not a student data file" : strerror(errno));
+    else if(student_bulk_commit(table, rows, 1) < 0)
+        printf("Error: memory allocation failed!\n");
+    else
+        printf("%zu students loaded from %s\n", rows, path);
+}
@@ -1,16 +1,20 @@
 #ifndef OPERATIONS_H
 #define OPERATIONS_H
 
-#include "memoryPool.h"
+#include "studentTable.h"
+#include "query.h"
+#include "bulkLoad.h"
+#include "heapFile.h"
 
-extern int totalStudents;
+#define STORE_FRAMES 256           // buffer frames (1 MB) for saving and opening data files
 
-typedef struct student{
-    char name[20];
-    int age;
-}student_t;
+void addDetails(student_table_t *table);
+void displayDetails(student_table_t *table);
+void findByName(student_table_t *table);
+void findByAge(student_table_t *table);
+void loadFile(student_table_t *table);
+void ageStatistics(student_table_t *table);
+void saveDataFile(student_table_t *table);
+void openDataFile(student_table_t *table);
 
-void addDetails(memory_pool_t *recordPool);
-void displayDetails(memory_pool_t *recordPool);
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,307 @@
+#include "query.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define QUERY_HAVE_AVX2 1
+#endif
+
+#define BITMAP_WORDS (QUERY_BLOCK_ROWS / 64)
+#define VALUE_COUNTS 4096           // buckets spanning fewer values are counted per value
+
+typedef struct query_worker
+{
+    pthread_t thread;
+    const query_column_t *column;
+    const query_t *query;
+    size_t *next_chunk;
+    bool simd;
+    uint64_t count;
+    int64_t sum;
+    uint64_t buckets[QUERY_MAX_BUCKETS];
+    uint64_t value_counts[VALUE_COUNTS];
+} query_worker_t;
+
+// The student ages as they stand; valid until the next insert
+void query_student_ages(const student_table_t *table, query_column_t *column)
+{
+    column->chunks = table->age_column;
+    column->rows = table->rows;
+    column->owned = false;
+}
+
+// A column of `rows` values of its own, to be filled in
+int query_column_create(query_column_t *column, size_t rows)
+{
+    size_t chunk_count = (rows + QUERY_CHUNK_ROWS - 1) / QUERY_CHUNK_ROWS;
+    column->chunks = calloc(chunk_count ? chunk_count : 1, sizeof(int32_t *));
+    column->rows = rows;
+    column->owned = true;
+    if (!column->chunks)
+        return -1;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        column->chunks[i] = malloc(QUERY_CHUNK_ROWS * sizeof(int32_t));
+        if (!column->chunks[i])
+        {
+            query_column_release(column);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// A columnar copy of the tuples' ids
+int query_tuple_ids(query_column_t *column, db_tuple_t *const *tuples, size_t count)
+{
+    if (query_column_create(column, count) < 0)
+        return -1;
+    for (size_t i = 0; i < count; i++)
+        column->chunks[i / QUERY_CHUNK_ROWS][i % QUERY_CHUNK_ROWS] = tuples[i]->id;
+    return 0;
+}
+
+void query_column_release(query_column_t *column)
+{
+    if (column->owned && column->chunks)
+    {
+        for (size_t i = 0; i * QUERY_CHUNK_ROWS < column->rows; i++)
+            free(column->chunks[i]);
+        free(column->chunks);
+    }
+    memset(column, 0, sizeof(query_column_t));
+}
+
+// low <= v <= high as one unsigned compare: v - low wraps to a large value
+// when v < low
+static void filter_scalar(const int32_t *values, size_t n, int32_t low, int32_t high, uint64_t *bitmap)
+{
+    uint32_t range = (uint32_t)high - (uint32_t)low;
+    for (size_t start = 0; start < n; start += 64)
+    {
+        uint64_t word = 0;
+        size_t end = n - start < 64 ? n - start : 64;
+        for (size_t i = 0; i < end; i++)
+            word |= (uint64_t)((uint32_t)values[start + i] - (uint32_t)low <= range) << i;
+        bitmap[start / 64] = word;
+    }
+}
+
+static void aggregate_scalar(const int32_t *values, size_t n, const uint64_t *bitmap, query_worker_t *worker)
+{
+    for (size_t start = 0; start < n; start += 64)
+    {
+        uint64_t word = bitmap[start / 64];
+        worker->count += (uint64_t)__builtin_popcountll(word);
+        while (word)
+        {
+            worker->sum += values[start + (size_t)__builtin_ctzll(word)];
+            word &= word - 1;
+        }
+    }
+}
+
+#ifdef QUERY_HAVE_AVX2
+// Eight compares per instruction: subtract low, then v - low <= range is
+// min_epu32(v - low, range) == v - low
+__attribute__((target("avx2")))
+static void filter_avx2(const int32_t *values, size_t n, int32_t low, int32_t high, uint64_t *bitmap)
+{
+    const __m256i base = _mm256_set1_epi32(low);
+    const __m256i range = _mm256_set1_epi32((int32_t)((uint32_t)high - (uint32_t)low));
+    size_t words = n / 64;
+
+    for (size_t w = 0; w < words; w++)
+    {
+        uint64_t word = 0;
+        for (int j = 0; j < 8; j++)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(values + w * 64 + j * 8));
+            v = _mm256_sub_epi32(v, base);
+            __m256i in = _mm256_cmpeq_epi32(_mm256_min_epu32(v, range), v);
+            word |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(in)) << (j * 8);
+        }
+        bitmap[w] = word;
+    }
+    if (n > words * 64)
+        filter_scalar(values + words * 64, n - words * 64, low, high, bitmap + words);
+}
+
+// Each byte of the bitmap spread back over eight lanes masks the values it
+// selected; the sum is kept in 64-bit lanes so it cannot overflow
+__attribute__((target("avx2,popcnt")))
+static void aggregate_avx2(const int32_t *values, size_t n, const uint64_t *bitmap, query_worker_t *worker)
+{
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i sum_low = _mm256_setzero_si256(), sum_high = _mm256_setzero_si256();
+    size_t groups = n / 8;
+
+    for (size_t g = 0; g < groups; g++)
+    {
+        uint32_t bits = (uint32_t)(bitmap[g / 8] >> (g % 8 * 8)) & 0xff;
+        if (!bits)
+            continue;
+        __m256i v = _mm256_loadu_si256((const __m256i *)(values + g * 8));
+        __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)bits), lane_bits), lane_bits);
+        v = _mm256_and_si256(v, mask);
+        sum_low = _mm256_add_epi64(sum_low, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+        sum_high = _mm256_add_epi64(sum_high, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+        worker->count += (uint64_t)__builtin_popcount(bits);
+    }
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(sum_low, sum_high));
+    worker->sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    for (size_t i = groups * 8; i < n; i++)
+    {
+        if (bitmap[i / 64] >> (i % 64) & 1)
+        {
+            worker->count++;
+            worker->sum += values[i];
+        }
+    }
+}
+#endif
+
+// GROUP BY over the selected rows. When the buckets cover few enough
+// values each row only bumps a count for its value, and the counts are
+// folded into buckets at the end (group_finish) - no division per row.
+static void group(const int32_t *values, size_t n, const uint64_t *bitmap, const query_t *query,
+                  query_worker_t *worker)
+{
+    uint64_t span = (uint64_t)query->bucket_width * query->bucket_count;
+    uint32_t width = (uint32_t)query->bucket_width;
+    uint32_t base = (uint32_t)query->bucket_base;
+
+    for (size_t start = 0; start < n; start += 64)
+    {
+        uint64_t word = bitmap[start / 64];
+        if (span <= VALUE_COUNTS && word == UINT64_MAX)
+        {
+            for (size_t i = start; i < start + 64; i++)
+            {
+                uint32_t offset = (uint32_t)values[i] - base;
+                if (offset < span)
+                    worker->value_counts[offset]++;
+            }
+            continue;
+        }
+        while (word)
+        {
+            uint32_t offset = (uint32_t)values[start + (size_t)__builtin_ctzll(word)] - base;
+            word &= word - 1;
+            if (offset >= span)
+                continue;
+            if (span <= VALUE_COUNTS)
+                worker->value_counts[offset]++;
+            else
+                worker->buckets[offset / width]++;
+        }
+    }
+}
+
+static void group_finish(const query_t *query, query_worker_t *worker)
+{
+    uint64_t span = (uint64_t)query->bucket_width * query->bucket_count;
+    if (span > VALUE_COUNTS)
+        return;
+    for (uint32_t offset = 0; offset < span; offset++)
+        worker->buckets[offset / (uint32_t)query->bucket_width] += worker->value_counts[offset];
+}
+
+static void *worker_main(void *arg)
+{
+    query_worker_t *worker = arg;
+    const query_column_t *column = worker->column;
+    const query_t *query = worker->query;
+    size_t chunk_count = (column->rows + QUERY_CHUNK_ROWS - 1) / QUERY_CHUNK_ROWS;
+    uint64_t bitmap[BITMAP_WORDS];
+
+    for (;;)
+    {
+        size_t chunk = __atomic_fetch_add(worker->next_chunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= chunk_count)
+            break;
+        const int32_t *values = column->chunks[chunk];
+        size_t rows = column->rows - chunk * QUERY_CHUNK_ROWS;
+        if (rows > QUERY_CHUNK_ROWS)
+            rows = QUERY_CHUNK_ROWS;
+
+        for (size_t start = 0; start < rows; start += QUERY_BLOCK_ROWS)
+        {
+            size_t n = rows - start < QUERY_BLOCK_ROWS ? rows - start : QUERY_BLOCK_ROWS;
+#ifdef QUERY_HAVE_AVX2
+            if (worker->simd)
+            {
+                filter_avx2(values + start, n, query->low, query->high, bitmap);
+                aggregate_avx2(values + start, n, bitmap, worker);
+            }
+            else
+#endif
+            {
+                filter_scalar(values + start, n, query->low, query->high, bitmap);
+                aggregate_scalar(values + start, n, bitmap, worker);
+            }
+            if (query->bucket_width)
+                group(values + start, n, bitmap, query, worker);
+        }
+    }
+    if (query->bucket_width)
+        group_finish(query, worker);
+    return NULL;
+}
+
+static bool use_avx2()
+{
+#ifdef QUERY_HAVE_AVX2
+    static int supported = -1;
+    if (supported < 0)
+        supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+// Running `query` over `column` on query->threads threads, the caller's
+// included. Returns -1 for a malformed query or when no memory is left.
+int query_run(const query_column_t *column, const query_t *query, query_result_t *result)
+{
+    memset(result, 0, sizeof(query_result_t));
+    if (query->threads < 1 || query->threads > QUERY_MAX_THREADS || query->bucket_width < 0 ||
+        query->bucket_count > QUERY_MAX_BUCKETS || (query->bucket_width && !query->bucket_count))
+        return -1;
+    if (query->low > query->high)
+        return 0;
+
+    query_worker_t *workers = calloc(query->threads, sizeof(query_worker_t));
+    if (!workers)
+        return -1;
+    size_t next_chunk = 0;
+    bool simd = !query->scalar && use_avx2();
+    int started = 1;
+    for (int i = 0; i < query->threads; i++)
+    {
+        workers[i].column = column;
+        workers[i].query = query;
+        workers[i].next_chunk = &next_chunk;
+        workers[i].simd = simd;
+    }
+    // Too few threads only makes the query slower, so a failed create is not an error
+    while (started < query->threads && pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) == 0)
+        started++;
+    worker_main(&workers[0]);
+
+    for (int i = 0; i < started; i++)
+    {
+        if (i > 0)
+            pthread_join(workers[i].thread, NULL);
+        result->count += workers[i].count;
+        result->sum += workers[i].sum;
+        for (size_t b = 0; b < query->bucket_count && query->bucket_width; b++)
+            result->buckets[b] += workers[i].buckets[b];
+    }
+    result->average = result->count ? (double)result->sum / result->count : 0;
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "studentTable.h"
+
+// Analytical queries over one int32 column:
+//
+//   SELECT COUNT(*), AVG(value) [, value / bucket_width]
+//   WHERE value BETWEEN low AND high [GROUP BY value / bucket_width]
+//
+// A column is a list of chunks of QUERY_CHUNK_ROWS values - the student
+// table's age column as it stands, or a copy of the tuples' ids. Threads
+// take chunks one at a time, so a slow thread does not hold the others up,
+// and each keeps its own totals until the end. Within a chunk the work goes
+// QUERY_BLOCK_ROWS rows at a time: the predicate is evaluated with AVX2,
+// eight values per compare, into a selection bitmap, and the aggregates are
+// taken from the values the bitmap selects while the block is still in L1.
+#define QUERY_CHUNK_ROWS STUDENT_SEGMENT_ROWS
+#define QUERY_BLOCK_ROWS 2048
+#define QUERY_MAX_THREADS 64
+#define QUERY_MAX_BUCKETS 1024
+
+typedef struct query_column
+{
+    int32_t **chunks;           // the last one may be partly used
+    size_t rows;
+    bool owned;                 // the chunks are the column's own copy
+} query_column_t;
+
+typedef struct query
+{
+    int32_t low;
+    int32_t high;
+    int32_t bucket_width;       // 0: no GROUP BY
+    int32_t bucket_base;        // lower edge of the first bucket
+    size_t bucket_count;        // rows outside the buckets are in no bucket
+    int threads;
+    bool scalar;                // no SIMD, for comparison
+} query_t;
+
+typedef struct query_result
+{
+    uint64_t count;
+    int64_t sum;
+    double average;
+    uint64_t buckets[QUERY_MAX_BUCKETS];
+} query_result_t;
+
+void query_student_ages(const student_table_t *table, query_column_t *column);
+int query_column_create(query_column_t *column, size_t rows);
+int query_tuple_ids(query_column_t *column, db_tuple_t *const *tuples, size_t count);
+void query_column_release(query_column_t *column);
+int query_run(const query_column_t *column, const query_t *query, query_result_t *result);
+
+#endif
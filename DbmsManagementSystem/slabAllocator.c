@@ -1,33 +1,446 @@
 #include "slabAllocator.h"
 
-// Creating a new slab
-slab_t *slab_create(size_t object_size)
+#define SLAB_TLS __attribute__((tls_model("initial-exec")))
+
+// A thread's view of one cache: valid while generation matches the cache's
+typedef struct slab_thread_slot
 {
-    slab_t *slab = malloc(sizeof(slab_t));
+    slab_thread_cache_t *thread_cache;
+    uint64_t generation;
+} slab_thread_slot_t;
 
-    if (!slab)
+static __thread slab_thread_slot_t thread_slots[SLAB_MAX_CACHES] SLAB_TLS;
+static __thread bool thread_registered SLAB_TLS;
+static __thread bool thread_exiting SLAB_TLS;
+
+// Caches with magazines by id, under registry_lock
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static slab_cache_t *registry[SLAB_MAX_CACHES];
+static uint64_t registry_generation;
+
+// Thread caches and magazines come from slab caches of their own (without
+// magazines), never from malloc
+static pthread_once_t internal_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_exit_key;
+static slab_cache_t thread_cache_cache;
+static slab_cache_t magazine_cache;
+
+// Shrinker
+static uint64_t shrink_passes;
+static uint64_t retired_reclaimed;  // reclaimed by caches since destroyed, under registry_lock
+static pthread_mutex_t shrinker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shrinker_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t shrinker_thread;
+static bool shrinker_running;
+static bool shrinker_stopping;
+static unsigned int shrinker_interval_ms;
+
+static slab_t *slab_of(const void *obj)
+{
+    slab_arena_t *arena = (slab_arena_t *)((uintptr_t)obj & ~(uintptr_t)(SLAB_ARENA_SIZE - 1));
+    return &arena->slabs[((uintptr_t)obj & (SLAB_ARENA_SIZE - 1)) >> arena->slab_shift];
+}
+
+// The cache an object came from; NULL if it did not come from a slab
+slab_cache_t *slab_cache_of(const void *obj)
+{
+    slab_arena_t *arena = (slab_arena_t *)((uintptr_t)obj & ~(uintptr_t)(SLAB_ARENA_SIZE - 1));
+    return arena->kind == SLAB_ARENA_SLABS ? slab_of(obj)->cache : NULL;
+}
+
+static slab_arena_t *arena_of(const slab_t *slab)
+{
+    return (slab_arena_t *)((uintptr_t)slab & ~(uintptr_t)(SLAB_ARENA_SIZE - 1));
+}
+
+static void list_push(slab_t **list, slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list)
+        (*list)->prev = slab;
+    *list = slab;
+}
+
+static void list_remove(slab_t **list, slab_t *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        *list = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+}
+
+// Mapping a new arena aligned to its size: map twice the size and unmap
+// the misaligned ends
+static slab_arena_t *arena_create(slab_cache_t *cache)
+{
+    char *mapping = mmap(NULL, 2 * SLAB_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
         return NULL;
 
-    slab->memory = aligned_alloc(4096, SLAB_SIZE); // Align the objects in a page
+    char *aligned = (char *)(((uintptr_t)mapping + SLAB_ARENA_SIZE - 1) & ~(uintptr_t)(SLAB_ARENA_SIZE - 1));
+    if (aligned > mapping)
+        munmap(mapping, aligned - mapping);
+    munmap(aligned + SLAB_ARENA_SIZE, mapping + SLAB_ARENA_SIZE - aligned);
 
-    slab->object_size = object_size;
-    slab->objects_per_slab = SLAB_SIZE / object_size;
-    slab->free_objects = slab->objects_per_slab;
-    slab->next = NULL;
+    // The header - descriptors for every slab - takes the first slab or slabs
+    slab_arena_t *arena = (slab_arena_t *)aligned;
+    size_t capacity = SLAB_ARENA_SIZE / cache->slab_size;
+    size_t header = sizeof(slab_arena_t) + capacity * sizeof(slab_t);
+    arena->kind = SLAB_ARENA_SLABS;
+    arena->slab_shift = cache->slab_shift;
+    arena->capacity = capacity;
+    arena->first = (header + cache->slab_size - 1) / cache->slab_size;
+    arena->carved = arena->first;
+    arena->live = 0;
+    arena->next = cache->arenas;
+    cache->arenas = arena;
+    return arena;
+}
+
+// Creating a new slab, in the place of a released one if there is one.
+// Objects are handed out from `unused` until it runs out rather than
+// threaded onto the free list up front, so a new slab costs no writes to
+// its object memory.
+static slab_t *slab_create(slab_cache_t *cache)
+{
+    slab_t *slab = cache->released;
+    if (slab)
+    {
+        list_remove(&cache->released, slab);
+        cache->released_count--;
+    }
+    else
+    {
+        slab_arena_t *arena = cache->arenas;
+        if (!arena || arena->carved == arena->capacity)
+        {
+            arena = arena_create(cache);
+            if (!arena)
+                return NULL;
+        }
+        slab = &arena->slabs[arena->carved];
+        slab->memory = (char *)arena + arena->carved * cache->slab_size;
+        arena->carved++;
+    }
 
+    slab->cache = cache;
     slab->free_list = NULL;
-    char *obj_ptr = (char *)slab->memory;
+    slab->unused = slab->memory;
+    slab->objects_per_slab = (uint32_t)cache->objects_per_slab;
+    slab->free_objects = slab->objects_per_slab;
+    slab->released = false;
+    arena_of(slab)->live++;
+    cache->slab_count++;
+    return slab;
+}
 
-    for (size_t iterator = 0; iterator < slab->objects_per_slab; iterator++)
+// Unmapping an arena none of whose slabs hold memory (cache lock held)
+static void arena_release(slab_cache_t *cache, slab_arena_t *arena)
+{
+    for (size_t i = arena->first; i < arena->carved; i++)
     {
-        object_header_t *header = (object_header_t *)obj_ptr;
-        header->next_free = slab->free_list;
-        slab->free_list = header;
-        obj_ptr += object_size;
+        list_remove(&cache->released, &arena->slabs[i]);
+        cache->released_count--;
     }
+    slab_arena_t **link = &cache->arenas;
+    while (*link != arena)
+        link = &(*link)->next;
+    *link = arena->next;
 
-    printf("Created a slab with %zu objects of size %zu \n", slab->objects_per_slab, object_size);
-    return slab;
+    cache->reclaimed_bytes += arena->first * cache->slab_size;    // the header
+    munmap(arena, SLAB_ARENA_SIZE);
+}
+
+// Giving an empty slab's pages back to the kernel (cache lock held). The
+// arena still being carved is never unmapped.
+static void slab_release(slab_cache_t *cache, slab_t *slab)
+{
+    list_remove(&cache->empty, slab);
+    cache->empty_count--;
+    madvise(slab->memory, cache->slab_size, MADV_DONTNEED);
+    slab->released = true;
+    list_push(&cache->released, slab);
+    cache->released_count++;
+    cache->slab_count--;
+    cache->reclaimed_bytes += cache->slab_size;
+
+    slab_arena_t *arena = arena_of(slab);
+    if (--arena->live == 0 && arena != cache->arenas)
+        arena_release(cache, arena);
+}
+
+// Allocating an object from the slab layer (cache lock held): a partial
+// slab first, then an empty one, then a new one
+static void *slab_layer_alloc(slab_cache_t *cache)
+{
+    slab_t *slab = cache->partial;
+
+    if (!slab)
+    {
+        slab = cache->empty;
+        if (slab)
+        {
+            list_remove(&cache->empty, slab);
+            if (--cache->empty_count < cache->empty_low)
+                cache->empty_low = cache->empty_count;
+        }
+        else
+        {
+            slab = slab_create(cache);
+            if (!slab)
+                return NULL;
+        }
+        list_push(&cache->partial, slab);
+    }
+
+    object_header_t *obj = slab->free_list;
+    if (obj)
+    {
+        slab->free_list = obj->next_free;
+    }
+    else
+    {
+        obj = (object_header_t *)slab->unused;
+        slab->unused += cache->object_size;
+    }
+
+    if (--slab->free_objects == 0)
+    {
+        list_remove(&cache->partial, slab);
+        list_push(&cache->full, slab);
+    }
+    if (++cache->objects_out > cache->objects_out_high)
+        cache->objects_out_high = cache->objects_out;
+    return obj;
+}
+
+// Returning an object to its slab (cache lock held)
+static void slab_layer_free(slab_cache_t *cache, void *obj)
+{
+    slab_t *slab = slab_of(obj);
+    object_header_t *header = (object_header_t *)obj;
+    header->next_free = slab->free_list;
+    slab->free_list = header;
+    cache->objects_out--;
+
+    if (slab->free_objects++ == 0)
+    {
+        list_remove(&cache->full, slab);
+        list_push(&cache->partial, slab);
+    }
+    if (slab->free_objects == slab->objects_per_slab)
+    {
+        list_remove(&cache->partial, slab);
+        list_push(&cache->empty, slab);
+        cache->empty_count++;
+    }
+}
+
+// Emptying a magazine back into the slab layer
+static void magazine_drain(slab_cache_t *cache, slab_magazine_t *magazine)
+{
+    if (magazine->rounds == 0)
+        return;
+    pthread_mutex_lock(&cache->lock);
+    while (magazine->rounds > 0)
+        slab_layer_free(cache, magazine->objects[--magazine->rounds]);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static slab_magazine_t *magazine_alloc()
+{
+    slab_magazine_t *magazine = slab_cache_alloc(&magazine_cache);
+    if (magazine)
+        magazine->rounds = 0;
+    return magazine;
+}
+
+// A thread is done with a cache: its objects go back to the slabs
+// (registry_lock held)
+static void thread_cache_release(slab_thread_cache_t *thread_cache)
+{
+    slab_cache_t *cache = thread_cache->cache;
+
+    magazine_drain(cache, thread_cache->loaded);
+    magazine_drain(cache, thread_cache->previous);
+
+    pthread_mutex_lock(&cache->depot_lock);
+    thread_cache->loaded->next = thread_cache->previous;
+    thread_cache->previous->next = cache->depot_empty;
+    cache->depot_empty = thread_cache->loaded;
+    cache->depot_empty_count += 2;
+    STAT_ADD_SHARED(cache->counters.allocations, thread_cache->counters.allocations);
+    STAT_ADD_SHARED(cache->counters.frees, thread_cache->counters.frees);
+    STAT_ADD_SHARED(cache->counters.requested_bytes, thread_cache->counters.requested_bytes);
+    STAT_ADD_SHARED(cache->counters.allocated_bytes, thread_cache->counters.allocated_bytes);
+    if (thread_cache->prev)
+        thread_cache->prev->next = thread_cache->next;
+    else
+        cache->thread_caches = thread_cache->next;
+    if (thread_cache->next)
+        thread_cache->next->prev = thread_cache->prev;
+    pthread_mutex_unlock(&cache->depot_lock);
+    slab_cache_free(&thread_cache_cache, thread_cache);
+}
+
+// Thread exit: release the thread's caches of every cache still alive.
+// Frees made later in the exit (other destructors) skip the magazines.
+static void thread_exit(void *arg)
+{
+    (void)arg;
+    thread_exiting = true;
+    pthread_mutex_lock(&registry_lock);
+    for (int id = 0; id < SLAB_MAX_CACHES; id++)
+    {
+        slab_thread_slot_t *slot = &thread_slots[id];
+        if (slot->generation && registry[id] && registry[id]->generation == slot->generation)
+            thread_cache_release(slot->thread_cache);
+        slot->generation = 0;
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static int cache_setup(slab_cache_t *cache, const char *name, size_t object_size);
+
+// fork() while another thread holds a cache lock would leave the child with
+// a lock nobody releases, so every lock is taken around the fork
+static void fork_prepare()
+{
+    pthread_mutex_lock(&registry_lock);
+    for (int id = 0; id < SLAB_MAX_CACHES; id++)
+    {
+        if (registry[id])
+        {
+            pthread_mutex_lock(&registry[id]->depot_lock);
+            pthread_mutex_lock(&registry[id]->lock);
+        }
+    }
+    pthread_mutex_lock(&thread_cache_cache.lock);
+    pthread_mutex_lock(&magazine_cache.lock);
+}
+
+static void fork_release()
+{
+    pthread_mutex_unlock(&magazine_cache.lock);
+    pthread_mutex_unlock(&thread_cache_cache.lock);
+    for (int id = SLAB_MAX_CACHES - 1; id >= 0; id--)
+    {
+        if (registry[id])
+        {
+            pthread_mutex_unlock(&registry[id]->lock);
+            pthread_mutex_unlock(&registry[id]->depot_lock);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static void internal_init()
+{
+    pthread_key_create(&thread_exit_key, thread_exit);
+    cache_setup(&thread_cache_cache, "slab_thread_caches", sizeof(slab_thread_cache_t));
+    cache_setup(&magazine_cache, "slab_magazines", sizeof(slab_magazine_t));
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+static slab_thread_cache_t *thread_cache_get(slab_cache_t *cache)
+{
+    slab_thread_slot_t *slot = &thread_slots[cache->id];
+    if (slot->generation == cache->generation)
+        return slot->thread_cache;
+    if (thread_exiting)
+        return NULL;
+
+    slab_thread_cache_t *thread_cache = slab_cache_alloc(&thread_cache_cache);
+    slab_magazine_t *loaded = magazine_alloc();
+    slab_magazine_t *previous = magazine_alloc();
+    if (!thread_cache || !loaded || !previous)
+    {
+        slab_cache_free(&thread_cache_cache, thread_cache);
+        slab_cache_free(&magazine_cache, loaded);
+        slab_cache_free(&magazine_cache, previous);
+        return NULL;
+    }
+    if (!thread_registered)
+    {
+        pthread_setspecific(thread_exit_key, (void *)1);
+        thread_registered = true;
+    }
+    thread_cache->cache = cache;
+    thread_cache->loaded = loaded;
+    thread_cache->previous = previous;
+    thread_cache->prev = NULL;
+    memset(&thread_cache->counters, 0, sizeof(alloc_counters_t));
+
+    pthread_mutex_lock(&cache->depot_lock);
+    thread_cache->next = cache->thread_caches;
+    if (cache->thread_caches)
+        cache->thread_caches->prev = thread_cache;
+    cache->thread_caches = thread_cache;
+    pthread_mutex_unlock(&cache->depot_lock);
+
+    slot->thread_cache = thread_cache;
+    slot->generation = cache->generation;
+    return thread_cache;
+}
+
+// Sizing the cache's slabs: the smallest power of two from SLAB_SIZE that
+// holds MINIMUM_OBJECTS_PER_SLAB objects (or as many as SLAB_MAX_SIZE
+// allows) and wastes at most an eighth of itself
+static int cache_setup(slab_cache_t *cache, const char *name, size_t object_size)
+{
+    size_t requested_size = object_size;
+    if (object_size < sizeof(object_header_t))
+        object_size = sizeof(object_header_t);
+    object_size = (object_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (object_size > SLAB_MAX_SIZE)
+        return -1;
+
+    size_t wanted = SLAB_MAX_SIZE / object_size < MINIMUM_OBJECTS_PER_SLAB ? SLAB_MAX_SIZE / object_size
+                                                                           : MINIMUM_OBJECTS_PER_SLAB;
+    uint32_t shift = 12;
+    while ((1u << shift) < SLAB_MAX_SIZE &&
+           ((1u << shift) / object_size < wanted || (1u << shift) % object_size > (1u << shift) / 8))
+        shift++;
+
+    memset(cache, 0, sizeof(slab_cache_t));
+    pthread_mutex_init(&cache->depot_lock, NULL);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->id = -1;
+    cache->empty_reserve = SLAB_EMPTY_RESERVE;
+    cache->requested_size = requested_size;
+    cache->object_size = object_size;
+    cache->slab_shift = shift;
+    cache->slab_size = (size_t)1 << shift;
+    cache->objects_per_slab = cache->slab_size / object_size;
+    strncpy(cache->name, name, sizeof(cache->name) - 1);
+    return 0;
+}
+
+// Setting up a cache in caller-provided storage; needs no malloc
+int slab_cache_init(slab_cache_t *cache, const char *name, size_t object_size)
+{
+    pthread_once(&internal_once, internal_init);
+    if (cache_setup(cache, name, object_size) < 0)
+        return -1;
+
+    // Without a free slot the cache still works, through the locked path
+    pthread_mutex_lock(&registry_lock);
+    for (int id = 0; id < SLAB_MAX_CACHES; id++)
+    {
+        if (!registry[id])
+        {
+            registry[id] = cache;
+            cache->id = id;
+            cache->generation = ++registry_generation;
+            cache->magazines = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return 0;
 }
 
 // Creating a slab cache
@@ -36,72 +449,502 @@ slab_cache_t *slab_cache_create(const char *name, size_t object_size)
     slab_cache_t *cache = malloc(sizeof(slab_cache_t));
     if (!cache)
         return NULL;
+    if (slab_cache_init(cache, name, object_size) < 0)
+    {
+        free(cache);
+        return NULL;
+    }
+    cache->allocated = true;
+    return cache;
+}
 
-    cache->slabs = NULL;
-    cache->object_size = object_size;
-    strncpy(cache->name, name, sizeof(cache->name) - 1);
+// Both magazines are empty: swap the empty previous one for a full one from
+// the depot, or failing that fill the loaded one straight from the slabs
+static int magazine_reload(slab_cache_t *cache, slab_thread_cache_t *thread_cache)
+{
+    pthread_mutex_lock(&cache->depot_lock);
+    slab_magazine_t *full = cache->depot_full;
+    if (full)
+    {
+        cache->depot_full = full->next;
+        if (--cache->depot_full_count < cache->depot_full_low)
+            cache->depot_full_low = cache->depot_full_count;
+        thread_cache->previous->next = cache->depot_empty;
+        cache->depot_empty = thread_cache->previous;
+        cache->depot_empty_count++;
+        thread_cache->previous = thread_cache->loaded;
+        thread_cache->loaded = full;
+    }
+    pthread_mutex_unlock(&cache->depot_lock);
+    if (full)
+        return 0;
 
-    printf("Created slab cache '%s' for the %zu bytes of objects \n", name, object_size);
-    return cache;
+    slab_magazine_t *loaded = thread_cache->loaded;
+    pthread_mutex_lock(&cache->lock);
+    while (loaded->rounds < SLAB_MAGAZINE_SIZE)
+    {
+        void *obj = slab_layer_alloc(cache);
+        if (!obj)
+            break;
+        loaded->objects[loaded->rounds++] = obj;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return loaded->rounds > 0 ? 0 : -1;
+}
+
+// Both magazines are full: hand the full previous one to the depot and take
+// an empty one in its place
+static int magazine_unload(slab_cache_t *cache, slab_thread_cache_t *thread_cache)
+{
+    pthread_mutex_lock(&cache->depot_lock);
+    slab_magazine_t *empty = cache->depot_empty;
+    if (empty)
+    {
+        cache->depot_empty = empty->next;
+        cache->depot_empty_count--;
+    }
+    else
+    {
+        pthread_mutex_unlock(&cache->depot_lock);
+        empty = magazine_alloc();
+        if (!empty)
+            return -1;
+        pthread_mutex_lock(&cache->depot_lock);
+    }
+    thread_cache->previous->next = cache->depot_full;
+    cache->depot_full = thread_cache->previous;
+    cache->depot_full_count++;
+    pthread_mutex_unlock(&cache->depot_lock);
+    thread_cache->previous = thread_cache->loaded;
+    thread_cache->loaded = empty;
+    return 0;
 }
 
 // Allocating object
-void *slab_alloc(slab_cache_t *cache)
+void *slab_cache_alloc(slab_cache_t *cache)
 {
-    slab_t *slab = cache->slabs;
+    return slab_cache_alloc_sized(cache, cache->requested_size);
+}
 
-    while (slab && slab->free_objects == 0)
+// Allocating an object for `size` bytes of it (no more than the object
+// size); the size only feeds the fragmentation figure
+void *slab_cache_alloc_sized(slab_cache_t *cache, size_t size)
+{
+    slab_thread_cache_t *thread_cache = cache->magazines ? thread_cache_get(cache) : NULL;
+    if (!thread_cache)
     {
-        slab = slab->next;
+        pthread_mutex_lock(&cache->lock);
+        void *obj = slab_layer_alloc(cache);
+        if (obj)
+        {
+            STAT_ADD(cache->locked.allocations, 1);
+            STAT_ADD(cache->locked.requested_bytes, size);
+            STAT_ADD(cache->locked.allocated_bytes, cache->object_size);
+        }
+        pthread_mutex_unlock(&cache->lock);
+        if (!obj)
+            STAT_ADD_SHARED(cache->failed, 1);
+        return obj;
     }
 
-    if (!slab)
+    slab_magazine_t *loaded = thread_cache->loaded;
+    if (loaded->rounds == 0)
     {
-        slab = slab_create(cache->object_size);
-        if (!slab)
+        if (thread_cache->previous->rounds > 0)
+        {
+            thread_cache->loaded = thread_cache->previous;
+            thread_cache->previous = loaded;
+        }
+        else if (magazine_reload(cache, thread_cache) < 0)
+        {
+            STAT_ADD_SHARED(cache->failed, 1);
             return NULL;
+        }
+        loaded = thread_cache->loaded;
+    }
+    STAT_ADD(thread_cache->counters.allocations, 1);
+    STAT_ADD(thread_cache->counters.requested_bytes, size);
+    STAT_ADD(thread_cache->counters.allocated_bytes, cache->object_size);
+    return loaded->objects[--loaded->rounds];
+}
+
+// Unallocating object (free); the object may come from any thread
+void slab_cache_free(slab_cache_t *cache, void *obj)
+{
+    if (!obj)
+        return;
+
+    slab_thread_cache_t *thread_cache = cache->magazines ? thread_cache_get(cache) : NULL;
+    if (thread_cache)
+    {
+        slab_magazine_t *loaded = thread_cache->loaded;
+        if (loaded->rounds == SLAB_MAGAZINE_SIZE)
+        {
+            if (thread_cache->previous->rounds == 0)
+            {
+                thread_cache->loaded = thread_cache->previous;
+                thread_cache->previous = loaded;
+            }
+            else if (magazine_unload(cache, thread_cache) < 0)
+            {
+                thread_cache = NULL;
+            }
+        }
+    }
+    if (!thread_cache)
+    {
+        pthread_mutex_lock(&cache->lock);
+        slab_layer_free(cache, obj);
+        STAT_ADD(cache->locked.frees, 1);
+        pthread_mutex_unlock(&cache->lock);
+        return;
+    }
+
+    slab_magazine_t *loaded = thread_cache->loaded;
+    loaded->objects[loaded->rounds++] = obj;
+    STAT_ADD(thread_cache->counters.frees, 1);
+}
 
-        slab->next = cache->slabs;
-        cache->slabs = slab;
+// Emptying up to `count` full magazines from the depot into the slabs; the
+// depot's empty magazines go back to the magazine cache as well
+static void depot_flush(slab_cache_t *cache, size_t count)
+{
+    pthread_mutex_lock(&cache->depot_lock);
+    slab_magazine_t *full = NULL;
+    while (count-- > 0 && cache->depot_full)
+    {
+        slab_magazine_t *magazine = cache->depot_full;
+        cache->depot_full = magazine->next;
+        cache->depot_full_count--;
+        magazine->next = full;
+        full = magazine;
     }
+    slab_magazine_t *empty = cache->depot_empty;
+    cache->depot_empty = NULL;
+    cache->depot_empty_count = 0;
+    cache->depot_full_low = cache->depot_full_count;
+    pthread_mutex_unlock(&cache->depot_lock);
 
-    object_header_t *obj = slab->free_list;
-    slab->free_list = obj->next_free;
-    slab->free_objects--;
+    while (full)
+    {
+        slab_magazine_t *next = full->next;
+        magazine_drain(cache, full);
+        slab_cache_free(&magazine_cache, full);
+        full = next;
+    }
+    while (empty)
+    {
+        slab_magazine_t *next = empty->next;
+        slab_cache_free(&magazine_cache, empty);
+        empty = next;
+    }
+}
 
-    return obj;
+// Releasing `count` empty slabs, but never the reserve (cache lock held)
+static void slabs_release(slab_cache_t *cache, size_t count)
+{
+    while (count-- > 0 && cache->empty_count > cache->empty_reserve)
+        slab_release(cache, cache->empty);
+    cache->empty_low = cache->empty_count;
+}
+
+// Idle memory only: the full magazines and empty slabs the cache has not
+// dipped into since the last reap
+static size_t cache_reap(slab_cache_t *cache)
+{
+    pthread_mutex_lock(&cache->depot_lock);
+    size_t idle_magazines = cache->depot_full_low;
+    pthread_mutex_unlock(&cache->depot_lock);
+    depot_flush(cache, idle_magazines);
+
+    pthread_mutex_lock(&cache->lock);
+    uint64_t before = cache->reclaimed_bytes;
+    slabs_release(cache, cache->empty_low);
+    size_t reclaimed = (size_t)(cache->reclaimed_bytes - before);
+    pthread_mutex_unlock(&cache->lock);
+    return reclaimed;
+}
+
+// Everything: the caller's magazines, the whole depot and every empty slab
+// beyond the reserve. Returns the bytes given back to the kernel.
+size_t slab_cache_shrink(slab_cache_t *cache)
+{
+    if (cache->magazines)
+    {
+        slab_thread_slot_t *slot = &thread_slots[cache->id];
+        if (slot->generation == cache->generation)
+        {
+            magazine_drain(cache, slot->thread_cache->loaded);
+            magazine_drain(cache, slot->thread_cache->previous);
+        }
+        depot_flush(cache, SIZE_MAX);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    uint64_t before = cache->reclaimed_bytes;
+    slabs_release(cache, SIZE_MAX);
+    size_t reclaimed = (size_t)(cache->reclaimed_bytes - before);
+    pthread_mutex_unlock(&cache->lock);
+    __atomic_fetch_add(&shrink_passes, 1, __ATOMIC_RELAXED);
+    return reclaimed;
+}
+
+// One pass of the shrinker over every cache. Returns the bytes given back.
+size_t slab_reap()
+{
+    size_t reclaimed = 0;
+    pthread_mutex_lock(&registry_lock);
+    for (int id = 0; id < SLAB_MAX_CACHES; id++)
+    {
+        if (registry[id])
+            reclaimed += cache_reap(registry[id]);
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    // Magazines freed above land in the magazine cache, so it goes last
+    if (thread_cache_cache.object_size)
+    {
+        reclaimed += cache_reap(&thread_cache_cache);
+        reclaimed += cache_reap(&magazine_cache);
+    }
+    __atomic_fetch_add(&shrink_passes, 1, __ATOMIC_RELAXED);
+    return reclaimed;
 }
 
-// Unallocating object (free)
-void slab_free(slab_cache_t *cache, void *obj)
+static void *shrinker_main(void *arg)
 {
-    slab_t *slab = cache->slabs;
-    while (slab)
+    (void)arg;
+    pthread_mutex_lock(&shrinker_lock);
+    while (!shrinker_stopping)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += shrinker_interval_ms / 1000;
+        deadline.tv_nsec += (long)(shrinker_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if (pthread_cond_timedwait(&shrinker_wake, &shrinker_lock, &deadline) != 0 && !shrinker_stopping)
+        {
+            pthread_mutex_unlock(&shrinker_lock);
+            slab_reap();
+            pthread_mutex_lock(&shrinker_lock);
+        }
+    }
+    pthread_mutex_unlock(&shrinker_lock);
+    return NULL;
+}
+
+// Background shrinker: slab_reap every interval_ms until slab_shrinker_stop
+int slab_shrinker_start(unsigned int interval_ms)
+{
+    pthread_mutex_lock(&shrinker_lock);
+    if (shrinker_running || interval_ms == 0)
+    {
+        pthread_mutex_unlock(&shrinker_lock);
+        return -1;
+    }
+    shrinker_interval_ms = interval_ms;
+    shrinker_stopping = false;
+    bool started = pthread_create(&shrinker_thread, NULL, shrinker_main, NULL) == 0;
+    shrinker_running = started;
+    pthread_mutex_unlock(&shrinker_lock);
+    return started ? 0 : -1;
+}
+
+void slab_shrinker_stop()
+{
+    pthread_mutex_lock(&shrinker_lock);
+    if (!shrinker_running || shrinker_stopping)     // not started, or another caller is joining it
+    {
+        pthread_mutex_unlock(&shrinker_lock);
+        return;
+    }
+    shrinker_stopping = true;
+    pthread_cond_signal(&shrinker_wake);
+    pthread_mutex_unlock(&shrinker_lock);
+    pthread_join(shrinker_thread, NULL);
+
+    pthread_mutex_lock(&shrinker_lock);
+    shrinker_running = false;
+    pthread_mutex_unlock(&shrinker_lock);
+}
+
+// Resident set size from /proc/self/statm, read without stdio (which may
+// allocate)
+size_t slab_resident_bytes()
+{
+    char buffer[128];
+    int fd = open("/proc/self/statm", O_RDONLY);
+    if (fd < 0)
+        return 0;
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0)
+        return 0;
+    buffer[length] = '\0';
+
+    char *field = strchr(buffer, ' ');
+    return field ? (size_t)strtoull(field + 1, NULL, 10) * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+static void cache_stats(slab_cache_t *cache, slab_shrink_stats_t *stats)
+{
+    pthread_mutex_lock(&cache->lock);
+    stats->reclaimed_bytes += cache->reclaimed_bytes;
+    stats->empty_bytes += cache->empty_count * cache->slab_size;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void slab_shrink_stats(slab_shrink_stats_t *stats)
+{
+    memset(stats, 0, sizeof(slab_shrink_stats_t));
+    pthread_mutex_lock(&registry_lock);
+    stats->reclaimed_bytes = retired_reclaimed;
+    for (int id = 0; id < SLAB_MAX_CACHES; id++)
+    {
+        if (registry[id])
+            cache_stats(registry[id], stats);
+    }
+    pthread_mutex_unlock(&registry_lock);
+    if (thread_cache_cache.object_size)
     {
-        char *slab_start = (char *)slab->memory;
-        char *slab_end = slab_start + SLAB_SIZE;
+        cache_stats(&thread_cache_cache, stats);
+        cache_stats(&magazine_cache, stats);
+    }
+    stats->passes = __atomic_load_n(&shrink_passes, __ATOMIC_RELAXED);
+    stats->resident_bytes = slab_resident_bytes();
+}
+
+// The cache's counters with every live thread's added in. Taking the depot
+// lock keeps the threads' caches from going away meanwhile; the locked-path
+// counters are read under the cache lock they are written under.
+void slab_cache_stats(slab_cache_t *cache, slab_cache_stats_t *stats)
+{
+    memset(stats, 0, sizeof(slab_cache_stats_t));
+    alloc_counters_t counters = { 0 };
+
+    pthread_mutex_lock(&cache->depot_lock);
+    alloc_counters_add(&counters, &cache->counters);
+    for (slab_thread_cache_t *thread_cache = cache->thread_caches; thread_cache; thread_cache = thread_cache->next)
+        alloc_counters_add(&counters, &thread_cache->counters);
+    stats->depot_full = cache->depot_full_count;
+    stats->depot_empty = cache->depot_empty_count;
+    pthread_mutex_unlock(&cache->depot_lock);
+
+    pthread_mutex_lock(&cache->lock);
+    alloc_counters_add(&counters, &cache->locked);
+    size_t objects_out = cache->objects_out;
+    size_t high = cache->objects_out_high;
+    stats->slab_count = cache->slab_count;
+    stats->empty_slabs = cache->empty_count;
+    stats->released_slabs = cache->released_count;
+    pthread_mutex_unlock(&cache->lock);
+
+    alloc_stats_fill(&stats->alloc, &counters, cache->object_size);
+    stats->alloc.failed = STAT_READ(cache->failed);
+    stats->alloc.high_water_bytes = high * cache->object_size;
+    stats->alloc.reserved_bytes = stats->slab_count * cache->slab_size;
+    stats->object_size = cache->object_size;
+    stats->slab_size = cache->slab_size;
+    if (stats->slab_count)
+        stats->utilization = (double)objects_out / (stats->slab_count * cache->objects_per_slab);
+}
 
-        if ((char *)obj >= slab_start && (char *)obj < slab_end)
+static void stats_print(FILE *out, const char *name, const slab_cache_stats_t *stats)
+{
+    alloc_stats_print(out, name, &stats->alloc);
+    fprintf(out, "  %zu-byte objects in %zu slabs of %zu bytes, %.1f%% utilized; %zu empty, %zu released; "
+                 "depot %zu full / %zu empty magazines\n",
+            stats->object_size, stats->slab_count, stats->slab_size, stats->utilization * 100, stats->empty_slabs,
+            stats->released_slabs, stats->depot_full, stats->depot_empty);
+}
+
+void slab_cache_stats_print(FILE *out, slab_cache_t *cache)
+{
+    slab_cache_stats_t stats;
+    slab_cache_stats(cache, &stats);
+    stats_print(out, cache->name, &stats);
+}
+
+// Every cache that has been used. The stats are taken under registry_lock
+// (so the cache cannot be destroyed meanwhile) but printed after it, since
+// printing may allocate.
+void slab_stats_dump_all(FILE *out)
+{
+    for (int id = 0; id < SLAB_MAX_CACHES; id++)
+    {
+        slab_cache_stats_t stats;
+        char name[64];
+        pthread_mutex_lock(&registry_lock);
+        slab_cache_t *cache = registry[id];
+        if (cache)
         {
-            object_header_t *header = (object_header_t *)obj;
-            header->next_free = slab->free_list;
-            slab->free_list = header;
-            slab->free_objects++;
-            return;
+            slab_cache_stats(cache, &stats);
+            memcpy(name, cache->name, sizeof(name));
         }
+        pthread_mutex_unlock(&registry_lock);
+        if (!cache || (!stats.alloc.allocations && !stats.slab_count))
+            continue;
 
-        slab = slab->next;
+        stats_print(out, name, &stats);
+    }
+    if (thread_cache_cache.object_size)
+    {
+        slab_cache_stats_print(out, &thread_cache_cache);
+        slab_cache_stats_print(out, &magazine_cache);
+    }
+}
+
+static void magazine_list_destroy(slab_magazine_t *magazine)
+{
+    while (magazine)
+    {
+        slab_magazine_t *next = magazine->next;
+        slab_cache_free(&magazine_cache, magazine);
+        magazine = next;
     }
 }
 
-// DB Tuple Usecase scenario
-typedef struct db_tuple
+// Destroying the cache with every slab in it; threads that used it must be
+// done with it. The structure itself is freed only if slab_cache_create
+// allocated it.
+void slab_cache_destroy(slab_cache_t *cache)
 {
-    int id;
-    char data[128]; // 128 bytes
-} db_tuple_t;
+    if (cache)
+    {
+        pthread_mutex_lock(&registry_lock);
+        if (cache->id >= 0)
+            registry[cache->id] = NULL;    // stale thread slots no longer match
+        retired_reclaimed += cache->reclaimed_bytes;
+        while (cache->thread_caches)
+        {
+            slab_thread_cache_t *thread_cache = cache->thread_caches;
+            cache->thread_caches = thread_cache->next;
+            slab_cache_free(&magazine_cache, thread_cache->loaded);
+            slab_cache_free(&magazine_cache, thread_cache->previous);
+            slab_cache_free(&thread_cache_cache, thread_cache);
+        }
+        pthread_mutex_unlock(&registry_lock);
+
+        magazine_list_destroy(cache->depot_full);
+        magazine_list_destroy(cache->depot_empty);
+        while (cache->arenas)
+        {
+            slab_arena_t *arena = cache->arenas;
+            cache->arenas = arena->next;
+            munmap(arena, SLAB_ARENA_SIZE);
+        }
+        pthread_mutex_destroy(&cache->depot_lock);
+        pthread_mutex_destroy(&cache->lock);
+        if (cache->allocated)
+            free(cache);
+    }
+}
 
-void dbms_scenario()
+void slab_scenario()
 {
     slab_cache_t *tuple_cache = slab_cache_create("db_tuples", sizeof(db_tuple_t));
 
@@ -109,7 +952,7 @@ void dbms_scenario()
 
     for (int iterator = 0; iterator < 1000; iterator++)
     {
-        tuples[iterator] = (db_tuple_t *)slab_alloc(tuple_cache);
+        tuples[iterator] = (db_tuple_t *)slab_cache_alloc(tuple_cache);
 
         if (tuples[iterator])
         {
@@ -120,8 +963,11 @@ void dbms_scenario()
 
     for (int iterator = 0; iterator < 500; iterator++)
     {
-        slab_free(tuple_cache, tuples[iterator]);
+        slab_cache_free(tuple_cache, tuples[iterator]);
     }
 
     printf("500 Tuple objects' memory are unallocated \n");
-}
\ No newline at end of file
+    slab_cache_stats_print(stdout, tuple_cache);
+    printf("%zu bytes returned to the OS \n", slab_cache_shrink(tuple_cache));
+    slab_cache_destroy(tuple_cache);
+}
@@ -1,12 +1,56 @@
 #ifndef SLABALLOCATOR_H
 #define SLABALLOCATOR_H
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#include "main.h"
+#include "allocStats.h"
 
-#define SLAB_SIZE 4096
-#define MAXIMUM_OBJECTS_PER_SLAB 64
+// Slabs are carved out of arenas of SLAB_ARENA_SIZE bytes aligned to their
+// own size. An arena starts with the descriptors (slab_t) of all its slabs,
+// so the slab owning an object is found from the object's address alone:
+// round down to the arena, then index by the offset / slab size. Keeping the
+// descriptors packed together rather than at the start of each slab also
+// keeps them out of the same few cache sets.
+//
+// A cache keeps its slabs on three lists - partial (some free objects), full
+// (none) and empty (all free) - and moves a slab between them as its free
+// count reaches 0 or objects_per_slab, so slab_cache_alloc and
+// slab_cache_free are O(1) whatever the number of slabs.
+//
+// Above the slabs sits a magazine layer (Bonwick & Adams): each thread owns
+// two magazines - stacks of up to SLAB_MAGAZINE_SIZE free objects - per
+// cache and allocates and frees through them without any lock. When both
+// are empty (or both full) the thread trades one for a full (or empty)
+// magazine at the depot, so the shared locks are taken once per magazine,
+// not once per object. An object may be freed by any thread; it simply
+// travels to another thread's magazines through the depot.
+//
+// Memory goes back to the kernel through the shrinker. slab_cache_shrink
+// (on demand) empties the depot and the caller's magazines into the slabs
+// and releases every empty slab beyond the cache's reserve. slab_reap (what
+// the background shrinker runs every interval) is gentler: it only releases
+// the magazines and empty slabs that stayed unused for the whole interval
+// since the last pass, so a cache that is freeing and reallocating in bursts
+// does not give pages back just to fault them in again. A released slab is
+// madvise(MADV_DONTNEED)ed and kept for reuse; an arena whose slabs are all
+// released is unmapped.
+//
+// Every cache counts its allocations, frees and failures (see allocStats.h)
+// and tracks how many objects are out of its slabs; slab_cache_stats reports
+// those with the slab count and how full the slabs are.
+//
+// Nothing below the cache structure itself is allocated with malloc, so the
+// allocator can stand in for malloc (see slabMalloc.h).
+#define SLAB_SIZE 4096              // smallest slab; each cache picks a power of two up to SLAB_MAX_SIZE
+#define SLAB_MAX_SIZE (128u << 10)
+#define SLAB_ARENA_SIZE (4u << 20)
+#define MINIMUM_OBJECTS_PER_SLAB 8
+#define SLAB_MAGAZINE_SIZE 32
+#define SLAB_MAX_CACHES 256         // caches with magazines alive at once
+#define SLAB_EMPTY_RESERVE 4        // empty slabs a cache keeps through shrinking
+
+// First word of every SLAB_ARENA_SIZE-aligned region the allocator maps
+#define SLAB_ARENA_SLABS 0x534c4142u
+#define SLAB_ARENA_LARGE 0x4c524745u
 
 typedef struct object_header
 {
@@ -15,19 +59,131 @@ typedef struct object_header
 
 typedef struct slab
 {
-    void *memory;
+    struct slab_cache *cache;
     object_header_t *free_list;
-    size_t object_size;
-    size_t objects_per_slab;
-    size_t free_objects;
+    char *memory;
+    char *unused;               // objects from here on were never handed out
+    uint32_t objects_per_slab;
+    uint32_t free_objects;
+    bool released;              // memory handed back to the kernel
+    struct slab *prev;
     struct slab *next;
 } slab_t;
 
+typedef struct slab_arena
+{
+    uint32_t kind;              // SLAB_ARENA_SLABS
+    uint32_t slab_shift;        // log2 of the owning cache's slab size
+    struct slab_arena *next;
+    size_t first;               // first slab after the header
+    size_t carved;              // slabs handed out so far, header slabs included
+    size_t capacity;            // slabs in the arena
+    size_t live;                // carved slabs that hold memory (not released)
+    slab_t slabs[];
+} slab_arena_t;
+
+typedef struct slab_magazine
+{
+    struct slab_magazine *next;
+    uint32_t rounds;            // objects held
+    void *objects[SLAB_MAGAZINE_SIZE];
+} slab_magazine_t;
+
+typedef struct slab_thread_cache
+{
+    struct slab_cache *cache;
+    slab_magazine_t *loaded;    // allocations and frees go here first
+    slab_magazine_t *previous;  // always empty or full
+    struct slab_thread_cache *prev; // registry of live thread caches, under depot_lock
+    struct slab_thread_cache *next;
+    alloc_counters_t counters;  // written by the owning thread only
+} slab_thread_cache_t;
+
 typedef struct slab_cache
 {
-    slab_t *slabs;
+    bool magazines;             // false sends every call to the locked slab layer
+    bool allocated;             // by slab_cache_create, so destroy frees it too
+    int id;                     // slot in each thread's cache table
+    uint64_t generation;        // tells a reused slot from a stale one
+
+    pthread_mutex_t depot_lock;
+    slab_magazine_t *depot_full;
+    slab_magazine_t *depot_empty;
+    size_t depot_full_count;
+    size_t depot_empty_count;
+    size_t depot_full_low;      // fewest full magazines since the last reap
+    slab_thread_cache_t *thread_caches;
+
+    pthread_mutex_t lock;       // protects the slab layer below
+    slab_t *partial;
+    slab_t *full;
+    slab_t *empty;
+    slab_t *released;           // descriptors of released slabs, reused before carving new ones
+    slab_arena_t *arenas;
+    size_t slab_count;          // slabs holding memory
+    size_t empty_count;
+    size_t empty_low;           // fewest empty slabs since the last reap
+    size_t empty_reserve;       // empty slabs shrinking leaves alone
+    size_t released_count;
+    uint64_t reclaimed_bytes;   // returned to the kernel over the cache's life
+    size_t objects_out;         // objects outside the slabs, magazine contents included
+    size_t objects_out_high;
+    alloc_counters_t locked;    // calls that took the locked path
+
+    alloc_counters_t counters;  // left by exited threads
+    uint64_t failed;
+    size_t requested_size;      // object size as asked for, before rounding
     size_t object_size;
+    size_t objects_per_slab;
+    size_t slab_size;
+    uint32_t slab_shift;
     char name[64];
 } slab_cache_t;
 
-#endif
\ No newline at end of file
+typedef struct slab_shrink_stats
+{
+    uint64_t passes;            // slab_reap / slab_cache_shrink calls
+    uint64_t reclaimed_bytes;   // returned to the kernel, all caches
+    size_t empty_bytes;         // held in empty slabs right now
+    size_t resident_bytes;      // process RSS
+} slab_shrink_stats_t;
+
+typedef struct slab_cache_stats
+{
+    alloc_stats_t alloc;
+    size_t object_size;
+    size_t slab_size;
+    size_t slab_count;
+    size_t empty_slabs;
+    size_t released_slabs;
+    size_t depot_full;          // magazines
+    size_t depot_empty;
+    double utilization;         // objects outside the slabs / what the slabs hold
+} slab_cache_stats_t;
+
+// DB Tuple Usecase
+typedef struct db_tuple
+{
+    int id;
+    char data[128]; // 128 bytes
+} db_tuple_t;
+
+slab_cache_t *slab_cache_create(const char *name, size_t object_size);
+int slab_cache_init(slab_cache_t *cache, const char *name, size_t object_size);
+void *slab_cache_alloc(slab_cache_t *cache);
+void *slab_cache_alloc_sized(slab_cache_t *cache, size_t size);
+void slab_cache_free(slab_cache_t *cache, void *obj);
+slab_cache_t *slab_cache_of(const void *obj);
+size_t slab_cache_shrink(slab_cache_t *cache);
+size_t slab_reap();
+int slab_shrinker_start(unsigned int interval_ms);
+void slab_shrinker_stop();
+void slab_shrink_stats(slab_shrink_stats_t *stats);
+size_t slab_resident_bytes();
+void slab_cache_stats(slab_cache_t *cache, slab_cache_stats_t *stats);
+void slab_cache_stats_print(FILE *out, slab_cache_t *cache);
+void slab_stats_dump_all(FILE *out);
+void slab_cache_destroy(slab_cache_t *cache);
+void slab_scenario();
+
+#endif
@@ -0,0 +1,384 @@
+#define _GNU_SOURCE                 // mremap
+#include "slabMalloc.h"
+#include <errno.h>
+
+static pthread_once_t classes_once = PTHREAD_ONCE_INIT;
+static slab_cache_t classes[SLAB_SIZE_CLASSES];
+static uint8_t class_of[SLAB_LARGE_THRESHOLD / SLAB_MALLOC_ALIGN + 1];  // (size + 15) / 16 -> class
+
+static pthread_mutex_t large_lock = PTHREAD_MUTEX_INITIALIZER;
+static slab_large_t *large_cached;  // freed mappings, newest first
+static size_t large_cached_count;
+static size_t large_cached_bytes;
+
+// Large allocations are counted on their own; the size classes count
+// themselves like any slab cache
+static alloc_counters_t large_counters;
+static uint64_t large_failed;
+static size_t large_in_use;         // bytes mapped for live large allocations
+static size_t large_high_water;
+
+static void large_count(ssize_t delta)
+{
+#if ALLOC_STATS
+    size_t in_use = __atomic_add_fetch(&large_in_use, (size_t)delta, __ATOMIC_RELAXED);
+    size_t high = __atomic_load_n(&large_high_water, __ATOMIC_RELAXED);
+    while (in_use > high &&
+           !__atomic_compare_exchange_n(&large_high_water, &high, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+#else
+    (void)delta;
+#endif
+}
+
+static void large_lock_take() { pthread_mutex_lock(&large_lock); }
+static void large_lock_drop() { pthread_mutex_unlock(&large_lock); }
+
+static void classes_init()
+{
+    size_t sizes[SLAB_SIZE_CLASSES];
+    int count = 0;
+    for (size_t size = SLAB_MALLOC_ALIGN; size <= 128; size += SLAB_MALLOC_ALIGN)
+        sizes[count++] = size;
+    for (size_t base = 128; base < SLAB_LARGE_THRESHOLD; base *= 2)
+    {
+        for (int step = 1; step <= 4; step++)
+            sizes[count++] = base + base / 4 * step;
+    }
+
+    int index = 0;
+    for (size_t i = 0; i < sizeof(class_of); i++)
+    {
+        while (sizes[index] < i * SLAB_MALLOC_ALIGN)
+            index++;
+        class_of[i] = (uint8_t)index;
+    }
+
+    for (int i = 0; i < SLAB_SIZE_CLASSES; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "size-%zu", sizes[i]);
+        slab_cache_init(&classes[i], name, sizes[i]);
+    }
+    pthread_atfork(large_lock_take, large_lock_drop, large_lock_drop);
+}
+
+// `length` bytes of fresh memory starting at a SLAB_ARENA_SIZE boundary
+static char *map_aligned(size_t length)
+{
+    char *mapping = mmap(NULL, length + SLAB_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    char *aligned = (char *)(((uintptr_t)mapping + SLAB_ARENA_SIZE - 1) & ~(uintptr_t)(SLAB_ARENA_SIZE - 1));
+    if (aligned > mapping)
+        munmap(mapping, aligned - mapping);
+    munmap(aligned + length, mapping + SLAB_ARENA_SIZE - aligned);
+    return aligned;
+}
+
+// Mapping a large allocation: the header sits at a SLAB_ARENA_SIZE boundary
+// so slab_free can tell it from a slab object, and the object starts at
+// `offset` (a page or more in) to keep its alignment
+static void *large_alloc(size_t size, size_t alignment)
+{
+    size_t offset = alignment > SLAB_SIZE ? alignment : SLAB_SIZE;
+    if (offset > SLAB_ARENA_SIZE / 2 || size > SIZE_MAX - offset - 2 * SLAB_ARENA_SIZE)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t length = (offset + size + SLAB_SIZE - 1) & ~(size_t)(SLAB_SIZE - 1);
+
+    // A cached mapping will do if it is big enough without being twice the size
+    pthread_mutex_lock(&large_lock);
+    for (slab_large_t **link = &large_cached; *link; link = &(*link)->next)
+    {
+        slab_large_t *large = *link;
+        if (large->offset == offset && large->mapped >= length && large->mapped / 2 < length)
+        {
+            *link = large->next;
+            large_cached_count--;
+            large_cached_bytes -= large->mapped;
+            pthread_mutex_unlock(&large_lock);
+            large_count((ssize_t)large->mapped);
+            STAT_ADD_SHARED(large_counters.allocations, 1);
+            STAT_ADD_SHARED(large_counters.requested_bytes, size);
+            STAT_ADD_SHARED(large_counters.allocated_bytes, large->mapped - offset);
+            return (char *)large + offset;
+        }
+    }
+    pthread_mutex_unlock(&large_lock);
+
+    char *aligned = map_aligned(length);
+    if (!aligned)
+    {
+        STAT_ADD_SHARED(large_failed, 1);
+        return NULL;
+    }
+
+    slab_large_t *large = (slab_large_t *)aligned;
+    large->kind = SLAB_ARENA_LARGE;
+    large->mapped = length;
+    large->offset = offset;
+    large_count((ssize_t)length);
+    STAT_ADD_SHARED(large_counters.allocations, 1);
+    STAT_ADD_SHARED(large_counters.requested_bytes, size);
+    STAT_ADD_SHARED(large_counters.allocated_bytes, length - offset);
+    return aligned + offset;
+}
+
+static void large_free(slab_large_t *large)
+{
+    large_count(-(ssize_t)large->mapped);
+    STAT_ADD_SHARED(large_counters.frees, 1);
+    pthread_mutex_lock(&large_lock);
+    if (large_cached_count < SLAB_LARGE_CACHED && large_cached_bytes + large->mapped <= SLAB_LARGE_RETAIN)
+    {
+        large->next = large_cached;
+        large_cached = large;
+        large_cached_count++;
+        large_cached_bytes += large->mapped;
+        large = NULL;
+    }
+    pthread_mutex_unlock(&large_lock);
+    if (large)
+        munmap(large, large->mapped);
+}
+
+static slab_large_t *large_of(const void *ptr)
+{
+    slab_large_t *large = (slab_large_t *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_ARENA_SIZE - 1));
+    return large->kind == SLAB_ARENA_LARGE ? large : NULL;
+}
+
+// Resizing a large allocation without copying it: shrink by unmapping the
+// tail, grow in place if the pages after it are free, and otherwise move the
+// pages with mremap to a new aligned region
+static void *large_realloc(slab_large_t *large, size_t size)
+{
+    if (size > SIZE_MAX - large->offset - 2 * SLAB_ARENA_SIZE)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t length = (large->offset + size + SLAB_SIZE - 1) & ~(size_t)(SLAB_SIZE - 1);
+    if (length <= large->mapped)
+    {
+        if (length < large->mapped / 2)
+        {
+            munmap((char *)large + length, large->mapped - length);
+            large_count(-(ssize_t)(large->mapped - length));
+            large->mapped = length;
+        }
+        return (char *)large + large->offset;
+    }
+
+    if (mremap(large, large->mapped, length, 0) != MAP_FAILED)
+    {
+        large_count((ssize_t)(length - large->mapped));
+        large->mapped = length;
+        return (char *)large + large->offset;
+    }
+
+    char *target = map_aligned(length);
+    if (!target)
+    {
+        STAT_ADD_SHARED(large_failed, 1);
+        return NULL;
+    }
+    if (mremap(large, large->mapped, length, MREMAP_MAYMOVE | MREMAP_FIXED, target) == MAP_FAILED)
+    {
+        munmap(target, length);
+        STAT_ADD_SHARED(large_failed, 1);
+        errno = ENOMEM;
+        return NULL;
+    }
+    large_count((ssize_t)(length - ((slab_large_t *)target)->mapped));
+    large = (slab_large_t *)target;
+    large->mapped = length;
+    return target + large->offset;
+}
+
+void *slab_malloc(size_t size)
+{
+    if (size > SLAB_LARGE_THRESHOLD)
+        return large_alloc(size, SLAB_MALLOC_ALIGN);
+
+    pthread_once(&classes_once, classes_init);
+    void *ptr = slab_cache_alloc_sized(&classes[class_of[(size + SLAB_MALLOC_ALIGN - 1) / SLAB_MALLOC_ALIGN]], size);
+    if (!ptr)
+        errno = ENOMEM;
+    return ptr;
+}
+
+void slab_free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    slab_large_t *large = large_of(ptr);
+    if (large)
+        large_free(large);
+    else
+        slab_cache_free(slab_cache_of(ptr), ptr);
+}
+
+size_t slab_usable_size(const void *ptr)
+{
+    if (!ptr)
+        return 0;
+
+    slab_large_t *large = large_of(ptr);
+    return large ? large->mapped - large->offset : slab_cache_of(ptr)->object_size;
+}
+
+void *slab_calloc(size_t count, size_t size)
+{
+    if (size && count > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *ptr = slab_malloc(count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+// A small block is kept while the new size still fits and uses at least
+// half of it; a large one is resized in place or moved without a copy
+void *slab_realloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        return slab_malloc(size);
+    if (size == 0)
+    {
+        slab_free(ptr);
+        return NULL;
+    }
+
+    slab_large_t *large = large_of(ptr);
+    if (large && size > SLAB_LARGE_THRESHOLD)
+        return large_realloc(large, size);
+
+    size_t usable = slab_usable_size(ptr);
+    if (size <= usable && size >= usable / 2)
+        return ptr;
+
+    void *moved = slab_malloc(size);
+    if (moved)
+    {
+        memcpy(moved, ptr, size < usable ? size : usable);
+        slab_free(ptr);
+    }
+    return moved;
+}
+
+// Power-of-two size classes are aligned to their size within their slab,
+// so small aligned requests round up to one of those
+void *slab_memalign(size_t alignment, size_t size)
+{
+    if (alignment <= SLAB_MALLOC_ALIGN)
+        return slab_malloc(size);
+    if (alignment & (alignment - 1))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t rounded = alignment;
+    while (rounded < size && rounded <= SLAB_LARGE_THRESHOLD)
+        rounded *= 2;
+    if (rounded <= SLAB_LARGE_THRESHOLD)
+        return slab_malloc(rounded);
+    return large_alloc(size, alignment);
+}
+
+// Everything the front end can give back: the cached large mappings and
+// every size class's idle slabs. Returns the bytes released.
+size_t slab_malloc_trim()
+{
+    pthread_mutex_lock(&large_lock);
+    slab_large_t *large = large_cached;
+    size_t released = large_cached_bytes;
+    large_cached = NULL;
+    large_cached_count = 0;
+    large_cached_bytes = 0;
+    pthread_mutex_unlock(&large_lock);
+    while (large)
+    {
+        slab_large_t *next = large->next;
+        munmap(large, large->mapped);
+        large = next;
+    }
+
+    pthread_once(&classes_once, classes_init);
+    for (int i = 0; i < SLAB_SIZE_CLASSES; i++)
+        released += slab_cache_shrink(&classes[i]);
+    return released;
+}
+
+// Large allocations only; the size classes are reported by
+// slab_stats_dump_all with the other caches
+void slab_malloc_large_stats(alloc_stats_t *stats)
+{
+    alloc_counters_t counters = { 0 };
+    alloc_counters_add(&counters, &large_counters);
+    alloc_stats_fill(stats, &counters, 0);
+    stats->failed = STAT_READ(large_failed);
+    stats->bytes_in_use = __atomic_load_n(&large_in_use, __ATOMIC_RELAXED);
+    stats->high_water_bytes = __atomic_load_n(&large_high_water, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&large_lock);
+    stats->reserved_bytes = stats->bytes_in_use + large_cached_bytes;
+    pthread_mutex_unlock(&large_lock);
+}
+
+#ifdef SLAB_MALLOC_PRELOAD
+
+void *malloc(size_t size) { return slab_malloc(size); }
+void free(void *ptr) { slab_free(ptr); }
+void cfree(void *ptr) { slab_free(ptr); }
+void *calloc(size_t count, size_t size) { return slab_calloc(count, size); }
+void *realloc(void *ptr, size_t size) { return slab_realloc(ptr, size); }
+void *memalign(size_t alignment, size_t size) { return slab_memalign(alignment, size); }
+void *aligned_alloc(size_t alignment, size_t size) { return slab_memalign(alignment, size); }
+void *valloc(size_t size) { return slab_memalign(SLAB_SIZE, size); }
+size_t malloc_usable_size(void *ptr) { return slab_usable_size(ptr); }
+
+void *pvalloc(size_t size)
+{
+    return slab_memalign(SLAB_SIZE, (size + SLAB_SIZE - 1) & ~(size_t)(SLAB_SIZE - 1));
+}
+
+void *reallocarray(void *ptr, size_t count, size_t size)
+{
+    if (size && count > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return slab_realloc(ptr, count * size);
+}
+
+int malloc_trim(size_t pad)
+{
+    (void)pad;
+    return slab_malloc_trim() > 0;
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)))
+        return EINVAL;
+    void *ptr = slab_memalign(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+    *result = ptr;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef SLABMALLOC_H
+#define SLABMALLOC_H
+
+#include "slabAllocator.h"
+
+// General-purpose allocator over the slab caches. Requests up to
+// SLAB_LARGE_THRESHOLD bytes are rounded up to one of the size classes -
+// 16-byte steps to 128, then four classes per doubling (160, 192, 224, 256,
+// 320 ...) - each served by its own slab cache with a slab size picked for
+// that class. Larger requests get a mapping of their own. A freed mapping
+// goes back to the kernel unless it fits in a small cache of recently freed
+// ones (SLAB_LARGE_RETAIN bytes at most), which spares a program that keeps
+// allocating and freeing the same large buffer an mmap and munmap each time.
+// slab_malloc_trim (malloc_trim in the preload build) unmaps those and
+// shrinks every size class; slab_shrinker_start does the gentle version in
+// the background. Large allocations are counted apart from the size classes
+// and reported by slab_malloc_large_stats.
+//
+// Built with -DSLAB_MALLOC_PRELOAD the file also defines malloc, free and
+// friends, so the shared library can replace the C library allocator:
+//   gcc -O2 -fPIC -shared -pthread -DSLAB_MALLOC_PRELOAD -o libslabmalloc.so slabMalloc.c slabAllocator.c
+//   LD_PRELOAD=./libslabmalloc.so <program>
+#define SLAB_LARGE_THRESHOLD (32u << 10)
+#define SLAB_SIZE_CLASSES 40
+#define SLAB_MALLOC_ALIGN 16
+#define SLAB_LARGE_CACHED 16        // freed large mappings kept for reuse
+#define SLAB_LARGE_RETAIN (16u << 20)
+
+// Header at the start of a large allocation's mapping
+typedef struct slab_large
+{
+    uint32_t kind;              // SLAB_ARENA_LARGE
+    size_t mapped;              // bytes mapped from the header on
+    size_t offset;              // where the object starts
+    struct slab_large *next;    // in the cache of freed mappings
+} slab_large_t;
+
+void *slab_malloc(size_t size);
+void *slab_calloc(size_t count, size_t size);
+void *slab_realloc(void *ptr, size_t size);
+void *slab_memalign(size_t alignment, size_t size);
+void slab_free(void *ptr);
+size_t slab_usable_size(const void *ptr);
+size_t slab_malloc_trim();
+void slab_malloc_large_stats(alloc_stats_t *stats);
+
+#endif
@@ -0,0 +1,763 @@
+#include "studentTable.h"
+
+#define NAME_LENGTH (sizeof(((student_t *)0)->name) - 1)
+
+// FNV-1a with a final mix, over the part of the name a row can hold
+static uint32_t name_hash(const char *name)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < NAME_LENGTH && name[i]; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 0x100000001b3ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return (uint32_t)hash;
+}
+
+// Ages are signed: flipping the sign bit makes them sort as unsigned keys
+static uint64_t age_key(int age, uint32_t row)
+{
+    return (uint64_t)((uint32_t)age ^ 0x80000000u) << 32 | row;
+}
+
+// First key >= key
+static uint32_t lower_bound(const uint64_t *keys, uint32_t count, uint64_t key)
+{
+    uint32_t low = 0, high = count;
+    while (low < high)
+    {
+        uint32_t middle = (low + high) / 2;
+        if (keys[middle] < key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// First key > key, which is also the child of an inner node to descend to
+static uint32_t upper_bound(const uint64_t *keys, uint32_t count, uint64_t key)
+{
+    uint32_t low = 0, high = count;
+    while (low < high)
+    {
+        uint32_t middle = (low + high) / 2;
+        if (keys[middle] <= key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+student_table_t *student_table_create()
+{
+    student_table_t *table = calloc(1, sizeof(student_table_t));
+    if (!table)
+        return NULL;
+
+    table->name_capacity = STUDENT_HASH_MIN;
+    table->name_index = malloc(table->name_capacity * sizeof(student_hash_slot_t));
+    table->node_cache = slab_cache_create("student_age_index", sizeof(student_node_t));
+    if (!table->name_index || !table->node_cache)
+    {
+        student_table_destroy(table);
+        return NULL;
+    }
+    memset(table->name_index, 0xff, table->name_capacity * sizeof(student_hash_slot_t));
+    table->node_cache->magazines = false;   // one thread, and no nodes parked in magazines
+    return table;
+}
+
+// Resizing the name index; the stored hashes place every row again without
+// touching the rows
+static int name_index_resize(student_table_t *table, size_t capacity)
+{
+    student_hash_slot_t *slots = malloc(capacity * sizeof(student_hash_slot_t));
+    if (!slots)
+        return -1;
+    memset(slots, 0xff, capacity * sizeof(student_hash_slot_t));
+
+    for (size_t i = 0; i < table->name_capacity; i++)
+    {
+        student_hash_slot_t slot = table->name_index[i];
+        if (slot.row == STUDENT_NO_ROW)
+            continue;
+        size_t index = slot.hash & (capacity - 1);
+        while (slots[index].row != STUDENT_NO_ROW)
+            index = (index + 1) & (capacity - 1);
+        slots[index] = slot;
+    }
+    free(table->name_index);
+    table->name_index = slots;
+    table->name_capacity = capacity;
+    return 0;
+}
+
+// Room for one more segment of rows and of ages
+static int segment_add(student_table_t *table)
+{
+    if (table->segment_count == table->segment_capacity)
+    {
+        size_t capacity = table->segment_capacity ? table->segment_capacity * 2 : 16;
+        student_t **segments = realloc(table->segments, capacity * sizeof(student_t *));
+        if (segments)
+            table->segments = segments;
+        int32_t **age_column = realloc(table->age_column, capacity * sizeof(int32_t *));
+        if (age_column)
+            table->age_column = age_column;
+        if (!segments || !age_column)
+            return -1;
+        table->segment_capacity = capacity;
+    }
+    student_t *segment = malloc(STUDENT_SEGMENT_ROWS * sizeof(student_t));
+    int32_t *ages = malloc(STUDENT_SEGMENT_ROWS * sizeof(int32_t));
+    if (!segment || !ages)
+    {
+        free(segment);
+        free(ages);
+        return -1;
+    }
+    table->age_column[table->segment_count] = ages;
+    table->segments[table->segment_count++] = segment;
+    return 0;
+}
+
+// Splitting a node takes one new node per level, plus a new root. Taking
+// them all up front means an insert either fails before it changes anything
+// or succeeds.
+static int nodes_reserve(student_table_t *table)
+{
+    while (table->spare_count < table->age_depth + 2)
+    {
+        student_node_t *node = slab_cache_alloc(table->node_cache);
+        if (!node)
+            return -1;
+        node->next = table->spare_nodes;
+        table->spare_nodes = node;
+        table->spare_count++;
+        table->node_count++;
+    }
+    return 0;
+}
+
+static student_node_t *node_take(student_table_t *table, bool leaf)
+{
+    student_node_t *node = table->spare_nodes;
+    table->spare_nodes = node->next;
+    table->spare_count--;
+    node->leaf = leaf;
+    node->count = 0;
+    node->next = NULL;
+    return node;
+}
+
+static void leaf_put(student_node_t *leaf, uint32_t position, uint64_t key)
+{
+    memmove(&leaf->keys[position + 1], &leaf->keys[position], (leaf->count - position) * sizeof(uint64_t));
+    leaf->keys[position] = key;
+    leaf->count++;
+}
+
+// A full leaf splits where the key goes (see studentTable.h), or in the
+// middle when that would leave the left part under a quarter full. Returns
+// the new right sibling.
+static student_node_t *leaf_insert(student_table_t *table, student_node_t *leaf, uint64_t key)
+{
+    uint32_t position = lower_bound(leaf->keys, leaf->count, key);
+    if (leaf->count < STUDENT_LEAF_KEYS)
+    {
+        leaf_put(leaf, position, key);
+        return NULL;
+    }
+
+    uint32_t split = position < leaf->count / 4 ? leaf->count / 2 : position;
+    student_node_t *right = node_take(table, true);
+    right->count = leaf->count - split;
+    memcpy(right->keys, &leaf->keys[split], right->count * sizeof(uint64_t));
+    leaf->count = split;
+    right->next = leaf->next;
+    leaf->next = right;
+
+    if (split == STUDENT_LEAF_KEYS)
+        leaf_put(right, 0, key);
+    else
+        leaf_put(leaf, position, key);
+    return right;
+}
+
+// Inserting under `node`; returns the new right sibling if `node` split,
+// with the first key under it in *separator
+static student_node_t *node_insert(student_table_t *table, student_node_t *node, uint64_t key, uint64_t *separator)
+{
+    if (node->leaf)
+    {
+        student_node_t *right = leaf_insert(table, node, key);
+        if (right)
+            *separator = right->keys[0];
+        return right;
+    }
+
+    uint32_t child = upper_bound(node->inner.keys, node->count, key);
+    uint64_t child_separator;
+    student_node_t *grown = node_insert(table, node->inner.children[child], key, &child_separator);
+    if (!grown)
+        return NULL;
+
+    if (node->count < STUDENT_INNER_KEYS)
+    {
+        memmove(&node->inner.keys[child + 1], &node->inner.keys[child], (node->count - child) * sizeof(uint64_t));
+        memmove(&node->inner.children[child + 2], &node->inner.children[child + 1],
+                (node->count - child) * sizeof(student_node_t *));
+        node->inner.keys[child] = child_separator;
+        node->inner.children[child + 1] = grown;
+        node->count++;
+        return NULL;
+    }
+
+    // Full inner node: lay out all count + 1 keys, then split in the middle;
+    // the middle key moves up
+    uint64_t keys[STUDENT_INNER_KEYS + 1];
+    student_node_t *children[STUDENT_INNER_KEYS + 2];
+    memcpy(keys, node->inner.keys, child * sizeof(uint64_t));
+    keys[child] = child_separator;
+    memcpy(&keys[child + 1], &node->inner.keys[child], (node->count - child) * sizeof(uint64_t));
+    memcpy(children, node->inner.children, (child + 1) * sizeof(student_node_t *));
+    children[child + 1] = grown;
+    memcpy(&children[child + 2], &node->inner.children[child + 1], (node->count - child) * sizeof(student_node_t *));
+
+    uint32_t total = node->count + 1;
+    uint32_t middle = total / 2;
+    student_node_t *right = node_take(table, false);
+    node->count = middle;
+    memcpy(node->inner.keys, keys, middle * sizeof(uint64_t));
+    memcpy(node->inner.children, children, (middle + 1) * sizeof(student_node_t *));
+    right->count = total - middle - 1;
+    memcpy(right->inner.keys, &keys[middle + 1], right->count * sizeof(uint64_t));
+    memcpy(right->inner.children, &children[middle + 1], (right->count + 1) * sizeof(student_node_t *));
+    *separator = keys[middle];
+    return right;
+}
+
+// Appending a row and indexing it. Returns the row id, or -1 when memory
+// runs out (the table is left as it was).
+int64_t student_insert(student_table_t *table, const char *name, int age)
+{
+    uint32_t row = table->rows;
+    if (row == STUDENT_NO_ROW)
+        return -1;
+
+    if (row == table->segment_count * STUDENT_SEGMENT_ROWS && segment_add(table) < 0)
+        return -1;
+    if (((size_t)row + 1) * 4 > table->name_capacity * 3 && name_index_resize(table, table->name_capacity * 2) < 0)
+        return -1;
+    if (nodes_reserve(table) < 0)
+        return -1;
+
+    student_t *student = student_row(table, row);
+    strncpy(student->name, name, NAME_LENGTH);
+    student->name[NAME_LENGTH] = '\0';
+    student->age = age;
+    table->age_column[row / STUDENT_SEGMENT_ROWS][row % STUDENT_SEGMENT_ROWS] = age;
+    table->rows++;
+
+    uint32_t hash = name_hash(student->name);
+    size_t index = hash & (table->name_capacity - 1);
+    while (table->name_index[index].row != STUDENT_NO_ROW)
+        index = (index + 1) & (table->name_capacity - 1);
+    table->name_index[index] = (student_hash_slot_t){ hash, row };
+
+    uint64_t key = age_key(age, row);
+    if (!table->age_root)
+    {
+        table->age_root = node_take(table, true);
+        table->age_depth = 1;
+    }
+    uint64_t separator;
+    student_node_t *right = node_insert(table, table->age_root, key, &separator);
+    if (right)
+    {
+        student_node_t *root = node_take(table, false);
+        root->count = 1;
+        root->inner.keys[0] = separator;
+        root->inner.children[0] = table->age_root;
+        root->inner.children[1] = right;
+        table->age_root = root;
+        table->age_depth++;
+    }
+    return row;
+}
+
+// Room for `rows` more rows: their segments, and a name index big enough
+// for all of them, so neither grows while they go in. Returns -1 when
+// memory runs out or the table would be too long; the rows already in are
+// left as they were.
+int student_bulk_reserve(student_table_t *table, size_t rows)
+{
+    size_t total = table->rows + rows;
+    if (total >= STUDENT_NO_ROW)
+        return -1;
+    while (table->segment_count * STUDENT_SEGMENT_ROWS < total)
+    {
+        if (segment_add(table) < 0)
+            return -1;
+    }
+    size_t capacity = table->name_capacity;
+    while (total * 4 > capacity * 3)
+        capacity *= 2;
+    if (capacity > table->name_capacity && name_index_resize(table, capacity) < 0)
+        return -1;
+    return 0;
+}
+
+// The age keys of rows [first, end) in key order. Rows are in order
+// already, so a stable counting sort on the age, one byte of it a pass, is
+// enough - one pass for ages that span fewer than 256 values.
+static uint64_t *age_keys_sorted(const student_table_t *table, uint32_t first, uint32_t end)
+{
+    size_t count = end - first;
+    uint64_t *keys = malloc((count ? count : 1) * sizeof(uint64_t));
+    if (!keys)
+        return NULL;
+
+    uint32_t lowest = UINT32_MAX, highest = 0;
+    for (uint32_t row = first; row < end; row++)
+    {
+        uint32_t age = (uint32_t)(age_key(table->age_column[row / STUDENT_SEGMENT_ROWS][row % STUDENT_SEGMENT_ROWS], 0) >> 32);
+        lowest = age < lowest ? age : lowest;
+        highest = age > highest ? age : highest;
+    }
+    int passes = 1;
+    while (passes < 4 && (highest - lowest) >> (8 * passes))
+        passes++;
+    uint64_t *scratch = NULL;
+    if (passes > 1 && !(scratch = malloc(count * sizeof(uint64_t))))
+    {
+        free(keys);
+        return NULL;
+    }
+
+    // Passes alternate between the two arrays and the last one ends in keys
+    uint64_t *to = passes % 2 ? keys : scratch, *from = NULL;
+    for (int pass = 0; pass < passes; pass++)
+    {
+        size_t offsets[256] = {0};
+        int shift = 8 * pass;
+        if (pass == 0)
+        {
+            for (uint32_t row = first; row < end; row++)
+                offsets[((uint32_t)(age_key(table->age_column[row / STUDENT_SEGMENT_ROWS][row % STUDENT_SEGMENT_ROWS], 0) >> 32) - lowest) & 0xff]++;
+        }
+        else
+        {
+            for (size_t i = 0; i < count; i++)
+                offsets[((uint32_t)(from[i] >> 32) - lowest) >> shift & 0xff]++;
+        }
+        size_t position = 0;
+        for (int digit = 0; digit < 256; digit++)
+        {
+            size_t n = offsets[digit];
+            offsets[digit] = position;
+            position += n;
+        }
+        if (pass == 0)
+        {
+            for (uint32_t row = first; row < end; row++)
+            {
+                uint64_t key = age_key(table->age_column[row / STUDENT_SEGMENT_ROWS][row % STUDENT_SEGMENT_ROWS], row);
+                to[offsets[((uint32_t)(key >> 32) - lowest) & 0xff]++] = key;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < count; i++)
+                to[offsets[((uint32_t)(from[i] >> 32) - lowest) >> shift & 0xff]++] = from[i];
+        }
+        from = to;
+        to = to == keys ? scratch : keys;
+    }
+    free(scratch);
+    return keys;
+}
+
+// A tree over `count` sorted keys, built a level at a time with the keys
+// (then the children) spread evenly over as few nodes as will hold them.
+// Returns -1, having freed what it took, when memory runs out.
+static int tree_build(student_table_t *table, const uint64_t *keys, size_t count, student_node_t **root,
+                      uint32_t *depth, size_t *node_count)
+{
+    *root = NULL;
+    *depth = 0;
+    *node_count = 0;
+    if (!count)
+        return 0;
+
+    size_t leaves = (count + STUDENT_LEAF_KEYS - 1) / STUDENT_LEAF_KEYS;
+    student_node_t **level = malloc(leaves * sizeof(student_node_t *));
+    uint64_t *firsts = malloc(leaves * sizeof(uint64_t));
+    student_node_t **built = malloc(2 * leaves * sizeof(student_node_t *));   // every level above has at most half as many nodes
+    size_t built_count = 0;
+    if (!level || !firsts || !built)
+        goto failed;
+
+    for (size_t i = 0; i < leaves; i++)
+    {
+        size_t start = count * i / leaves, end = count * (i + 1) / leaves;
+        student_node_t *leaf = slab_cache_alloc(table->node_cache);
+        if (!leaf)
+            goto failed;
+        built[built_count++] = leaf;
+        leaf->leaf = true;
+        leaf->count = (uint32_t)(end - start);
+        leaf->next = NULL;
+        memcpy(leaf->keys, &keys[start], leaf->count * sizeof(uint64_t));
+        if (i > 0)
+            level[i - 1]->next = leaf;
+        level[i] = leaf;
+        firsts[i] = keys[start];
+    }
+    *depth = 1;
+
+    // A parent's slot is never past the first of its children, so each level
+    // overwrites the one below in place
+    for (size_t nodes = leaves; nodes > 1; (*depth)++)
+    {
+        size_t parents = (nodes + STUDENT_INNER_KEYS) / (STUDENT_INNER_KEYS + 1);
+        for (size_t p = 0; p < parents; p++)
+        {
+            size_t start = nodes * p / parents, end = nodes * (p + 1) / parents;
+            student_node_t *inner = slab_cache_alloc(table->node_cache);
+            if (!inner)
+                goto failed;
+            built[built_count++] = inner;
+            inner->leaf = false;
+            inner->count = (uint32_t)(end - start - 1);
+            inner->next = NULL;
+            memcpy(inner->inner.children, &level[start], (end - start) * sizeof(student_node_t *));
+            memcpy(inner->inner.keys, &firsts[start + 1], inner->count * sizeof(uint64_t));
+            level[p] = inner;
+            firsts[p] = firsts[start];
+        }
+        nodes = parents;
+    }
+    *root = level[0];
+    *node_count = built_count;
+    free(level);
+    free(firsts);
+    free(built);
+    return 0;
+
+failed:
+    for (size_t i = 0; built && i < built_count; i++)
+        slab_cache_free(table->node_cache, built[i]);
+    free(level);
+    free(firsts);
+    free(built);
+    *root = NULL;
+    *depth = 0;
+    return -1;
+}
+
+static void tree_free(student_table_t *table, student_node_t *node)
+{
+    if (!node->leaf)
+    {
+        for (uint32_t i = 0; i <= node->count; i++)
+            tree_free(table, node->inner.children[i]);
+    }
+    slab_cache_free(table->node_cache, node);
+}
+
+// Bulk name indexing in three steps, each spread over the threads: hash
+// the new rows, scatter them into partitions by the stretch of the table
+// their home slot is in, and put the partitions in one after another. A
+// partition covers NAME_PARTITION_SLOTS slots, so the inserts walk the
+// table in order instead of landing anywhere in it. A slot is claimed with
+// a compare-and-swap, as a probe may run on into another thread's stretch.
+#define NAME_PARTITION_SLOTS 4096
+#define NAME_MAX_PARTITIONS 16384
+
+typedef struct name_index_worker
+{
+    student_table_t *table;
+    uint32_t base;                  // the first new row
+    uint32_t first;                 // this worker's rows
+    uint32_t end;
+    student_hash_slot_t *hashed;    // in row order, from base
+    student_hash_slot_t *sorted;    // in partition order
+    size_t *counts;                 // this worker's rows in each partition, then where they go
+    const size_t *starts;           // where each partition starts in sorted
+    size_t partitions;
+    int partition_shift;
+    size_t partition_first;         // the partitions this worker puts in
+    size_t partition_end;
+} name_index_worker_t;
+
+static void *name_hash_main(void *arg)
+{
+    name_index_worker_t *worker = arg;
+    for (uint32_t row = worker->first; row < worker->end; row++)
+    {
+        student_hash_slot_t slot = { name_hash(student_row(worker->table, row)->name), row };
+        worker->hashed[row - worker->base] = slot;
+        worker->counts[(slot.hash & (worker->table->name_capacity - 1)) >> worker->partition_shift]++;
+    }
+    return NULL;
+}
+
+static void *name_scatter_main(void *arg)
+{
+    name_index_worker_t *worker = arg;
+    for (uint32_t row = worker->first; row < worker->end; row++)
+    {
+        student_hash_slot_t slot = worker->hashed[row - worker->base];
+        worker->sorted[worker->counts[(slot.hash & (worker->table->name_capacity - 1)) >> worker->partition_shift]++] = slot;
+    }
+    return NULL;
+}
+
+static void *name_insert_main(void *arg)
+{
+    name_index_worker_t *worker = arg;
+    student_hash_slot_t *slots = worker->table->name_index;
+    size_t mask = worker->table->name_capacity - 1;
+
+    for (size_t i = worker->starts[worker->partition_first]; i < worker->starts[worker->partition_end]; i++)
+    {
+        student_hash_slot_t slot = worker->sorted[i];
+        for (size_t index = slot.hash & mask;; index = (index + 1) & mask)
+        {
+            student_hash_slot_t current;
+            __atomic_load(&slots[index], &current, __ATOMIC_RELAXED);
+            if (current.row == STUDENT_NO_ROW &&
+                __atomic_compare_exchange(&slots[index], &current, &slot, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+    }
+    return NULL;
+}
+
+// `routine` over each of `count` workers, `size` bytes apart, the first on
+// the calling thread; a worker whose thread cannot be started, or past
+// STUDENT_BULK_THREADS, runs on the calling thread too
+void student_run_workers(void *workers, size_t size, int count, void *(*routine)(void *))
+{
+    pthread_t threads[STUDENT_BULK_THREADS];
+    char *worker = workers;
+    int started = 1;
+    while (started < count && started < STUDENT_BULK_THREADS &&
+           pthread_create(&threads[started], NULL, routine, worker + started * size) == 0)
+        started++;
+    for (int i = started; i < count; i++)
+        routine(worker + i * size);
+    routine(worker);
+    for (int i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+// Indexing the `rows` rows put in after student_bulk_reserve, on `threads`
+// threads, and making them visible. The age tree is rebuilt from the keys
+// already in it merged with the new ones, and replaces the old tree only
+// once it is whole. Returns -1 when memory runs out; the rows put in are
+// then dropped and the table is left as it was.
+int student_bulk_commit(student_table_t *table, size_t rows, int threads)
+{
+    uint32_t first = table->rows, end = (uint32_t)(first + rows);
+    if (!rows)
+        return 0;
+    threads = threads < 1 ? 1 : threads > STUDENT_BULK_THREADS ? STUDENT_BULK_THREADS : threads;
+
+    // Everything the names take is taken first: past the tree, nothing fails
+    int partition_shift = 0;
+    while ((table->name_capacity >> partition_shift) > NAME_MAX_PARTITIONS ||
+           ((size_t)1 << partition_shift) < NAME_PARTITION_SLOTS)
+        partition_shift++;
+    size_t partitions = (table->name_capacity + ((size_t)1 << partition_shift) - 1) >> partition_shift;
+    student_hash_slot_t *hashed = malloc(rows * sizeof(student_hash_slot_t));
+    student_hash_slot_t *sorted = malloc(rows * sizeof(student_hash_slot_t));
+    size_t *counts = calloc((size_t)threads * partitions + partitions + 1, sizeof(size_t));
+    uint64_t *keys = hashed && sorted && counts ? age_keys_sorted(table, first, end) : NULL;
+    if (!keys)
+    {
+        free(hashed);
+        free(sorted);
+        free(counts);
+        return -1;
+    }
+    if (first > 0)
+    {
+        // Merging with the keys in the tree, which all have smaller rows
+        uint64_t *merged = malloc((size_t)end * sizeof(uint64_t));
+        if (!merged)
+        {
+            free(keys);
+            free(hashed);
+            free(sorted);
+            free(counts);
+            return -1;
+        }
+        const student_node_t *leaf = table->age_root;
+        while (!leaf->leaf)
+            leaf = leaf->inner.children[0];
+        size_t out = 0, fresh = 0;
+        for (; leaf; leaf = leaf->next)
+        {
+            for (uint32_t i = 0; i < leaf->count; i++)
+            {
+                while (fresh < rows && keys[fresh] < leaf->keys[i])
+                    merged[out++] = keys[fresh++];
+                merged[out++] = leaf->keys[i];
+            }
+        }
+        while (fresh < rows)
+            merged[out++] = keys[fresh++];
+        free(keys);
+        keys = merged;
+    }
+
+    student_node_t *root;
+    uint32_t depth;
+    size_t node_count;
+    int built = tree_build(table, keys, end, &root, &depth, &node_count);
+    free(keys);
+    if (built < 0)
+    {
+        free(hashed);
+        free(sorted);
+        free(counts);
+        return -1;
+    }
+
+    name_index_worker_t workers[STUDENT_BULK_THREADS];
+    size_t *starts = counts + (size_t)threads * partitions;
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i] = (name_index_worker_t){
+            .table = table, .base = first, .hashed = hashed, .sorted = sorted,
+            .first = (uint32_t)(first + rows * i / threads), .end = (uint32_t)(first + rows * (i + 1) / threads),
+            .counts = counts + (size_t)i * partitions, .starts = starts, .partitions = partitions,
+            .partition_shift = partition_shift,
+            .partition_first = partitions * i / threads, .partition_end = partitions * (i + 1) / threads,
+        };
+    }
+    student_run_workers(workers, sizeof(name_index_worker_t), threads, name_hash_main);
+    // Partition by partition, each worker's rows after the rows of the
+    // workers before it, so a partition stays in row order
+    size_t position = 0;
+    for (size_t p = 0; p < partitions; p++)
+    {
+        starts[p] = position;
+        for (int i = 0; i < threads; i++)
+        {
+            size_t n = workers[i].counts[p];
+            workers[i].counts[p] = position;
+            position += n;
+        }
+    }
+    starts[partitions] = position;
+    student_run_workers(workers, sizeof(name_index_worker_t), threads, name_scatter_main);
+    student_run_workers(workers, sizeof(name_index_worker_t), threads, name_insert_main);
+    free(hashed);
+    free(sorted);
+    free(counts);
+
+    if (table->age_root)
+        tree_free(table, table->age_root);
+    table->age_root = root;
+    table->age_depth = depth;
+    table->node_count = table->spare_count + node_count;
+    table->rows = end;
+    return 0;
+}
+
+// Rows named `name`: the first `max` of them go to `rows`; returns how many
+// there are
+size_t student_find_name(const student_table_t *table, const char *name, uint32_t *rows, size_t max)
+{
+    uint32_t hash = name_hash(name);
+    size_t found = 0;
+    for (size_t index = hash & (table->name_capacity - 1); table->name_index[index].row != STUDENT_NO_ROW;
+         index = (index + 1) & (table->name_capacity - 1))
+    {
+        student_hash_slot_t slot = table->name_index[index];
+        if (slot.hash == hash && strncmp(student_row(table, slot.row)->name, name, NAME_LENGTH) == 0)
+        {
+            if (found < max)
+                rows[found] = slot.row;
+            found++;
+        }
+    }
+    return found;
+}
+
+// Positioning `cursor` on the first row aged `low` or more
+void student_find_age(const student_table_t *table, int low, int high, student_cursor_t *cursor)
+{
+    cursor->leaf = NULL;
+    cursor->index = 0;
+    cursor->last = age_key(high, STUDENT_NO_ROW);
+    if (!table->age_root || low > high)
+        return;
+
+    uint64_t first = age_key(low, 0);
+    const student_node_t *node = table->age_root;
+    while (!node->leaf)
+        node = node->inner.children[upper_bound(node->inner.keys, node->count, first)];
+    cursor->leaf = node;
+    cursor->index = lower_bound(node->keys, node->count, first);
+}
+
+bool student_cursor_next(student_cursor_t *cursor, uint32_t *row)
+{
+    while (cursor->leaf && cursor->index == cursor->leaf->count)
+    {
+        cursor->leaf = cursor->leaf->next;
+        cursor->index = 0;
+    }
+    if (!cursor->leaf)
+        return false;
+
+    uint64_t key = cursor->leaf->keys[cursor->index++];
+    if (key > cursor->last)
+    {
+        cursor->leaf = NULL;
+        return false;
+    }
+    *row = (uint32_t)key;
+    return true;
+}
+
+void student_table_stats(const student_table_t *table, student_table_stats_t *stats)
+{
+    slab_cache_stats_t nodes;
+    slab_cache_stats(table->node_cache, &nodes);
+
+    stats->rows = table->rows;
+    stats->row_bytes = table->segment_count * STUDENT_SEGMENT_ROWS * sizeof(student_t);
+    stats->column_bytes = table->segment_count * STUDENT_SEGMENT_ROWS * sizeof(int32_t);
+    stats->name_index_bytes = table->name_capacity * sizeof(student_hash_slot_t);
+    stats->age_index_bytes = nodes.alloc.reserved_bytes;
+    stats->age_depth = table->age_depth;
+    size_t total = stats->row_bytes + stats->column_bytes + stats->name_index_bytes + stats->age_index_bytes;
+    stats->bytes_per_row = table->rows ? (double)total / table->rows : 0;
+}
+
+void student_table_destroy(student_table_t *table)
+{
+    if (table)
+    {
+        for (size_t i = 0; i < table->segment_count; i++)
+        {
+            free(table->segments[i]);
+            free(table->age_column[i]);
+        }
+        free(table->segments);
+        free(table->age_column);
+        free(table->name_index);
+        slab_cache_destroy(table->node_cache);   // every node with it
+        free(table);
+    }
+}
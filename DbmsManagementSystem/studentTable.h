@@ -0,0 +1,133 @@
+#ifndef STUDENTTABLE_H
+#define STUDENTTABLE_H
+
+#include "main.h"
+#include "slabAllocator.h"
+
+typedef struct student{
+    char name[20];
+    int age;
+}student_t;
+
+// Students packed back to back, STUDENT_SEGMENT_ROWS to a segment, so a row
+// costs its 24 bytes and nothing else; a row's id is its position and rows
+// never move. Each segment has a columnar copy of its ages next to it, 4
+// bytes a row, for scans that read nothing else (see query.h). Two
+// secondary indexes answer lookups without a scan:
+//
+// - name: open-addressing hash table with linear probing. A slot holds the
+//   row id and 32 bits of the name's hash, so a probe only touches a row
+//   whose hash matches. The table doubles at 3/4 full.
+// - age: B+tree of (age, row) keys in STUDENT_NODE_SIZE nodes taken from a
+//   slab cache of the table's own; leaves are chained for range scans.
+//   Rows arrive in id order, so each age's keys only ever grow at the end of
+//   their run, and a full leaf is split where the new key goes rather than
+//   in the middle: the half that will not grow again stays full.
+//
+// A bulk load (see bulkLoad.h) skips the per-row index upkeep: it reserves
+// room for all its rows at once, fills them in from any number of threads
+// with student_bulk_put, and student_bulk_commit then indexes them in one
+// go - the age tree is rebuilt bottom-up from sorted keys, and the names go
+// into the hash table from several threads. Rows of the same name may then
+// come back from a lookup in any order.
+//
+// Not thread-safe otherwise; callers serialize.
+#define STUDENT_SEGMENT_ROWS 65536   // 1.5 MB
+#define STUDENT_HASH_MIN 1024
+#define STUDENT_NODE_SIZE 4096
+#define STUDENT_LEAF_KEYS ((STUDENT_NODE_SIZE - 16) / sizeof(uint64_t))
+#define STUDENT_INNER_KEYS ((STUDENT_NODE_SIZE - 24) / (2 * sizeof(uint64_t)))
+#define STUDENT_NO_ROW UINT32_MAX
+#define STUDENT_BULK_THREADS 64
+
+typedef struct student_hash_slot
+{
+    uint32_t hash;
+    uint32_t row;                   // STUDENT_NO_ROW when the slot is empty
+} student_hash_slot_t;
+
+typedef struct student_node
+{
+    uint32_t leaf;
+    uint32_t count;                 // keys
+    struct student_node *next;      // leaves: the next leaf in key order
+    union
+    {
+        uint64_t keys[STUDENT_LEAF_KEYS];
+        struct
+        {
+            uint64_t keys[STUDENT_INNER_KEYS];  // keys[i] is the first key under children[i + 1]
+            struct student_node *children[STUDENT_INNER_KEYS + 1];
+        } inner;
+    };
+} student_node_t;
+
+typedef struct student_table
+{
+    student_t **segments;
+    int32_t **age_column;           // one chunk per segment
+    size_t segment_count;
+    size_t segment_capacity;
+    uint32_t rows;
+
+    student_hash_slot_t *name_index;
+    size_t name_capacity;           // slots, a power of two
+
+    slab_cache_t *node_cache;
+    student_node_t *age_root;
+    size_t node_count;
+    uint32_t age_depth;
+    student_node_t *spare_nodes;    // taken before an insert so it cannot fail halfway
+    size_t spare_count;
+} student_table_t;
+
+// Rows with ages in [low, high], in age order then row order
+typedef struct student_cursor
+{
+    const student_node_t *leaf;
+    uint32_t index;
+    uint64_t last;                  // key of the last row wanted
+} student_cursor_t;
+
+typedef struct student_table_stats
+{
+    uint32_t rows;
+    size_t row_bytes;               // segments
+    size_t column_bytes;            // columnar copies
+    size_t name_index_bytes;
+    size_t age_index_bytes;         // nodes, slab overhead included
+    uint32_t age_depth;
+    double bytes_per_row;
+} student_table_stats_t;
+
+static inline student_t *student_row(const student_table_t *table, uint32_t row)
+{
+    return &table->segments[row / STUDENT_SEGMENT_ROWS][row % STUDENT_SEGMENT_ROWS];
+}
+
+// Row `row` of a bulk load, in the room student_bulk_reserve made. Rows
+// are not visible until student_bulk_commit. Threads may fill in different
+// rows at once.
+static inline void student_bulk_put(student_table_t *table, uint32_t row, const char *name, size_t length, int age)
+{
+    student_t *student = student_row(table, row);
+    if (length > sizeof(student->name) - 1)
+        length = sizeof(student->name) - 1;
+    memcpy(student->name, name, length);
+    memset(student->name + length, 0, sizeof(student->name) - length);
+    student->age = age;
+    table->age_column[row / STUDENT_SEGMENT_ROWS][row % STUDENT_SEGMENT_ROWS] = age;
+}
+
+student_table_t *student_table_create();
+int64_t student_insert(student_table_t *table, const char *name, int age);
+int student_bulk_reserve(student_table_t *table, size_t rows);
+int student_bulk_commit(student_table_t *table, size_t rows, int threads);
+void student_run_workers(void *workers, size_t size, int count, void *(*routine)(void *));
+size_t student_find_name(const student_table_t *table, const char *name, uint32_t *rows, size_t max);
+void student_find_age(const student_table_t *table, int low, int high, student_cursor_t *cursor);
+bool student_cursor_next(student_cursor_t *cursor, uint32_t *row);
+void student_table_stats(const student_table_t *table, student_table_stats_t *stats);
+void student_table_destroy(student_table_t *table);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -6,72 +7,536 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
-static ssize_t write_all(int fd, const void *buffer, size_t count)
+// Build: gcc -O2 -pthread -o binFileCopy binFileCopy.c
+//
+// binFileCopy [--strategy=auto|range|sendfile|splice|buffer] [--threads=N] [src] [dest]
+// binFileCopy --bench [src] [dest]
+//
+// Every strategy copies by explicit offset, so a large file is cut into
+// chunks that several threads copy at once, each with its own descriptors.
+// Only the source's data extents are copied; the destination is sized up
+// front with ftruncate, so holes in a sparse source stay holes.
+
+#define COPY_BUFFER_SIZE (1u << 20)             // read/write fallback
+#define COPY_CHUNK_SIZE (64ull << 20)           // unit of work handed to one thread
+#define COPY_PARALLEL_THRESHOLD (256ull << 20)  // smaller files use one thread
+#define COPY_MAX_THREADS 16
+
+enum
+{
+    STRATEGY_RANGE,     // copy_file_range: reflink or in-kernel copy
+    STRATEGY_SENDFILE,  // in-kernel page cache to file
+    STRATEGY_SPLICE,    // through a pipe, no user-space copy
+    STRATEGY_BUFFER,    // pread/pwrite through a large buffer
+    STRATEGY_COUNT,
+    STRATEGY_AUTO = STRATEGY_COUNT
+};
+
+static const char *strategy_names[] = { "copy_file_range", "sendfile", "splice", "buffer" };
+
+typedef struct
+{
+    off_t offset;
+    off_t length;
+} Extent;
+
+typedef struct
+{
+    const char *srcPath;
+    const char *destPath;
+    int strategy;                   // first strategy tried; AUTO starts at RANGE
+    Extent *chunks;
+    size_t chunkCount;
+    atomic_size_t nextChunk;
+    atomic_int failed;
+
+    pthread_mutex_t statsLock;
+    uint64_t bytes[STRATEGY_COUNT];
+    double seconds[STRATEGY_COUNT]; // summed over threads
+} CopyJob;
+
+typedef struct
 {
-    const uint8_t *pointer = buffer;
-    size_t left = count;
+    CopyJob *job;
+    int fd_src;
+    int fd_destination;
+    int strategy;                   // current strategy of this worker, only moves down the list
+    int pipe_fds[2];
+    char *buffer;
+} Worker;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The kernel, filesystem or file pair cannot do this strategy; try the next one
+static int unsupported(int error)
+{
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP ||
+           error == ENOTSUP || error == EBADF;
+}
+
+// Each copy_* moves up to `length` bytes at `offset` and returns how many,
+// 0 at end of file, or -1 with errno set
+
+static ssize_t copy_range(Worker *worker, off_t offset, size_t length)
+{
+    loff_t in = offset, out = offset;
+    return copy_file_range(worker->fd_src, &in, worker->fd_destination, &out, length, 0);
+}
 
+// sendfile writes at the destination's file position, which belongs to this worker alone
+static ssize_t copy_sendfile(Worker *worker, off_t offset, size_t length)
+{
+    if (lseek(worker->fd_destination, offset, SEEK_SET) < 0)
+        return -1;
+    off_t in = offset;
+    return sendfile(worker->fd_destination, worker->fd_src, &in, length);
+}
+
+static ssize_t copy_splice(Worker *worker, off_t offset, size_t length)
+{
+    if (worker->pipe_fds[0] < 0 && pipe(worker->pipe_fds) < 0)
+        return -1;
+
+    loff_t in = offset, out = offset;
+    ssize_t filled = splice(worker->fd_src, &in, worker->pipe_fds[1], NULL, length, SPLICE_F_MOVE);
+    if (filled <= 0)
+        return filled;
+
+    // Drain everything that entered the pipe, or the next call would see stale data
+    ssize_t left = filled;
     while (left > 0)
     {
-        ssize_t bytes_written = write(fd, pointer, left);
+        ssize_t moved = splice(worker->pipe_fds[0], NULL, worker->fd_destination, &out, (size_t)left, SPLICE_F_MOVE);
+        if (moved <= 0)
+        {
+            if (moved < 0 && errno == EINTR)
+                continue;
+            if (moved == 0)
+                errno = EIO; // the destination takes nothing; retrying would spin
+            // Drop the pipe with what is left in it, so no later call sees that data
+            int saved = errno;
+            close(worker->pipe_fds[0]);
+            close(worker->pipe_fds[1]);
+            worker->pipe_fds[0] = worker->pipe_fds[1] = -1;
+            errno = saved;
+            return -1;
+        }
+        left -= moved;
+    }
+    return filled;
+}
+
+static ssize_t copy_buffer(Worker *worker, off_t offset, size_t length)
+{
+    if (!worker->buffer && !(worker->buffer = malloc(COPY_BUFFER_SIZE)))
+        return -1;
+    if (length > COPY_BUFFER_SIZE)
+        length = COPY_BUFFER_SIZE;
+
+    ssize_t bytesRead = pread(worker->fd_src, worker->buffer, length, offset);
+    if (bytesRead <= 0)
+        return bytesRead;
 
+    ssize_t written = 0;
+    while (written < bytesRead)
+    {
+        ssize_t bytes_written = pwrite(worker->fd_destination, worker->buffer + written,
+                                       (size_t)(bytesRead - written), offset + written);
         if (bytes_written < 0)
         {
             if (errno == EINTR)
                 continue;
             return -1;
         }
-        left -= (size_t)bytes_written;
-        pointer += bytes_written;
+        written += bytes_written;
     }
+    return bytesRead;
+}
 
-    return (ssize_t)count;
+static ssize_t copy_step(Worker *worker, off_t offset, size_t length)
+{
+    switch (worker->strategy)
+    {
+    case STRATEGY_RANGE:
+        return copy_range(worker, offset, length);
+    case STRATEGY_SENDFILE:
+        return copy_sendfile(worker, offset, length);
+    case STRATEGY_SPLICE:
+        return copy_splice(worker, offset, length);
+    default:
+        return copy_buffer(worker, offset, length);
+    }
 }
 
-int main()
+// Copy one extent, stepping down the strategy list when the current one is
+// refused. A forced strategy never falls back.
+static int copy_extent(Worker *worker, const Extent *extent, int fallback)
 {
-    const char *srcFilePath = "records.bin";
-    const char *destFilePath = "copy.bin";
+    off_t offset = extent->offset;
+    off_t end = extent->offset + extent->length;
+
+    while (offset < end)
+    {
+        int strategy = worker->strategy;
+        double start = now_seconds();
+        ssize_t copied = copy_step(worker, offset, (size_t)(end - offset));
+        double elapsed = now_seconds() - start;
+
+        if (copied < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (fallback && unsupported(errno) && worker->strategy < STRATEGY_BUFFER)
+            {
+                worker->strategy++;
+                continue;
+            }
+            return -1;
+        }
+        if (copied == 0)
+            break; // source shrank underneath us
+
+        pthread_mutex_lock(&worker->job->statsLock);
+        worker->job->bytes[strategy] += (uint64_t)copied;
+        worker->job->seconds[strategy] += elapsed;
+        pthread_mutex_unlock(&worker->job->statsLock);
+        offset += copied;
+    }
+    return 0;
+}
+
+static void *worker_main(void *arg)
+{
+    Worker *worker = arg;
+    CopyJob *job = worker->job;
+    int fallback = job->strategy == STRATEGY_AUTO;
+
+    size_t index;
+    while (!atomic_load(&job->failed) && (index = atomic_fetch_add(&job->nextChunk, 1)) < job->chunkCount)
+    {
+        if (copy_extent(worker, &job->chunks[index], fallback) < 0)
+        {
+            perror(strategy_names[worker->strategy]);
+            atomic_store(&job->failed, 1);
+        }
+    }
+    return NULL;
+}
+
+// Data extents of the source cut into chunks of at most COPY_CHUNK_SIZE.
+// Without SEEK_DATA support the whole file is one data extent.
+static int plan_chunks(int fd, off_t size, Extent **chunks, size_t *count)
+{
+    size_t capacity = 16;
+    *count = 0;
+    *chunks = malloc(sizeof(Extent) * capacity);
+    if (!*chunks)
+        return -1;
+
+    off_t offset = 0;
+    while (offset < size)
+    {
+        off_t data = lseek(fd, offset, SEEK_DATA);
+        if (data < 0 && errno == ENXIO)
+            break; // only a hole remains
+        off_t hole = data < 0 ? size : lseek(fd, data, SEEK_HOLE);
+        if (data < 0)
+            data = offset;
+        if (hole < 0)
+            hole = size;
+
+        for (off_t chunk = data; chunk < hole; chunk += (off_t)COPY_CHUNK_SIZE)
+        {
+            if (*count == capacity)
+            {
+                capacity *= 2;
+                Extent *grown = realloc(*chunks, sizeof(Extent) * capacity);
+                if (!grown)
+                {
+                    free(*chunks);
+                    *chunks = NULL;
+                    return -1;
+                }
+                *chunks = grown;
+            }
+            off_t length = hole - chunk < (off_t)COPY_CHUNK_SIZE ? hole - chunk : (off_t)COPY_CHUNK_SIZE;
+            (*chunks)[(*count)++] = (Extent){ chunk, length };
+        }
+        offset = hole;
+    }
+    return 0;
+}
+
+static int open_worker(Worker *worker, CopyJob *job)
+{
+    memset(worker, 0, sizeof(*worker));
+    worker->job = job;
+    worker->strategy = job->strategy == STRATEGY_AUTO ? STRATEGY_RANGE : job->strategy;
+    worker->pipe_fds[0] = worker->pipe_fds[1] = -1;
+    worker->fd_src = open(job->srcPath, O_RDONLY);
+    worker->fd_destination = open(job->destPath, O_WRONLY);
+    if (worker->fd_src < 0 || worker->fd_destination < 0)
+        return -1;
+    return 0;
+}
+
+static void close_worker(Worker *worker)
+{
+    if (worker->fd_src >= 0)
+        close(worker->fd_src);
+    if (worker->fd_destination >= 0)
+        close(worker->fd_destination);
+    if (worker->pipe_fds[0] >= 0)
+    {
+        close(worker->pipe_fds[0]);
+        close(worker->pipe_fds[1]);
+    }
+    free(worker->buffer);
+}
 
-    int fd_src = open(srcFilePath, O_RDONLY, 0644);
+// Copy srcPath to destPath with `strategy` on up to `threads` threads.
+// Per-strategy byte counts and time are left in *job for reporting.
+static int copy_file(const char *srcPath, const char *destPath, int strategy, int threads, CopyJob *job, off_t *fileSize)
+{
+    int fd_src = open(srcPath, O_RDONLY);
 
     if (fd_src < 0)
     {
         perror("open-src");
-        return 1;
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd_src, &st) < 0)
+    {
+        perror("stat-src");
+        close(fd_src);
+        return -1;
     }
 
-    int fd_destination = open(destFilePath, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    int fd_destination = open(destPath, O_CREAT | O_WRONLY | O_TRUNC, st.st_mode & 0777);
 
     if (fd_destination < 0)
     {
         perror("open-dest");
-        return 1;
+        close(fd_src);
+        return -1;
     }
 
-    char buffer[4096];
-    ssize_t bytesRead;
+    // Sizing first leaves every range we do not copy as a hole
+    if (ftruncate(fd_destination, st.st_size) < 0)
+    {
+        perror("ftruncate");
+        close(fd_src);
+        close(fd_destination);
+        return -1;
+    }
+
+    memset(job, 0, sizeof(*job));
+    job->srcPath = srcPath;
+    job->destPath = destPath;
+    job->strategy = strategy;
+    pthread_mutex_init(&job->statsLock, NULL);
 
-    while ((bytesRead = read(fd_src, buffer, sizeof(buffer))) > 0)
+    if (plan_chunks(fd_src, st.st_size, &job->chunks, &job->chunkCount) < 0)
     {
-        if (write_all(fd_destination, buffer, bytesRead) != bytesRead)
+        perror("plan");
+        close(fd_src);
+        close(fd_destination);
+        return -1;
+    }
+    close(fd_src);
+
+    if ((uint64_t)st.st_size < COPY_PARALLEL_THRESHOLD)
+        threads = 1;
+    if ((size_t)threads > job->chunkCount)
+        threads = job->chunkCount ? (int)job->chunkCount : 1;
+
+    Worker workers[COPY_MAX_THREADS];
+    pthread_t tids[COPY_MAX_THREADS];
+    int started = 0;
+    int rc = 0;
+
+    for (; started < threads; started++)
+    {
+        if (open_worker(&workers[started], job) < 0)
         {
-            perror("write");
-            close(fd_src);
-            close(fd_destination);
-            return 1;
+            perror("open-worker");
+            close_worker(&workers[started]);
+            rc = -1;
+            break;
         }
-        if (bytesRead < 0)
+        if (pthread_create(&tids[started], NULL, worker_main, &workers[started]) != 0)
         {
-            perror("read");
+            perror("pthread_create");
+            close_worker(&workers[started]);
+            rc = -1;
+            break;
         }
+    }
+    if (rc < 0)
+        atomic_store(&job->failed, 1);
 
-        close(fd_src);
-        close(fd_destination);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+        close_worker(&workers[i]);
+    }
 
-        printf("File copied from %s → %s\n", srcFilePath, destFilePath);
-        return 0;
+    if (atomic_load(&job->failed))
+        rc = -1;
+    if (rc == 0 && fsync(fd_destination) < 0)
+    {
+        perror("fsync");
+        rc = -1;
     }
-}
\ No newline at end of file
+
+    close(fd_destination);
+    free(job->chunks);
+    pthread_mutex_destroy(&job->statsLock);
+    *fileSize = st.st_size;
+    return rc;
+}
+
+// Bytes the chunks actually moved: the data extents, not the holes between them
+static uint64_t copied_bytes(const CopyJob *job)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < STRATEGY_COUNT; i++)
+        total += job->bytes[i];
+    return total;
+}
+
+static void print_stats(const CopyJob *job)
+{
+    for (int i = 0; i < STRATEGY_COUNT; i++)
+    {
+        if (!job->bytes[i])
+            continue;
+        double mib = job->bytes[i] / (1024.0 * 1024.0);
+        printf("  %-16s %10.1f MiB %10.1f MiB/s per thread\n", strategy_names[i], mib,
+               job->seconds[i] > 0 ? mib / job->seconds[i] : 0);
+    }
+}
+
+// Copy the same source once with each strategy forced, then once with the
+// automatic fallback chain, and report the wall-clock throughput of each
+static int bench(const char *srcPath, const char *destPath, int threads)
+{
+    printf("%-16s %10s %10s %12s %10s\n", "strategy", "MiB", "seconds", "MiB/s", "file MiB");
+
+    for (int strategy = 0; strategy <= STRATEGY_AUTO; strategy++)
+    {
+        CopyJob job;
+        off_t size;
+        double start = now_seconds();
+        int rc = copy_file(srcPath, destPath, strategy, threads, &job, &size);
+        double elapsed = now_seconds() - start;
+
+        const char *name = strategy == STRATEGY_AUTO ? "auto" : strategy_names[strategy];
+        if (rc < 0)
+        {
+            printf("%-16s %10s\n", name, "failed");
+            continue;
+        }
+        double mib = copied_bytes(&job) / (1024.0 * 1024.0);
+        printf("%-16s %10.1f %10.3f %12.1f %10.1f\n", name, mib, elapsed, elapsed > 0 ? mib / elapsed : 0,
+               size / (1024.0 * 1024.0));
+    }
+    return 0;
+}
+
+static int parse_strategy(const char *name)
+{
+    if (strcmp(name, "auto") == 0)
+        return STRATEGY_AUTO;
+    if (strcmp(name, "range") == 0)
+        return STRATEGY_RANGE;
+    if (strcmp(name, "sendfile") == 0)
+        return STRATEGY_SENDFILE;
+    if (strcmp(name, "splice") == 0)
+        return STRATEGY_SPLICE;
+    if (strcmp(name, "buffer") == 0)
+        return STRATEGY_BUFFER;
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *srcFilePath = "records.bin";
+    const char *destFilePath = "copy.bin";
+    int strategy = STRATEGY_AUTO;
+    int benchmark = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus < 1 ? 1 : cpus > COPY_MAX_THREADS ? COPY_MAX_THREADS : (int)cpus;
+    int positional = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--strategy=", 11) == 0)
+        {
+            strategy = parse_strategy(argv[i] + 11);
+            if (strategy < 0)
+            {
+                fprintf(stderr, "unknown strategy %s\n", argv[i] + 11);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            threads = atoi(argv[i] + 10);
+            if (threads < 1 || threads > COPY_MAX_THREADS)
+            {
+                fprintf(stderr, "threads must be 1..%d\n", COPY_MAX_THREADS);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            benchmark = 1;
+        }
+        else if (positional == 0)
+        {
+            srcFilePath = argv[i];
+            positional++;
+        }
+        else if (positional == 1)
+        {
+            destFilePath = argv[i];
+            positional++;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--strategy=auto|range|sendfile|splice|buffer] [--threads=N] [--bench] [src] [dest]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (benchmark)
+        return bench(srcFilePath, destFilePath, threads);
+
+    CopyJob job;
+    off_t size;
+    double start = now_seconds();
+
+    if (copy_file(srcFilePath, destFilePath, strategy, threads, &job, &size) < 0)
+        return 1;
+
+    double elapsed = now_seconds() - start;
+    double mib = copied_bytes(&job) / (1024.0 * 1024.0);
+    printf("File copied from %s → %s: %.1f MiB of data in %.3f s (%.1f MiB/s), file size %.1f MiB\n",
+           srcFilePath, destFilePath, mib, elapsed, elapsed > 0 ? mib / elapsed : 0, size / (1024.0 * 1024.0));
+    print_stats(&job);
+    return 0;
+}
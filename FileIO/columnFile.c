@@ -0,0 +1,441 @@
+#include "columnFile.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define COLUMN_HAVE_AVX2 1
+#endif
+
+static size_t align_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static size_t ids_bytes(uint32_t block_records)
+{
+    return align_up((size_t)block_records * sizeof(uint32_t), COLUMN_ALIGN);
+}
+
+static size_t values_bytes(uint32_t block_records)
+{
+    return align_up((size_t)block_records * sizeof(double), COLUMN_ALIGN);
+}
+
+static size_t block_size(uint32_t block_records)
+{
+    return ids_bytes(block_records) + values_bytes(block_records) + (size_t)block_records * 32;
+}
+
+// Records in `block`: block_records, except in the last block, which is
+// laid out for the records it holds
+static uint32_t block_rows(const column_header_t *header, uint32_t block)
+{
+    if (block + 1 < header->block_count)
+        return header->block_records;
+    return (uint32_t)(header->count - (uint64_t)block * header->block_records);
+}
+
+static char *block_base(const column_file_t *file, uint32_t block)
+{
+    return file->map + file->header->data_offset + (size_t)block * file->header->block_bytes;
+}
+
+const uint32_t *column_ids(const column_file_t *file, uint32_t block)
+{
+    return (const uint32_t *)block_base(file, block);
+}
+
+const double *column_values(const column_file_t *file, uint32_t block)
+{
+    return (const double *)(block_base(file, block) + ids_bytes(block_rows(file->header, block)));
+}
+
+const char (*column_names(const column_file_t *file, uint32_t block))[32]
+{
+    uint32_t records = block_rows(file->header, block);
+    return (const char (*)[32])(block_base(file, block) + ids_bytes(records) + values_bytes(records));
+}
+
+// Rewrite a record file column by column. The source is only read. The
+// output is built in a mapping of its final size and synced before it is
+// renamed into place.
+int column_file_convert(const char *record_path, const char *column_path)
+{
+    record_file_t *source = record_file_open_readonly(record_path);
+    if (!source)
+        return -1;
+
+    uint32_t count = source->count;
+    uint32_t block_count = (count + COLUMN_BLOCK_RECORDS - 1) / COLUMN_BLOCK_RECORDS;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t data_offset = align_up(sizeof(column_header_t) + block_count * sizeof(column_block_stats_t), page);
+    size_t block_bytes = block_size(COLUMN_BLOCK_RECORDS);
+    size_t size = data_offset;
+    if (block_count)
+        size += (size_t)(block_count - 1) * block_bytes +
+                block_size(count - (block_count - 1) * COLUMN_BLOCK_RECORDS);
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", column_path);
+    int fd = open(tmp_path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        record_file_close(source);
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size) < 0)
+        goto fail;
+
+    column_file_t out;
+    out.fd = fd;
+    out.size = size;
+    out.map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (out.map == MAP_FAILED)
+        goto fail;
+
+    column_header_t *header = (column_header_t *)out.map;
+    column_block_stats_t *stats = (column_block_stats_t *)(out.map + sizeof(column_header_t));
+    header->magic = COLUMN_FILE_MAGIC;
+    header->version = COLUMN_FILE_VERSION;
+    header->count = count;
+    header->block_records = COLUMN_BLOCK_RECORDS;
+    header->block_count = block_count;
+    header->block_bytes = block_bytes;
+    header->data_offset = data_offset;
+    out.header = header;
+    out.stats = stats;
+
+    for (uint32_t block = 0; block < block_count; block++)
+    {
+        uint32_t first = block * COLUMN_BLOCK_RECORDS;
+        uint32_t rows = block_rows(header, block);
+        uint32_t *ids = (uint32_t *)column_ids(&out, block);
+        double *values = (double *)column_values(&out, block);
+        char (*names)[32] = (char (*)[32])column_names(&out, block);
+
+        stats[block].min = INFINITY;
+        stats[block].max = -INFINITY;
+        stats[block].count = rows;
+        stats[block].nans = 0;
+        for (uint32_t i = 0; i < rows; i++)
+        {
+            const Record *record = record_file_at(source, first + i);
+            ids[i] = record->id;
+            values[i] = record->value;
+            memcpy(names[i], record->name, sizeof(record->name));
+            if (isnan(values[i]))
+                stats[block].nans++;
+            if (values[i] < stats[block].min)
+                stats[block].min = values[i];
+            if (values[i] > stats[block].max)
+                stats[block].max = values[i];
+        }
+    }
+
+    int rc = msync(out.map, size, MS_SYNC);
+    munmap(out.map, size);
+    if (rc < 0 || close(fd) < 0)
+    {
+        fd = -1;
+        goto fail;
+    }
+    record_file_close(source);
+    return rename(tmp_path, column_path);
+
+fail:
+    {
+        int saved = errno;
+        if (fd >= 0)
+            close(fd);
+        unlink(tmp_path);
+        record_file_close(source);
+        errno = saved;
+        return -1;
+    }
+}
+
+// The header against the file size, and the stats against the header, so
+// that nothing the accessors and the scan compute lands outside the mapping
+static int column_file_valid(const column_file_t *file)
+{
+    const column_header_t *header = file->header;
+    uint64_t records = header->block_records;
+    if (header->magic != COLUMN_FILE_MAGIC || header->version != COLUMN_FILE_VERSION || records == 0 ||
+        header->block_bytes < block_size(header->block_records) ||
+        header->block_bytes % COLUMN_ALIGN || header->data_offset % COLUMN_ALIGN ||
+        header->data_offset > file->size ||
+        header->data_offset < sizeof(column_header_t) + (uint64_t)header->block_count * sizeof(column_block_stats_t) ||
+        header->count > (uint64_t)header->block_count * records ||
+        (header->block_count && header->count <= (uint64_t)(header->block_count - 1) * records))
+        return 0;
+
+    // Every block but the last is full; the last holds the rest
+    if (header->block_count)
+    {
+        uint64_t room = file->size - header->data_offset;
+        uint64_t full = header->block_count - 1;
+        if (full && header->block_bytes > room / full)
+            return 0;
+        if (block_size(block_rows(header, header->block_count - 1)) > room - full * header->block_bytes)
+            return 0;
+    }
+
+    for (uint32_t block = 0; block < header->block_count; block++)
+    {
+        if (file->stats[block].count != block_rows(header, block) ||
+            file->stats[block].nans > file->stats[block].count)
+            return 0;
+    }
+    return 1;
+}
+
+column_file_t *column_file_open(const char *path)
+{
+    column_file_t *file = calloc(1, sizeof(column_file_t));
+    if (!file)
+        return NULL;
+
+    struct stat st;
+    file->fd = open(path, O_RDONLY);
+    if (file->fd < 0 || fstat(file->fd, &st) < 0)
+        goto fail;
+    file->size = (size_t)st.st_size;
+    if (file->size < sizeof(column_header_t))
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    file->map = mmap(NULL, file->size, PROT_READ, MAP_SHARED, file->fd, 0);
+    if (file->map == MAP_FAILED)
+    {
+        file->map = NULL;
+        goto fail;
+    }
+    file->header = (const column_header_t *)file->map;
+    file->stats = (const column_block_stats_t *)(file->map + sizeof(column_header_t));
+
+    if (!column_file_valid(file))
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+    madvise(file->map, file->size, MADV_SEQUENTIAL);
+    return file;
+
+fail:
+    {
+        int saved = errno;
+        if (file->map)
+            munmap(file->map, file->size);
+        if (file->fd >= 0)
+            close(file->fd);
+        free(file);
+        errno = saved;
+        return NULL;
+    }
+}
+
+void column_file_close(column_file_t *file)
+{
+    if (!file)
+        return;
+    munmap(file->map, file->size);
+    close(file->fd);
+    free(file);
+}
+
+static void merge(column_aggregate_t *result, uint64_t count, double sum, double min, double max)
+{
+    result->count += count;
+    result->sum += sum;
+    if (min < result->min)
+        result->min = min;
+    if (max > result->max)
+        result->max = max;
+}
+
+// Scalar kernels: the portable path and the tail of every vector loop
+
+static void aggregate_scalar(const double *values, size_t n, column_aggregate_t *result)
+{
+    double sum = 0, min = INFINITY, max = -INFINITY;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += values[i];
+        min = values[i] < min ? values[i] : min;
+        max = values[i] > max ? values[i] : max;
+    }
+    merge(result, n, sum, min, max);
+}
+
+static void filter_scalar(const double *values, size_t n, double lo, double hi, column_aggregate_t *result)
+{
+    uint64_t count = 0;
+    double sum = 0, min = INFINITY, max = -INFINITY;
+    for (size_t i = 0; i < n; i++)
+    {
+        double v = values[i];
+        if (v >= lo && v <= hi)
+        {
+            count++;
+            sum += v;
+            min = v < min ? v : min;
+            max = v > max ? v : max;
+        }
+    }
+    merge(result, count, sum, min, max);
+}
+
+#ifdef COLUMN_HAVE_AVX2
+__attribute__((target("avx2")))
+static inline double hsum(__m256d v)
+{
+    double lanes[4];
+    _mm256_storeu_pd(lanes, v);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+__attribute__((target("avx2")))
+static inline double hmin(__m256d v)
+{
+    double lanes[4];
+    _mm256_storeu_pd(lanes, v);
+    double a = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+    double b = lanes[2] < lanes[3] ? lanes[2] : lanes[3];
+    return a < b ? a : b;
+}
+
+__attribute__((target("avx2")))
+static inline double hmax(__m256d v)
+{
+    double lanes[4];
+    _mm256_storeu_pd(lanes, v);
+    double a = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    double b = lanes[2] > lanes[3] ? lanes[2] : lanes[3];
+    return a > b ? a : b;
+}
+
+// Two independent accumulators hide the latency of the vector adds
+__attribute__((target("avx2")))
+static void aggregate_avx2(const double *values, size_t n, column_aggregate_t *result)
+{
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d min = _mm256_set1_pd(INFINITY), max = _mm256_set1_pd(-INFINITY);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d a = _mm256_load_pd(values + i);
+        __m256d b = _mm256_load_pd(values + i + 4);
+        sum0 = _mm256_add_pd(sum0, a);
+        sum1 = _mm256_add_pd(sum1, b);
+        min = _mm256_min_pd(min, _mm256_min_pd(a, b));
+        max = _mm256_max_pd(max, _mm256_max_pd(a, b));
+    }
+    merge(result, i, hsum(_mm256_add_pd(sum0, sum1)), hmin(min), hmax(max));
+    aggregate_scalar(values + i, n - i, result);
+}
+
+// Compare to a mask, then use it to zero the sum input, to park rejected
+// lanes at +/-inf for min/max, and to count matches
+__attribute__((target("avx2,popcnt")))
+static void filter_avx2(const double *values, size_t n, double lo, double hi, column_aggregate_t *result)
+{
+    const __m256d low = _mm256_set1_pd(lo), high = _mm256_set1_pd(hi);
+    const __m256d pos_inf = _mm256_set1_pd(INFINITY), neg_inf = _mm256_set1_pd(-INFINITY);
+    __m256d sum = _mm256_setzero_pd(), min = pos_inf, max = neg_inf;
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d v = _mm256_load_pd(values + i);
+        __m256d mask = _mm256_and_pd(_mm256_cmp_pd(v, low, _CMP_GE_OQ), _mm256_cmp_pd(v, high, _CMP_LE_OQ));
+        sum = _mm256_add_pd(sum, _mm256_and_pd(mask, v));
+        min = _mm256_min_pd(min, _mm256_blendv_pd(pos_inf, v, mask));
+        max = _mm256_max_pd(max, _mm256_blendv_pd(neg_inf, v, mask));
+        count += (uint64_t)__builtin_popcount((unsigned)_mm256_movemask_pd(mask));
+    }
+    merge(result, count, hsum(sum), hmin(min), hmax(max));
+    filter_scalar(values + i, n - i, lo, hi, result);
+}
+#endif
+
+static int use_avx2(void)
+{
+#ifdef COLUMN_HAVE_AVX2
+    static int supported = -1;
+    if (supported < 0)
+        supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    return supported;
+#else
+    return 0;
+#endif
+}
+
+static void aggregate_values(const double *values, size_t n, column_aggregate_t *result)
+{
+#ifdef COLUMN_HAVE_AVX2
+    if (use_avx2())
+    {
+        aggregate_avx2(values, n, result);
+        return;
+    }
+#endif
+    aggregate_scalar(values, n, result);
+}
+
+static void filter_values(const double *values, size_t n, double lo, double hi, column_aggregate_t *result)
+{
+#ifdef COLUMN_HAVE_AVX2
+    if (use_avx2())
+    {
+        filter_avx2(values, n, lo, hi, result);
+        return;
+    }
+#endif
+    filter_scalar(values, n, lo, hi, result);
+}
+
+// Per block: skip it when its min/max lie outside [lo, hi], aggregate it
+// without compares when they lie inside and it has no NaNs, filter it
+// otherwise
+void column_scan(const column_file_t *file, double lo, double hi, column_aggregate_t *result)
+{
+    result->count = 0;
+    result->sum = 0;
+    result->min = INFINITY;
+    result->max = -INFINITY;
+
+    for (uint32_t block = 0; block < file->header->block_count; block++)
+    {
+        const column_block_stats_t *stats = &file->stats[block];
+        if (stats->count == 0 || stats->max < lo || stats->min > hi)
+            continue;
+        if (stats->nans == 0 && stats->min >= lo && stats->max <= hi)
+            aggregate_values(column_values(file, block), stats->count, result);
+        else
+            filter_values(column_values(file, block), stats->count, lo, hi, result);
+    }
+}
+
+void record_scan(const Record *records, size_t n, double lo, double hi, column_aggregate_t *result)
+{
+    uint64_t count = 0;
+    double sum = 0, min = INFINITY, max = -INFINITY;
+    for (size_t i = 0; i < n; i++)
+    {
+        double v = records[i].value;
+        if (v >= lo && v <= hi)
+        {
+            count++;
+            sum += v;
+            min = v < min ? v : min;
+            max = v > max ? v : max;
+        }
+    }
+    result->count = count;
+    result->sum = sum;
+    result->min = min;
+    result->max = max;
+}
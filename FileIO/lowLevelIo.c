@@ -1,20 +1,19 @@
-#include<stdio.h>
-#include<stdlib.h>
-#include<stdint.h>
-#include<string.h>
-#include<stddef.h>
-#include<fcntl.h>
-#include<unistd.h>
-#include<sys/stat.h>
-#include<errno.h>
-
-#pragma pack(push,1)
-typedef struct {
-    uint32_t id;
-    double value;
-    char name[32];
-}Record;
-#pragma pack(pop)
+// Build: gcc -O2 -pthread -o lowLevelIo lowLevelIo.c recordFile.c recordBatch.c columnFile.c pageCache.c
+//
+// lowLevelIo                  write, read and patch three records with one syscall each
+// lowLevelIo bench [n]        the same work on n records (default 10M) through
+//                             syscalls per record and through the mapped record file
+// lowLevelIo bench-batch [n]  scattered reads over n records (default 1M): read loop,
+//                             preadv batches and io_uring
+// lowLevelIo bench-scan [n]   aggregate scans over n records (default 10M), rows vs columns
+// lowLevelIo bench-update [n] [updates]  random one-byte patches, fsync each vs page cache
+// lowLevelIo convert <records> <columns>  rewrite a record file in the columnar layout
+
+#include "recordFile.h"
+#include "recordBatch.h"
+#include "columnFile.h"
+#include "pageCache.h"
+#include<time.h>
 
 static ssize_t read_all(int fd, void *buffer, size_t count)
 {
@@ -64,8 +63,627 @@ static ssize_t write_all(int fd, const void *buffer, size_t count)
     return (ssize_t)count;
 }
 
-int main()
+#define BENCH_DEFAULT_RECORDS 10000000u
+#define BENCH_BATCH 4096
+#define BENCH_RANDOM_READS 1000000u
+#define BENCH_UPDATES 1000u
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_record(Record *record, uint32_t index)
+{
+    memset(record, 0, sizeof(*record));
+    record->id = index;
+    record->value = index * 0.5;
+    snprintf(record->name, sizeof(record->name), "rec%u", index);
+}
+
+static uint32_t bench_index(uint64_t i, uint32_t n)
+{
+    uint64_t x = i * 0x9E3779B97F4A7C15ull;
+    x ^= x >> 29;
+    return (uint32_t)(x % n);
+}
+
+static void report(const char *phase, double syscall_seconds, double mapped_seconds)
+{
+    printf("%-22s %12.3f %12.3f %9.1fx\n", phase, syscall_seconds, mapped_seconds,
+           mapped_seconds > 0 ? syscall_seconds / mapped_seconds : 0);
+}
+
+// The original path: one write, read or lseek+write per record, fsync to commit
+static int bench_syscalls(const char *fpath, uint32_t n, double seconds[4], double *checksum)
 {
+    Record record;
+    int fd = open(fpath, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        perror("open");
+        return -1;
+    }
+
+    double start = now_seconds();
+    if(write_all(fd, &n, sizeof(n)) != (ssize_t)sizeof(n))
+        goto fail;
+    for (uint32_t iterator = 0; iterator < n; ++iterator)
+    {
+        make_record(&record, iterator);
+        if(write_all(fd, &record, sizeof(Record)) != (ssize_t)sizeof(Record))
+            goto fail;
+    }
+    if(fsync(fd) != 0)
+        goto fail;
+    seconds[0] = now_seconds() - start;
+
+    start = now_seconds();
+    if(lseek(fd, sizeof(n), SEEK_SET) == (off_t)-1)
+        goto fail;
+    for (uint32_t iterator = 0; iterator < n; ++iterator)
+    {
+        if(read_all(fd, &record, sizeof(record)) != (ssize_t)sizeof(record))
+            goto fail;
+        *checksum += record.value;
+    }
+    seconds[1] = now_seconds() - start;
+
+    start = now_seconds();
+    for (uint32_t iterator = 0; iterator < BENCH_RANDOM_READS; ++iterator)
+    {
+        off_t offset = (off_t)sizeof(n) + (off_t)bench_index(iterator, n) * (off_t)sizeof(Record);
+        if(lseek(fd, offset, SEEK_SET) == (off_t)-1 || read_all(fd, &record, sizeof(record)) != (ssize_t)sizeof(record))
+            goto fail;
+        *checksum += record.value;
+    }
+    seconds[2] = now_seconds() - start;
+
+    start = now_seconds();
+    for (uint32_t iterator = 0; iterator < BENCH_UPDATES; ++iterator)
+    {
+        off_t offset = (off_t)sizeof(n) + (off_t)bench_index(iterator + n, n) * (off_t)sizeof(Record) + (off_t)offsetof(Record, name);
+        char new_character = 'X';
+        if(lseek(fd, offset, SEEK_SET) == (off_t)-1 || write_all(fd, &new_character, 1) != 1 || fsync(fd) != 0)
+            goto fail;
+    }
+    seconds[3] = now_seconds() - start;
+
+    close(fd);
+    return 0;
+
+fail:
+    perror("syscall path");
+    close(fd);
+    return -1;
+}
+
+// The mapped path: bulk appends, direct addressing, range-limited msync per update
+static int bench_mapped(const char *fpath, uint32_t n, double seconds[4], double *checksum)
+{
+    Record *batch = malloc(sizeof(Record) * BENCH_BATCH);
+    record_file_t *file = record_file_open(fpath, 1);
+    if (!file || !batch)
+    {
+        perror("open record file");
+        free(batch);
+        return -1;
+    }
+
+    double start = now_seconds();
+    for (uint32_t done = 0; done < n;)
+    {
+        uint32_t count = n - done < BENCH_BATCH ? n - done : BENCH_BATCH;
+        for (uint32_t iterator = 0; iterator < count; ++iterator)
+            make_record(&batch[iterator], done + iterator);
+        if (record_file_append(file, batch, count) < 0)
+            goto fail;
+        done += count;
+    }
+    if (record_file_sync(file) < 0)
+        goto fail;
+    seconds[0] = now_seconds() - start;
+
+    start = now_seconds();
+    for (uint32_t iterator = 0; iterator < n; ++iterator)
+        *checksum += record_file_at(file, iterator)->value;
+    seconds[1] = now_seconds() - start;
+
+    start = now_seconds();
+    for (uint32_t iterator = 0; iterator < BENCH_RANDOM_READS; ++iterator)
+        *checksum += record_file_at(file, bench_index(iterator, n))->value;
+    seconds[2] = now_seconds() - start;
+
+    start = now_seconds();
+    for (uint32_t iterator = 0; iterator < BENCH_UPDATES; ++iterator)
+    {
+        uint32_t index = bench_index(iterator + n, n);
+        record_file_at(file, index)->name[0] = 'X';
+        if (record_file_sync_range(file, index, 1) < 0)
+            goto fail;
+    }
+    seconds[3] = now_seconds() - start;
+
+    free(batch);
+    return record_file_close(file);
+
+fail:
+    perror("mapped path");
+    record_file_close(file);
+    free(batch);
+    return -1;
+}
+
+static int run_benchmark(uint32_t n)
+{
+    double syscall_seconds[4], mapped_seconds[4];
+    double syscall_checksum = 0, mapped_checksum = 0;
+
+    if (n == 0)
+        n = BENCH_DEFAULT_RECORDS;
+    printf("%u records of %zu bytes\n", n, sizeof(Record));
+    if (bench_syscalls("bench_syscall.bin", n, syscall_seconds, &syscall_checksum) < 0 ||
+        bench_mapped("bench_mapped.bin", n, mapped_seconds, &mapped_checksum) < 0)
+        return 1;
+    if (syscall_checksum != mapped_checksum)
+    {
+        fprintf(stderr, "checksums differ: %f vs %f\n", syscall_checksum, mapped_checksum);
+        return 1;
+    }
+
+    printf("%-22s %12s %12s %10s\n", "seconds", "syscall", "mapped", "speedup");
+    report("bulk write + sync", syscall_seconds[0], mapped_seconds[0]);
+    report("sequential read", syscall_seconds[1], mapped_seconds[1]);
+    report("1M random reads", syscall_seconds[2], mapped_seconds[2]);
+    report("1000 durable updates", syscall_seconds[3], mapped_seconds[3]);
+
+    unlink("bench_syscall.bin");
+    unlink("bench_mapped.bin");
+    return 0;
+}
+
+#define BATCH_BENCH_RECORDS 1000000u
+#define BATCH_BENCH_SIZE 256            // record indices per request
+#define BATCH_BENCH_REQUESTS 1000
+
+typedef struct {
+    uint64_t checked;
+    uint64_t wrong;
+} BatchCheck;
+
+static void check_record(record_io_t *io, int error, void *arg)
+{
+    BatchCheck *check = arg;
+    check->checked++;
+    if (error || io->buffer->id != io->index)
+        check->wrong++;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double left = *(const double *)a, right = *(const double *)b;
+    return (left > right) - (left < right);
+}
+
+static void report_batch(const char *method, double *latency, double elapsed, const BatchCheck *check)
+{
+    qsort(latency, BATCH_BENCH_REQUESTS, sizeof(double), compare_doubles);
+    printf("%-18s %12.0f %10.1f %10.1f %10.1f %8llu\n", method,
+           check->checked / elapsed, latency[BATCH_BENCH_REQUESTS / 2],
+           latency[BATCH_BENCH_REQUESTS * 99 / 100], latency[BATCH_BENCH_REQUESTS - 1],
+           (unsigned long long)check->wrong);
+}
+
+// Random-read requests of BATCH_BENCH_SIZE scattered records each, served by
+// lseek + read_all per record, by the preadv batch API and by io_uring at
+// several queue depths. Latency is per request, IOPS per record.
+static int run_batch_benchmark(uint32_t n)
+{
+    const char *fpath = "bench_batch.bin";
+    static const unsigned depths[] = { 1, 8, 32, 128 };
+    record_io_t ios[BATCH_BENCH_SIZE];
+    Record *buffers = malloc(sizeof(Record) * BATCH_BENCH_SIZE);
+    double *latency = malloc(sizeof(double) * BATCH_BENCH_REQUESTS);
+    Record *chunk = malloc(sizeof(Record) * BENCH_BATCH);
+    if (!buffers || !latency || !chunk)
+    {
+        perror("malloc");
+        return 1;
+    }
+    if (n == 0)
+        n = BATCH_BENCH_RECORDS;
+
+    record_file_t *file = record_file_open(fpath, 1);
+    if (!file)
+    {
+        perror("open record file");
+        return 1;
+    }
+    for (uint32_t done = 0; done < n;)
+    {
+        uint32_t count = n - done < BENCH_BATCH ? n - done : BENCH_BATCH;
+        for (uint32_t iterator = 0; iterator < count; ++iterator)
+            make_record(&chunk[iterator], done + iterator);
+        if (record_file_append(file, chunk, count) < 0)
+        {
+            perror("append");
+            return 1;
+        }
+        done += count;
+    }
+    if (record_file_close(file) < 0)
+    {
+        perror("close record file");
+        return 1;
+    }
+
+    int fd = open(fpath, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+
+    printf("%u records, %d requests of %d random records\n", n, BATCH_BENCH_REQUESTS, BATCH_BENCH_SIZE);
+    printf("%-18s %12s %10s %10s %10s %8s\n", "method", "records/s", "p50 us", "p99 us", "max us", "wrong");
+
+    BatchCheck check = { 0, 0 };
+    double start = now_seconds();
+    for (int request = 0; request < BATCH_BENCH_REQUESTS; request++)
+    {
+        double begin = now_seconds();
+        for (int i = 0; i < BATCH_BENCH_SIZE; i++)
+        {
+            uint32_t index = bench_index((uint64_t)request * BATCH_BENCH_SIZE + (uint64_t)i, n);
+            record_io_t io = { index, &buffers[i] };
+            off_t offset = (off_t)sizeof(uint32_t) + (off_t)index * (off_t)sizeof(Record);
+            int error = 0;
+            if (lseek(fd, offset, SEEK_SET) == (off_t)-1 || read_all(fd, &buffers[i], sizeof(Record)) != (ssize_t)sizeof(Record))
+                error = errno ? errno : EIO;
+            check_record(&io, error, &check);
+        }
+        latency[request] = (now_seconds() - begin) * 1e6;
+    }
+    report_batch("read loop", latency, now_seconds() - start, &check);
+
+    for (int method = -1; method < (int)(sizeof(depths) / sizeof(depths[0])); method++)
+    {
+        record_ring_t *ring = NULL;
+        char name[32];
+        if (method < 0)
+            snprintf(name, sizeof(name), "preadv batch");
+        else
+        {
+            ring = record_ring_open(depths[method]);
+            if (!ring)
+            {
+                perror("io_uring");
+                break;
+            }
+            snprintf(name, sizeof(name), "io_uring depth %u", depths[method]);
+        }
+
+        memset(&check, 0, sizeof(check));
+        start = now_seconds();
+        for (int request = 0; request < BATCH_BENCH_REQUESTS; request++)
+        {
+            for (int i = 0; i < BATCH_BENCH_SIZE; i++)
+            {
+                ios[i].index = bench_index((uint64_t)request * BATCH_BENCH_SIZE + (uint64_t)i, n);
+                ios[i].buffer = &buffers[i];
+            }
+            double begin = now_seconds();
+            int failed = ring ? record_ring_read(ring, fd, ios, BATCH_BENCH_SIZE, check_record, &check)
+                              : record_read_batch(fd, ios, BATCH_BENCH_SIZE, check_record, &check);
+            latency[request] = (now_seconds() - begin) * 1e6;
+            if (failed < 0)
+            {
+                perror(name);
+                return 1;
+            }
+        }
+        report_batch(name, latency, now_seconds() - start, &check);
+        record_ring_close(ring);
+    }
+
+    close(fd);
+    unlink(fpath);
+    free(chunk);
+    free(latency);
+    free(buffers);
+    return 0;
+}
+
+#define SCAN_BENCH_REPEATS 5
+
+typedef struct {
+    const char *name;
+    double lo;
+    double hi;
+} ScanQuery;
+
+// Best of SCAN_BENCH_REPEATS; GB/s counts the bytes each layout has to read
+static double time_scan(const Record *rows, uint32_t n, const column_file_t *columns,
+                        const ScanQuery *query, column_aggregate_t *result)
+{
+    double best = 0;
+    for (int repeat = 0; repeat < SCAN_BENCH_REPEATS; repeat++)
+    {
+        double start = now_seconds();
+        if (columns)
+            column_scan(columns, query->lo, query->hi, result);
+        else
+            record_scan(rows, n, query->lo, query->hi, result);
+        double elapsed = now_seconds() - start;
+        if (repeat == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+// Aggregate `value` over n records in the packed row file and in its
+// columnar conversion. Values are spread pseudo-randomly over [0, 10000),
+// so the block min/max cannot prune and the vector kernels do the work.
+static int run_scan_benchmark(uint32_t n)
+{
+    const char *row_path = "bench_rows.bin";
+    const char *column_path = "bench_columns.col";
+    static const ScanQuery queries[] = {
+        { "sum/min/max/count", -INFINITY, INFINITY },
+        { "value in [0, 1000)", 0, 999.99 },
+        { "value in [0, 5000)", 0, 4999.99 },
+    };
+    Record *chunk = malloc(sizeof(Record) * BENCH_BATCH);
+    if (!chunk)
+    {
+        perror("malloc");
+        return 1;
+    }
+    if (n == 0)
+        n = BENCH_DEFAULT_RECORDS;
+
+    record_file_t *rows = record_file_open(row_path, 1);
+    if (!rows)
+    {
+        perror("open record file");
+        return 1;
+    }
+    for (uint32_t done = 0; done < n;)
+    {
+        uint32_t count = n - done < BENCH_BATCH ? n - done : BENCH_BATCH;
+        for (uint32_t iterator = 0; iterator < count; ++iterator)
+        {
+            make_record(&chunk[iterator], done + iterator);
+            chunk[iterator].value = bench_index(done + iterator, 1000000) / 100.0;
+        }
+        if (record_file_append(rows, chunk, count) < 0)
+        {
+            perror("append");
+            return 1;
+        }
+        done += count;
+    }
+    if (record_file_sync(rows) < 0)
+    {
+        perror("sync");
+        return 1;
+    }
+
+    double start = now_seconds();
+    if (column_file_convert(row_path, column_path) < 0)
+    {
+        perror("convert");
+        return 1;
+    }
+    printf("%u records, converted in %.3f s\n", n, now_seconds() - start);
+
+    column_file_t *columns = column_file_open(column_path);
+    if (!columns)
+    {
+        perror("open column file");
+        return 1;
+    }
+
+    printf("%-20s %-8s %10s %10s %12s %12s\n", "query", "layout", "matches", "ms", "GB/s", "Mrows/s");
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++)
+    {
+        column_aggregate_t row_result, column_result;
+        double row_seconds = time_scan(record_file_at(rows, 0), n, NULL, &queries[q], &row_result);
+        double column_seconds = time_scan(NULL, n, columns, &queries[q], &column_result);
+
+        printf("%-20s %-8s %10llu %10.2f %12.2f %12.1f\n", queries[q].name, "rows",
+               (unsigned long long)row_result.count, row_seconds * 1e3,
+               (double)n * sizeof(Record) / row_seconds / 1e9, n / row_seconds / 1e6);
+        printf("%-20s %-8s %10llu %10.2f %12.2f %12.1f\n", "", "columns",
+               (unsigned long long)column_result.count, column_seconds * 1e3,
+               (double)n * sizeof(double) / column_seconds / 1e9, n / column_seconds / 1e6);
+
+        if (row_result.count != column_result.count || row_result.min != column_result.min ||
+            row_result.max != column_result.max ||
+            fabs(row_result.sum - column_result.sum) > 1e-9 * fabs(row_result.sum))
+        {
+            fprintf(stderr, "layouts disagree on %s\n", queries[q].name);
+            return 1;
+        }
+    }
+
+    column_file_close(columns);
+    record_file_close(rows);
+    unlink(row_path);
+    unlink(column_path);
+    free(chunk);
+    return 0;
+}
+
+#define UPDATE_BENCH_RECORDS 1000000u
+#define UPDATE_BENCH_UPDATES 20000u
+#define UPDATE_BENCH_CACHE_PAGES 4096   // 16 MB, smaller than the file so pages are evicted
+
+static off_t update_offset(uint32_t update, uint32_t n)
+{
+    return (off_t)sizeof(uint32_t) + (off_t)bench_index(update, n) * (off_t)sizeof(Record) +
+           (off_t)offsetof(Record, name) + (off_t)(update % 16);
+}
+
+static int create_update_file(const char *fpath, uint32_t n)
+{
+    Record *chunk = malloc(sizeof(Record) * BENCH_BATCH);
+    record_file_t *file = record_file_open(fpath, 1);
+    if (!chunk || !file)
+    {
+        free(chunk);
+        return -1;
+    }
+    for (uint32_t done = 0; done < n;)
+    {
+        uint32_t count = n - done < BENCH_BATCH ? n - done : BENCH_BATCH;
+        for (uint32_t iterator = 0; iterator < count; ++iterator)
+            make_record(&chunk[iterator], done + iterator);
+        if (record_file_append(file, chunk, count) < 0)
+        {
+            free(chunk);
+            record_file_close(file);
+            return -1;
+        }
+        done += count;
+    }
+    free(chunk);
+    return record_file_close(file);
+}
+
+// Random one-byte patches to record names: the lseek + write_all + fsync flow
+// against the page cache with a barrier every 1, 16, 256 updates and only at
+// the end. Every run applies the same patches, so the files must match after.
+static int run_update_benchmark(uint32_t n, uint32_t updates)
+{
+    const char *direct_path = "bench_update_direct.bin";
+    const char *cached_path = "bench_update_cached.bin";
+    static const uint32_t barrier_every[] = { 1, 16, 256, 0 };
+
+    if (n == 0)
+        n = UPDATE_BENCH_RECORDS;
+    if (updates == 0)
+        updates = UPDATE_BENCH_UPDATES;
+    if (create_update_file(direct_path, n) < 0 || create_update_file(cached_path, n) < 0)
+    {
+        perror("create");
+        return 1;
+    }
+
+    printf("%u records, %u one-byte updates, cache of %u pages\n", n, updates, UPDATE_BENCH_CACHE_PAGES);
+    printf("%-22s %12s %10s %12s %10s\n", "path", "updates/s", "barriers", "pages out", "pwritevs");
+
+    int fd = open(direct_path, O_RDWR);
+    if (fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    double start = now_seconds();
+    for (uint32_t update = 0; update < updates; update++)
+    {
+        char new_character = (char)('A' + update % 26);
+        if(lseek(fd, update_offset(update, n), SEEK_SET) == (off_t)-1 ||
+           write_all(fd, &new_character, 1) != 1 || fsync(fd) != 0)
+        {
+            perror("uncached update");
+            return 1;
+        }
+    }
+    double elapsed = now_seconds() - start;
+    printf("%-22s %12.0f %10u %12s %10s\n", "lseek+write+fsync", updates / elapsed, updates, "-", "-");
+    close(fd);
+
+    for (size_t b = 0; b < sizeof(barrier_every) / sizeof(barrier_every[0]); b++)
+    {
+        page_cache_t *cache = page_cache_open(cached_path, UPDATE_BENCH_CACHE_PAGES);
+        if (!cache)
+        {
+            perror("page cache");
+            return 1;
+        }
+
+        start = now_seconds();
+        for (uint32_t update = 0; update < updates; update++)
+        {
+            char new_character = (char)('A' + update % 26);
+            if (page_cache_write(cache, update_offset(update, n), &new_character, 1) < 0 ||
+                (barrier_every[b] && (update + 1) % barrier_every[b] == 0 && page_cache_barrier(cache) < 0))
+            {
+                perror("cached update");
+                return 1;
+            }
+        }
+        if (page_cache_barrier(cache) < 0)
+        {
+            perror("barrier");
+            return 1;
+        }
+        elapsed = now_seconds() - start;
+
+        char name[32];
+        if (barrier_every[b])
+            snprintf(name, sizeof(name), "cache, barrier/%u", barrier_every[b]);
+        else
+            snprintf(name, sizeof(name), "cache, barrier at end");
+        printf("%-22s %12.0f %10llu %12llu %10llu\n", name, updates / elapsed,
+               (unsigned long long)cache->barriers, (unsigned long long)cache->pages_written,
+               (unsigned long long)cache->write_calls);
+        if (page_cache_close(cache) < 0)
+        {
+            perror("close cache");
+            return 1;
+        }
+    }
+
+    // Same patches in the same order: the two files must be identical
+    int fd_a = open(direct_path, O_RDONLY), fd_b = open(cached_path, O_RDONLY);
+    char block_a[65536], block_b[65536];
+    ssize_t got_a, got_b;
+    int same = fd_a >= 0 && fd_b >= 0;
+    while (same && (got_a = read_all(fd_a, block_a, sizeof(block_a))) > 0)
+    {
+        got_b = read_all(fd_b, block_b, sizeof(block_b));
+        same = got_a == got_b && memcmp(block_a, block_b, (size_t)got_a) == 0;
+    }
+    if (same && read_all(fd_b, block_b, 1) != 0)
+        same = 0;
+    close(fd_a);
+    close(fd_b);
+    unlink(direct_path);
+    unlink(cached_path);
+    if (!same)
+    {
+        fprintf(stderr, "cached file differs from the uncached one\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return run_benchmark(argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 0);
+    if (argc > 1 && strcmp(argv[1], "bench-batch") == 0)
+        return run_batch_benchmark(argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 0);
+    if (argc > 1 && strcmp(argv[1], "bench-update") == 0)
+        return run_update_benchmark(argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 0,
+                                    argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 10) : 0);
+    if (argc > 1 && strcmp(argv[1], "bench-scan") == 0)
+        return run_scan_benchmark(argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 0);
+    if (argc == 4 && strcmp(argv[1], "convert") == 0)
+    {
+        if (column_file_convert(argv[2], argv[3]) < 0)
+        {
+            perror("convert");
+            return 1;
+        }
+        printf("Converted %s → %s\n", argv[2], argv[3]);
+        return 0;
+    }
+
     const char *fpath = "records.bin";
 
     Record records[3] = {
@@ -104,7 +722,7 @@ int main()
     }
 
     //WAL like durable updation
-    if (_commit(fd) != 0)
+    if (fsync(fd) != 0)
     {
         perror("fsync");
         close(fd);
@@ -176,7 +794,7 @@ int main()
         return 1;
     }
 
-    if(_commit(fd_rw) != 0)
+    if(fsync(fd_rw) != 0)
     {
         perror("fsync after modify");
         close(fd_rw);
@@ -0,0 +1,344 @@
+#include "pageCache.h"
+
+#define NO_FRAME (-1)
+
+static size_t bucket_of(const page_cache_t *cache, uint64_t page)
+{
+    return (size_t)((page * 0x9E3779B97F4A7C15ull) >> 32) & cache->bucket_mask;
+}
+
+static int32_t lookup(const page_cache_t *cache, uint64_t page)
+{
+    for (int32_t i = cache->buckets[bucket_of(cache, page)]; i != NO_FRAME; i = cache->frames[i].next)
+    {
+        if (cache->frames[i].page == page)
+            return i;
+    }
+    return NO_FRAME;
+}
+
+static void unlink_frame(page_cache_t *cache, int32_t index)
+{
+    int32_t *link = &cache->buckets[bucket_of(cache, cache->frames[index].page)];
+    while (*link != index)
+        link = &cache->frames[*link].next;
+    *link = cache->frames[index].next;
+}
+
+page_cache_t *page_cache_open(const char *path, size_t capacity_pages)
+{
+    if (capacity_pages == 0 || capacity_pages > INT32_MAX)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    page_cache_t *cache = calloc(1, sizeof(page_cache_t));
+    if (!cache)
+        return NULL;
+
+    size_t buckets = 1;
+    while (buckets < capacity_pages * 2)
+        buckets <<= 1;
+
+    struct stat st;
+    cache->fd = open(path, O_CREAT | O_RDWR, 0644);
+    cache->frames = calloc(capacity_pages, sizeof(page_frame_t));
+    cache->buckets = malloc(buckets * sizeof(int32_t));
+    if (cache->fd < 0 || !cache->frames || !cache->buckets ||
+        posix_memalign((void **)&cache->memory, PAGE_CACHE_PAGE, capacity_pages * PAGE_CACHE_PAGE) != 0 ||
+        fstat(cache->fd, &st) < 0)
+    {
+        int saved = errno;
+        if (cache->fd >= 0)
+            close(cache->fd);
+        free(cache->memory);
+        free(cache->frames);
+        free(cache->buckets);
+        free(cache);
+        errno = saved ? saved : ENOMEM;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < buckets; i++)
+        cache->buckets[i] = NO_FRAME;
+    for (size_t i = 0; i < capacity_pages; i++)
+    {
+        cache->frames[i].page = UINT64_MAX;
+        cache->frames[i].next = NO_FRAME;
+        cache->frames[i].data = cache->memory + i * PAGE_CACHE_PAGE;
+    }
+    cache->capacity = capacity_pages;
+    cache->bucket_mask = buckets - 1;
+    cache->dirty_limit = capacity_pages / 2 ? capacity_pages / 2 : 1;
+    cache->size = st.st_size;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static int compare_pages(const void *a, const void *b)
+{
+    uint64_t left = (*(page_frame_t *const *)a)->page;
+    uint64_t right = (*(page_frame_t *const *)b)->page;
+    return (left > right) - (left < right);
+}
+
+static int write_run(page_cache_t *cache, page_frame_t **run, size_t count)
+{
+    struct iovec iov[PAGE_CACHE_MAX_RUN];
+    off_t offset = (off_t)(run[0]->page * PAGE_CACHE_PAGE);
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // The last page stops at the file size, so the file does not grow to a page multiple
+        off_t start = (off_t)(run[i]->page * PAGE_CACHE_PAGE);
+        size_t length = cache->size - start < (off_t)PAGE_CACHE_PAGE ? (size_t)(cache->size - start) : PAGE_CACHE_PAGE;
+        iov[i].iov_base = run[i]->data;
+        iov[i].iov_len = length;
+        bytes += length;
+    }
+
+    struct iovec *next = iov;
+    int left = (int)count;
+    while (bytes > 0)
+    {
+        ssize_t written = pwritev(cache->fd, next, left, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        cache->write_calls++;
+        offset += written;
+        bytes -= (size_t)written;
+        while (left > 0 && (size_t)written >= next->iov_len)
+        {
+            written -= (ssize_t)next->iov_len;
+            next++;
+            left--;
+        }
+        if (left > 0)
+        {
+            next->iov_base = (char *)next->iov_base + written;
+            next->iov_len -= (size_t)written;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+        run[i]->dirty = 0;
+    cache->dirty_count -= count;
+    cache->pages_written += count;
+    return 0;
+}
+
+// Write every dirty page in page order, adjacent pages in one pwritev
+static int flush_locked(page_cache_t *cache)
+{
+    if (cache->dirty_count == 0)
+        return 0;
+
+    page_frame_t **dirty = malloc(cache->dirty_count * sizeof(page_frame_t *));
+    if (!dirty)
+        return -1;
+    size_t count = 0;
+    for (size_t i = 0; i < cache->capacity; i++)
+    {
+        if (cache->frames[i].dirty)
+            dirty[count++] = &cache->frames[i];
+    }
+    qsort(dirty, count, sizeof(page_frame_t *), compare_pages);
+
+    int rc = 0;
+    for (size_t start = 0; start < count && rc == 0;)
+    {
+        size_t end = start + 1;
+        while (end < count && end - start < PAGE_CACHE_MAX_RUN && dirty[end]->page == dirty[end - 1]->page + 1)
+            end++;
+        rc = write_run(cache, dirty + start, end - start);
+        start = end;
+    }
+    free(dirty);
+    return rc;
+}
+
+// CLOCK: clear reference bits until an unreferenced frame comes round. A
+// dirty victim triggers a grouped flush of all dirty pages rather than a
+// single-page write.
+static int32_t evict(page_cache_t *cache)
+{
+    for (;;)
+    {
+        page_frame_t *frame = &cache->frames[cache->clock_hand];
+        int32_t index = (int32_t)cache->clock_hand;
+        cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+
+        if (frame->page == UINT64_MAX)
+            return index;
+        if (frame->referenced)
+        {
+            frame->referenced = 0;
+            continue;
+        }
+        if (frame->dirty && flush_locked(cache) < 0)
+            return NO_FRAME;
+        unlink_frame(cache, index);
+        frame->page = UINT64_MAX;
+        cache->evictions++;
+        return index;
+    }
+}
+
+// Frame holding `page`, read in from the file unless the caller is about
+// to overwrite all of it
+static page_frame_t *get_page(page_cache_t *cache, uint64_t page, int overwrite)
+{
+    int32_t index = lookup(cache, page);
+    if (index != NO_FRAME)
+    {
+        cache->hits++;
+        cache->frames[index].referenced = 1;
+        return &cache->frames[index];
+    }
+
+    cache->misses++;
+    index = evict(cache);
+    if (index == NO_FRAME)
+        return NULL;
+    page_frame_t *frame = &cache->frames[index];
+
+    size_t filled = 0;
+    off_t offset = (off_t)(page * PAGE_CACHE_PAGE);
+    while (!overwrite && filled < PAGE_CACHE_PAGE && offset + (off_t)filled < cache->size)
+    {
+        ssize_t got = pread(cache->fd, frame->data + filled, PAGE_CACHE_PAGE - filled, offset + (off_t)filled);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return NULL;
+        }
+        if (got == 0)
+            break;
+        filled += (size_t)got;
+    }
+    memset(frame->data + filled, 0, PAGE_CACHE_PAGE - filled);
+
+    size_t bucket = bucket_of(cache, page);
+    frame->page = page;
+    frame->dirty = 0;
+    frame->referenced = 1;
+    frame->next = cache->buckets[bucket];
+    cache->buckets[bucket] = index;
+    return frame;
+}
+
+int page_cache_read(page_cache_t *cache, off_t offset, void *buffer, size_t length)
+{
+    char *out = buffer;
+    pthread_mutex_lock(&cache->lock);
+    if (offset < 0 || offset + (off_t)length > cache->size)
+    {
+        pthread_mutex_unlock(&cache->lock);
+        errno = EINVAL;
+        return -1;
+    }
+
+    while (length > 0)
+    {
+        uint64_t page = (uint64_t)offset / PAGE_CACHE_PAGE;
+        size_t within = (size_t)offset % PAGE_CACHE_PAGE;
+        size_t chunk = PAGE_CACHE_PAGE - within < length ? PAGE_CACHE_PAGE - within : length;
+
+        page_frame_t *frame = get_page(cache, page, 0);
+        if (!frame)
+        {
+            pthread_mutex_unlock(&cache->lock);
+            return -1;
+        }
+        memcpy(out, frame->data + within, chunk);
+        out += chunk;
+        offset += (off_t)chunk;
+        length -= chunk;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
+
+int page_cache_write(page_cache_t *cache, off_t offset, const void *data, size_t length)
+{
+    const char *in = data;
+    int rc = 0;
+    if (offset < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    while (length > 0)
+    {
+        uint64_t page = (uint64_t)offset / PAGE_CACHE_PAGE;
+        size_t within = (size_t)offset % PAGE_CACHE_PAGE;
+        size_t chunk = PAGE_CACHE_PAGE - within < length ? PAGE_CACHE_PAGE - within : length;
+
+        page_frame_t *frame = get_page(cache, page, chunk == PAGE_CACHE_PAGE);
+        if (!frame)
+        {
+            rc = -1;
+            break;
+        }
+        memcpy(frame->data + within, in, chunk);
+        if (!frame->dirty)
+        {
+            frame->dirty = 1;
+            cache->dirty_count++;
+        }
+        if (offset + (off_t)chunk > cache->size)
+            cache->size = offset + (off_t)chunk;
+
+        in += chunk;
+        offset += (off_t)chunk;
+        length -= chunk;
+    }
+
+    if (rc == 0 && cache->dirty_count > cache->dirty_limit)
+        rc = flush_locked(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return rc;
+}
+
+// Hand dirty pages to the kernel; not a durability point
+int page_cache_flush(page_cache_t *cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    int rc = flush_locked(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return rc;
+}
+
+int page_cache_barrier(page_cache_t *cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    int rc = flush_locked(cache);
+    if (rc == 0)
+    {
+        rc = fdatasync(cache->fd);
+        cache->barriers++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return rc;
+}
+
+int page_cache_close(page_cache_t *cache)
+{
+    int rc = page_cache_barrier(cache);
+    close(cache->fd);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->memory);
+    free(cache->frames);
+    free(cache->buckets);
+    free(cache);
+    return rc;
+}
@@ -0,0 +1,56 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include "recordFile.h"
+#include <pthread.h>
+#include <sys/uio.h>
+
+// Write-back cache of 4 KB file pages for small in-place updates. A write
+// only copies into a cached page and marks it dirty; dirty pages go to the
+// file in groups, sorted by page number and merged into one pwritev per run
+// of adjacent pages, when the dirty count passes its limit, when a dirty
+// page has to be evicted, and at a barrier. Nothing is durable until
+// page_cache_barrier returns: it writes every dirty page and then
+// fdatasyncs, so every write made before the call survives a crash.
+#define PAGE_CACHE_PAGE 4096u
+#define PAGE_CACHE_MAX_RUN 1024     // pages per pwritev, at most IOV_MAX
+
+typedef struct page_frame {
+    uint64_t page;          // file page held, UINT64_MAX when free
+    int32_t next;           // hash chain, -1 at the end
+    uint8_t dirty;
+    uint8_t referenced;     // CLOCK second chance
+    char *data;
+} page_frame_t;
+
+typedef struct page_cache {
+    int fd;
+    pthread_mutex_t lock;
+
+    page_frame_t *frames;
+    char *memory;           // capacity pages, page-aligned
+    size_t capacity;
+    int32_t *buckets;       // page number -> first frame in chain
+    size_t bucket_mask;
+    size_t clock_hand;
+
+    size_t dirty_count;
+    size_t dirty_limit;     // a write that leaves more dirty pages than this flushes them all before returning
+    off_t size;             // file size including cached writes past the end
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t pages_written;
+    uint64_t write_calls;   // pwritev calls; pages_written / write_calls is the coalescing
+    uint64_t barriers;
+} page_cache_t;
+
+page_cache_t *page_cache_open(const char *path, size_t capacity_pages);
+int page_cache_read(page_cache_t *cache, off_t offset, void *buffer, size_t length);
+int page_cache_write(page_cache_t *cache, off_t offset, const void *data, size_t length);
+int page_cache_flush(page_cache_t *cache);
+int page_cache_barrier(page_cache_t *cache);
+int page_cache_close(page_cache_t *cache);
+
+#endif
@@ -0,0 +1,395 @@
+#include "recordBatch.h"
+#include <sys/syscall.h>
+#include <stdatomic.h>
+
+// A run of adjacent records: order[start .. start + count) in the sorted batch
+typedef struct io_run {
+    uint32_t first;
+    size_t start;
+    size_t count;
+    int reported;           // its records have been passed to the callback
+} io_run_t;
+
+typedef struct io_plan {
+    record_io_t **order;    // batch sorted by index
+    struct iovec *iov;      // parallel to order
+    io_run_t *runs;
+    size_t run_count;
+} io_plan_t;
+
+static int compare_index(const void *a, const void *b)
+{
+    uint32_t left = (*(record_io_t *const *)a)->index;
+    uint32_t right = (*(record_io_t *const *)b)->index;
+    return (left > right) - (left < right);
+}
+
+static off_t record_position(uint32_t index)
+{
+    return (off_t)RECORD_FILE_HEADER + (off_t)index * (off_t)sizeof(Record);
+}
+
+// Sort the batch and cut it into runs. A repeated index starts a new run,
+// so each buffer still gets its own transfer.
+static int plan_batch(io_plan_t *plan, record_io_t *ios, size_t n)
+{
+    memset(plan, 0, sizeof(*plan));
+    plan->order = malloc(sizeof(record_io_t *) * (n ? n : 1));
+    plan->iov = malloc(sizeof(struct iovec) * (n ? n : 1));
+    plan->runs = malloc(sizeof(io_run_t) * (n ? n : 1));
+    if (!plan->order || !plan->iov || !plan->runs)
+    {
+        free(plan->order);
+        free(plan->iov);
+        free(plan->runs);
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        plan->order[i] = &ios[i];
+    qsort(plan->order, n, sizeof(record_io_t *), compare_index);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        record_io_t *io = plan->order[i];
+        plan->iov[i].iov_base = io->buffer;
+        plan->iov[i].iov_len = sizeof(Record);
+
+        io_run_t *run = plan->run_count ? &plan->runs[plan->run_count - 1] : NULL;
+        if (run && io->index == run->first + run->count && run->count < RECORD_BATCH_MAX_RUN)
+            run->count++;
+        else
+            plan->runs[plan->run_count++] = (io_run_t){ io->index, i, 1, 0 };
+    }
+    return 0;
+}
+
+static void free_plan(io_plan_t *plan)
+{
+    free(plan->order);
+    free(plan->iov);
+    free(plan->runs);
+}
+
+// Finish a run whose first `moved` bytes are already transferred, with as
+// many preadv/pwritev calls as short transfers require. Returns the bytes
+// moved in total; *error is set when that falls short of the run.
+static size_t finish_run(int fd, io_plan_t *plan, const io_run_t *run, size_t moved, int write, int *error)
+{
+    struct iovec *iov = plan->iov + run->start;
+    int iovcnt = (int)run->count;
+    size_t skip = moved;
+
+    *error = 0;
+    while (iovcnt > 0 && skip >= iov->iov_len)
+    {
+        skip -= iov->iov_len;
+        iov++;
+        iovcnt--;
+    }
+    if (iovcnt > 0)
+    {
+        iov->iov_base = (char *)iov->iov_base + skip;
+        iov->iov_len -= skip;
+    }
+
+    while (iovcnt > 0)
+    {
+        off_t offset = record_position(run->first) + (off_t)moved;
+        ssize_t bytes = write ? pwritev(fd, iov, iovcnt, offset) : preadv(fd, iov, iovcnt, offset);
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            *error = errno;
+            break;
+        }
+        if (bytes == 0)
+        {
+            *error = ENODATA;
+            break;
+        }
+
+        moved += (size_t)bytes;
+        while (iovcnt > 0 && (size_t)bytes >= iov->iov_len)
+        {
+            bytes -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + bytes;
+            iov->iov_len -= (size_t)bytes;
+        }
+    }
+    return moved;
+}
+
+// Records wholly inside `moved` succeeded; the rest get `error`
+static size_t complete_run(io_plan_t *plan, io_run_t *run, size_t moved, int error,
+                           record_io_fn done, void *arg)
+{
+    size_t whole = moved / sizeof(Record);
+    size_t failed = 0;
+    run->reported = 1;
+    for (size_t i = 0; i < run->count; i++)
+    {
+        int status = i < whole ? 0 : (error ? error : EIO);
+        failed += status != 0;
+        if (done)
+            done(plan->order[run->start + i], status, arg);
+    }
+    return failed;
+}
+
+static int batch(int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg, int write)
+{
+    io_plan_t plan;
+    if (plan_batch(&plan, ios, n) < 0)
+        return -1;
+
+    size_t failed = 0;
+    for (size_t r = 0; r < plan.run_count; r++)
+    {
+        int error;
+        size_t moved = finish_run(fd, &plan, &plan.runs[r], 0, write, &error);
+        failed += complete_run(&plan, &plan.runs[r], moved, error, done, arg);
+    }
+
+    free_plan(&plan);
+    return (int)failed;
+}
+
+int record_read_batch(int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg)
+{
+    return batch(fd, ios, n, done, arg, 0);
+}
+
+int record_write_batch(int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg)
+{
+    return batch(fd, ios, n, done, arg, 1);
+}
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+record_ring_t *record_ring_open(unsigned depth)
+{
+    if (depth == 0 || depth > RECORD_RING_MAX_DEPTH)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    record_ring_t *ring = calloc(1, sizeof(record_ring_t));
+    if (!ring)
+        return NULL;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = io_uring_setup(depth, &params);
+    if (ring->fd < 0)
+    {
+        free(ring);
+        return NULL;
+    }
+    ring->depth = params.sq_entries;
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_map_size > ring->sq_map_size)
+            ring->sq_map_size = ring->cq_map_size;
+        ring->cq_map_size = ring->sq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED)
+        goto fail;
+    ring->cq_map = ring->sq_map;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED)
+            goto fail;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto fail;
+
+    char *sq = ring->sq_map;
+    char *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return ring;
+
+fail:
+    {
+        int saved = errno;
+        if (ring->sqes && ring->sqes != MAP_FAILED)
+            munmap(ring->sqes, ring->sqes_size);
+        if (ring->cq_map && ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map)
+            munmap(ring->cq_map, ring->cq_map_size);
+        if (ring->sq_map && ring->sq_map != MAP_FAILED)
+            munmap(ring->sq_map, ring->sq_map_size);
+        close(ring->fd);
+        free(ring);
+        errno = saved;
+        return NULL;
+    }
+}
+
+void record_ring_close(record_ring_t *ring)
+{
+    if (!ring)
+        return;
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != ring->sq_map)
+        munmap(ring->cq_map, ring->cq_map_size);
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+    free(ring);
+}
+
+static void queue_run(record_ring_t *ring, int fd, io_plan_t *plan, size_t r, int write)
+{
+    const io_run_t *run = &plan->runs[r];
+    unsigned tail = *ring->sq_tail;
+    unsigned slot = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[slot];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->off = (uint64_t)record_position(run->first);
+    sqe->addr = (uint64_t)(uintptr_t)(plan->iov + run->start);
+    sqe->len = (uint32_t)run->count;
+    sqe->user_data = r;
+    ring->sq_array[slot] = slot;
+
+    // The kernel must see the entry before it sees the new tail
+    atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, tail + 1, memory_order_release);
+}
+
+// Complete the runs whose CQEs have arrived
+static size_t reap(record_ring_t *ring, int fd, io_plan_t *plan, int write, record_io_fn done, void *arg,
+                   unsigned *in_flight)
+{
+    size_t failed = 0;
+    unsigned head = *ring->cq_head;
+    unsigned tail = atomic_load_explicit((_Atomic unsigned *)ring->cq_tail, memory_order_acquire);
+    for (; head != tail; head++)
+    {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        io_run_t *run = &plan->runs[cqe->user_data];
+        size_t moved = cqe->res > 0 ? (size_t)cqe->res : 0;
+        int error = 0;
+
+        if (moved < run->count * sizeof(Record))
+            moved = finish_run(fd, plan, run, moved, write, &error);
+        failed += complete_run(plan, run, moved, error, done, arg);
+        (*in_flight)--;
+    }
+    atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head, memory_order_release);
+    return failed;
+}
+
+// Keep up to `depth` runs in flight and complete each as its CQE arrives.
+// A short or failed completion is finished synchronously from where the
+// kernel stopped, so callers see the same results as with the batch API.
+// If io_uring_enter fails, the runs already submitted are waited for and
+// completed as usual, every other run is reported with its errno, and -1
+// is returned with errno set.
+static int ring_batch(record_ring_t *ring, int fd, record_io_t *ios, size_t n,
+                      record_io_fn done, void *arg, int write)
+{
+    io_plan_t plan;
+    if (plan_batch(&plan, ios, n) < 0)
+        return -1;
+
+    size_t next = 0, failed = 0;
+    unsigned in_flight = 0, unsubmitted = 0;
+    int rc = 0, error = 0;
+
+    while (next < plan.run_count || in_flight > 0)
+    {
+        while (next < plan.run_count && in_flight < ring->depth)
+        {
+            queue_run(ring, fd, &plan, next++, write);
+            in_flight++;
+            unsubmitted++;
+        }
+
+        int entered = io_uring_enter(ring->fd, unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if (entered < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            rc = -1;
+            error = errno;
+            break;
+        }
+        unsubmitted -= (unsigned)entered;
+        failed += reap(ring, fd, &plan, write, done, arg, &in_flight);
+    }
+
+    int drained = 1;
+    if (rc < 0)
+    {
+        // Wait for what the kernel already owns before the buffers go away
+        while (in_flight > unsubmitted)
+        {
+            if (io_uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                    continue;
+                drained = 0;
+                break;
+            }
+            failed += reap(ring, fd, &plan, write, done, arg, &in_flight);
+        }
+        *ring->sq_tail -= unsubmitted;  // never submitted; their iovecs are about to be freed
+
+        // Queued but never submitted, never queued, or lost with a second failed enter
+        for (size_t r = 0; r < plan.run_count; r++)
+            if (!plan.runs[r].reported)
+                failed += complete_run(&plan, &plan.runs[r], 0, error, done, arg);
+    }
+
+    // When the ring cannot even be waited on, runs the kernel took may still
+    // read their iovecs: the plan is leaked rather than freed under them
+    if (drained)
+        free_plan(&plan);
+    if (rc < 0)
+        errno = error;
+    return rc < 0 ? -1 : (int)failed;
+}
+
+int record_ring_read(record_ring_t *ring, int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg)
+{
+    return ring_batch(ring, fd, ios, n, done, arg, 0);
+}
+
+int record_ring_write(record_ring_t *ring, int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg)
+{
+    return ring_batch(ring, fd, ios, n, done, arg, 1);
+}
@@ -0,0 +1,62 @@
+#ifndef RECORDBATCH_H
+#define RECORDBATCH_H
+
+#include "recordFile.h"
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// Scattered Record I/O against a record file (count header, packed Records).
+// A batch is a list of record indices, each with the caller's buffer. The
+// indices are sorted and runs of adjacent records become one vectored
+// transfer, so n neighbours cost one syscall or one ring entry instead of n.
+// Every record is reported to the caller's callback exactly once, with 0 or
+// an errno; a read past the last record reports ENODATA.
+#define RECORD_BATCH_MAX_RUN 1024       // records per preadv/pwritev, at most IOV_MAX
+#define RECORD_RING_MAX_DEPTH 4096
+
+typedef struct record_io {
+    uint32_t index;     // record number, not byte offset
+    Record *buffer;     // filled by reads, taken by writes
+} record_io_t;
+
+typedef void (*record_io_fn)(record_io_t *io, int error, void *arg);
+
+// Synchronous: one preadv/pwritev per run of adjacent records.
+// Return the number of records that failed, or -1 if the batch could not start.
+int record_read_batch(int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg);
+int record_write_batch(int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg);
+
+// io_uring without liburing: the same runs go out as READV/WRITEV entries,
+// at most `depth` in flight. A ring is used by one thread at a time.
+// Return as above, or -1 with errno if io_uring_enter fails part way; the
+// records it kept from being submitted are reported with that errno. If
+// the ring then cannot be waited on either, runs may still be in the
+// kernel: their buffers stay in use until the ring is closed.
+typedef struct record_ring {
+    int fd;
+    unsigned depth;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;       // same as sq_map when the kernel maps both rings together
+    size_t cq_map_size;
+    size_t sqes_size;
+} record_ring_t;
+
+record_ring_t *record_ring_open(unsigned depth);
+int record_ring_read(record_ring_t *ring, int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg);
+int record_ring_write(record_ring_t *ring, int fd, record_io_t *ios, size_t n, record_io_fn done, void *arg);
+void record_ring_close(record_ring_t *ring);
+
+#endif
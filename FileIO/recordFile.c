@@ -0,0 +1,219 @@
+#include "recordFile.h"
+
+static size_t page_size(void)
+{
+    static size_t size;
+    if (!size)
+        size = (size_t)sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+static size_t record_offset(uint32_t index)
+{
+    return RECORD_FILE_HEADER + (size_t)index * sizeof(Record);
+}
+
+// Extend the file and the mapping to hold at least `needed` bytes
+static int grow(record_file_t *file, size_t needed)
+{
+    size_t size = file->mapped;
+    while (size < needed)
+        size += RECORD_FILE_EXTENT;
+
+    int err = posix_fallocate(file->fd, (off_t)file->mapped, (off_t)(size - file->mapped));
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+
+    char *map = file->map
+        ? mremap(file->map, file->mapped, size, MREMAP_MAYMOVE)
+        : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+
+    file->map = map;
+    file->mapped = size;
+    return 0;
+}
+
+// Unmap and close without syncing or trimming; keeps errno
+static void release(record_file_t *file)
+{
+    int saved = errno;
+    if (file->map)
+        munmap(file->map, file->mapped);
+    close(file->fd);
+    free(file);
+    errno = saved;
+}
+
+// Open `path` with `flags` and map all of it, checking the header against
+// the file size
+static record_file_t *map_file(const char *path, int flags)
+{
+    record_file_t *file = calloc(1, sizeof(record_file_t));
+    if (!file)
+        return NULL;
+
+    file->readonly = (flags & O_ACCMODE) == O_RDONLY;
+    file->fd = open(path, flags, 0644);
+    if (file->fd < 0)
+    {
+        free(file);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(file->fd, &st) < 0)
+        goto fail;
+
+    uint32_t count = 0;
+    if ((size_t)st.st_size >= RECORD_FILE_HEADER)
+    {
+        if (pread(file->fd, &count, sizeof(count), 0) != (ssize_t)sizeof(count))
+            goto fail;
+        if (record_offset(count) > (size_t)st.st_size)
+        {
+            errno = EINVAL; // header claims more records than the file holds
+            goto fail;
+        }
+    }
+
+    file->mapped = (size_t)st.st_size;
+    if (file->mapped > 0)
+    {
+        int protection = file->readonly ? PROT_READ : PROT_READ | PROT_WRITE;
+        file->map = mmap(NULL, file->mapped, protection, MAP_SHARED, file->fd, 0);
+        if (file->map == MAP_FAILED)
+        {
+            file->map = NULL;
+            goto fail;
+        }
+    }
+    file->count = count;
+    file->synced = count;
+    return file;
+
+fail:
+    release(file);
+    return NULL;
+}
+
+// Open or create a record file; with truncate set any existing records are dropped
+record_file_t *record_file_open(const char *path, int truncate)
+{
+    record_file_t *file = map_file(path, O_CREAT | O_RDWR | (truncate ? O_TRUNC : 0));
+    if (file && file->mapped < RECORD_FILE_HEADER && grow(file, RECORD_FILE_HEADER) < 0)
+    {
+        release(file);
+        return NULL;
+    }
+    return file;
+}
+
+// A file too short for the header is not a record file: EINVAL
+record_file_t *record_file_open_readonly(const char *path)
+{
+    record_file_t *file = map_file(path, O_RDONLY);
+    if (file && file->mapped < RECORD_FILE_HEADER)
+    {
+        release(file);
+        errno = EINVAL;
+        return NULL;
+    }
+    return file;
+}
+
+Record *record_file_at(record_file_t *file, uint32_t index)
+{
+    if (index >= file->count)
+        return NULL;
+    return (Record *)(file->map + record_offset(index));
+}
+
+// Bulk append: one copy into the mapping, growing by whole extents when full.
+// The count is kept in memory only; the header on disk, and with it the new
+// records, move forward at record_file_sync.
+int record_file_append(record_file_t *file, const Record *records, size_t n)
+{
+    if (file->readonly)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    if (n > UINT32_MAX - file->count)
+    {
+        errno = EFBIG;
+        return -1;
+    }
+
+    size_t end = record_offset(file->count + (uint32_t)n);
+    if (end > file->mapped && grow(file, end) < 0)
+        return -1;
+
+    memcpy(file->map + record_offset(file->count), records, n * sizeof(Record));
+    file->count += (uint32_t)n;
+    return 0;
+}
+
+// msync only the pages covering records [first, first + n), for in-place updates
+int record_file_sync_range(record_file_t *file, uint32_t first, uint32_t n)
+{
+    if (n == 0)
+        return 0;
+    if (first >= file->count || n > file->count - first)
+    {
+        errno = ERANGE;
+        return -1;
+    }
+
+    size_t start = record_offset(first) & ~(page_size() - 1);
+    size_t end = record_offset(first + n);
+    return msync(file->map + start, end - start, MS_SYNC);
+}
+
+// Make appended records durable, then write the header that counts them and
+// make it durable, so a crash never leaves a count covering records that
+// were not written. The count only reaches the mapping here: written there by
+// every append, writeback could have put it on disk ahead of its records.
+int record_file_sync(record_file_t *file)
+{
+    if (file->readonly)
+        return 0;   // nothing to make durable
+    if (file->count > file->synced)
+    {
+        size_t start = record_offset(file->synced) & ~(page_size() - 1);
+        if (msync(file->map + start, record_offset(file->count) - start, MS_SYNC) < 0)
+            return -1;
+    }
+    memcpy(file->map, &file->count, sizeof(file->count));
+    if (msync(file->map, RECORD_FILE_HEADER, MS_SYNC) < 0)
+        return -1;
+    file->synced = file->count;
+    return 0;
+}
+
+// Sync, trim the unused tail of the last extent and release the file. A
+// read-only file is only unmapped and closed.
+int record_file_close(record_file_t *file)
+{
+    if (file->readonly)
+    {
+        release(file);
+        return 0;
+    }
+
+    int rc = record_file_sync(file);
+    size_t used = record_offset(file->count);
+
+    munmap(file->map, file->mapped);
+    if (rc == 0 && used < file->mapped && ftruncate(file->fd, (off_t)used) < 0)
+        rc = -1;
+    if (rc == 0 && fsync(file->fd) < 0)
+        rc = -1;
+    close(file->fd);
+    free(file);
+    return rc;
+}
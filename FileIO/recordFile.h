@@ -0,0 +1,53 @@
+#ifndef RECORDFILE_H
+#define RECORDFILE_H
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#pragma pack(push,1)
+typedef struct {
+    uint32_t id;
+    double value;
+    char name[32];
+}Record;
+#pragma pack(pop)
+
+// Same layout lowLevelIo has always written: a uint32_t record count, then
+// packed Records. The file is mapped whole, so record i sits at a fixed
+// address, and it grows in RECORD_FILE_EXTENT steps with blocks allocated up
+// front, so appends neither remap nor fault in new blocks one page at a time.
+// Space past the last record is trimmed on close, which keeps the file
+// readable by the read()-per-record path.
+#define RECORD_FILE_HEADER sizeof(uint32_t)
+#define RECORD_FILE_EXTENT (64u * 1024 * 1024)
+
+typedef struct record_file {
+    int fd;
+    char *map;          // header followed by records
+    size_t mapped;      // bytes mapped, equal to the file size while open
+    uint32_t count;     // records in use
+    uint32_t synced;    // records [0, synced) made durable by record_file_sync
+    int readonly;       // opened by record_file_open_readonly
+} record_file_t;
+
+// Pointers returned by record_file_at are valid until the next append
+record_file_t *record_file_open(const char *path, int truncate);
+// Map an existing file for reading only: nothing is created, appended,
+// synced or trimmed, and the records must not be written through
+record_file_t *record_file_open_readonly(const char *path);
+Record *record_file_at(record_file_t *file, uint32_t index);
+int record_file_append(record_file_t *file, const Record *records, size_t n);
+int record_file_sync_range(record_file_t *file, uint32_t first, uint32_t n);
+int record_file_sync(record_file_t *file);
+int record_file_close(record_file_t *file);
+
+#endif
@@ -1,80 +1,427 @@
 #include "buffer-pool.h"
 
+// Page table bucket of a page
+static size_t bucket_of(buffer_pool_t *pool, uint64_t tag)
+{
+    return (size_t)((tag * 0x9E3779B97F4A7C15ull) >> 32) & pool->bucket_mask;
+}
+
+static pool_stripe_t* stripe_of(buffer_pool_t *pool, size_t bucket)
+{
+    return &pool->stripes[bucket % POOL_LOCK_STRIPES];
+}
+
+// Look a page up in its bucket; the stripe lock is held
+static buffer_t* find_buffer(buffer_pool_t *pool, size_t bucket, uint64_t tag)
+{
+    int index = pool->buckets[bucket];
+    while (index != -1)
+    {
+        buffer_t *buffer = &pool->buffers[index];
+        if (atomic_load_explicit(&buffer->tag, memory_order_relaxed) == tag) return buffer;
+        index = buffer->next;
+    }
+    return NULL;
+}
+
+// Take a buffer out of its bucket; the stripe lock is held
+static void unlink_buffer(buffer_pool_t *pool, size_t bucket, buffer_t *buffer)
+{
+    int *link = &pool->buckets[bucket];
+    while (*link != buffer->buffer_id)
+    {
+        link = &pool->buffers[*link].next;
+    }
+    *link = buffer->next;
+    buffer->next = -1;
+    atomic_store(&buffer->tag, NO_PAGE);
+}
+
+// Count a use for the clock sweep, up to POOL_MAX_USAGE
+static void use_buffer(buffer_t *buffer)
+{
+    unsigned int usage = atomic_load_explicit(&buffer->usage, memory_order_relaxed);
+    while (usage < POOL_MAX_USAGE &&
+           !atomic_compare_exchange_weak(&buffer->usage, &usage, usage + 1))
+    {
+    }
+}
+
+// Write a buffer's page back to its file
+static int write_page(buffer_pool_t *pool, buffer_t *buffer, uint64_t tag)
+{
+    int fd = (int)(tag >> 32);
+    off_t offset = (off_t)(uint32_t)tag * BUFFER_SIZE;
+    size_t done = 0;
+
+    while (done < BUFFER_SIZE)
+    {
+        ssize_t written = pwrite(fd, buffer->data + done, BUFFER_SIZE - done, offset + done);
+        if (written == -1)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += written;
+    }
+
+    atomic_fetch_add_explicit(&pool->writes, 1, memory_order_relaxed);
+    return 0;
+}
+
+// Read a buffer's page in; past the end of the file it reads as zeros
+static int read_page(buffer_pool_t *pool, buffer_t *buffer, int fd, uint32_t page)
+{
+    off_t offset = (off_t)page * BUFFER_SIZE;
+    size_t done = 0;
+
+    while (done < BUFFER_SIZE)
+    {
+        ssize_t got = pread(fd, buffer->data + done, BUFFER_SIZE - done, offset + done);
+        if (got == -1)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (got == 0)
+        {
+            memset(buffer->data + done, 0, BUFFER_SIZE - done);
+            break;
+        }
+        done += got;
+    }
+
+    atomic_fetch_add_explicit(&pool->reads, 1, memory_order_relaxed);
+    return 0;
+}
+
+// Write a buffer back if dirty, the caller holding its only pin. Pinners
+// arriving meanwhile find it not valid and wait on io_lock, so the page
+// does not change while it is written. 0 when someone else has it pinned
+// and it was left alone, 1 when it is clean, -1 when the write failed.
+static int clean_buffer(buffer_pool_t *pool, buffer_t *buffer, uint64_t tag)
+{
+    pthread_mutex_lock(&buffer->io_lock);
+    atomic_store(&buffer->valid, false);
+
+    // A pinner either comes after this and waits, or is counted here
+    if (atomic_load(&buffer->pins) != 1)
+    {
+        atomic_store(&buffer->valid, true);
+        pthread_mutex_unlock(&buffer->io_lock);
+        return 0;
+    }
+
+    int result = 1;
+    if (atomic_exchange(&buffer->dirty, false) && write_page(pool, buffer, tag) == -1)
+    {
+        atomic_store(&buffer->dirty, true);
+        result = -1;
+    }
+
+    atomic_store(&buffer->valid, true);
+    pthread_mutex_unlock(&buffer->io_lock);
+    return result;
+}
+
+// Clock sweep for a buffer nobody uses. It comes back pinned once, out of
+// the page table and clean; NULL with EBUSY when every buffer stayed
+// pinned for a few turns of the hand.
+static buffer_t* take_victim(buffer_pool_t *pool)
+{
+    size_t limit = (size_t)pool->total_buffers * (POOL_MAX_USAGE + 2);
+
+    for (size_t step = 0; step < limit; step++)
+    {
+        size_t hand = atomic_fetch_add_explicit(&pool->clock_hand, 1, memory_order_relaxed);
+        buffer_t *buffer = &pool->buffers[hand % pool->total_buffers];
+
+        if (atomic_load_explicit(&buffer->pins, memory_order_relaxed)) continue;
+
+        unsigned int usage = atomic_load_explicit(&buffer->usage, memory_order_relaxed);
+        if (usage)
+        {
+            atomic_compare_exchange_strong(&buffer->usage, &usage, usage - 1);
+            continue;
+        }
+
+        unsigned int unpinned = 0;
+        if (!atomic_compare_exchange_strong(&buffer->pins, &unpinned, 1)) continue;
+
+        // Ours now: nobody else can claim it or change its page
+        uint64_t tag = atomic_load(&buffer->tag);
+        if (tag == NO_PAGE) return buffer;
+
+        // Written while still in the table, so nobody reads the old page from disk too early
+        int cleaned = clean_buffer(pool, buffer, tag);
+        if (cleaned == -1)
+        {
+            int saved = errno;
+            atomic_fetch_sub(&buffer->pins, 1);
+            errno = saved;
+            return NULL;
+        }
+
+        // Someone pinned it meanwhile: theirs to keep
+        size_t bucket = bucket_of(pool, tag);
+        pool_stripe_t *stripe = stripe_of(pool, bucket);
+        pthread_mutex_lock(&stripe->lock);
+        if (cleaned && atomic_load(&buffer->pins) == 1 && !atomic_load(&buffer->dirty))
+        {
+            unlink_buffer(pool, bucket, buffer);
+            pthread_mutex_unlock(&stripe->lock);
+            return buffer;
+        }
+        pthread_mutex_unlock(&stripe->lock);
+        atomic_fetch_sub(&buffer->pins, 1);
+    }
+
+    errno = EBUSY;
+    return NULL;
+}
+
+// A buffer found in the table may still be being read in by whoever missed on it
+static buffer_t* wait_valid(buffer_t *buffer)
+{
+    if (atomic_load_explicit(&buffer->valid, memory_order_acquire)) return buffer;
+
+    pthread_mutex_lock(&buffer->io_lock);
+    bool valid = atomic_load(&buffer->valid);
+    pthread_mutex_unlock(&buffer->io_lock);
+
+    if (valid) return buffer;
+
+    atomic_fetch_sub(&buffer->pins, 1);
+    errno = EIO;
+    return NULL;
+}
+
 // Initialize the buffer pool
 buffer_pool_t* create_buffer_pool(int pool_size)
 {
-    buffer_pool_t *pool = malloc(sizeof(buffer_pool_t));
+    if (pool_size <= 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    buffer_pool_t *pool = calloc(1, sizeof(buffer_pool_t));
     if (!pool) return NULL;
 
-    pool->buffers = malloc(sizeof(buffer_t) * pool_size);
-    if (!pool->buffers)
+    size_t bucket_count = POOL_LOCK_STRIPES;
+    while (bucket_count < (size_t)pool_size * 2) bucket_count *= 2;
+
+    pool->buffers = calloc(pool_size, sizeof(buffer_t));
+    pool->buckets = malloc(sizeof(int) * bucket_count);
+    if (!pool->buffers || !pool->buckets ||
+        posix_memalign((void **)&pool->memory, BUFFER_SIZE, (size_t)pool_size * BUFFER_SIZE) != 0)
     {
+        free(pool->buffers);
+        free(pool->buckets);
         free(pool);
         return NULL;
     }
 
     pool->total_buffers = pool_size;
-    pool->free_count = pool_size;
-    pool->free_list = &pool->buffers[0];
+    pool->bucket_mask = bucket_count - 1;
+    atomic_init(&pool->clock_hand, 0);
+    atomic_init(&pool->reads, 0);
+    atomic_init(&pool->writes, 0);
 
+    for (size_t iterator = 0; iterator < bucket_count; iterator++)
+    {
+        pool->buckets[iterator] = -1;
+    }
 
-    for (int iterator = 0; iterator < pool_size; iterator++)
+    for (int iterator = 0; iterator < POOL_LOCK_STRIPES; iterator++)
     {
-        pool->buffers[iterator].is_free = true;
-        pool->buffers[iterator].buffer_id = iterator;
+        pthread_mutex_init(&pool->stripes[iterator].lock, NULL);
+    }
 
-        if(iterator == pool_size - 1)
-        {
-            pool->buffers[iterator].next = NULL;
-        }
-        else
-        {
-            pool->buffers[iterator].next = &pool->buffers[iterator + 1];
-        }
+    for (int iterator = 0; iterator < pool_size; iterator++)
+    {
+        buffer_t *buffer = &pool->buffers[iterator];
+        buffer->data = pool->memory + (size_t)iterator * BUFFER_SIZE;
+        buffer->buffer_id = iterator;
+        buffer->next = -1;
+        atomic_init(&buffer->tag, NO_PAGE);
+        atomic_init(&buffer->pins, 0);
+        atomic_init(&buffer->usage, 0);
+        atomic_init(&buffer->dirty, false);
+        atomic_init(&buffer->valid, false);
+        pthread_mutex_init(&buffer->io_lock, NULL);
     }
 
     return pool;
 }
 
-//Acquiring the buffer
+//Acquiring a buffer that holds no page, evicting one if need be
 buffer_t* acquire_buffer(buffer_pool_t *pool) {
-    if(pool->free_count == 0)
+    return take_victim(pool);
+}
+
+//Release the buffer; its contents are left as they are
+void release_buffer(buffer_pool_t *pool, buffer_t *buffer)
+{
+    (void)pool;
+    if(!buffer || atomic_load(&buffer->pins) == 0) return;
+
+    // First in line for the clock hand
+    atomic_store(&buffer->usage, 0);
+    atomic_fetch_sub(&buffer->pins, 1);
+}
+
+//Pin a page of a file, reading it in on a miss
+buffer_t* pin_page(buffer_pool_t *pool, int fd, uint32_t page)
+{
+    if (fd < 0)
+    {
+        errno = EBADF;
+        return NULL;
+    }
+
+    uint64_t tag = ((uint64_t)fd << 32) | page;
+    size_t bucket = bucket_of(pool, tag);
+    pool_stripe_t *stripe = stripe_of(pool, bucket);
+
+    pthread_mutex_lock(&stripe->lock);
+    buffer_t *buffer = find_buffer(pool, bucket, tag);
+    if (buffer)
     {
-        printf("Buffer pool is already exhausted \n");
+        atomic_fetch_add(&buffer->pins, 1);
+        stripe->hits++;
+        pthread_mutex_unlock(&stripe->lock);
+        use_buffer(buffer);
+        return wait_valid(buffer);
+    }
+    stripe->misses++;
+    pthread_mutex_unlock(&stripe->lock);
+
+    buffer_t *victim = take_victim(pool);
+    if (!victim) return NULL;
+
+    // Someone else may have missed on the same page while we swept
+    pthread_mutex_lock(&stripe->lock);
+    buffer = find_buffer(pool, bucket, tag);
+    if (buffer)
+    {
+        atomic_fetch_add(&buffer->pins, 1);
+        pthread_mutex_unlock(&stripe->lock);
+        release_buffer(pool, victim);
+        use_buffer(buffer);
+        return wait_valid(buffer);
+    }
+
+    // In the table before it is read, io_lock held so others finding it wait
+    pthread_mutex_lock(&victim->io_lock);
+    atomic_store(&victim->valid, false);
+    atomic_store(&victim->usage, 1);
+    atomic_store(&victim->tag, tag);
+    victim->next = pool->buckets[bucket];
+    pool->buckets[bucket] = victim->buffer_id;
+    pthread_mutex_unlock(&stripe->lock);
+
+    if (read_page(pool, victim, fd, page) == -1)
+    {
+        int saved = errno;
+        pthread_mutex_lock(&stripe->lock);
+        unlink_buffer(pool, bucket, victim);
+        pthread_mutex_unlock(&stripe->lock);
+        pthread_mutex_unlock(&victim->io_lock);
+        release_buffer(pool, victim);
+        errno = saved;
         return NULL;
     }
 
-    buffer_t *buffer = pool->free_list;
-    pool->free_list = buffer->next;
-    buffer->is_free = false;
-    buffer->next = NULL;
-    pool->free_count--;
+    atomic_store_explicit(&victim->valid, true, memory_order_release);
+    pthread_mutex_unlock(&victim->io_lock);
+    return victim;
+}
 
-    printf("The acquired buffer is %d\n", buffer->buffer_id);
-    return buffer;
+//Unpin a page, saying whether it was changed
+void unpin_page(buffer_pool_t *pool, buffer_t *buffer, bool dirty)
+{
+    (void)pool;
+    if (dirty) atomic_store(&buffer->dirty, true);
+    atomic_fetch_sub(&buffer->pins, 1);
 }
 
-//Release the buffer
-void release_buffer(buffer_pool_t *pool, buffer_t *buffer)
+//Write every dirty page back to its file (not synced). Pages pinned by
+//others are left dirty, and the flush fails with EBUSY.
+int flush_buffer_pool(buffer_pool_t *pool)
 {
-    if(buffer->is_free || !buffer) return;
+    int result = 0;
+    int error = 0;
+
+    for (int iterator = 0; iterator < pool->total_buffers; iterator++)
+    {
+        buffer_t *buffer = &pool->buffers[iterator];
+        uint64_t tag = atomic_load(&buffer->tag);
+        if (tag == NO_PAGE || !atomic_load(&buffer->dirty)) continue;
+
+        // Pin it, if it still holds that page, so it is not evicted under us
+        size_t bucket = bucket_of(pool, tag);
+        pool_stripe_t *stripe = stripe_of(pool, bucket);
+        pthread_mutex_lock(&stripe->lock);
+        if (atomic_load(&buffer->tag) != tag)
+        {
+            pthread_mutex_unlock(&stripe->lock);
+            continue;
+        }
+        atomic_fetch_add(&buffer->pins, 1);
+        pthread_mutex_unlock(&stripe->lock);
 
-    memset(buffer->data, 0, BUFFER_SIZE);
+        int cleaned = clean_buffer(pool, buffer, tag);
+        if (cleaned != 1)
+        {
+            error = cleaned == 0 ? EBUSY : errno;
+            result = -1;
+        }
+        atomic_fetch_sub(&buffer->pins, 1);
+    }
 
-    buffer->is_free = true;
-    buffer->next = pool->free_list;
-    pool->free_list = buffer;
-    pool->free_count++;
+    if (result == -1) errno = error;
+    return result;
+}
 
-    prinf("Released buffer is %d \n", buffer->buffer_id);
+//Lookups, reads and writes so far
+void buffer_pool_stats(buffer_pool_t *pool, pool_stats_t *stats)
+{
+    stats->hits = 0;
+    stats->misses = 0;
+
+    for (int iterator = 0; iterator < POOL_LOCK_STRIPES; iterator++)
+    {
+        pool_stripe_t *stripe = &pool->stripes[iterator];
+        pthread_mutex_lock(&stripe->lock);
+        stats->hits += stripe->hits;
+        stats->misses += stripe->misses;
+        pthread_mutex_unlock(&stripe->lock);
+    }
+
+    stats->reads = atomic_load(&pool->reads);
+    stats->writes = atomic_load(&pool->writes);
 }
 
-//Destroy the buffer pool
+//Destroy the buffer pool, writing dirty pages back first
 void destroy_buffer_pool(buffer_pool_t *pool)
 {
     if(pool)
     {
+        flush_buffer_pool(pool);
+
+        for (int iterator = 0; iterator < pool->total_buffers; iterator++)
+        {
+            pthread_mutex_destroy(&pool->buffers[iterator].io_lock);
+        }
+        for (int iterator = 0; iterator < POOL_LOCK_STRIPES; iterator++)
+        {
+            pthread_mutex_destroy(&pool->stripes[iterator].lock);
+        }
+
+        free(pool->memory);
+        free(pool->buckets);
         free(pool->buffers);
         free(pool);
     }
-}
\ No newline at end of file
+}
@@ -1,30 +1,78 @@
-#ifndef BUFFERPOOL.H
+#ifndef BUFFERPOOL_H
 #define BUFFERPOOL_H
 
 #include "main.h"
 
 #define BUFFER_SIZE 4096
 #define POOL_SIZE 5
+#define POOL_LOCK_STRIPES 128   // page table buckets share this many locks
+#define POOL_MAX_USAGE 5        // clock-sweep usage count cap
+#define NO_PAGE UINT64_MAX
 
 // Buffer
+//
+// A buffer either holds a page of a file, found through the pool's page
+// table by (fd, page), or is handed out bare by acquire_buffer. Pins say how
+// many users have it; a pinned buffer keeps its page. Its contents are the
+// users' to coordinate: the pool only guarantees the page does not change
+// under them.
 typedef struct buffer {
-    char data[BUFFER_SIZE];
-    bool is_free;
+    char *data;
     int buffer_id;
-    struct buffer *next; 
+    _Atomic uint64_t tag;       // (fd << 32) | page, NO_PAGE when it holds none
+    int next;                   // page table chain, -1 at the end
+    atomic_uint pins;
+    atomic_uint usage;          // pins since the clock hand last passed
+    atomic_bool dirty;
+    atomic_bool valid;          // the page has been read in
+    pthread_mutex_t io_lock;    // held while the page is read in
 }buffer_t;
 
+// One lock of the page table, with the counts of lookups made under it
+typedef struct pool_stripe {
+    pthread_mutex_t lock;
+    unsigned long hits;
+    unsigned long misses;
+}__attribute__((aligned(64))) pool_stripe_t;
+
 // Buffer Pool manager
+//
+// A page table maps (fd, page) to a buffer: chained buckets, each guarded
+// by one of POOL_LOCK_STRIPES locks, so lookups of different pages rarely
+// meet. Pinning a page found in the table is the bucket lock and an atomic
+// increment. On a miss a buffer is taken with a clock sweep: the hand skips
+// pinned buffers, and lowers the usage count of the others until it finds
+// one at zero. A victim is claimed by moving its pins from 0 to 1; if it is
+// dirty it is written back before it leaves the table, so a reader missing
+// on that page afterwards finds it on disk.
 typedef struct buffer_pool {
     buffer_t *buffers;
-    buffer_t *free_list;
+    char *memory;
     int total_buffers;
-    int free_count;
+    atomic_size_t clock_hand;
+
+    int *buckets;
+    size_t bucket_mask;
+    pool_stripe_t stripes[POOL_LOCK_STRIPES];
+
+    atomic_ulong reads;
+    atomic_ulong writes;
 }buffer_pool_t;
 
+typedef struct pool_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long reads;
+    unsigned long writes;
+}pool_stats_t;
+
 buffer_pool_t* create_buffer_pool(int pool_size);
 buffer_t* acquire_buffer(buffer_pool_t *pool);
 void release_buffer(buffer_pool_t *pool, buffer_t *buffer);
+buffer_t* pin_page(buffer_pool_t *pool, int fd, uint32_t page);
+void unpin_page(buffer_pool_t *pool, buffer_t *buffer, bool dirty);
+int flush_buffer_pool(buffer_pool_t *pool);
+void buffer_pool_stats(buffer_pool_t *pool, pool_stats_t *stats);
 void destroy_buffer_pool(buffer_pool_t *pool);
 
 #endif
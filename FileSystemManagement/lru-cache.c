@@ -1,159 +1,351 @@
 #include "lru-cache.h"
 
-//hashing
-unsigned int hash(const char *key)
+//hashing: FNV-1a, then mixed so the high bits (the shard) depend on every byte
+uint64_t hash_key(const void *key, size_t length)
 {
-    unsigned int hash_value = 0;
-    while (*key)
+    const unsigned char *bytes = key;
+    uint64_t hash_value = 0xcbf29ce484222325ull;
+    for (size_t index = 0; index < length; index++)
     {
-        hash_value = (hash_value * 31) + *key++ ;
+        hash_value = (hash_value ^ bytes[index]) * 0x100000001b3ull;
     }
 
-    return hash_value % CACHE_SIZE;
+    hash_value ^= hash_value >> 33;
+    hash_value *= 0xff51afd7ed558ccdull;
+    hash_value ^= hash_value >> 33;
+    return hash_value;
 }
 
-//Initialize LRU cache
-lru_cache_t* create_lru_cache(){
-    lru_cache_t *cache = malloc(sizeof(lru_cache_t));
-    if(!cache) return NULL;
+//hashing a string into one of CACHE_SIZE slots
+unsigned int hash(const char *key)
+{
+    return hash_key(key, strlen(key)) % CACHE_SIZE;
+}
+
+static cache_shard_t* shard_of(lru_cache_t *cache, uint64_t hash_value)
+{
+    return &cache->shards[(hash_value >> 54) & (cache->shard_count - 1)];
+}
 
-    cache->head = NULL;
-    cache->tail = NULL;
-    cache->count = 0;
-    cache->capacity = CACHE_SIZE;
+// What an entry counts against max_bytes
+static size_t charge_of(size_t key_length, size_t data_length)
+{
+    return sizeof(cache_node_t) + key_length + data_length;
+}
 
-    for (int iterator = 0; iterator < CACHE_SIZE; iterator++)
+// Look a key up in its bucket; the shard lock is held
+static cache_node_t* find_node(cache_shard_t *shard, uint64_t hash_value, const void *key, size_t key_length)
+{
+    cache_node_t *current = shard->buckets[hash_value & shard->bucket_mask];
+    while (current)
     {
-        cache->nodes[iterator] = NULL;
+        if (current->hash == hash_value && current->key_length == key_length &&
+            memcmp(current->bytes, key, key_length) == 0)
+        {
+            return current;
+        }
+        current = current->hash_next;
     }
-
-    return cache;
+    return NULL;
 }
 
-//Push the Node to front (to mark it as MRU)
-void move_to_front(lru_cache_t *cache, cache_node_t *node)
+static void hash_link(cache_shard_t *shard, cache_node_t *node)
 {
-    if(cache->head == node) return;
-
-    if(node->prev) node->prev->next = node->next;
-    if(node->next) node->next->prev = node->prev;
-    if(cache->tail == node) cache->tail = node->prev;
+    cache_node_t **bucket = &shard->buckets[node->hash & shard->bucket_mask];
+    node->hash_next = *bucket;
+    if (*bucket) (*bucket)->hash_pprev = &node->hash_next;
+    node->hash_pprev = bucket;
+    *bucket = node;
+}
 
-    node->prev = NULL;
-    node->next = cache->head;
-    if(cache->head) cache->head->prev = node;
-    cache->head = node;
+static void hash_unlink(cache_node_t *node)
+{
+    *node->hash_pprev = node->hash_next;
+    if (node->hash_next) node->hash_next->hash_pprev = node->hash_pprev;
+}
 
-    if(!cache->tail) cache->tail = node;
+//Take the Node out of the recency list
+static void list_unlink(cache_shard_t *shard, cache_node_t *node)
+{
+    if (node->prev) node->prev->next = node->next;
+    else shard->head = node->next;
 
+    if (node->next) node->next->prev = node->prev;
+    else shard->tail = node->prev;
 }
 
 //Add Node at the front
-void add_to_front(lru_cache_t *cache, cache_node_t *node){
+static void add_to_front(cache_shard_t *shard, cache_node_t *node)
+{
     node->prev = NULL;
-    node->next = cache->head;
+    node->next = shard->head;
 
-    if(cache->head)
+    if (shard->head)
     {
-        cache->head->prev = node;
+        shard->head->prev = node;
     }
-    cache->head = node;
+    shard->head = node;
 
-    if(!cache->tail)
+    if (!shard->tail)
     {
-        cache->tail = node;
+        shard->tail = node;
     }
 }
 
-//Remove LRU Node
-cache_node_t* remove_lru(lru_cache_t *cache)
+//Push the Node to front (to mark it as MRU)
+static void move_to_front(cache_shard_t *shard, cache_node_t *node)
+{
+    if (shard->head == node) return;
+
+    list_unlink(shard, node);
+    add_to_front(shard, node);
+}
+
+//Remove LRU Node from both lists
+static cache_node_t* remove_lru(cache_shard_t *shard)
 {
-    if(!cache->tail) return NULL;
+    cache_node_t *lru = shard->tail;
+    if (!lru) return NULL;
+
+    list_unlink(shard, lru);
+    hash_unlink(lru);
+    shard->count--;
+    shard->bytes -= charge_of(lru->key_length, lru->data_length);
+    return lru;
+}
+
+// Double the table; on failure the chains just get longer
+static void grow_table(cache_shard_t *shard)
+{
+    size_t bucket_count = (shard->bucket_mask + 1) * 2;
+    cache_node_t **buckets = calloc(bucket_count, sizeof(cache_node_t *));
+    if (!buckets) return;
+
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_mask = bucket_count - 1;
 
-    cache_node_t *lru = cache->tail;
+    for (cache_node_t *node = shard->head; node; node = node->next)
+    {
+        hash_link(shard, node);
+    }
+}
 
-    if(cache->tail->prev)
+//Initialize LRU cache. The limits are for the whole cache; each shard gets
+//its own share of them (see lru-cache.h), and fewer shards are used when a
+//share would be too small.
+lru_cache_t* create_lru_cache(size_t max_entries, size_t max_bytes, int shards)
+{
+    if ((max_entries == 0 && max_bytes == 0) || shards <= 0 || shards > CACHE_MAX_SHARDS)
     {
-        cache->tail->prev->next = NULL;
-    }else
+        errno = EINVAL;
+        return NULL;
+    }
+
+    int shard_count = 1;
+    while (shard_count < shards) shard_count *= 2;
+    while (shard_count > 1 &&
+           ((max_entries && max_entries < (size_t)shard_count) ||
+            (max_bytes && max_bytes / shard_count < CACHE_MIN_SHARD_BYTES)))
     {
-        cache->head = NULL;
+        shard_count /= 2;
     }
 
-    cache->tail = cache->tail->prev;
+    lru_cache_t *cache = malloc(sizeof(lru_cache_t));
+    if (!cache) return NULL;
 
-    return lru;
-}
+    if (posix_memalign((void **)&cache->shards, 64, sizeof(cache_shard_t) * shard_count) != 0)
+    {
+        free(cache);
+        return NULL;
+    }
+    cache->shard_count = shard_count;
 
-// Getter - to get data from the cache
-char* cache_get(lru_cache_t *cache, const char *key) {
-    unsigned int index = hash(key);
-    cache_node_t *current = cache->nodes[index];
+    size_t shard_entries = max_entries / shard_count;
+    size_t bucket_count = CACHE_MIN_BUCKETS;
+    while (bucket_count <= shard_entries) bucket_count *= 2;
 
-    while (current)
+    for (int iterator = 0; iterator < shard_count; iterator++)
     {
-        if(strcmp(current->key, key) == 0)
+        cache_shard_t *shard = &cache->shards[iterator];
+        memset(shard, 0, sizeof(cache_shard_t));
+        pthread_mutex_init(&shard->lock, NULL);
+        // The remainders go to the first shards, so the shares add up to the limits
+        shard->max_entries = shard_entries + ((size_t)iterator < max_entries % shard_count);
+        shard->max_bytes = max_bytes / shard_count + ((size_t)iterator < max_bytes % shard_count);
+        shard->buckets = calloc(bucket_count, sizeof(cache_node_t *));
+        shard->bucket_mask = bucket_count - 1;
+
+        if (!shard->buckets)
         {
-            move_to_front(cache, current);
-            printf("Cache successfully HIT for the key %s \n", key);
-            return current->data;
+            cache->shard_count = iterator + 1;
+            destroy_lru_cache(cache);
+            return NULL;
         }
-        current = current->next;
     }
-    printf("Cache MISS for the key %s \n", key);
-    return NULL;
+
+    return cache;
 }
 
-// Put - to put the data to the cache
-void cache_put(lru_cache_t *cache, const char *key, const char *data)
+// Getter - copies up to size bytes of the value into data and returns the
+// value's length; -1 with ENOENT on a miss
+ssize_t cache_get(lru_cache_t *cache, const void *key, size_t key_length, void *data, size_t size)
 {
-    unsigned int index = hash(key);
+    uint64_t hash_value = hash_key(key, key_length);
+    cache_shard_t *shard = shard_of(cache, hash_value);
 
-    char *existing = cache_get(cache, key);
-    if(existing)
+    pthread_mutex_lock(&shard->lock);
+    cache_node_t *node = find_node(shard, hash_value, key, key_length);
+    if (!node)
     {
-        cache_node_t *current = cache->nodes[index];
-        while (current && strcmp(current->key, key) != 0) {
-            current = current->next;
-        }
-        if(current)
-        {
-            strncpy(current->data, data, DATA_SIZE - 1);
-            current->data[DATA_SIZE - 1] = '\0';
-        }
-        return;
+        shard->misses++;
+        pthread_mutex_unlock(&shard->lock);
+        errno = ENOENT;
+        return -1;
     }
 
-    cache_node_t *new_node = malloc(sizeof(cache_node_t));
-    if(!new_node) return;
+    shard->hits++;
+    move_to_front(shard, node);
+    size_t length = node->data_length;
+    memcpy(data, node->bytes + key_length, length < size ? length : size);
+    pthread_mutex_unlock(&shard->lock);
 
-    strncpy(new_node->key, key, KEY_SIZE - 1);
-    new_node->key[KEY_SIZE - 1] = '\0';
+    return (ssize_t)length;
+}
 
-    strncpy(new_node->data, data, DATA_SIZE - 1);
-    new_node->data[DATA_SIZE - 1] = '\0';
+// Put - adds or replaces an entry, evicting from the shard's LRU end until
+// it is within its limits again. An entry bigger than its shard's share of
+// max_bytes is refused with E2BIG, leaving any old value in place.
+int cache_put(lru_cache_t *cache, const void *key, size_t key_length, const void *data, size_t data_length)
+{
+    uint64_t hash_value = hash_key(key, key_length);
+    cache_shard_t *shard = shard_of(cache, hash_value);
+    size_t charge = charge_of(key_length, data_length);
 
-    new_node->prev = new_node->next = NULL;
+    if (shard->max_bytes && charge > shard->max_bytes)
+    {
+        errno = E2BIG;
+        return -1;
+    }
 
-    if(cache->count >= cache->capacity){
-        cache_node_t *lru = remove_lru(cache);
+    // Built before taking the lock, freed after dropping it
+    cache_node_t *new_node = malloc(charge);
+    if (!new_node) return -1;
 
-        if(lru)
-        {
-            unsigned int lru_index = hash(lru->key);
-            if(cache->nodes[lru_index] == lru) {
-                cache->nodes[lru_index] = lru->next;
-            }
-            free(lru);
-            cache->count--;
-        }
+    new_node->hash = hash_value;
+    new_node->key_length = key_length;
+    new_node->data_length = data_length;
+    memcpy(new_node->bytes, key, key_length);
+    memcpy(new_node->bytes + key_length, data, data_length);
+
+    cache_node_t *evicted = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+
+    cache_node_t *existing = find_node(shard, hash_value, key, key_length);
+    if (existing)
+    {
+        hash_unlink(existing);
+        list_unlink(shard, existing);
+        shard->count--;
+        shard->bytes -= charge_of(existing->key_length, existing->data_length);
+        existing->next = NULL;
+        evicted = existing;
+    }
+
+    hash_link(shard, new_node);
+    add_to_front(shard, new_node);
+    shard->count++;
+    shard->bytes += charge;
+
+    // The new entry fits on its own, so it is never the one to go
+    while ((shard->max_entries && shard->count > shard->max_entries) ||
+           (shard->max_bytes && shard->bytes > shard->max_bytes))
+    {
+        cache_node_t *lru = remove_lru(shard);
+        lru->next = evicted;
+        evicted = lru;
+        shard->evictions++;
+    }
+
+    if (shard->count > shard->bucket_mask + 1) grow_table(shard);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    while (evicted)
+    {
+        cache_node_t *next = evicted->next;
+        free(evicted);
+        evicted = next;
+    }
+
+    return 0;
+}
+
+// Remove - drops an entry; -1 with ENOENT if there is none
+int cache_remove(lru_cache_t *cache, const void *key, size_t key_length)
+{
+    uint64_t hash_value = hash_key(key, key_length);
+    cache_shard_t *shard = shard_of(cache, hash_value);
+
+    pthread_mutex_lock(&shard->lock);
+    cache_node_t *node = find_node(shard, hash_value, key, key_length);
+    if (node)
+    {
+        hash_unlink(node);
+        list_unlink(shard, node);
+        shard->count--;
+        shard->bytes -= charge_of(node->key_length, node->data_length);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (!node)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    free(node);
+    return 0;
+}
+
+//Totals over all the shards
+void cache_stats(lru_cache_t *cache, cache_stats_t *stats)
+{
+    memset(stats, 0, sizeof(cache_stats_t));
+
+    for (int iterator = 0; iterator < cache->shard_count; iterator++)
+    {
+        cache_shard_t *shard = &cache->shards[iterator];
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->entries += shard->count;
+        stats->bytes += shard->bytes;
+        pthread_mutex_unlock(&shard->lock);
     }
+}
 
-    add_to_front(cache, new_node);
-    new_node->next = cache->nodes[index];
-    cache->nodes[index] = new_node;
-    cache->count++;
+//Destroy the cache and every entry in it
+void destroy_lru_cache(lru_cache_t *cache)
+{
+    if (!cache) return;
 
-    printf("Cached key is %s with the data %s \n", key, data);
+    for (int iterator = 0; iterator < cache->shard_count; iterator++)
+    {
+        cache_shard_t *shard = &cache->shards[iterator];
+        cache_node_t *node = shard->head;
+        while (node)
+        {
+            cache_node_t *next = node->next;
+            free(node);
+            node = next;
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
 
+    free(cache->shards);
+    free(cache);
 }
@@ -2,32 +2,75 @@
 #define LRU_CACHE
 
 #define CACHE_SIZE 5
-#define KEY_SIZE 32
-#define DATA_SIZE 256
+#define CACHE_MAX_SHARDS 1024
+#define CACHE_MIN_BUCKETS 16
+#define CACHE_MIN_SHARD_BYTES (64 * 1024)   // smallest byte share worth a shard of its own
 
 #include "main.h"
 
+// Cache entry: one allocation holding the key, then the value. It sits on
+// two lists at once - its bucket's chain, and its shard's recency list -
+// both doubly linked so it leaves either in O(1).
 typedef struct cache_node {
-    char key[KEY_SIZE];
-    char data[DATA_SIZE];
-    struct cache_node *prev;
-    struct cache_node *next;
+    struct cache_node *hash_next;
+    struct cache_node **hash_pprev;  // the link pointing at this node
+    struct cache_node *prev;         // towards MRU
+    struct cache_node *next;         // towards LRU
+    uint64_t hash;
+    size_t key_length;
+    size_t data_length;
+    char bytes[];
 }cache_node_t;
 
-typedef struct lru_cache {
+// A shard is a small LRU cache of its own, with its own lock, table and
+// share of the capacity. The table doubles when it holds more entries than
+// buckets.
+typedef struct cache_shard {
+    pthread_mutex_t lock;
+    cache_node_t **buckets;
+    size_t bucket_mask;
     cache_node_t *head; //MRU
     cache_node_t *tail; //LRU
-    cache_node_t *nodes[CACHE_SIZE];
-    int count;
-    int capacity;
+    size_t count;
+    size_t bytes;                    // charged for entries: node header, key and value
+    size_t max_entries;              // 0: no limit
+    size_t max_bytes;                // 0: no limit
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+}__attribute__((aligned(64))) cache_shard_t;
+
+// The high bits of a key's hash pick its shard and the low bits its bucket,
+// so threads working on different keys rarely share a lock. Recency is kept
+// per shard: a put evicts from its own shard's LRU end.
+//
+// The limits given to create_lru_cache are split between the shards, and
+// each shard enforces its own share: together they never hold more than
+// max_entries entries or max_bytes bytes, but a shard can be full while
+// others have room, and an entry bigger than one shard's share of
+// max_bytes is refused. So that every share holds at least one entry and
+// CACHE_MIN_SHARD_BYTES bytes, a cache with small limits gets fewer shards
+// than asked for (shard_count says how many).
+typedef struct lru_cache {
+    cache_shard_t *shards;
+    int shard_count;                 // a power of two
 }lru_cache_t;
 
+typedef struct cache_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    size_t entries;
+    size_t bytes;
+}cache_stats_t;
+
+uint64_t hash_key(const void *key, size_t length);
 unsigned int hash(const char *key);
-lru_cache_t* create_lru_cache();
-void move_to_front(lru_cache_t *cache, cache_node_t *node);
-void add_to_front(lru_cache_t *cache, cache_node_t *node);
-cache_node_t* remove_lru(lru_cache_t *cache);
-char* cache_get(lru_cache_t *cache, const char *key);
-void cache_put(lru_cache_t *cache, const char *key, const char *data);
-
-#endif
\ No newline at end of file
+lru_cache_t* create_lru_cache(size_t max_entries, size_t max_bytes, int shards);
+ssize_t cache_get(lru_cache_t *cache, const void *key, size_t key_length, void *data, size_t size);
+int cache_put(lru_cache_t *cache, const void *key, size_t key_length, const void *data, size_t data_length);
+int cache_remove(lru_cache_t *cache, const void *key, size_t key_length);
+void cache_stats(lru_cache_t *cache, cache_stats_t *stats);
+void destroy_lru_cache(lru_cache_t *cache);
+
+#endif
@@ -1,6 +1,419 @@
 #include "buffer-pool.h"
+#include "lru-cache.h"
+
+// Build: gcc -O2 -pthread -o run main.c buffer-pool.c lru-cache.c file-caching-system.c
+// Run:   ./run                     reads file1.txt through the buffer pool
+//        ./run bench [buffers=1024] [pages=4096] [threads=8] [ops=1000000]
+//        ./run lru-bench [shards=16] [threads=8] [ops=1000000] [keys=200000] [entries=50000] [megabytes=16]
+//
+// The benchmark pins random pages of a file of `pages` pages through a pool
+// of `buffers` buffers from 1, 2, 4 ... `threads` threads, each doing `ops`
+// pins. Every page starts with its own number, checked on each pin; one pin
+// in ten also bumps the thread's counter in the page and unpins it dirty.
+// At the end the pool is flushed and the counters read back from the file
+// must add up to the writes made. "uniform" picks any page; "skewed" sends
+// nine pins in ten to the first tenth of the pages.
+//
+// The LRU benchmark looks keys up in the cache from 1, 2, 4 ... `threads`
+// threads and puts each key it misses on, once with one shard and once with
+// `shards`. There are `keys` keys of 8 to 39 bytes, each with its own value of
+// 16 to 1024 bytes, and hits are checked against it. The cache holds at most
+// `entries` entries and `megabytes` MB, whichever comes first; with small
+// limits it uses fewer shards than asked for, and the shards column says how
+// many.
+#define BENCH_FILE "/tmp/buffer-pool-bench.dat"
+#define LRU_KEY_MAX 40
+#define LRU_VALUE_MAX 1024
+#define BENCH_MAX_THREADS 64
+
+typedef struct bench_worker {
+    pthread_t thread;
+    buffer_pool_t *pool;
+    int fd;
+    int id;
+    uint32_t pages;
+    long ops;
+    bool skewed;
+    uint64_t seed;
+    unsigned long writes;
+    unsigned long mismatches;
+    unsigned long failures;
+}bench_worker_t;
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static double now_seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void* bench_main(void *argument)
+{
+    bench_worker_t *worker = argument;
+    uint32_t hot = worker->pages / 10 ? worker->pages / 10 : 1;
+
+    for (long op = 0; op < worker->ops; op++)
+    {
+        uint64_t random = next_random(&worker->seed);
+        uint32_t page;
+        if (worker->skewed && random % 10 != 0)
+        {
+            page = (random >> 8) % hot;
+        }
+        else
+        {
+            page = (random >> 8) % worker->pages;
+        }
+
+        buffer_t *buffer = pin_page(worker->pool, worker->fd, page);
+        if (!buffer)
+        {
+            worker->failures++;
+            continue;
+        }
+
+        uint32_t stored;
+        memcpy(&stored, buffer->data, sizeof(stored));
+        if (stored != page) worker->mismatches++;
+
+        bool write = (random >> 40) % 10 == 0;
+        if (write)
+        {
+            uint64_t *counter = (uint64_t *)(buffer->data + 64) + worker->id;
+            (*counter)++;
+            worker->writes++;
+        }
+        unpin_page(worker->pool, buffer, write);
+    }
+
+    return NULL;
+}
+
+// A file of `pages` pages, each starting with its number
+static int bench_file(uint32_t pages)
+{
+    int fd = open(BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return -1;
+
+    char page_data[BUFFER_SIZE] = {0};
+    for (uint32_t page = 0; page < pages; page++)
+    {
+        memcpy(page_data, &page, sizeof(page));
+        if (pwrite(fd, page_data, BUFFER_SIZE, (off_t)page * BUFFER_SIZE) != BUFFER_SIZE)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+// Counters in the file against the writes the workers made
+static unsigned long bench_check(int fd, uint32_t pages, bench_worker_t *workers, int threads)
+{
+    unsigned long totals[BENCH_MAX_THREADS] = {0};
+    char page_data[BUFFER_SIZE];
+    unsigned long wrong = 0;
+
+    for (uint32_t page = 0; page < pages; page++)
+    {
+        if (pread(fd, page_data, BUFFER_SIZE, (off_t)page * BUFFER_SIZE) != BUFFER_SIZE) return pages;
+
+        uint32_t stored;
+        memcpy(&stored, page_data, sizeof(stored));
+        if (stored != page) wrong++;
+
+        for (int id = 0; id < threads; id++)
+        {
+            uint64_t counter;
+            memcpy(&counter, page_data + 64 + id * sizeof(counter), sizeof(counter));
+            totals[id] += counter;
+        }
+    }
+
+    for (int id = 0; id < threads; id++)
+    {
+        if (totals[id] != workers[id].writes) wrong++;
+    }
+    return wrong;
+}
+
+static int bench_run(int buffers, uint32_t pages, int threads, long ops, bool skewed)
+{
+    int fd = bench_file(pages);
+    if (fd == -1)
+    {
+        perror(BENCH_FILE);
+        return -1;
+    }
+
+    buffer_pool_t *pool = create_buffer_pool(buffers);
+    if (!pool)
+    {
+        perror("create_buffer_pool");
+        close(fd);
+        return -1;
+    }
+
+    bench_worker_t workers[BENCH_MAX_THREADS];
+    double start = now_seconds();
+    for (int id = 0; id < threads; id++)
+    {
+        workers[id] = (bench_worker_t){
+            .pool = pool, .fd = fd, .id = id, .pages = pages, .ops = ops,
+            .skewed = skewed, .seed = 0x9E3779B97F4A7C15ull * (id + 1)};
+        pthread_create(&workers[id].thread, NULL, bench_main, &workers[id]);
+    }
+
+    unsigned long writes = 0, mismatches = 0, failures = 0;
+    for (int id = 0; id < threads; id++)
+    {
+        pthread_join(workers[id].thread, NULL);
+        writes += workers[id].writes;
+        mismatches += workers[id].mismatches;
+        failures += workers[id].failures;
+    }
+    double elapsed = now_seconds() - start;
+
+    pool_stats_t stats;
+    buffer_pool_stats(pool, &stats);
+    int flushed = flush_buffer_pool(pool);
+    unsigned long wrong = bench_check(fd, pages, workers, threads);
+    destroy_buffer_pool(pool);
+    close(fd);
+
+    double lookups = stats.hits + stats.misses;
+    printf("%-8s %7d %12.0f %8.1f%% %10lu %10lu %9lu %9lu %9lu\n",
+           skewed ? "skewed" : "uniform", threads, threads * ops / elapsed,
+           lookups ? 100.0 * stats.hits / lookups : 0.0, stats.reads, stats.writes,
+           writes, mismatches + wrong, failures);
+
+    return flushed == -1 || mismatches || wrong ? -1 : 0;
+}
+
+static int bench(int argc, char *argv[])
+{
+    int buffers = argc > 2 ? atoi(argv[2]) : 1024;
+    long pages = argc > 3 ? atol(argv[3]) : 4096;
+    int threads = argc > 4 ? atoi(argv[4]) : 8;
+    long ops = argc > 5 ? atol(argv[5]) : 1000000;
+
+    if (buffers <= 0 || pages <= 0 || pages > UINT32_MAX || threads <= 0 ||
+        threads > BENCH_MAX_THREADS || ops <= 0)
+    {
+        printf("Usage: %s bench [buffers] [pages] [threads 1..%d] [ops per thread]\n",
+               argv[0], BENCH_MAX_THREADS);
+        return 1;
+    }
+
+    printf("%d buffers (%.1f MB), %ld pages (%.1f MB), %ld pins per thread\n",
+           buffers, buffers * (double)BUFFER_SIZE / (1 << 20),
+           pages, pages * (double)BUFFER_SIZE / (1 << 20), ops);
+    printf("%-8s %7s %12s %9s %10s %10s %9s %9s %9s\n",
+           "access", "threads", "pins/s", "hit rate", "reads", "writes", "dirtied", "wrong", "failed");
+
+    int status = 0;
+    for (int skewed = 0; skewed <= 1; skewed++)
+    {
+        for (int count = 1; count <= threads; count = count < threads && count * 2 > threads ? threads : count * 2)
+        {
+            if (bench_run(buffers, (uint32_t)pages, count, ops, skewed) == -1) status = 1;
+        }
+    }
+
+    unlink(BENCH_FILE);
+    return status;
+}
+
+typedef struct lru_worker {
+    pthread_t thread;
+    lru_cache_t *cache;
+    uint32_t keys;
+    long ops;
+    bool skewed;
+    uint64_t seed;
+    unsigned long wrong;
+    unsigned long refused;          // puts that failed, E2BIG for a value too big for its shard
+}lru_worker_t;
+
+// Key and value of key number `id`; returns the key's length
+static size_t lru_key(uint32_t id, char *key)
+{
+    size_t length = 8 + id % (LRU_KEY_MAX - 8);
+    memcpy(key, &id, sizeof(id));
+    memset(key + sizeof(id), 'k', length - sizeof(id));
+    return length;
+}
+
+static size_t lru_value(uint32_t id, char *value)
+{
+    size_t length = 16 + (id * 2654435761u) % (LRU_VALUE_MAX - 15);
+    for (size_t index = 0; index < length; index++)
+    {
+        value[index] = (char)(id + index);
+    }
+    return length;
+}
+
+static void* lru_main(void *argument)
+{
+    lru_worker_t *worker = argument;
+    uint32_t hot = worker->keys / 10 ? worker->keys / 10 : 1;
+    char key[LRU_KEY_MAX];
+    char value[LRU_VALUE_MAX];
+    char expected[LRU_VALUE_MAX];
+
+    for (long op = 0; op < worker->ops; op++)
+    {
+        uint64_t random = next_random(&worker->seed);
+        uint32_t id;
+        if (worker->skewed && random % 10 != 0)
+        {
+            id = (random >> 8) % hot;
+        }
+        else
+        {
+            id = (random >> 8) % worker->keys;
+        }
+
+        size_t key_length = lru_key(id, key);
+        ssize_t length = cache_get(worker->cache, key, key_length, value, sizeof(value));
+        if (length == -1)
+        {
+            size_t value_length = lru_value(id, value);
+            if (cache_put(worker->cache, key, key_length, value, value_length) == -1) worker->refused++;
+            continue;
+        }
+
+        size_t expected_length = lru_value(id, expected);
+        if ((size_t)length != expected_length || memcmp(value, expected, expected_length) != 0)
+        {
+            worker->wrong++;
+        }
+    }
+
+    return NULL;
+}
+
+static int lru_run(int shards, int threads, long ops, uint32_t keys, size_t entries, size_t bytes, bool skewed)
+{
+    lru_cache_t *cache = create_lru_cache(entries, bytes, shards);
+    if (!cache)
+    {
+        perror("create_lru_cache");
+        return -1;
+    }
+
+    lru_worker_t workers[BENCH_MAX_THREADS];
+    double start = now_seconds();
+    for (int id = 0; id < threads; id++)
+    {
+        workers[id] = (lru_worker_t){
+            .cache = cache, .keys = keys, .ops = ops, .skewed = skewed,
+            .seed = 0x9E3779B97F4A7C15ull * (id + 1)};
+        pthread_create(&workers[id].thread, NULL, lru_main, &workers[id]);
+    }
+
+    unsigned long wrong = 0, refused = 0;
+    for (int id = 0; id < threads; id++)
+    {
+        pthread_join(workers[id].thread, NULL);
+        wrong += workers[id].wrong;
+        refused += workers[id].refused;
+    }
+    double elapsed = now_seconds() - start;
+
+    cache_stats_t stats;
+    cache_stats(cache, &stats);
+    int shard_count = cache->shard_count;
+    destroy_lru_cache(cache);
+
+    double lookups = stats.hits + stats.misses;
+    printf("%-8s %6d %7d %12.0f %8.1f%% %10lu %8zu %8.1f %7lu %7lu\n",
+           skewed ? "skewed" : "uniform", shard_count, threads, threads * ops / elapsed,
+           lookups ? 100.0 * stats.hits / lookups : 0.0, stats.evictions,
+           stats.entries, stats.bytes / (double)(1 << 20), refused, wrong);
+
+    return wrong || (entries && stats.entries > entries) || (bytes && stats.bytes > bytes) ? -1 : 0;
+}
+
+static int lru_bench(int argc, char *argv[])
+{
+    int shards = argc > 2 ? atoi(argv[2]) : 16;
+    int threads = argc > 3 ? atoi(argv[3]) : 8;
+    long ops = argc > 4 ? atol(argv[4]) : 1000000;
+    long keys = argc > 5 ? atol(argv[5]) : 200000;
+    long entries = argc > 6 ? atol(argv[6]) : 50000;
+    long megabytes = argc > 7 ? atol(argv[7]) : 16;
+
+    if (shards <= 0 || shards > CACHE_MAX_SHARDS || threads <= 0 || threads > BENCH_MAX_THREADS ||
+        ops <= 0 || keys <= 0 || keys > UINT32_MAX || entries < 0 || megabytes < 0 ||
+        (entries == 0 && megabytes == 0))
+    {
+        printf("Usage: %s lru-bench [shards 1..%d] [threads 1..%d] [ops per thread] [keys] [entries] [megabytes]\n",
+               argv[0], CACHE_MAX_SHARDS, BENCH_MAX_THREADS);
+        return 1;
+    }
+
+    printf("%ld keys, at most %ld entries and %ld MB, %ld lookups per thread\n",
+           keys, entries, megabytes, ops);
+    printf("%-8s %6s %7s %12s %9s %10s %8s %8s %7s %7s\n",
+           "access", "shards", "threads", "lookups/s", "hit rate", "evictions", "entries", "MB",
+           "refused", "wrong");
+
+    // One lock against `shards` of them
+    int shard_counts[2] = {1, shards};
+    int status = 0;
+    for (int skewed = 0; skewed <= 1; skewed++)
+    {
+        for (int pass = 0; pass < (shards > 1 ? 2 : 1); pass++)
+        {
+            for (int count = 1; count <= threads; count = count < threads && count * 2 > threads ? threads : count * 2)
+            {
+                if (lru_run(shard_counts[pass], count, ops, (uint32_t)keys, entries,
+                            (size_t)megabytes << 20, skewed) == -1) status = 1;
+            }
+        }
+    }
+
+    return status;
+}
+
+int main(int argc, char *argv[]){
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) return bench(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "lru-bench") == 0) return lru_bench(argc, argv);
+
+    int fd = open("file1.txt", O_RDONLY);
+    if (fd == -1)
+    {
+        perror("file1.txt");
+        return 1;
+    }
 
-int main(){
-    FILE *fp = fopen("file1.txt", "r");
     buffer_pool_t* pool = create_buffer_pool(POOL_SIZE);
-}
\ No newline at end of file
+    if (!pool)
+    {
+        close(fd);
+        return 1;
+    }
+
+    buffer_t *buffer = pin_page(pool, fd, 0);
+    if (buffer)
+    {
+        printf("%.*s", (int)strnlen(buffer->data, BUFFER_SIZE), buffer->data);
+        unpin_page(pool, buffer, false);
+    }
+
+    destroy_buffer_pool(pool);
+    close(fd);
+    return 0;
+}
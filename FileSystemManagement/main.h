@@ -7,4 +7,9 @@
 #include <stdbool.h>
 #include<fcntl.h>
 #include<unistd.h>
+#include<stdint.h>
+#include<errno.h>
+#include<time.h>
+#include<pthread.h>
+#include<stdatomic.h>
 #endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "faultInject.h"
+
+const char *const fault_points[] = {
+    FAULT_WAL_MID_RECORD,
+    FAULT_WAL_BEFORE_SYNC,
+    FAULT_WAL_BEFORE_ACK,
+    FAULT_WAL_ROTATE,
+    FAULT_SEGMENT_BEFORE_RENAME,
+    FAULT_COMPACTION_SWAPPED,
+    FAULT_CHECKPOINT_FLUSHED,
+    FAULT_CHECKPOINT_TMP,
+    FAULT_CHECKPOINT_WRITTEN,
+    FAULT_TRUNCATE_PARTIAL,
+};
+const size_t fault_point_count = sizeof(fault_points) / sizeof(fault_points[0]);
+
+static pthread_once_t fault_once = PTHREAD_ONCE_INIT;
+static char armed_point[64];
+static uint64_t armed_hit;
+static atomic_uint_fast64_t hits;
+static int power_loss;
+
+static void fault_init() {
+    const char *spec = getenv(FAULT_ENV);
+    if (spec && *spec) {
+        const char *colon = strchr(spec, ':');
+        size_t length = colon ? (size_t)(colon - spec) : strlen(spec);
+        if (length < sizeof(armed_point)) {
+            memcpy(armed_point, spec, length);
+            armed_point[length] = '\0';
+            armed_hit = colon ? strtoull(colon + 1, NULL, 10) : 1;
+        }
+    }
+    const char *power = getenv(FAULT_POWER_ENV);
+    power_loss = power && strcmp(power, "1") == 0;
+}
+
+// Overrides the environment; call before any thread reaches a crash point
+void fault_arm(const char *point, uint64_t hit, int tear_unsynced) {
+    pthread_once(&fault_once, fault_init);
+    snprintf(armed_point, sizeof(armed_point), "%s", point);
+    armed_hit = hit ? hit : 1;
+    atomic_store(&hits, 0);
+    power_loss = tear_unsynced;
+}
+
+// Unarmed points cost one string compare against an empty name
+int fault_should_crash(const char *point) {
+    pthread_once(&fault_once, fault_init);
+    if (armed_point[0] == '\0' || strcmp(armed_point, point) != 0)
+        return 0;
+    return atomic_fetch_add(&hits, 1) + 1 == armed_hit;
+}
+
+// Times the armed point has been reached; arm with hit UINT64_MAX to count without crashing
+uint64_t fault_hits() {
+    return atomic_load(&hits);
+}
+
+int fault_power_loss() {
+    pthread_once(&fault_once, fault_init);
+    return power_loss;
+}
+
+void fault_crash(const char *point) {
+    fprintf(stderr, "fault: crashing at %s\n", point);
+    _exit(FAULT_EXIT_CODE);
+}
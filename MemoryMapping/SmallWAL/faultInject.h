@@ -0,0 +1,38 @@
+#ifndef FAULTINJECT_H
+#define FAULTINJECT_H
+
+#include "main.h"
+
+// Named crash points compiled into the WAL, the store and the checkpoint
+// path. A point is armed with SMALLWAL_CRASH=<point>[:<hit>] in the
+// environment, or with fault_arm from a harness child; the process then
+// _exits with FAULT_EXIT_CODE on the hit-th time it reaches that point.
+// With SMALLWAL_CRASH_POWER=1 (or power_loss set) the WAL writer also tears
+// whatever it has not synced yet, as a power cut would, before dying.
+#define FAULT_ENV "SMALLWAL_CRASH"
+#define FAULT_POWER_ENV "SMALLWAL_CRASH_POWER"
+#define FAULT_EXIT_CODE 99
+
+#define FAULT_WAL_MID_RECORD        "wal-mid-record"        // part of a batch written
+#define FAULT_WAL_BEFORE_SYNC       "wal-before-sync"       // batch written, not synced
+#define FAULT_WAL_BEFORE_ACK        "wal-before-ack"        // synced, committers not woken
+#define FAULT_WAL_ROTATE            "wal-rotate"            // old segment closed, new not opened
+#define FAULT_SEGMENT_BEFORE_RENAME "segment-before-rename" // sorted segment built as .tmp
+#define FAULT_COMPACTION_SWAPPED    "compaction-swapped"    // output live, inputs not unlinked
+#define FAULT_CHECKPOINT_FLUSHED    "checkpoint-flushed"    // memtable flushed, checkpoint not moved
+#define FAULT_CHECKPOINT_TMP        "checkpoint-tmp"        // checkpoint.tmp synced, not renamed
+#define FAULT_CHECKPOINT_WRITTEN    "checkpoint-written"    // checkpoint moved, log not truncated
+#define FAULT_TRUNCATE_PARTIAL      "truncate-partial"      // one covered segment recycled
+
+extern const char *const fault_points[];
+extern const size_t fault_point_count;
+
+void fault_arm(const char *point, uint64_t hit, int tear_unsynced);
+int fault_should_crash(const char *point);
+uint64_t fault_hits();
+int fault_power_loss();
+void fault_crash(const char *point);
+
+#define FAULT_POINT(point) do { if (fault_should_crash(point)) fault_crash(point); } while (0)
+
+#endif
@@ -0,0 +1,702 @@
+#include "kvStore.h"
+#include "faultInject.h"
+#include <dirent.h>
+#include <inttypes.h>
+
+// A copied memtable row; scans copy memtable ranges so they never hold its lock
+typedef struct kv_entry {
+    char *key;
+    uint32_t key_length;
+    char *value;
+    uint32_t value_length;
+    int deleted;
+} kv_entry_t;
+
+// One input of a k-way merge: either a segment cursor or a copied memtable range
+typedef struct merge_source {
+    int is_segment;
+    segment_iter_t iter;
+    kv_entry_t *entries;
+    size_t count;
+    size_t position;
+} merge_source_t;
+
+// Merge output; unlike kv_scan_fn it also sees tombstones
+typedef int (*merge_fn)(const char *key, uint32_t key_length,
+                        const char *value, uint32_t value_length, int deleted, void *arg);
+
+typedef struct scan_visitor {
+    kv_scan_fn fn;
+    void *arg;
+} scan_visitor_t;
+
+typedef struct segment_output {
+    segment_builder_t *builder;
+    int drop_tombstones;
+} segment_output_t;
+
+static int segment_file_path(char *path, size_t capacity, const char *dir,
+                             uint64_t seq, uint32_t generation, int tmp) {
+    int length = snprintf(path, capacity, "%s/%016" PRIx64 "-%04x" KV_SEGMENT_SUFFIX "%s",
+                          dir, seq, generation, tmp ? ".tmp" : "");
+    return length < 0 || (size_t)length >= capacity ? -1 : 0;
+}
+
+static int fsync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+static int compare_segment_ptrs(const void *a, const void *b) {
+    const sorted_segment_t *left = *(sorted_segment_t *const *)a;
+    const sorted_segment_t *right = *(sorted_segment_t *const *)b;
+    if (left->seq != right->seq)
+        return (left->seq > right->seq) - (left->seq < right->seq);
+    return (left->generation > right->generation) - (left->generation < right->generation);
+}
+
+static int append_segment(kv_store_t *store, sorted_segment_t *segment) {
+    if (store->segment_count == store->segment_capacity) {
+        size_t capacity = store->segment_capacity ? store->segment_capacity * 2 : 16;
+        sorted_segment_t **grown = realloc(store->segments, sizeof(sorted_segment_t *) * capacity);
+        if (!grown)
+            return -1;
+        store->segments = grown;
+        store->segment_capacity = capacity;
+    }
+    store->segments[store->segment_count++] = segment;
+    return 0;
+}
+
+// Load every segment in the directory. Leftover .tmp files and generations
+// superseded by a finished compaction are removed.
+static int load_segments(kv_store_t *store) {
+    DIR *d = opendir(store->dir);
+    if (!d)
+        return -1;
+
+    char path[PATH_MAX];
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        uint64_t seq;
+        unsigned int generation;
+        char suffix[16];
+
+        if (sscanf(entry->d_name, "%16" SCNx64 "-%4x%15s", &seq, &generation, suffix) != 3)
+            continue;
+        int length = snprintf(path, sizeof(path), "%s/%s", store->dir, entry->d_name);
+        if (length < 0 || (size_t)length >= sizeof(path))
+            continue;
+        if (strcmp(suffix, KV_SEGMENT_SUFFIX) != 0) {
+            unlink(path);
+            continue;
+        }
+
+        sorted_segment_t *segment = sorted_segment_open(path, seq, generation);
+        if (!segment || append_segment(store, segment) < 0) {
+            closedir(d);
+            return -1;
+        }
+        if (seq >= store->next_seq)
+            store->next_seq = seq + 1;
+    }
+    closedir(d);
+
+    if (store->segment_count > 1)
+        qsort(store->segments, store->segment_count, sizeof(sorted_segment_t *), compare_segment_ptrs);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < store->segment_count; i++) {
+        sorted_segment_t *segment = store->segments[i];
+        if (i + 1 < store->segment_count && store->segments[i + 1]->seq == segment->seq) {
+            unlink(segment->path);
+            sorted_segment_release(segment);
+            continue;
+        }
+        store->segments[kept++] = segment;
+    }
+    store->segment_count = kept;
+    return 0;
+}
+
+static int create_tables(mem_table_t **tables) {
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS; i++) {
+        tables[i] = mem_table_create();
+        if (!tables[i]) {
+            while (i-- > 0)
+                mem_table_destroy(tables[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void destroy_tables(mem_table_t **tables) {
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS; i++) {
+        mem_table_destroy(tables[i]);
+        tables[i] = NULL;
+    }
+}
+
+unsigned int kv_store_shard(const char *key, uint32_t key_length) {
+    return (unsigned int)(key_hash(key, key_length) & (KV_MEMTABLE_SHARDS - 1));
+}
+
+static int source_valid(const merge_source_t *source) {
+    return source->is_segment ? source->iter.valid : source->position < source->count;
+}
+
+static void source_current(const merge_source_t *source, const char **key, uint32_t *key_length,
+                           const char **value, uint32_t *value_length, int *deleted) {
+    if (source->is_segment) {
+        *key = source->iter.key;
+        *key_length = source->iter.key_length;
+        *value = source->iter.value;
+        *value_length = source->iter.value_length;
+        *deleted = source->iter.deleted;
+    }
+    else {
+        const kv_entry_t *entry = &source->entries[source->position];
+        *key = entry->key;
+        *key_length = entry->key_length;
+        *value = entry->value;
+        *value_length = entry->value_length;
+        *deleted = entry->deleted;
+    }
+}
+
+static void source_next(merge_source_t *source) {
+    if (source->is_segment)
+        segment_iter_next(&source->iter);
+    else
+        source->position++;
+}
+
+// Emit each distinct key once, taking the value (or tombstone) from the
+// lowest-numbered (newest) source, until end or until fn returns non-zero
+static int merge_sources(merge_source_t *sources, size_t count, const char *end, uint32_t end_length,
+                         merge_fn fn, void *arg) {
+    for (;;) {
+        const char *min_key = NULL, *min_value = NULL;
+        uint32_t min_key_length = 0, min_value_length = 0;
+        int min_deleted = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            if (!source_valid(&sources[i]))
+                continue;
+            const char *key, *value;
+            uint32_t key_length, value_length;
+            int deleted;
+            source_current(&sources[i], &key, &key_length, &value, &value_length, &deleted);
+            if (!min_key || key_compare(key, key_length, min_key, min_key_length) < 0) {
+                min_key = key;
+                min_key_length = key_length;
+                min_value = value;
+                min_value_length = value_length;
+                min_deleted = deleted;
+            }
+        }
+
+        if (!min_key || (end && key_compare(min_key, min_key_length, end, end_length) >= 0))
+            return 0;
+
+        int rc = fn(min_key, min_key_length, min_value, min_value_length, min_deleted, arg);
+
+        // Step every source past this key. Keys live in the segment mapping
+        // or the copied entries, so min_key stays valid while sources advance.
+        for (size_t i = 0; i < count; i++) {
+            while (source_valid(&sources[i])) {
+                const char *key, *value;
+                uint32_t key_length, value_length;
+                int deleted;
+                source_current(&sources[i], &key, &key_length, &value, &value_length, &deleted);
+                if (key_compare(key, key_length, min_key, min_key_length) > 0)
+                    break;
+                source_next(&sources[i]);
+            }
+        }
+
+        if (rc != 0)
+            return rc;
+    }
+}
+
+static int builder_add_entry(const char *key, uint32_t key_length,
+                             const char *value, uint32_t value_length, int deleted, void *arg) {
+    segment_output_t *output = arg;
+    if (deleted && output->drop_tombstones)
+        return 0;
+    return segment_builder_add(output->builder, key, key_length, value, value_length, deleted);
+}
+
+static int scan_visit(const char *key, uint32_t key_length,
+                      const char *value, uint32_t value_length, int deleted, void *arg) {
+    scan_visitor_t *visitor = arg;
+    if (deleted)
+        return 0;
+    return visitor->fn(key, key_length, value, value_length, visitor->arg);
+}
+
+// Write a segment as .tmp, then rename it into place and open it. Tombstones
+// can only be dropped when nothing older than the inputs could still hold the key.
+static sorted_segment_t *write_segment(kv_store_t *store, uint64_t seq, uint32_t generation,
+                                       merge_source_t *sources, size_t count, uint64_t expected_keys,
+                                       int drop_tombstones) {
+    char tmp_path[PATH_MAX], path[PATH_MAX];
+    uint64_t bytes;
+
+    if (segment_file_path(tmp_path, sizeof(tmp_path), store->dir, seq, generation, 1) < 0 ||
+        segment_file_path(path, sizeof(path), store->dir, seq, generation, 0) < 0) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    segment_builder_t *builder = segment_builder_open(tmp_path, expected_keys);
+    if (!builder)
+        return NULL;
+    segment_output_t output = { builder, drop_tombstones };
+    if (merge_sources(sources, count, NULL, 0, builder_add_entry, &output) != 0) {
+        segment_builder_abort(builder);
+        unlink(tmp_path);
+        return NULL;
+    }
+    if (segment_builder_finish(builder, &bytes) < 0) {
+        unlink(tmp_path);
+        return NULL;
+    }
+    FAULT_POINT(FAULT_SEGMENT_BEFORE_RENAME);
+    if (rename(tmp_path, path) < 0 || fsync_dir(store->dir) < 0) {
+        unlink(tmp_path);
+        return NULL;
+    }
+
+    atomic_fetch_add(&store->disk_bytes, bytes);
+    return sorted_segment_open(path, seq, generation);
+}
+
+// Size-tiered policy: the newest run of KV_COMPACTION_WIDTH adjacent segments
+// whose sizes are within 4x of each other. Returns the run start or -1.
+static long pick_compaction(kv_store_t *store) {
+    size_t width = KV_COMPACTION_WIDTH;
+    if (store->segment_count < KV_COMPACTION_TRIGGER || store->segment_count < width)
+        return -1;
+
+    for (size_t start = store->segment_count - width + 1; start-- > 0;) {
+        size_t smallest = SIZE_MAX, largest = 0;
+        for (size_t i = start; i < start + width; i++) {
+            size_t size = store->segments[i]->size;
+            if (size < smallest)
+                smallest = size;
+            if (size > largest)
+                largest = size;
+        }
+        if (largest <= smallest * 4)
+            return (long)start;
+    }
+    return -1;
+}
+
+// Merge one run of adjacent segments into a segment that takes the seq of
+// the run's newest input with a higher generation, so it sorts exactly where
+// its inputs were. Returns 1 after a merge, 0 when nothing qualifies.
+static int compact_once(kv_store_t *store) {
+    sorted_segment_t *inputs[KV_COMPACTION_WIDTH];
+    merge_source_t sources[KV_COMPACTION_WIDTH];
+    size_t width = KV_COMPACTION_WIDTH;
+    uint64_t expected_keys = 0;
+    uint32_t generation = 0;
+
+    pthread_rwlock_rdlock(&store->lock);
+    long start = pick_compaction(store);
+    if (start < 0) {
+        pthread_rwlock_unlock(&store->lock);
+        return 0;
+    }
+    for (size_t i = 0; i < width; i++) {
+        inputs[i] = store->segments[start + i];
+        sorted_segment_retain(inputs[i]);
+    }
+    pthread_rwlock_unlock(&store->lock);
+
+    // Newest input first so it wins on duplicate keys
+    for (size_t i = 0; i < width; i++) {
+        sorted_segment_t *segment = inputs[width - 1 - i];
+        memset(&sources[i], 0, sizeof(sources[i]));
+        sources[i].is_segment = 1;
+        segment_iter_seek(&sources[i].iter, segment, NULL, 0);
+        expected_keys += segment->footer.entry_count;
+        if (segment->generation >= generation)
+            generation = segment->generation + 1;
+    }
+
+    // The oldest segments hold nothing below them, so their tombstones can go
+    sorted_segment_t *output = write_segment(store, inputs[width - 1]->seq, generation,
+                                             sources, width, expected_keys, start == 0);
+    if (!output) {
+        for (size_t i = 0; i < width; i++)
+            sorted_segment_release(inputs[i]);
+        return -1;
+    }
+
+    // Compaction is the only remover and flushes only append, so the run is
+    // still at the same position
+    pthread_rwlock_wrlock(&store->lock);
+    store->segments[start] = output;
+    memmove(&store->segments[start + 1], &store->segments[start + width],
+            sizeof(sorted_segment_t *) * (store->segment_count - start - width));
+    store->segment_count -= width - 1;
+    pthread_rwlock_unlock(&store->lock);
+    FAULT_POINT(FAULT_COMPACTION_SWAPPED);
+
+    for (size_t i = 0; i < width; i++) {
+        unlink(inputs[i]->path);
+        sorted_segment_release(inputs[i]);     // our reference
+        sorted_segment_release(inputs[i]);     // the store's reference
+    }
+    fsync_dir(store->dir);
+    atomic_fetch_add(&store->compactions, 1);
+    return 1;
+}
+
+static void *compactor_main(void *arg) {
+    kv_store_t *store = arg;
+
+    pthread_mutex_lock(&store->compact_lock);
+    for (;;) {
+        while (!store->stopping && !store->compaction_pending)
+            pthread_cond_wait(&store->compact_cond, &store->compact_lock);
+        if (store->stopping)
+            break;
+
+        store->compaction_pending = 0;
+        store->compacting = 1;
+        pthread_mutex_unlock(&store->compact_lock);
+        int rc;
+        while ((rc = compact_once(store)) > 0)
+            ;
+        // A failed pass leaves the segments as they were; the thread stays
+        // up so waiters are released and the next flush tries again
+        if (rc < 0)
+            perror("compaction");
+
+        pthread_mutex_lock(&store->compact_lock);
+        store->compacting = 0;
+        pthread_cond_broadcast(&store->idle_cond);
+    }
+    pthread_mutex_unlock(&store->compact_lock);
+    return NULL;
+}
+
+kv_store_t *kv_store_open(const char *dir) {
+    kv_store_t *store = calloc(1, sizeof(kv_store_t));
+    if (!store)
+        return NULL;
+
+    snprintf(store->dir, sizeof(store->dir), "%s", dir);
+    store->next_seq = 1;
+    if ((mkdir(dir, 0755) < 0 && errno != EEXIST) || load_segments(store) < 0)
+        goto fail;
+    if (create_tables(store->active) < 0)
+        goto fail;
+
+    pthread_rwlock_init(&store->lock, NULL);
+    pthread_mutex_init(&store->flush_lock, NULL);
+    pthread_mutex_init(&store->compact_lock, NULL);
+    pthread_cond_init(&store->compact_cond, NULL);
+    pthread_cond_init(&store->idle_cond, NULL);
+    store->compaction_pending = store->segment_count >= KV_COMPACTION_TRIGGER;
+    if (pthread_create(&store->compactor, NULL, compactor_main, store) != 0)
+        goto fail;
+    return store;
+
+fail:
+    for (size_t i = 0; i < store->segment_count; i++)
+        sorted_segment_release(store->segments[i]);
+    free(store->segments);
+    destroy_tables(store->active);
+    free(store);
+    return NULL;
+}
+
+// Stops compaction; unflushed memtable contents are dropped (the WAL still has them)
+void kv_store_close(kv_store_t *store) {
+    if (!store)
+        return;
+
+    pthread_mutex_lock(&store->compact_lock);
+    store->stopping = 1;
+    pthread_cond_signal(&store->compact_cond);
+    pthread_mutex_unlock(&store->compact_lock);
+    pthread_join(store->compactor, NULL);
+
+    for (size_t i = 0; i < store->segment_count; i++)
+        sorted_segment_release(store->segments[i]);
+    free(store->segments);
+    destroy_tables(store->active);
+    pthread_rwlock_destroy(&store->lock);
+    pthread_mutex_destroy(&store->flush_lock);
+    pthread_mutex_destroy(&store->compact_lock);
+    pthread_cond_destroy(&store->compact_cond);
+    pthread_cond_destroy(&store->idle_cond);
+    free(store);
+}
+
+int kv_store_put(kv_store_t *store, const char *key, uint32_t key_length,
+                 const char *value, uint32_t value_length) {
+    pthread_rwlock_rdlock(&store->lock);
+    int rc = mem_table_put(store->active[kv_store_shard(key, key_length)], key, key_length,
+                           value, value_length);
+    pthread_rwlock_unlock(&store->lock);
+
+    if (rc == 0)
+        atomic_fetch_add(&store->user_bytes, key_length + value_length);
+    return rc;
+}
+
+// Records a tombstone that hides every older version of the key
+int kv_store_delete(kv_store_t *store, const char *key, uint32_t key_length) {
+    pthread_rwlock_rdlock(&store->lock);
+    int rc = mem_table_delete(store->active[kv_store_shard(key, key_length)], key, key_length);
+    pthread_rwlock_unlock(&store->lock);
+
+    if (rc == 0)
+        atomic_fetch_add(&store->user_bytes, key_length);
+    return rc;
+}
+
+// Newest data first: memtable, the memtable being flushed, then segments newest
+// to oldest; the first version or tombstone found decides.
+// Returns 1 with a malloc'd value, 0 when the key does not exist.
+int kv_store_get(kv_store_t *store, const char *key, uint32_t key_length,
+                 char **value, uint32_t *value_length) {
+    unsigned int shard = kv_store_shard(key, key_length);
+    pthread_rwlock_rdlock(&store->lock);
+    int found = mem_table_get(store->active[shard], key, key_length, value, value_length);
+    if (found == KV_NOT_FOUND && store->immutable[shard])
+        found = mem_table_get(store->immutable[shard], key, key_length, value, value_length);
+    if (found != KV_NOT_FOUND) {
+        pthread_rwlock_unlock(&store->lock);
+        return found == KV_DELETED ? 0 : found;
+    }
+
+    size_t count = store->segment_count;
+    sorted_segment_t **snapshot = malloc(sizeof(sorted_segment_t *) * (count ? count : 1));
+    if (!snapshot) {
+        pthread_rwlock_unlock(&store->lock);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        snapshot[i] = store->segments[i];
+        sorted_segment_retain(snapshot[i]);
+    }
+    pthread_rwlock_unlock(&store->lock);
+
+    for (size_t i = count; i-- > 0 && found == KV_NOT_FOUND;) {
+        const char *data;
+        uint32_t length;
+        found = sorted_segment_get(snapshot[i], key, key_length, &data, &length);
+        if (found == KV_FOUND) {
+            *value = malloc(length ? length : 1);
+            if (!*value) {
+                found = -1;
+                break;
+            }
+            memcpy(*value, data, length);
+            *value_length = length;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+        sorted_segment_release(snapshot[i]);
+    free(snapshot);
+    return found == KV_DELETED ? 0 : found;
+}
+
+static void free_entries(kv_entry_t *entries, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(entries[i].key);
+        free(entries[i].value);
+    }
+    free(entries);
+}
+
+// Copy [start, end) of a memtable under its lock
+static int copy_range(mem_table_t *table, const char *start, uint32_t start_length,
+                      const char *end, uint32_t end_length, merge_source_t *source) {
+    size_t capacity = 0;
+
+    memset(source, 0, sizeof(*source));
+    pthread_mutex_lock(&table->lock);
+    for (mem_node_t *node = mem_table_seek(table, start, start_length); node; node = node->next[0]) {
+        if (end && key_compare(node->key, node->key_length, end, end_length) >= 0)
+            break;
+        if (source->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            kv_entry_t *grown = realloc(source->entries, sizeof(kv_entry_t) * capacity);
+            if (!grown)
+                goto fail;
+            source->entries = grown;
+        }
+        kv_entry_t *entry = &source->entries[source->count];
+        entry->key = malloc(node->key_length ? node->key_length : 1);
+        entry->value = malloc(node->value_length ? node->value_length : 1);
+        source->count++;
+        if (!entry->key || !entry->value)
+            goto fail;
+        memcpy(entry->key, node->key, node->key_length);
+        entry->key_length = node->key_length;
+        memcpy(entry->value, node->value, node->value_length);
+        entry->value_length = node->value_length;
+        entry->deleted = node->deleted;
+    }
+    pthread_mutex_unlock(&table->lock);
+    return 0;
+
+fail:
+    pthread_mutex_unlock(&table->lock);
+    free_entries(source->entries, source->count);
+    source->entries = NULL;
+    source->count = 0;
+    return -1;
+}
+
+// Visit live keys in [start, end) in order; NULL bounds are open. Only index
+// lookups and the requested range are touched, never whole segments.
+int kv_store_scan(kv_store_t *store, const char *start, uint32_t start_length,
+                  const char *end, uint32_t end_length, kv_scan_fn fn, void *arg) {
+    pthread_rwlock_rdlock(&store->lock);
+    size_t count = 2 * KV_MEMTABLE_SHARDS + store->segment_count, used = 0;
+    merge_source_t *sources = calloc(count, sizeof(merge_source_t));
+    sorted_segment_t **snapshot = calloc(count, sizeof(sorted_segment_t *));
+    if (!sources || !snapshot) {
+        pthread_rwlock_unlock(&store->lock);
+        free(sources);
+        free(snapshot);
+        return -1;
+    }
+
+    // Shards hold disjoint keys, so only active-before-immutable order matters
+    int rc = 0;
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS && rc == 0; i++)
+        rc = copy_range(store->active[i], start, start_length, end, end_length, &sources[used++]);
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS && rc == 0 && store->immutable[i]; i++)
+        rc = copy_range(store->immutable[i], start, start_length, end, end_length, &sources[used++]);
+
+    size_t segments = store->segment_count;
+    for (size_t i = 0; i < segments; i++) {
+        snapshot[i] = store->segments[segments - 1 - i];
+        sorted_segment_retain(snapshot[i]);
+    }
+    pthread_rwlock_unlock(&store->lock);
+
+    for (size_t i = 0; i < segments; i++) {
+        merge_source_t *source = &sources[used++];
+        source->is_segment = 1;
+        segment_iter_seek(&source->iter, snapshot[i], start, start_length);
+    }
+
+    scan_visitor_t visitor = { fn, arg };
+    if (rc == 0)
+        rc = merge_sources(sources, used, end, end_length, scan_visit, &visitor);
+
+    for (size_t i = 0; i < used; i++) {
+        if (!sources[i].is_segment)
+            free_entries(sources[i].entries, sources[i].count);
+    }
+    for (size_t i = 0; i < segments; i++)
+        sorted_segment_release(snapshot[i]);
+    free(snapshot);
+    free(sources);
+    return rc < 0 ? -1 : 0;
+}
+
+// Write the memtable out as a new segment and make it durable. Reads keep
+// seeing its contents through store->immutable while the segment is built.
+// All shards go into one segment, so a flush costs one file and one fsync.
+int kv_store_flush(kv_store_t *store) {
+    mem_table_t *fresh[KV_MEMTABLE_SHARDS], *frozen[KV_MEMTABLE_SHARDS];
+    merge_source_t sources[KV_MEMTABLE_SHARDS];
+    uint64_t entries = 0;
+
+    pthread_mutex_lock(&store->flush_lock);
+    if (create_tables(fresh) < 0) {
+        pthread_mutex_unlock(&store->flush_lock);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&store->lock);
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS; i++)
+        entries += store->active[i]->count;
+    if (entries == 0) {
+        pthread_rwlock_unlock(&store->lock);
+        pthread_mutex_unlock(&store->flush_lock);
+        destroy_tables(fresh);
+        return 0;
+    }
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS; i++) {
+        frozen[i] = store->active[i];
+        store->immutable[i] = frozen[i];
+        store->active[i] = fresh[i];
+    }
+    uint64_t seq = store->next_seq++;
+    pthread_rwlock_unlock(&store->lock);
+
+    int rc = 0;
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS; i++) {
+        if (copy_range(frozen[i], NULL, 0, NULL, 0, &sources[i]) < 0)
+            rc = -1;
+    }
+    sorted_segment_t *segment = NULL;
+    if (rc == 0)
+        segment = write_segment(store, seq, 0, sources, KV_MEMTABLE_SHARDS, entries, 0);
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS; i++)
+        free_entries(sources[i].entries, sources[i].count);
+
+    // On failure the frozen tables go back under the active ones, which hold
+    // anything written since, so reads keep finding every key and the next
+    // flush tries again
+    pthread_rwlock_wrlock(&store->lock);
+    rc = segment ? append_segment(store, segment) : -1;
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS; i++) {
+        if (rc < 0)
+            mem_table_absorb(store->active[i], frozen[i]);
+        store->immutable[i] = NULL;
+    }
+    pthread_rwlock_unlock(&store->lock);
+
+    if (rc < 0 && segment) {
+        unlink(segment->path);
+        sorted_segment_release(segment);
+    }
+    if (rc == 0) {
+        destroy_tables(frozen);
+        atomic_fetch_add(&store->flushes, 1);
+        pthread_mutex_lock(&store->compact_lock);
+        store->compaction_pending = 1;
+        pthread_cond_signal(&store->compact_cond);
+        pthread_mutex_unlock(&store->compact_lock);
+    }
+    pthread_mutex_unlock(&store->flush_lock);
+    return rc;
+}
+
+size_t kv_store_memtable_bytes(kv_store_t *store) {
+    size_t bytes = 0;
+    pthread_rwlock_rdlock(&store->lock);
+    for (size_t i = 0; i < KV_MEMTABLE_SHARDS; i++)
+        bytes += store->active[i]->bytes;
+    pthread_rwlock_unlock(&store->lock);
+    return bytes;
+}
+
+// Block until the compactor has nothing left to do
+void kv_store_wait_compaction(kv_store_t *store) {
+    pthread_mutex_lock(&store->compact_lock);
+    while (!store->stopping && (store->compacting || store->compaction_pending))
+        pthread_cond_wait(&store->idle_cond, &store->compact_lock);
+    pthread_mutex_unlock(&store->compact_lock);
+}
@@ -0,0 +1,66 @@
+#ifndef KVSTORE_H
+#define KVSTORE_H
+
+#include "main.h"
+#include "memTable.h"
+#include "sortedSegment.h"
+
+// Log-structured key-value store: writes land in a memtable, a full memtable
+// is written out as an immutable sorted segment, and a background thread
+// merges runs of similarly sized segments once too many pile up. Durability
+// of the memtable is the WAL's job; kv_store_flush is what a checkpoint calls.
+// The memtable is split into shards by key hash so writers to different keys,
+// such as parallel recovery appliers, do not serialize on one skip list lock.
+#define KV_MEMTABLE_LIMIT (4u * 1024 * 1024)
+#define KV_MEMTABLE_SHARDS 16       // power of two
+#define KV_COMPACTION_TRIGGER 4     // compact when this many segments exist
+#define KV_COMPACTION_WIDTH 4       // number of adjacent segments merged per run
+#define KV_SEGMENT_SUFFIX ".sst"
+
+typedef struct kv_store {
+    char dir[PATH_MAX];
+
+    pthread_rwlock_t lock;          // protects the pointers below
+    mem_table_t *active[KV_MEMTABLE_SHARDS];
+    mem_table_t *immutable[KV_MEMTABLE_SHARDS];     // being flushed, still readable
+    sorted_segment_t **segments;    // oldest first
+    size_t segment_count;
+    size_t segment_capacity;
+    uint64_t next_seq;
+
+    pthread_mutex_t flush_lock;     // one flush at a time
+
+    pthread_mutex_t compact_lock;
+    pthread_cond_t compact_cond;
+    pthread_cond_t idle_cond;
+    int compaction_pending;         // a flush added a segment since the last pass
+    int compacting;
+    int stopping;
+    pthread_t compactor;
+
+    atomic_uint_fast64_t user_bytes;    // key + value bytes put by callers
+    atomic_uint_fast64_t disk_bytes;    // segment bytes written by flush and compaction
+    atomic_uint_fast64_t flushes;
+    atomic_uint_fast64_t compactions;
+} kv_store_t;
+
+typedef int (*kv_scan_fn)(const char *key, uint32_t key_length,
+                          const char *value, uint32_t value_length, void *arg);
+
+kv_store_t *kv_store_open(const char *dir);
+unsigned int kv_store_shard(const char *key, uint32_t key_length);
+void kv_store_close(kv_store_t *store);
+
+int kv_store_put(kv_store_t *store, const char *key, uint32_t key_length,
+                 const char *value, uint32_t value_length);
+int kv_store_delete(kv_store_t *store, const char *key, uint32_t key_length);
+int kv_store_get(kv_store_t *store, const char *key, uint32_t key_length,
+                 char **value, uint32_t *value_length);
+int kv_store_scan(kv_store_t *store, const char *start, uint32_t start_length,
+                  const char *end, uint32_t end_length, kv_scan_fn fn, void *arg);
+
+int kv_store_flush(kv_store_t *store);
+size_t kv_store_memtable_bytes(kv_store_t *store);
+void kv_store_wait_compaction(kv_store_t *store);
+
+#endif
@@ -0,0 +1,233 @@
+#include "memTable.h"
+
+int key_compare(const char *a, uint32_t a_length, const char *b, uint32_t b_length) {
+    uint32_t common = a_length < b_length ? a_length : b_length;
+    int rc = common ? memcmp(a, b, common) : 0;
+    if (rc != 0)
+        return rc;
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+// FNV-1a with a final mix; bloom filters, memtable shards and recovery
+// partitions all hash keys with it
+uint64_t key_hash(const char *key, uint32_t key_length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < key_length; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 0x100000001b3ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static mem_node_t *node_create(int level) {
+    mem_node_t *node = calloc(1, sizeof(mem_node_t) + sizeof(mem_node_t *) * (size_t)level);
+    if (node)
+        node->level = level;
+    return node;
+}
+
+mem_table_t *mem_table_create() {
+    mem_table_t *table = calloc(1, sizeof(mem_table_t));
+    if (!table)
+        return NULL;
+
+    table->head = node_create(MEM_TABLE_MAX_LEVEL);
+    if (!table->head) {
+        free(table);
+        return NULL;
+    }
+    table->level = 1;
+    table->random_state = 0x9E3779B97F4A7C15ull;
+    pthread_mutex_init(&table->lock, NULL);
+    return table;
+}
+
+// Each level is kept with probability 1/4
+static int random_level(mem_table_t *table) {
+    uint64_t x = table->random_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    table->random_state = x;
+
+    int level = 1;
+    while (level < MEM_TABLE_MAX_LEVEL && (x & 3) == 0) {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+// Last node before key on every level; update may be NULL when only the position matters
+static mem_node_t *find_greater_or_equal(mem_table_t *table, const char *key, uint32_t key_length,
+                                         mem_node_t **update) {
+    mem_node_t *node = table->head;
+    for (int level = table->level - 1; level >= 0; level--) {
+        while (node->next[level] &&
+               key_compare(node->next[level]->key, node->next[level]->key_length, key, key_length) < 0)
+            node = node->next[level];
+        if (update)
+            update[level] = node;
+    }
+    return node->next[0];
+}
+
+// Insert or overwrite; the table keeps its own copies of key and value
+static int mem_table_upsert(mem_table_t *table, const char *key, uint32_t key_length,
+                            const char *value, uint32_t value_length, int deleted) {
+    mem_node_t *update[MEM_TABLE_MAX_LEVEL];
+
+    char *value_copy = malloc(value_length ? value_length : 1);
+    if (!value_copy)
+        return -1;
+    if (value_length)
+        memcpy(value_copy, value, value_length);
+
+    pthread_mutex_lock(&table->lock);
+    mem_node_t *node = find_greater_or_equal(table, key, key_length, update);
+
+    if (node && key_compare(node->key, node->key_length, key, key_length) == 0) {
+        table->bytes = table->bytes - node->value_length + value_length;
+        free(node->value);
+        node->value = value_copy;
+        node->value_length = value_length;
+        node->deleted = deleted;
+        pthread_mutex_unlock(&table->lock);
+        return 0;
+    }
+
+    int level = random_level(table);
+    node = node_create(level);
+    char *key_copy = malloc(key_length ? key_length : 1);
+    if (!node || !key_copy) {
+        pthread_mutex_unlock(&table->lock);
+        free(node);
+        free(key_copy);
+        free(value_copy);
+        return -1;
+    }
+    memcpy(key_copy, key, key_length);
+    node->key = key_copy;
+    node->key_length = key_length;
+    node->value = value_copy;
+    node->value_length = value_length;
+    node->deleted = deleted;
+
+    if (level > table->level) {
+        for (int i = table->level; i < level; i++)
+            update[i] = table->head;
+        table->level = level;
+    }
+    for (int i = 0; i < level; i++) {
+        node->next[i] = update[i]->next[i];
+        update[i]->next[i] = node;
+    }
+
+    table->count++;
+    table->bytes += key_length + value_length;
+    pthread_mutex_unlock(&table->lock);
+    return 0;
+}
+
+int mem_table_put(mem_table_t *table, const char *key, uint32_t key_length,
+                  const char *value, uint32_t value_length) {
+    return mem_table_upsert(table, key, key_length, value, value_length, 0);
+}
+
+int mem_table_delete(mem_table_t *table, const char *key, uint32_t key_length) {
+    return mem_table_upsert(table, key, key_length, NULL, 0, 1);
+}
+
+// KV_FOUND with a malloc'd copy of the value, KV_DELETED for a tombstone,
+// KV_NOT_FOUND when the table has nothing for the key
+int mem_table_get(mem_table_t *table, const char *key, uint32_t key_length,
+                  char **value, uint32_t *value_length) {
+    int found = KV_NOT_FOUND;
+
+    pthread_mutex_lock(&table->lock);
+    mem_node_t *node = find_greater_or_equal(table, key, key_length, NULL);
+    if (node && key_compare(node->key, node->key_length, key, key_length) == 0) {
+        if (node->deleted) {
+            found = KV_DELETED;
+        }
+        else {
+            *value = malloc(node->value_length ? node->value_length : 1);
+            if (!*value) {
+                pthread_mutex_unlock(&table->lock);
+                return -1;
+            }
+            memcpy(*value, node->value, node->value_length);
+            *value_length = node->value_length;
+            found = KV_FOUND;
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+    return found;
+}
+
+// First node with key >= the given key (NULL key: first node). Only for tables
+// no longer receiving writes, or with the lock held; walk on with next[0].
+mem_node_t *mem_table_seek(mem_table_t *table, const char *key, uint32_t key_length) {
+    if (!key)
+        return table->head->next[0];
+    return find_greater_or_equal(table, key, key_length, NULL);
+}
+
+// Move the entries of an older table that this one has no newer version of
+// into it, then destroy the older table. Nodes are relinked, not copied, so
+// nothing is allocated and it cannot fail. The caller keeps writers off both.
+void mem_table_absorb(mem_table_t *table, mem_table_t *older) {
+    mem_node_t *update[MEM_TABLE_MAX_LEVEL];
+
+    pthread_mutex_lock(&table->lock);
+    mem_node_t *node = older->head->next[0];
+    while (node) {
+        mem_node_t *next = node->next[0];
+        mem_node_t *newer = find_greater_or_equal(table, node->key, node->key_length, update);
+
+        if (newer && key_compare(newer->key, newer->key_length, node->key, node->key_length) == 0) {
+            free(node->key);
+            free(node->value);
+            free(node);
+        }
+        else {
+            if (node->level > table->level) {
+                for (int i = table->level; i < node->level; i++)
+                    update[i] = table->head;
+                table->level = node->level;
+            }
+            for (int i = 0; i < node->level; i++) {
+                node->next[i] = update[i]->next[i];
+                update[i]->next[i] = node;
+            }
+            table->count++;
+            table->bytes += node->key_length + node->value_length;
+        }
+        node = next;
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    free(older->head);
+    pthread_mutex_destroy(&older->lock);
+    free(older);
+}
+
+void mem_table_destroy(mem_table_t *table) {
+    if (!table)
+        return;
+
+    mem_node_t *node = table->head->next[0];
+    while (node) {
+        mem_node_t *next = node->next[0];
+        free(node->key);
+        free(node->value);
+        free(node);
+        node = next;
+    }
+    free(table->head);
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
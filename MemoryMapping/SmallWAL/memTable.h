@@ -0,0 +1,48 @@
+#ifndef MEMTABLE_H
+#define MEMTABLE_H
+
+#include "main.h"
+
+#define MEM_TABLE_MAX_LEVEL 16
+
+// Lookup results shared by the memtable, sorted segments and the store.
+// A deleted key is recorded as a tombstone so it hides older versions.
+#define KV_NOT_FOUND 0
+#define KV_FOUND     1
+#define KV_DELETED   2
+
+// Sorted in-memory write buffer (skip list). Keys are byte strings ordered by
+// memcmp with the shorter key first on a common prefix.
+typedef struct mem_node {
+    char *key;
+    uint32_t key_length;
+    char *value;
+    uint32_t value_length;
+    int deleted;            // tombstone
+    int level;
+    struct mem_node *next[];
+} mem_node_t;
+
+typedef struct mem_table {
+    pthread_mutex_t lock;
+    mem_node_t *head;
+    int level;
+    uint64_t random_state;
+    size_t count;
+    size_t bytes;           // key + value bytes held, drives flushing
+} mem_table_t;
+
+int key_compare(const char *a, uint32_t a_length, const char *b, uint32_t b_length);
+uint64_t key_hash(const char *key, uint32_t key_length);
+
+mem_table_t *mem_table_create();
+int mem_table_put(mem_table_t *table, const char *key, uint32_t key_length,
+                  const char *value, uint32_t value_length);
+int mem_table_delete(mem_table_t *table, const char *key, uint32_t key_length);
+int mem_table_get(mem_table_t *table, const char *key, uint32_t key_length,
+                  char **value, uint32_t *value_length);
+mem_node_t *mem_table_seek(mem_table_t *table, const char *key, uint32_t key_length);
+void mem_table_absorb(mem_table_t *table, mem_table_t *older);
+void mem_table_destroy(mem_table_t *table);
+
+#endif
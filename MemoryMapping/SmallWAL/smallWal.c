@@ -1,149 +1,1083 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-
-#define WAL_FILE "wallog"
-#define DB_FILE  "dbtxt"
+// Build: gcc -O2 -pthread -o smallWal smallWal.c walWriter.c walRecord.c walLog.c
+//        walRecovery.c kvStore.c memTable.c sortedSegment.c faultInject.c
+
+#include "main.h"
+#include "walWriter.h"
+#include "walRecord.h"
+#include "walLog.h"
+#include "walRecovery.h"
+#include "kvStore.h"
+#include "faultInject.h"
+
+#define WAL_DIR  "wal"
+#define DB_DIR   "db"
+#define BENCH_DB_DIR "db.bench"
+#define BENCH_WAL_DIR "wal.bench"
 #define LINE_BUF 256
+#define BENCH_MAX_CLIENTS 64
+#define WAL_CHECKPOINT_SEGMENTS 4   // checkpoint once this many segments pile up
+#define BENCH_MAX_BATCH 1024
+#define BENCH_SYNC_CLIENTS 8
+#define DEFAULT_SYNC_INTERVAL_MS 10
+#define CRASH_TEST_DIR "crash.test"
+#define CRASH_TEST_COMMITS 640
+#define CRASH_TEST_CHECKPOINT_EVERY 160
+#define CRASH_TEST_VALUE (32u * 1024)     // two per commit, so segments rotate
+
+// Durability of commit, delete, batch and crash-after-wal; set with --sync
+static int durability = WAL_SYNC_COMMIT;
+static int sync_interval_ms = DEFAULT_SYNC_INTERVAL_MS;
 
-static int txn_id = 1;
+// One operation of a write batch; value is ignored for DELETE
+typedef struct wal_op {
+    uint8_t type;           // WAL_RECORD_SET or WAL_RECORD_DELETE
+    const char *key;
+    const char *value;
+} wal_op_t;
 
-static void safe_write(int fd, const char *msg, int sync) {
-    ssize_t n = write(fd, msg, strlen(msg));
-    if (n < 0) {
-        perror("write");
+// BEGIN, every operation and COMMIT are encoded into one buffer, so the
+// flusher never splits the batch and one flush makes all of it durable.
+// Returns the transaction id the writer assigned.
+static uint64_t wal_commit_batch(wal_writer_t *writer, const wal_op_t *ops, size_t count) {
+    size_t length = wal_record_size(0, 0) * 2;
+    for (size_t i = 0; i < count; i++) {
+        size_t key_length = strlen(ops[i].key);
+        size_t value_length = ops[i].type == WAL_RECORD_SET ? strlen(ops[i].value) : 0;
+        if (key_length > WAL_MAX_KEY || value_length > WAL_MAX_VALUE) {
+            fprintf(stderr, "record too long\n");
+            exit(1);
+        }
+        length += wal_record_size((uint32_t)key_length, (uint32_t)value_length);
+    }
+
+    char *buf = malloc(length);
+    if (!buf) {
+        perror("malloc");
         exit(1);
     }
-    if (sync && fsync(fd) < 0) {
-        perror("fsync");
+
+    char *p = buf;
+    p += wal_record_encode(p, WAL_RECORD_BEGIN, NULL, 0, NULL, 0);
+    for (size_t i = 0; i < count; i++) {
+        const char *value = ops[i].type == WAL_RECORD_SET ? ops[i].value : NULL;
+        p += wal_record_encode(p, ops[i].type, ops[i].key, (uint32_t)strlen(ops[i].key),
+                               value, value ? (uint32_t)strlen(value) : 0);
+    }
+    p += wal_record_encode(p, WAL_RECORD_COMMIT, NULL, 0, NULL, 0);
+
+    uint64_t id;
+    if (wal_writer_append(writer, buf, length, &id) < 0) {
+        perror("wal append");
         exit(1);
     }
+    free(buf);
+    return id;
+}
+
+static void wal_append(wal_writer_t *writer, const char *key, const char *value) {
+    wal_op_t op = { WAL_RECORD_SET, key, value };
+    wal_commit_batch(writer, &op, 1);
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-static void wal_append(const char *key, const char *value, int sync) {
-    char buf[LINE_BUF];
-    int fd = open(WAL_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd < 0) {
+static wal_writer_t *open_wal(const char *path, int mode) {
+    wal_writer_t *writer = wal_writer_open(path, mode, sync_interval_ms);
+    if (!writer) {
         perror("open wal");
         exit(1);
     }
+    return writer;
+}
 
-    snprintf(buf, sizeof(buf), "TRANSACTION %d BEGIN\n", txn_id);
-    safe_write(fd, buf, sync);
+// Replay state. Recovery hands committed operations to apply_op on several
+// threads at once; the store's memtable shards keep them from contending.
+typedef struct apply_state {
+    kv_store_t *store;
+    wal_recovery_t recovery;    // applied LSN and txn id, starting at the checkpoint
+} apply_state_t;
 
-    snprintf(buf, sizeof(buf), "SET %s %s\n", key, value);
-    safe_write(fd, buf, sync);
+static int apply_op(const wal_record_t *op, void *arg) {
+    apply_state_t *state = arg;
+    if (op->type == WAL_RECORD_SET)
+        return kv_store_put(state->store, op->key, op->key_length, op->value, op->value_length);
+    return kv_store_delete(state->store, op->key, op->key_length);
+}
 
-    snprintf(buf, sizeof(buf), "TRANSACTION %d COMMIT\n", txn_id);
-    safe_write(fd, buf, sync);
+// One applier per core, rounded down to a power of two no larger than the
+// shard count, so each memtable shard is only ever written by one applier
+static int recovery_appliers() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int appliers = 1;
+    while (appliers * 2 <= cores && appliers * 2 <= KV_MEMTABLE_SHARDS)
+        appliers *= 2;
+    return appliers;
+}
 
-    close(fd);
+static void replay_wal(apply_state_t *state, const char *wal_dir, int appliers, int verbose) {
+    wal_recovery_t *recovery = &state->recovery;
+    double start = now_seconds();
+    if (wal_recover(wal_dir, recovery->applied_lsn, appliers, apply_op, state, recovery) < 0) {
+        perror("replay wal");
+        exit(1);
+    }
+    if (verbose) {
+        printf("Recovered %llu transactions (%llu operations) with %d appliers in %.3f s\n",
+               (unsigned long long)recovery->transactions, (unsigned long long)recovery->operations,
+               appliers, now_seconds() - start);
+    }
+    if (recovery->incomplete && verbose) {
+        printf("Found incomplete transaction in WAL, ignoring\n");
+    }
 }
 
-static void db_append(const char *key, const char *value) {
-    char buf[LINE_BUF];
-    int fd = open(DB_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd < 0) {
+// Open the store and rebuild its memtable from the WAL written since the last
+// checkpoint; everything before that is already in sorted segments
+static kv_store_t *open_database(apply_state_t *state, int verbose) {
+    wal_checkpoint_t checkpoint;
+    if (wal_checkpoint_read(WAL_DIR, &checkpoint) < 0) {
+        perror("read checkpoint");
+        exit(1);
+    }
+
+    memset(state, 0, sizeof(*state));
+    state->recovery.applied_lsn = checkpoint.lsn;
+    state->recovery.last_txn_id = checkpoint.last_txn_id;
+    state->store = kv_store_open(DB_DIR);
+    if (!state->store) {
         perror("open db");
         exit(1);
     }
 
-    snprintf(buf, sizeof(buf), "%s=%s\n", key, value);
-    if (write(fd, buf, strlen(buf)) < 0) {
-        perror("db write");
+    replay_wal(state, WAL_DIR, recovery_appliers(), verbose);
+    return state->store;
+}
+
+// Flush the memtable to a segment, move the checkpoint up to the last applied
+// commit and drop the WAL segments it covers. Recovery replays only what was
+// logged after the checkpoint, so its cost stays bounded however long the
+// system has been running. The checkpoint also carries the highest
+// transaction id, so ids stay monotonic once the log behind it is gone.
+static void checkpoint(apply_state_t *state, int verbose) {
+    wal_checkpoint_t previous, next;
+    if (wal_checkpoint_read(WAL_DIR, &previous) < 0) {
+        perror("read checkpoint");
+        exit(1);
+    }
+
+    if (kv_store_flush(state->store) < 0) {
+        perror("flush db");
+        exit(1);
+    }
+    FAULT_POINT(FAULT_CHECKPOINT_FLUSHED);
+
+    next.lsn = state->recovery.applied_lsn;
+    next.last_txn_id = state->recovery.last_txn_id;
+    size_t removed = 0;
+    if ((next.lsn != previous.lsn || next.last_txn_id != previous.last_txn_id) &&
+        wal_checkpoint_write(WAL_DIR, &next) < 0) {
+        perror("write checkpoint");
+        exit(1);
+    }
+    FAULT_POINT(FAULT_CHECKPOINT_WRITTEN);
+    if (wal_log_truncate(WAL_DIR, next.lsn, &removed) < 0) {
+        perror("truncate wal");
+        exit(1);
+    }
+
+    if (verbose) {
+        printf("Checkpoint at LSN %llu: replayed %llu transactions, removed %zu segments\n",
+               (unsigned long long)next.lsn, (unsigned long long)state->recovery.transactions, removed);
     }
+}
 
-    fsync(fd);
-    close(fd);
+static void maybe_checkpoint() {
+    wal_segment_t *segments;
+    size_t count;
+    if (wal_segment_list(WAL_DIR, &segments, &count) == 0) {
+        free(segments);
+        if (count > WAL_CHECKPOINT_SEGMENTS) {
+            apply_state_t state;
+            kv_store_t *store = open_database(&state, 0);
+            checkpoint(&state, 0);
+            kv_store_close(store);
+        }
+    }
 }
 
+// The store is brought up to date from the WAL by readers and checkpoints, not by each commit
 static void cmd_commit(const char *key, const char *value) {
-    wal_append(key, value, 1);
-    db_append(key, value);
+    wal_writer_t *writer = open_wal(WAL_DIR, durability);
+    wal_append(writer, key, value);
+    wal_writer_close(writer);
     printf("Committed: %s=%s\n", key, value);
-    txn_id++;
+    maybe_checkpoint();
 }
 
 static void cmd_commit_nosync(const char *key, const char *value) {
-    wal_append(key, value, 0);
-    db_append(key, value);
+    wal_writer_t *writer = open_wal(WAL_DIR, WAL_SYNC_NONE);
+    wal_append(writer, key, value);
+    wal_writer_close(writer);
     printf("Committed (no sync): %s=%s\n", key, value);
-    txn_id++;
+    maybe_checkpoint();
+}
+
+static void cmd_delete(const char *key) {
+    wal_writer_t *writer = open_wal(WAL_DIR, durability);
+    wal_op_t op = { WAL_RECORD_DELETE, key, NULL };
+    wal_commit_batch(writer, &op, 1);
+    wal_writer_close(writer);
+    printf("Deleted: %s\n", key);
+    maybe_checkpoint();
+}
+
+// args: a list of "set <key> <value>" and "del <key>" operations
+static void cmd_batch(int argc, char *argv[]) {
+    wal_op_t *ops = malloc(sizeof(wal_op_t) * (size_t)(argc ? argc : 1));
+    size_t count = 0;
+    if (!ops) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i = 0; i < argc;) {
+        if (strcmp(argv[i], "set") == 0 && i + 2 < argc) {
+            ops[count++] = (wal_op_t){ WAL_RECORD_SET, argv[i + 1], argv[i + 2] };
+            i += 3;
+        }
+        else if (strcmp(argv[i], "del") == 0 && i + 1 < argc) {
+            ops[count++] = (wal_op_t){ WAL_RECORD_DELETE, argv[i + 1], NULL };
+            i += 2;
+        }
+        else {
+            fprintf(stderr, "Invalid batch operation: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (count == 0) {
+        fprintf(stderr, "Empty batch\n");
+        exit(1);
+    }
+
+    wal_writer_t *writer = open_wal(WAL_DIR, durability);
+    uint64_t id = wal_commit_batch(writer, ops, count);
+    wal_writer_close(writer);
+    printf("Committed transaction %llu with %zu operations\n", (unsigned long long)id, count);
+    free(ops);
+    maybe_checkpoint();
 }
 
 static void cmd_crash_after_wal(const char *key, const char *value) {
-    wal_append(key, value, 1);
+    wal_writer_t *writer = open_wal(WAL_DIR, durability);
+    wal_append(writer, key, value);
     printf("Simulated crash after WAL write\n");
     exit(1);
 }
 
-static void cmd_recover() {
-    FILE *f = fopen(WAL_FILE, "r");
-    if (!f) {
-        printf("No WAL to recover\n");
-        return;
+typedef struct bench_client {
+    wal_writer_t *writer;
+    int id;
+    int commits;
+} bench_client_t;
+
+static void *bench_client_main(void *arg) {
+    bench_client_t *client = arg;
+    char key[32], value[32];
+
+    for (int i = 0; i < client->commits; i++) {
+        snprintf(key, sizeof(key), "c%d-k%d", client->id, i);
+        snprintf(value, sizeof(value), "v%d", i);
+        wal_append(client->writer, key, value);
+    }
+    return NULL;
+}
+
+// Commits per second with 1, 2, 4 ... 64 concurrent committers sharing one WAL handle
+static void cmd_bench_commit(int commits_per_client) {
+    pthread_t threads[BENCH_MAX_CLIENTS];
+    bench_client_t clients[BENCH_MAX_CLIENTS];
+
+    printf("%8s %12s %14s %16s\n", "clients", "commits", "commits/sec", "commits/fsync");
+
+    for (int nclients = 1; nclients <= BENCH_MAX_CLIENTS; nclients *= 2) {
+        wal_log_destroy(BENCH_WAL_DIR);
+        wal_writer_t *writer = open_wal(BENCH_WAL_DIR, WAL_SYNC_COMMIT);
+
+        double start = now_seconds();
+        for (int i = 0; i < nclients; i++) {
+            clients[i].writer = writer;
+            clients[i].id = i;
+            clients[i].commits = commits_per_client;
+            pthread_create(&threads[i], NULL, bench_client_main, &clients[i]);
+        }
+        for (int i = 0; i < nclients; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        double elapsed = now_seconds() - start;
+
+        long total = (long)nclients * commits_per_client;
+        printf("%8d %12ld %14.0f %16.2f\n", nclients, total, total / elapsed,
+               (double)total / (double)writer->batches);
+        wal_writer_close(writer);
     }
 
-    char line[LINE_BUF], key[128], val[128];
-    int inside_tx = 0, committed = 0;
+    wal_log_destroy(BENCH_WAL_DIR);
+}
+
+// Latency below which the given fraction of the histogram's syncs fall
+static double histogram_percentile(const uint64_t *histogram, uint64_t total, double fraction) {
+    uint64_t seen = 0;
+    for (int i = 0; i < WAL_LATENCY_BUCKETS; i++) {
+        seen += histogram[i];
+        if (total && seen >= (uint64_t)(fraction * (double)total))
+            return (double)(1ull << i);
+    }
+    return 0;
+}
 
-    while (fgets(line, sizeof(line), f)) {
-        if (strstr(line, "BEGIN")) {
-            inside_tx = 1;
-            committed = 0;
+// Commit throughput and sync latency histogram for every durability mode,
+// BENCH_SYNC_CLIENTS committers sharing one handle. In dsync mode the timed
+// sync is the O_DSYNC write; in none mode nothing is ever synced.
+static void cmd_bench_sync(int commits_per_client) {
+    static const int modes[] = { WAL_SYNC_COMMIT, WAL_SYNC_PERIODIC, WAL_SYNC_DSYNC, WAL_SYNC_NONE };
+    pthread_t threads[BENCH_SYNC_CLIENTS];
+    bench_client_t clients[BENCH_SYNC_CLIENTS];
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        wal_log_destroy(BENCH_WAL_DIR);
+        wal_writer_t *writer = open_wal(BENCH_WAL_DIR, modes[m]);
+
+        double start = now_seconds();
+        for (int i = 0; i < BENCH_SYNC_CLIENTS; i++) {
+            clients[i].writer = writer;
+            clients[i].id = i;
+            clients[i].commits = commits_per_client;
+            pthread_create(&threads[i], NULL, bench_client_main, &clients[i]);
         }
-        else if (strncmp(line, "SET", 3) == 0 && inside_tx) {
-            sscanf(line, "SET %127s %127s", key, val);
+        for (int i = 0; i < BENCH_SYNC_CLIENTS; i++) {
+            pthread_join(threads[i], NULL);
         }
-        else if (strstr(line, "COMMIT") && inside_tx) {
-            db_append(key, val);
-            printf("Recovered: %s=%s\n", key, val);
-            inside_tx = 0;
-            committed = 1;
+        double elapsed = now_seconds() - start;
+
+        uint64_t histogram[WAL_LATENCY_BUCKETS];
+        pthread_mutex_lock(&writer->lock);
+        uint64_t syncs = writer->syncs;
+        memcpy(histogram, writer->sync_histogram, sizeof(histogram));
+        pthread_mutex_unlock(&writer->lock);
+
+        long total = (long)BENCH_SYNC_CLIENTS * commits_per_client;
+        printf("%s: %ld commits, %.0f commits/sec, %llu syncs, p50 < %.0f us, p99 < %.0f us\n",
+               wal_durability_name(modes[m]), total, total / elapsed, (unsigned long long)syncs,
+               histogram_percentile(histogram, syncs, 0.5), histogram_percentile(histogram, syncs, 0.99));
+        for (int i = 0; i < WAL_LATENCY_BUCKETS; i++) {
+            if (histogram[i])
+                printf("  < %10llu us %10llu\n", 1ull << i, (unsigned long long)histogram[i]);
         }
+        wal_writer_close(writer);
     }
 
-    if (inside_tx && !committed) {
-        printf("Found incomplete transaction in WAL, ignoring\n");
+    wal_log_destroy(BENCH_WAL_DIR);
+}
+
+// Per-key commit cost for batches of 1, 2, 4 ... BENCH_MAX_BATCH keys, one
+// committer, every batch made durable with its own flush
+static void cmd_bench_batch(int keys) {
+    wal_op_t ops[BENCH_MAX_BATCH];
+    char (*names)[32] = malloc(sizeof(*names) * BENCH_MAX_BATCH);
+    if (!names) {
+        perror("malloc");
+        exit(1);
+    }
+
+    printf("%8s %10s %10s %14s %12s\n", "batch", "keys", "commits", "keys/sec", "us/key");
+
+    for (int batch = 1; batch <= BENCH_MAX_BATCH; batch *= 2) {
+        wal_log_destroy(BENCH_WAL_DIR);
+        wal_writer_t *writer = open_wal(BENCH_WAL_DIR, WAL_SYNC_COMMIT);
+        int total = keys < batch ? batch : keys - keys % batch;
+
+        double start = now_seconds();
+        for (int done = 0; done < total; done += batch) {
+            for (int i = 0; i < batch; i++) {
+                snprintf(names[i], sizeof(names[i]), "k%d", done + i);
+                ops[i] = (wal_op_t){ WAL_RECORD_SET, names[i], "value" };
+            }
+            wal_commit_batch(writer, ops, (size_t)batch);
+        }
+        double elapsed = now_seconds() - start;
+
+        printf("%8d %10d %10d %14.0f %12.2f\n", batch, total, total / batch,
+               total / elapsed, elapsed * 1e6 / total);
+        wal_writer_close(writer);
     }
 
-    fclose(f);
+    wal_log_destroy(BENCH_WAL_DIR);
+    free(names);
 }
 
-static void cmd_show() {
-    printf("===== WAL LOG =====\n");
-    FILE *wal_fp = fopen(WAL_FILE, "r");
-    if (wal_fp) {
-        char line[LINE_BUF];
-        while (fgets(line, sizeof(line), wal_fp)) {
-            fputs(line, stdout);
+static uint64_t bench_key_id(uint64_t i, uint64_t key_space) {
+    uint64_t x = i + 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return (x ^ (x >> 31)) % key_space;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double left = *(const double *)a, right = *(const double *)b;
+    return (left > right) - (left < right);
+}
+
+// Recovery time for one log replayed with 1, 2, 4 ... KV_MEMTABLE_SHARDS
+// appliers, followed by the single flush that makes the result durable
+static void cmd_bench_recover(int transactions) {
+    const int batch = 16;
+    wal_op_t ops[16];
+    char names[16][32], value[100];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+
+    wal_log_destroy(BENCH_WAL_DIR);
+    wal_writer_t *writer = open_wal(BENCH_WAL_DIR, WAL_SYNC_NONE);
+    for (int t = 0; t < transactions; t++) {
+        for (int i = 0; i < batch; i++) {
+            snprintf(names[i], sizeof(names[i]), "key%012llu",
+                     (unsigned long long)bench_key_id((uint64_t)t * batch + i, (uint64_t)transactions * batch));
+            ops[i] = (wal_op_t){ WAL_RECORD_SET, names[i], value };
+        }
+        wal_commit_batch(writer, ops, batch);
+    }
+    wal_writer_close(writer);
+
+    printf("%9s %12s %12s %14s %10s\n", "appliers", "operations", "replay s", "ops/sec", "flush s");
+    for (int appliers = 1; appliers <= KV_MEMTABLE_SHARDS; appliers *= 2) {
+        apply_state_t state;
+        memset(&state, 0, sizeof(state));
+        wal_log_destroy(BENCH_DB_DIR);
+        state.store = kv_store_open(BENCH_DB_DIR);
+        if (!state.store) {
+            perror("open bench db");
+            exit(1);
+        }
+
+        double start = now_seconds();
+        replay_wal(&state, BENCH_WAL_DIR, appliers, 0);
+        double replay = now_seconds() - start;
+        start = now_seconds();
+        if (kv_store_flush(state.store) < 0) {
+            perror("flush");
+            exit(1);
+        }
+        double flush = now_seconds() - start;
+
+        printf("%9d %12llu %12.3f %14.0f %10.3f\n", appliers,
+               (unsigned long long)state.recovery.operations, replay,
+               state.recovery.operations / replay, flush);
+        kv_store_close(state.store);
+    }
+
+    wal_log_destroy(BENCH_DB_DIR);
+    wal_log_destroy(BENCH_WAL_DIR);
+}
+
+// Point-read latency and write amplification at 10^4, 10^5 ... max_keys puts.
+// Keys are drawn at random from a space as large as the final key count, so
+// later rounds also overwrite earlier keys. Write amplification is segment
+// bytes written by flushes and compactions per user byte (WAL excluded).
+static void cmd_bench_store(uint64_t max_keys) {
+    const int reads = 20000;
+    double *latency = malloc(sizeof(double) * reads);
+    char key[32], value[100];
+    memset(value, 'v', sizeof(value));
+
+    wal_log_destroy(BENCH_DB_DIR);
+    kv_store_t *store = kv_store_open(BENCH_DB_DIR);
+    if (!store || !latency) {
+        perror("open bench db");
+        exit(1);
+    }
+
+    printf("%12s %9s %12s %12s %12s %10s\n", "puts", "segments", "hit avg us", "hit p99 us",
+           "miss avg us", "write amp");
+
+    uint64_t put = 0;
+    for (uint64_t milestone = 10000; milestone <= max_keys; milestone *= 10) {
+        for (; put < milestone; put++) {
+            int key_length = snprintf(key, sizeof(key), "key%012llu",
+                                      (unsigned long long)bench_key_id(put, max_keys));
+            if (kv_store_put(store, key, (uint32_t)key_length, value, sizeof(value)) < 0) {
+                perror("put");
+                exit(1);
+            }
+            if (kv_store_memtable_bytes(store) >= KV_MEMTABLE_LIMIT && kv_store_flush(store) < 0) {
+                perror("flush");
+                exit(1);
+            }
+        }
+        kv_store_wait_compaction(store);
+
+        double hit_total = 0, miss_total = 0;
+        for (int i = 0; i < reads; i++) {
+            char *found;
+            uint32_t found_length;
+            int key_length = snprintf(key, sizeof(key), "key%012llu",
+                                      (unsigned long long)bench_key_id((uint64_t)rand() % put, max_keys));
+            double start = now_seconds();
+            int rc = kv_store_get(store, key, (uint32_t)key_length, &found, &found_length);
+            latency[i] = (now_seconds() - start) * 1e6;
+            hit_total += latency[i];
+            if (rc != 1) {
+                fprintf(stderr, "bench: %s missing\n", key);
+                exit(1);
+            }
+            free(found);
+
+            key_length = snprintf(key, sizeof(key), "miss%011d", i);
+            start = now_seconds();
+            kv_store_get(store, key, (uint32_t)key_length, &found, &found_length);
+            miss_total += (now_seconds() - start) * 1e6;
+        }
+        qsort(latency, reads, sizeof(double), compare_doubles);
+
+        pthread_rwlock_rdlock(&store->lock);
+        size_t segments = store->segment_count;
+        pthread_rwlock_unlock(&store->lock);
+        printf("%12llu %9zu %12.2f %12.2f %12.2f %10.2f\n", (unsigned long long)put, segments,
+               hit_total / reads, latency[reads * 99 / 100], miss_total / reads,
+               (double)atomic_load(&store->disk_bytes) / (double)atomic_load(&store->user_bytes));
+    }
+
+    kv_store_close(store);
+    wal_log_destroy(BENCH_DB_DIR);
+    free(latency);
+}
+
+typedef struct load_client {
+    wal_writer_t *writer;
+    int id;
+    double deadline;
+    double *latency;        // microseconds per commit
+    size_t commits;
+    size_t capacity;
+} load_client_t;
+
+static void *load_client_main(void *arg) {
+    load_client_t *client = arg;
+    char key[32], value[32];
+
+    for (double now = now_seconds(); now < client->deadline;) {
+        if (client->commits == client->capacity) {
+            size_t capacity = client->capacity ? client->capacity * 2 : 4096;
+            double *grown = realloc(client->latency, sizeof(double) * capacity);
+            if (!grown) {
+                perror("malloc");
+                exit(1);
+            }
+            client->latency = grown;
+            client->capacity = capacity;
         }
-        fclose(wal_fp);
+        snprintf(key, sizeof(key), "load%d-k%zu", client->id, client->commits);
+        snprintf(value, sizeof(value), "v%zu", client->commits);
+        wal_append(client->writer, key, value);
+
+        double done = now_seconds();
+        client->latency[client->commits++] = (done - now) * 1e6;
+        now = done;
+    }
+    return NULL;
+}
+
+// Closed-loop load: `clients` committers, each issuing its next commit as soon
+// as the previous one is acknowledged, for `seconds` under the --sync mode.
+// Latency is measured per commit from append to acknowledgement.
+static void cmd_load(int nclients, double seconds) {
+    pthread_t threads[BENCH_MAX_CLIENTS];
+    load_client_t clients[BENCH_MAX_CLIENTS];
+    if (nclients < 1 || nclients > BENCH_MAX_CLIENTS) {
+        fprintf(stderr, "clients must be 1..%d\n", BENCH_MAX_CLIENTS);
+        exit(1);
+    }
+
+    wal_log_destroy(BENCH_WAL_DIR);
+    wal_writer_t *writer = open_wal(BENCH_WAL_DIR, durability);
+
+    double start = now_seconds();
+    memset(clients, 0, sizeof(clients));
+    for (int i = 0; i < nclients; i++) {
+        clients[i].writer = writer;
+        clients[i].id = i;
+        clients[i].deadline = start + seconds;
+        pthread_create(&threads[i], NULL, load_client_main, &clients[i]);
+    }
+    for (int i = 0; i < nclients; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_seconds() - start;
+
+    size_t total = 0;
+    for (int i = 0; i < nclients; i++)
+        total += clients[i].commits;
+    double *latency = malloc(sizeof(double) * (total ? total : 1));
+    if (!latency) {
+        perror("malloc");
+        exit(1);
+    }
+    size_t n = 0;
+    for (int i = 0; i < nclients; i++) {
+        memcpy(latency + n, clients[i].latency, sizeof(double) * clients[i].commits);
+        n += clients[i].commits;
+        free(clients[i].latency);
+    }
+    qsort(latency, total, sizeof(double), compare_doubles);
+
+    printf("%s, %d clients: %zu commits in %.2f s, %.0f commits/sec, %llu batches\n",
+           wal_durability_name(durability), nclients, total, elapsed, total / elapsed,
+           (unsigned long long)writer->batches);
+    if (total) {
+        printf("latency us: p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+               latency[total / 2], latency[total * 99 / 100], latency[total * 999 / 1000],
+               latency[total - 1]);
     }
 
+    free(latency);
+    wal_writer_close(writer);
+    wal_log_destroy(BENCH_WAL_DIR);
+}
+
+// Crash-test workload: commit CRASH_TEST_COMMITS two-key transactions,
+// reporting each acknowledged one down `ack_fd`, and checkpoint every
+// CRASH_TEST_CHECKPOINT_EVERY commits so the checkpoint, flush, compaction and
+// truncation paths run too. Values are large enough to rotate WAL segments.
+static void crash_test_key(char *buf, size_t size, uint64_t i, char side) {
+    snprintf(buf, size, "h%06llu-%c", (unsigned long long)i, side);
+}
+
+static void crash_test_value(char *buf, uint64_t i) {
+    memset(buf, 'v', CRASH_TEST_VALUE - 1);
+    snprintf(buf, 24, "v%llu:", (unsigned long long)i);
+    buf[strlen(buf)] = 'v';
+    buf[CRASH_TEST_VALUE - 1] = '\0';
+}
+
+static void crash_test_child(int ack_fd) {
+    char key_a[32], key_b[32];
+    char *value = malloc(CRASH_TEST_VALUE);
+    if (!value) {
+        perror("malloc");
+        _exit(1);
+    }
+
+    wal_writer_t *writer = open_wal(WAL_DIR, durability);
+    for (uint64_t i = 0; i < CRASH_TEST_COMMITS; i++) {
+        crash_test_key(key_a, sizeof(key_a), i, 'a');
+        crash_test_key(key_b, sizeof(key_b), i, 'b');
+        crash_test_value(value, i);
+        wal_op_t ops[2] = { { WAL_RECORD_SET, key_a, value }, { WAL_RECORD_SET, key_b, value } };
+        wal_commit_batch(writer, ops, 2);
+        if (write(ack_fd, &i, sizeof(i)) != sizeof(i))
+            _exit(1);
+
+        if ((i + 1) % CRASH_TEST_CHECKPOINT_EVERY == 0) {
+            wal_writer_close(writer);
+            apply_state_t state;
+            kv_store_t *store = open_database(&state, 0);
+            checkpoint(&state, 0);
+            kv_store_close(store);
+            writer = open_wal(WAL_DIR, durability);
+        }
+    }
+    wal_writer_close(writer);
+
+    // A clean finish reports how often the armed point was reached
+    uint64_t trailer[2] = { UINT64_MAX, fault_hits() };
+    if (write(ack_fd, trailer, sizeof(trailer)) != sizeof(trailer))
+        _exit(1);
+    _exit(0);
+}
+
+typedef struct crash_run {
+    int crashed;
+    uint64_t acked;
+    uint64_t hits;          // from a run that finished
+} crash_run_t;
+
+// Fork a workload armed to crash at the hit-th arrival at `point`
+static void crash_test_run(const char *point, uint64_t hit, int power_loss, crash_run_t *run) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        fault_arm(point, hit, power_loss);
+        crash_test_child(fds[1]);
+    }
+    close(fds[1]);
+
+    memset(run, 0, sizeof(*run));
+    uint64_t message;
+    while (read(fds[0], &message, sizeof(message)) == sizeof(message)) {
+        if (message == UINT64_MAX) {
+            if (read(fds[0], &run->hits, sizeof(run->hits)) != sizeof(run->hits))
+                run->hits = 0;
+            break;
+        }
+        run->acked = message + 1;
+    }
+    close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        exit(1);
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == FAULT_EXIT_CODE)
+        run->crashed = 1;
+    else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "crash-test: workload at %s failed with status %d\n", point, status);
+        exit(1);
+    }
+}
+
+static int crash_test_lookup(kv_store_t *store, uint64_t i, char side, const char *expected) {
+    char key[32];
+    char *value;
+    uint32_t value_length;
+    crash_test_key(key, sizeof(key), i, side);
+    int found = kv_store_get(store, key, (uint32_t)strlen(key), &value, &value_length);
+    if (found < 0) {
+        perror("get");
+        exit(1);
+    }
+    if (!found)
+        return 0;
+    int intact = value_length == strlen(expected) && memcmp(value, expected, value_length) == 0;
+    free(value);
+    return intact ? 1 : -1;
+}
+
+// Recover and check: every acknowledged commit is present with both keys and
+// the right value, the commit in flight is all-or-nothing, nothing later
+// exists, and the log accepts a new commit afterwards
+static void crash_test_verify(uint64_t acked, uint64_t *lost, uint64_t *violations) {
+    char *expected = malloc(CRASH_TEST_VALUE);
+    if (!expected) {
+        perror("malloc");
+        exit(1);
+    }
+    apply_state_t state;
+    kv_store_t *store = open_database(&state, 0);
+
+    for (uint64_t i = 0; i < CRASH_TEST_COMMITS; i++) {
+        crash_test_value(expected, i);
+        int a = crash_test_lookup(store, i, 'a', expected);
+        int b = crash_test_lookup(store, i, 'b', expected);
+        if (a < 0 || b < 0 || a != b)
+            (*violations)++;
+        else if (i < acked && !a)
+            (*lost)++;
+        else if (i > acked && a)
+            (*violations)++;
+    }
+    kv_store_close(store);
+
+    wal_writer_t *writer = open_wal(WAL_DIR, durability);
+    wal_append(writer, "probe", "ok");
+    wal_writer_close(writer);
+    store = open_database(&state, 0);
+    char *value;
+    uint32_t value_length;
+    if (kv_store_get(store, "probe", 5, &value, &value_length) != 1)
+        (*violations)++;
+    else
+        free(value);
+    kv_store_close(store);
+    free(expected);
+}
+
+// Run the workload `runs` times per crash point, each crashing at a random
+// arrival, and verify recovery after every crash. Without a simulated power
+// cut no acknowledged commit may be lost in any mode; with one
+// (SMALLWAL_CRASH_POWER=1) losses are only violations where an
+// acknowledgement promises durability, the commit and dsync modes.
+static void cmd_crash_test(int runs) {
+    int power_loss = fault_power_loss();
+    int durable_ack = durability == WAL_SYNC_COMMIT || durability == WAL_SYNC_DSYNC;
+    uint64_t failures = 0;
+
+    if (mkdir(CRASH_TEST_DIR, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir");
+        exit(1);
+    }
+    if (chdir(CRASH_TEST_DIR) < 0) {
+        perror("chdir");
+        exit(1);
+    }
+    srand((unsigned int)time(NULL) ^ (unsigned int)getpid());
+
+    printf("%s%s, %d runs per point, %d commits per run\n", wal_durability_name(durability),
+           power_loss ? " with power loss" : "", runs, CRASH_TEST_COMMITS);
+    printf("%-22s %8s %8s %8s %10s %8s %11s\n", "point", "reached", "crashes", "clean",
+           "acked", "lost", "violations");
+
+    for (size_t p = 0; p < fault_point_count; p++) {
+        const char *point = fault_points[p];
+        crash_run_t run;
+
+        wal_log_destroy(WAL_DIR);
+        wal_log_destroy(DB_DIR);
+        crash_test_run(point, UINT64_MAX, 0, &run);
+        uint64_t reached = run.hits;
+
+        int crashes = 0, clean = 0;
+        uint64_t acked = 0, lost = 0, violations = 0;
+        for (int r = 0; reached && r < runs; r++) {
+            wal_log_destroy(WAL_DIR);
+            wal_log_destroy(DB_DIR);
+            crash_test_run(point, 1 + (uint64_t)rand() % reached, power_loss, &run);
+            crashes += run.crashed;
+            clean += !run.crashed;
+            acked += run.acked;
+            crash_test_verify(run.acked, &lost, &violations);
+        }
+        if (!power_loss || durable_ack)
+            violations += lost;
+        failures += violations;
+
+        printf("%-22s %8llu %8d %8d %10llu %8llu %11llu\n", point, (unsigned long long)reached,
+               crashes, clean, (unsigned long long)acked, (unsigned long long)lost,
+               (unsigned long long)violations);
+    }
+
+    wal_log_destroy(WAL_DIR);
+    wal_log_destroy(DB_DIR);
+    if (chdir("..") == 0)
+        rmdir(CRASH_TEST_DIR);
+    if (failures) {
+        printf("FAILED: %llu violations\n", (unsigned long long)failures);
+        exit(1);
+    }
+    printf("All acknowledged commits survived\n");
+}
+
+static void cmd_recover() {
+    apply_state_t state;
+    kv_store_t *store = open_database(&state, 1);
+    checkpoint(&state, 1);
+    kv_store_close(store);
+}
+
+static void cmd_checkpoint() {
+    apply_state_t state;
+    kv_store_t *store = open_database(&state, 0);
+    checkpoint(&state, 1);
+    kv_store_close(store);
+}
+
+static void cmd_get(const char *key) {
+    apply_state_t state;
+    kv_store_t *store = open_database(&state, 0);
+    char *value;
+    uint32_t value_length;
+
+    int found = kv_store_get(store, key, (uint32_t)strlen(key), &value, &value_length);
+    if (found < 0) {
+        perror("get");
+        exit(1);
+    }
+    if (found) {
+        printf("%s=%.*s\n", key, (int)value_length, value);
+        free(value);
+    }
+    else {
+        printf("%s not found\n", key);
+    }
+    kv_store_close(store);
+}
+
+static int print_entry(const char *key, uint32_t key_length, const char *value, uint32_t value_length, void *arg) {
+    (void)arg;
+    printf("%.*s=%.*s\n", (int)key_length, key, (int)value_length, value);
+    return 0;
+}
+
+// Keys in [start, end); either bound may be omitted
+static void cmd_scan(const char *start, const char *end) {
+    apply_state_t state;
+    kv_store_t *store = open_database(&state, 0);
+
+    if (kv_store_scan(store, start, start ? (uint32_t)strlen(start) : 0,
+                      end, end ? (uint32_t)strlen(end) : 0, print_entry, NULL) < 0) {
+        perror("scan");
+        exit(1);
+    }
+    kv_store_close(store);
+}
+
+static int print_record(const wal_record_t *record, void *arg) {
+    (void)arg;
+    printf("%llu TRANSACTION %llu %s", (unsigned long long)record->lsn,
+           (unsigned long long)record->txn_id, wal_record_type_name(record->type));
+    if (record->type == WAL_RECORD_SET) {
+        printf(" %.*s %.*s", (int)record->key_length, record->key,
+               (int)record->value_length, record->value);
+    }
+    else if (record->type == WAL_RECORD_DELETE) {
+        printf(" %.*s", (int)record->key_length, record->key);
+    }
+    printf("\n");
+    return 0;
+}
+
+static void print_wal() {
+    wal_checkpoint_t checkpoint;
+    uint64_t last_lsn;
+
+    if (wal_checkpoint_read(WAL_DIR, &checkpoint) < 0) {
+        perror("read checkpoint");
+        return;
+    }
+    printf("checkpoint LSN %llu, last transaction %llu\n", (unsigned long long)checkpoint.lsn,
+           (unsigned long long)checkpoint.last_txn_id);
+    if (wal_log_replay(WAL_DIR, checkpoint.lsn, print_record, NULL, &last_lsn) < 0) {
+        perror("read wal");
+    }
+}
+
+static void cmd_show() {
+    printf("===== WAL LOG =====\n");
+    print_wal();
+
     printf("\n===== DB CONTENTS =====\n");
-    FILE *db_fp = fopen(DB_FILE, "r");
-    if (db_fp) {
-        char line[LINE_BUF];
-        while (fgets(line, sizeof(line), db_fp)) {
-            fputs(line, stdout);
+    cmd_scan(NULL, NULL);
+}
+
+// Rewrite an old text WAL ("TRANSACTION n BEGIN" / "SET k v" / "TRANSACTION n COMMIT")
+// as the first segment of a new binary log directory. Lines that do not parse
+// end the conversion, as the old recovery would have ignored them anyway.
+static void cmd_convert_text(const char *in_path, const char *out_dir) {
+    char out_path[PATH_MAX];
+
+    FILE *in = fopen(in_path, "r");
+    if (!in) {
+        perror("open text wal");
+        exit(1);
+    }
+    if (mkdir(out_dir, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir wal");
+        exit(1);
+    }
+    wal_segment_path(out_path, sizeof(out_path), out_dir, 1);
+    int out = open(out_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (out < 0) {
+        perror("open binary wal");
+        exit(1);
+    }
+
+    char line[4 * LINE_BUF], key[2 * LINE_BUF], value[2 * LINE_BUF];
+    char *record = malloc(wal_record_size(sizeof(key), sizeof(value)));
+    if (!record) {
+        perror("malloc");
+        exit(1);
+    }
+    uint64_t lsn = 1, converted = 0;
+    unsigned long long id = 0;
+
+    while (fgets(line, sizeof(line), in)) {
+        size_t length;
+        if (sscanf(line, "TRANSACTION %llu BEGIN", &id) == 1 && strstr(line, "BEGIN")) {
+            length = wal_record_encode(record, WAL_RECORD_BEGIN, NULL, 0, NULL, 0);
+        }
+        else if (sscanf(line, "TRANSACTION %llu COMMIT", &id) == 1 && strstr(line, "COMMIT")) {
+            length = wal_record_encode(record, WAL_RECORD_COMMIT, NULL, 0, NULL, 0);
+        }
+        else if (sscanf(line, "SET %511s %511s", key, value) == 2) {
+            length = wal_record_encode(record, WAL_RECORD_SET, key, (uint32_t)strlen(key),
+                                       value, (uint32_t)strlen(value));
+        }
+        else {
+            fprintf(stderr, "Stopping at unparsable line: %s", line);
+            break;
+        }
+
+        lsn = wal_record_stamp(record, length, lsn, id);
+        if (write(out, record, length) != (ssize_t)length) {
+            perror("write binary wal");
+            exit(1);
         }
-        fclose(db_fp);
+        converted++;
     }
+
+    if (fsync(out) < 0 || wal_fsync_dir(out_dir) < 0) {
+        perror("fsync");
+        exit(1);
+    }
+    close(out);
+    fclose(in);
+    free(record);
+    printf("Converted %llu records from %s to %s\n", (unsigned long long)converted, in_path, out_dir);
+}
+
+// commit, periodic[:ms], dsync or none
+static int parse_durability(const char *mode) {
+    if (strcmp(mode, "commit") == 0)
+        durability = WAL_SYNC_COMMIT;
+    else if (strncmp(mode, "periodic", 8) == 0 && (mode[8] == '\0' || mode[8] == ':')) {
+        durability = WAL_SYNC_PERIODIC;
+        if (mode[8] == ':')
+            sync_interval_ms = atoi(mode + 9);
+    }
+    else if (strcmp(mode, "dsync") == 0)
+        durability = WAL_SYNC_DSYNC;
+    else if (strcmp(mode, "none") == 0)
+        durability = WAL_SYNC_NONE;
+    else
+        return -1;
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
+    if (argc > 1 && strncmp(argv[1], "--sync=", 7) == 0) {
+        if (parse_durability(argv[1] + 7) < 0) {
+            fprintf(stderr, "Invalid durability mode: %s\n", argv[1] + 7);
+            return 1;
+        }
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+
     if (argc < 2) {
         printf("\nUsage:\n");
+        printf("%s [--sync=commit|periodic[:ms]|dsync|none] <command> ...\n", argv[0]);
         printf("%s commit <key> <value>\n", argv[0]);
         printf("%s commit-nosync <key> <value>\n", argv[0]);
+        printf("%s delete <key>\n", argv[0]);
+        printf("%s batch set <key> <value> | del <key> ...\n", argv[0]);
         printf("%s crash-after-wal <key> <value>\n", argv[0]);
         printf("%s recover\n", argv[0]);
+        printf("%s checkpoint\n", argv[0]);
+        printf("%s get <key>\n", argv[0]);
+        printf("%s scan [start [end]]\n", argv[0]);
         printf("%s show\n", argv[0]);
+        printf("%s bench-commit [commits-per-client]\n", argv[0]);
+        printf("%s bench-batch [keys]\n", argv[0]);
+        printf("%s bench-sync [commits-per-client]\n", argv[0]);
+        printf("%s bench-store [max-keys]\n", argv[0]);
+        printf("%s bench-recover [transactions]\n", argv[0]);
+        printf("%s load [clients] [seconds]\n", argv[0]);
+        printf("%s crash-test [runs-per-point]\n", argv[0]);
+        printf("%s convert-text <text-wal> <binary-wal-dir>\n", argv[0]);
         return 1;
     }
 
@@ -153,15 +1087,54 @@ int main(int argc, char *argv[]) {
     else if (strcmp(argv[1], "commit-nosync") == 0 && argc == 4) {
         cmd_commit_nosync(argv[2], argv[3]);
     }
+    else if (strcmp(argv[1], "delete") == 0 && argc == 3) {
+        cmd_delete(argv[2]);
+    }
+    else if (strcmp(argv[1], "batch") == 0) {
+        cmd_batch(argc - 2, argv + 2);
+    }
     else if (strcmp(argv[1], "crash-after-wal") == 0 && argc == 4) {
         cmd_crash_after_wal(argv[2], argv[3]);
     }
     else if (strcmp(argv[1], "recover") == 0) {
         cmd_recover();
     }
+    else if (strcmp(argv[1], "checkpoint") == 0) {
+        cmd_checkpoint();
+    }
+    else if (strcmp(argv[1], "get") == 0 && argc == 3) {
+        cmd_get(argv[2]);
+    }
+    else if (strcmp(argv[1], "scan") == 0 && argc <= 4) {
+        cmd_scan(argc > 2 ? argv[2] : NULL, argc > 3 ? argv[3] : NULL);
+    }
     else if (strcmp(argv[1], "show") == 0) {
         cmd_show();
     }
+    else if (strcmp(argv[1], "convert-text") == 0 && argc == 4) {
+        cmd_convert_text(argv[2], argv[3]);
+    }
+    else if (strcmp(argv[1], "load") == 0) {
+        cmd_load(argc > 2 ? atoi(argv[2]) : BENCH_SYNC_CLIENTS, argc > 3 ? atof(argv[3]) : 5);
+    }
+    else if (strcmp(argv[1], "crash-test") == 0) {
+        cmd_crash_test(argc > 2 ? atoi(argv[2]) : 5);
+    }
+    else if (strcmp(argv[1], "bench-store") == 0) {
+        cmd_bench_store(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000);
+    }
+    else if (strcmp(argv[1], "bench-recover") == 0) {
+        cmd_bench_recover(argc > 2 ? atoi(argv[2]) : 100000);
+    }
+    else if (strcmp(argv[1], "bench-sync") == 0) {
+        cmd_bench_sync(argc > 2 ? atoi(argv[2]) : 500);
+    }
+    else if (strcmp(argv[1], "bench-batch") == 0) {
+        cmd_bench_batch(argc > 2 ? atoi(argv[2]) : 8192);
+    }
+    else if (strcmp(argv[1], "bench-commit") == 0) {
+        cmd_bench_commit(argc > 2 ? atoi(argv[2]) : 200);
+    }
     else {
         fprintf(stderr, "Invalid command\n");
         return 1;
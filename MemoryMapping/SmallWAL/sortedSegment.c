@@ -0,0 +1,350 @@
+#include "sortedSegment.h"
+#include "memTable.h"
+#include <sys/mman.h>
+
+#define BUILDER_BUFFER_SIZE (256 * 1024)
+#define BLOOM_HASHES 7
+
+typedef struct builder_index_entry {
+    char *key;
+    uint32_t key_length;
+    uint64_t offset;
+} builder_index_entry_t;
+
+struct segment_builder {
+    int fd;
+    char *buffer;
+    size_t buffered;
+    uint64_t offset;
+    uint64_t entry_count;
+
+    builder_index_entry_t *index;
+    size_t index_count;
+    size_t index_capacity;
+
+    uint8_t *bloom;
+    uint64_t bloom_bits;
+};
+
+// Double hashing: probe i is h1 + i * h2
+static void bloom_add(uint8_t *bloom, uint64_t bits, uint64_t hash) {
+    uint64_t h1 = hash & 0xffffffffu, h2 = (hash >> 32) | 1;
+    for (uint64_t i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + i * h2) % bits;
+        bloom[bit / 8] |= (uint8_t)(1u << (bit % 8));
+    }
+}
+
+static int bloom_may_contain(const uint8_t *bloom, uint64_t bits, uint32_t hashes, uint64_t hash) {
+    uint64_t h1 = hash & 0xffffffffu, h2 = (hash >> 32) | 1;
+    for (uint64_t i = 0; i < hashes; i++) {
+        uint64_t bit = (h1 + i * h2) % bits;
+        if (!(bloom[bit / 8] & (1u << (bit % 8))))
+            return 0;
+    }
+    return 1;
+}
+
+static int builder_flush(segment_builder_t *builder) {
+    size_t done = 0;
+    while (done < builder->buffered) {
+        ssize_t n = write(builder->fd, builder->buffer + done, builder->buffered - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    builder->buffered = 0;
+    return 0;
+}
+
+static int builder_write(segment_builder_t *builder, const void *data, size_t length) {
+    const char *p = data;
+    builder->offset += length;
+    while (length > 0) {
+        size_t room = BUILDER_BUFFER_SIZE - builder->buffered;
+        size_t chunk = length < room ? length : room;
+        memcpy(builder->buffer + builder->buffered, p, chunk);
+        builder->buffered += chunk;
+        p += chunk;
+        length -= chunk;
+        if (builder->buffered == BUILDER_BUFFER_SIZE && builder_flush(builder) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// expected_keys sizes the bloom filter; overshooting only costs a few bytes
+segment_builder_t *segment_builder_open(const char *path, uint64_t expected_keys) {
+    segment_builder_t *builder = calloc(1, sizeof(segment_builder_t));
+    if (!builder)
+        return NULL;
+
+    builder->bloom_bits = expected_keys * SEGMENT_BLOOM_BITS_PER_KEY;
+    if (builder->bloom_bits < 64)
+        builder->bloom_bits = 64;
+    builder->buffer = malloc(BUILDER_BUFFER_SIZE);
+    builder->bloom = calloc((size_t)(builder->bloom_bits + 7) / 8, 1);
+    builder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!builder->buffer || !builder->bloom || builder->fd < 0) {
+        if (builder->fd >= 0)
+            close(builder->fd);
+        free(builder->buffer);
+        free(builder->bloom);
+        free(builder);
+        return NULL;
+    }
+    return builder;
+}
+
+// Keys must arrive in strictly increasing order
+int segment_builder_add(segment_builder_t *builder, const char *key, uint32_t key_length,
+                        const char *value, uint32_t value_length, int deleted) {
+    if (builder->entry_count % SEGMENT_INDEX_INTERVAL == 0) {
+        if (builder->index_count == builder->index_capacity) {
+            size_t capacity = builder->index_capacity ? builder->index_capacity * 2 : 256;
+            builder_index_entry_t *grown = realloc(builder->index, sizeof(builder_index_entry_t) * capacity);
+            if (!grown)
+                return -1;
+            builder->index = grown;
+            builder->index_capacity = capacity;
+        }
+        builder_index_entry_t *entry = &builder->index[builder->index_count];
+        entry->key = malloc(key_length ? key_length : 1);
+        if (!entry->key)
+            return -1;
+        memcpy(entry->key, key, key_length);
+        entry->key_length = key_length;
+        entry->offset = builder->offset;
+        builder->index_count++;
+    }
+
+    bloom_add(builder->bloom, builder->bloom_bits, key_hash(key, key_length));
+
+    if (deleted)
+        value_length = 0;
+    uint32_t lengths[2] = { key_length, deleted ? SEGMENT_TOMBSTONE : value_length };
+    if (builder_write(builder, lengths, sizeof(lengths)) < 0 ||
+        builder_write(builder, key, key_length) < 0 ||
+        builder_write(builder, value, value_length) < 0)
+        return -1;
+
+    builder->entry_count++;
+    return 0;
+}
+
+static void builder_free(segment_builder_t *builder) {
+    for (size_t i = 0; i < builder->index_count; i++)
+        free(builder->index[i].key);
+    free(builder->index);
+    free(builder->buffer);
+    free(builder->bloom);
+    free(builder);
+}
+
+// Append index, bloom filter and footer, then fsync. The caller renames the
+// file into place, so a half-written segment is never visible.
+int segment_builder_finish(segment_builder_t *builder, uint64_t *bytes_written) {
+    segment_footer_t footer;
+    memset(&footer, 0, sizeof(footer));
+
+    footer.index_offset = builder->offset;
+    footer.index_count = builder->index_count;
+    for (size_t i = 0; i < builder->index_count; i++) {
+        builder_index_entry_t *entry = &builder->index[i];
+        if (builder_write(builder, &entry->key_length, sizeof(entry->key_length)) < 0 ||
+            builder_write(builder, entry->key, entry->key_length) < 0 ||
+            builder_write(builder, &entry->offset, sizeof(entry->offset)) < 0)
+            goto fail;
+    }
+
+    footer.bloom_offset = builder->offset;
+    footer.bloom_bits = builder->bloom_bits;
+    footer.bloom_hashes = BLOOM_HASHES;
+    if (builder_write(builder, builder->bloom, (size_t)(builder->bloom_bits + 7) / 8) < 0)
+        goto fail;
+
+    footer.entry_count = builder->entry_count;
+    footer.magic = SEGMENT_MAGIC;
+    if (builder_write(builder, &footer, sizeof(footer)) < 0 || builder_flush(builder) < 0)
+        goto fail;
+    if (fsync(builder->fd) < 0)
+        goto fail;
+
+    close(builder->fd);
+    if (bytes_written)
+        *bytes_written = builder->offset;
+    builder_free(builder);
+    return 0;
+
+fail:
+    close(builder->fd);
+    builder_free(builder);
+    return -1;
+}
+
+void segment_builder_abort(segment_builder_t *builder) {
+    if (!builder)
+        return;
+    close(builder->fd);
+    builder_free(builder);
+}
+
+sorted_segment_t *sorted_segment_open(const char *path, uint64_t seq, uint32_t generation) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(segment_footer_t)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    char *data = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    sorted_segment_t *segment = calloc(1, sizeof(sorted_segment_t));
+    if (!segment) {
+        munmap(data, (size_t)sb.st_size);
+        return NULL;
+    }
+    segment->data = data;
+    segment->size = (size_t)sb.st_size;
+    segment->seq = seq;
+    segment->generation = generation;
+    snprintf(segment->path, sizeof(segment->path), "%s", path);
+    atomic_init(&segment->refs, 1);
+    memcpy(&segment->footer, data + segment->size - sizeof(segment_footer_t), sizeof(segment_footer_t));
+
+    // The footer must describe regions inside the file, in order, and a
+    // bloom filter with at least one bit; every index entry is at least a
+    // length and an offset
+    segment_footer_t *footer = &segment->footer;
+    size_t body = segment->size - sizeof(segment_footer_t);
+    size_t min_entry = sizeof(uint32_t) + sizeof(uint64_t);
+    if (footer->magic != SEGMENT_MAGIC || footer->bloom_offset > body ||
+        footer->index_offset > footer->bloom_offset || footer->bloom_bits == 0 ||
+        (footer->bloom_bits - 1) / 8 + 1 > body - footer->bloom_offset ||
+        footer->index_count > (footer->bloom_offset - footer->index_offset) / min_entry) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    segment->index = malloc(sizeof(segment_index_entry_t) * (footer->index_count ? footer->index_count : 1));
+    if (!segment->index)
+        goto fail;
+
+    const char *p = data + footer->index_offset;
+    const char *index_end = data + footer->bloom_offset;
+    for (uint64_t i = 0; i < footer->index_count; i++) {
+        segment_index_entry_t *entry = &segment->index[i];
+        if ((size_t)(index_end - p) < min_entry) {
+            errno = EINVAL;
+            goto fail;
+        }
+        memcpy(&entry->key_length, p, sizeof(uint32_t));
+        if (entry->key_length > (size_t)(index_end - p) - min_entry) {
+            errno = EINVAL;
+            goto fail;
+        }
+        entry->key = p + sizeof(uint32_t);
+        memcpy(&entry->offset, entry->key + entry->key_length, sizeof(uint64_t));
+        p = entry->key + entry->key_length + sizeof(uint64_t);
+    }
+    segment->bloom = (const uint8_t *)data + footer->bloom_offset;
+    return segment;
+
+fail:
+    munmap(data, segment->size);
+    free(segment->index);
+    free(segment);
+    return NULL;
+}
+
+void sorted_segment_retain(sorted_segment_t *segment) {
+    atomic_fetch_add(&segment->refs, 1);
+}
+
+// Readers hold a reference, so compaction can drop a segment while it is being read
+void sorted_segment_release(sorted_segment_t *segment) {
+    if (atomic_fetch_sub(&segment->refs, 1) != 1)
+        return;
+    munmap(segment->data, segment->size);
+    free(segment->index);
+    free(segment);
+}
+
+static void iter_load(segment_iter_t *iter) {
+    const sorted_segment_t *segment = iter->segment;
+    if (iter->offset >= segment->footer.index_offset) {
+        iter->valid = 0;
+        return;
+    }
+
+    const char *p = segment->data + iter->offset;
+    uint32_t lengths[2];
+    memcpy(lengths, p, sizeof(lengths));
+    iter->key = p + sizeof(lengths);
+    iter->key_length = lengths[0];
+    iter->value = iter->key + lengths[0];
+    iter->deleted = lengths[1] == SEGMENT_TOMBSTONE;
+    iter->value_length = iter->deleted ? 0 : lengths[1];
+    iter->valid = 1;
+}
+
+void segment_iter_next(segment_iter_t *iter) {
+    iter->offset += 2 * sizeof(uint32_t) + iter->key_length + iter->value_length;
+    iter_load(iter);
+}
+
+// Position on the first entry with key >= the given key (NULL key: first entry)
+void segment_iter_seek(segment_iter_t *iter, const sorted_segment_t *segment,
+                       const char *key, uint32_t key_length) {
+    iter->segment = segment;
+    iter->offset = 0;
+
+    if (key && segment->footer.index_count > 0) {
+        // Last index entry whose key is <= key
+        uint64_t low = 0, high = segment->footer.index_count;
+        while (high - low > 1) {
+            uint64_t mid = low + (high - low) / 2;
+            const segment_index_entry_t *entry = &segment->index[mid];
+            if (key_compare(entry->key, entry->key_length, key, key_length) <= 0)
+                low = mid;
+            else
+                high = mid;
+        }
+        iter->offset = segment->index[low].offset;
+    }
+
+    iter_load(iter);
+    while (key && iter->valid && key_compare(iter->key, iter->key_length, key, key_length) < 0)
+        segment_iter_next(iter);
+}
+
+// KV_FOUND and a pointer into the mapping, KV_DELETED for a tombstone,
+// KV_NOT_FOUND when the segment has nothing for the key
+int sorted_segment_get(const sorted_segment_t *segment, const char *key, uint32_t key_length,
+                       const char **value, uint32_t *value_length) {
+    const segment_footer_t *footer = &segment->footer;
+    if (!bloom_may_contain(segment->bloom, footer->bloom_bits, footer->bloom_hashes,
+                           key_hash(key, key_length)))
+        return KV_NOT_FOUND;
+
+    segment_iter_t iter;
+    segment_iter_seek(&iter, segment, key, key_length);
+    if (iter.valid && key_compare(iter.key, iter.key_length, key, key_length) == 0) {
+        if (iter.deleted)
+            return KV_DELETED;
+        *value = iter.value;
+        *value_length = iter.value_length;
+        return KV_FOUND;
+    }
+    return KV_NOT_FOUND;
+}
@@ -0,0 +1,78 @@
+#ifndef SORTEDSEGMENT_H
+#define SORTEDSEGMENT_H
+
+#include "main.h"
+#include <limits.h>
+
+// Immutable sorted segment file:
+//   data   : [u32 key_length][u32 value_length][key][value] ... in key order;
+//            a tombstone has value_length SEGMENT_TOMBSTONE and no value bytes
+//   index  : every SEGMENT_INDEX_INTERVAL-th key as [u32 key_length][key][u64 data offset]
+//   bloom  : bloom_bits bits, bloom_hashes probes per key
+//   footer : segment_footer_t
+// A point read checks the bloom filter, binary-searches the sparse index and
+// scans at most one index interval of data.
+#define SEGMENT_INDEX_INTERVAL 16
+#define SEGMENT_BLOOM_BITS_PER_KEY 10
+#define SEGMENT_MAGIC 0x53474553u
+#define SEGMENT_TOMBSTONE UINT32_MAX
+
+typedef struct segment_footer {
+    uint64_t index_offset;
+    uint64_t index_count;
+    uint64_t bloom_offset;
+    uint64_t bloom_bits;
+    uint64_t entry_count;
+    uint32_t bloom_hashes;
+    uint32_t magic;
+} segment_footer_t;
+
+typedef struct segment_index_entry {
+    const char *key;
+    uint32_t key_length;
+    uint64_t offset;
+} segment_index_entry_t;
+
+typedef struct sorted_segment {
+    uint64_t seq;           // newer segments have higher seq
+    uint32_t generation;    // bumped each time compaction rewrites the seq
+    char path[PATH_MAX];
+    char *data;
+    size_t size;
+    segment_footer_t footer;
+    segment_index_entry_t *index;
+    const uint8_t *bloom;
+    atomic_int refs;
+} sorted_segment_t;
+
+// Cursor over one segment's entries
+typedef struct segment_iter {
+    const sorted_segment_t *segment;
+    uint64_t offset;
+    const char *key;
+    uint32_t key_length;
+    const char *value;
+    uint32_t value_length;
+    int deleted;
+    int valid;
+} segment_iter_t;
+
+typedef struct segment_builder segment_builder_t;
+
+segment_builder_t *segment_builder_open(const char *path, uint64_t expected_keys);
+int segment_builder_add(segment_builder_t *builder, const char *key, uint32_t key_length,
+                        const char *value, uint32_t value_length, int deleted);
+int segment_builder_finish(segment_builder_t *builder, uint64_t *bytes_written);
+void segment_builder_abort(segment_builder_t *builder);
+
+sorted_segment_t *sorted_segment_open(const char *path, uint64_t seq, uint32_t generation);
+void sorted_segment_retain(sorted_segment_t *segment);
+void sorted_segment_release(sorted_segment_t *segment);
+int sorted_segment_get(const sorted_segment_t *segment, const char *key, uint32_t key_length,
+                       const char **value, uint32_t *value_length);
+
+void segment_iter_seek(segment_iter_t *iter, const sorted_segment_t *segment,
+                       const char *key, uint32_t key_length);
+void segment_iter_next(segment_iter_t *iter);
+
+#endif
@@ -0,0 +1,303 @@
+#include "walLog.h"
+#include "faultInject.h"
+#include <dirent.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+
+typedef struct checkpoint_file {
+    wal_checkpoint_t checkpoint;
+    uint32_t crc;
+} checkpoint_file_t;
+
+void wal_segment_path(char *path, size_t capacity, const char *dir, uint64_t first_lsn) {
+    snprintf(path, capacity, "%s/%016" PRIx64 WAL_SEGMENT_SUFFIX, dir, first_lsn);
+}
+
+static int compare_segments(const void *a, const void *b) {
+    const wal_segment_t *left = a, *right = b;
+    return (left->first_lsn > right->first_lsn) - (left->first_lsn < right->first_lsn);
+}
+
+// All segments of the log ordered by first LSN; a missing directory is an empty log
+int wal_segment_list(const char *dir, wal_segment_t **segments, size_t *count) {
+    *segments = NULL;
+    *count = 0;
+
+    DIR *d = opendir(dir);
+    if (!d)
+        return errno == ENOENT ? 0 : -1;
+
+    size_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        size_t suffix = strlen(WAL_SEGMENT_SUFFIX);
+        if (length != 16 + suffix || strcmp(entry->d_name + 16, WAL_SEGMENT_SUFFIX) != 0)
+            continue;
+
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            wal_segment_t *grown = realloc(*segments, sizeof(wal_segment_t) * capacity);
+            if (!grown) {
+                closedir(d);
+                free(*segments);
+                *segments = NULL;
+                errno = ENOMEM;
+                return -1;
+            }
+            *segments = grown;
+        }
+
+        wal_segment_t *segment = &(*segments)[(*count)++];
+        segment->first_lsn = strtoull(entry->d_name, NULL, 16);
+        snprintf(segment->path, sizeof(segment->path), "%s/%s", dir, entry->d_name);
+    }
+    closedir(d);
+
+    if (*count > 1)
+        qsort(*segments, *count, sizeof(wal_segment_t), compare_segments);
+    return 0;
+}
+
+// Overwrite a range with zeros. Unlike fallocate alone this leaves the blocks
+// written, so later appends into them only dirty data, never extent metadata.
+int wal_zero_fill(int fd, off_t offset, size_t length) {
+    static const char zeros[64 * 1024];
+    while (length > 0) {
+        size_t chunk = length < sizeof(zeros) ? length : sizeof(zeros);
+        ssize_t n = pwrite(fd, zeros, chunk, offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        offset += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static int count_spares(const char *dir, char *path, size_t capacity) {
+    DIR *d = opendir(dir);
+    if (!d)
+        return -1;
+
+    int count = 0;
+    struct dirent *entry;
+    size_t suffix = strlen(WAL_SPARE_SUFFIX);
+    while ((entry = readdir(d)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length <= suffix || strcmp(entry->d_name + length - suffix, WAL_SPARE_SUFFIX) != 0)
+            continue;
+        if (count++ == 0 && path)
+            snprintf(path, capacity, "%s/%s", dir, entry->d_name);
+    }
+    closedir(d);
+    return count;
+}
+
+// Rename a spare into place as segment_path. Returns 1 when a spare was
+// taken, 0 when there is none.
+int wal_spare_take(const char *dir, const char *segment_path) {
+    char path[PATH_MAX];
+    int count = count_spares(dir, path, sizeof(path));
+    if (count <= 0)
+        return count;
+    if (rename(path, segment_path) < 0)
+        return -1;
+    return 1;
+}
+
+// Zero a covered segment and park it as a spare, or delete it once enough
+// spares are waiting or it is not a standard-size segment
+static int recycle_segment(const char *dir, const wal_segment_t *segment) {
+    char path[PATH_MAX];
+    struct stat sb;
+
+    int spares = count_spares(dir, NULL, 0);
+    int fd = spares >= 0 && spares < WAL_SPARE_SEGMENTS ? open(segment->path, O_WRONLY) : -1;
+    if (fd < 0 || fstat(fd, &sb) < 0 || sb.st_size != WAL_SEGMENT_SIZE) {
+        if (fd >= 0)
+            close(fd);
+        return unlink(segment->path);
+    }
+
+    int rc = wal_zero_fill(fd, 0, (size_t)sb.st_size) < 0 || fdatasync(fd) < 0 ? -1 : 0;
+    close(fd);
+    if (rc < 0)
+        return unlink(segment->path);
+
+    snprintf(path, sizeof(path), "%s/%016" PRIx64 WAL_SPARE_SUFFIX, dir, segment->first_lsn);
+    return rename(segment->path, path);
+}
+
+// Make creates, renames and unlinks inside dir durable
+int wal_fsync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+// A missing or damaged checkpoint reads as LSN 0: replay the whole log
+int wal_checkpoint_read(const char *dir, wal_checkpoint_t *checkpoint) {
+    char path[PATH_MAX];
+    checkpoint_file_t file;
+
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    snprintf(path, sizeof(path), "%s/%s", dir, WAL_CHECKPOINT_FILE);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT ? 0 : -1;
+    ssize_t n = read(fd, &file, sizeof(file));
+    close(fd);
+
+    if (n == (ssize_t)sizeof(file) && crc32c(0, &file.checkpoint, sizeof(file.checkpoint)) == file.crc)
+        *checkpoint = file.checkpoint;
+    else
+        fprintf(stderr, "WAL: ignoring damaged checkpoint file\n");
+    return 0;
+}
+
+// Write-to-temp, fsync, rename: the checkpoint is replaced atomically or not at all
+int wal_checkpoint_write(const char *dir, const wal_checkpoint_t *checkpoint) {
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    checkpoint_file_t file;
+
+    memset(&file, 0, sizeof(file));
+    file.checkpoint = *checkpoint;
+    file.crc = crc32c(0, &file.checkpoint, sizeof(file.checkpoint));
+
+    snprintf(path, sizeof(path), "%s/%s", dir, WAL_CHECKPOINT_FILE);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s.tmp", dir, WAL_CHECKPOINT_FILE);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    if (write(fd, &file, sizeof(file)) != (ssize_t)sizeof(file) || fsync(fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    FAULT_POINT(FAULT_CHECKPOINT_TMP);
+    if (rename(tmp_path, path) < 0)
+        return -1;
+    return wal_fsync_dir(dir);
+}
+
+// Feed every intact record with LSN > after_lsn to fn, in log order. A
+// segment's records end where the writer rotated, so replay moves on to the
+// next segment at the first record that does not decode and stops when that
+// segment does not continue the LSN sequence, or when fn returns non-zero.
+// *last_lsn is the last LSN visited (after_lsn when nothing was replayed).
+int wal_log_replay(const char *dir, uint64_t after_lsn, wal_replay_fn fn, void *arg, uint64_t *last_lsn) {
+    wal_segment_t *segments;
+    size_t count;
+    int rc = 0;
+
+    *last_lsn = after_lsn;
+    if (wal_segment_list(dir, &segments, &count) < 0)
+        return -1;
+
+    // Start at the segment holding after_lsn + 1
+    size_t first = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (segments[i].first_lsn <= after_lsn + 1)
+            first = i;
+    }
+
+    uint64_t expected = 0;
+    for (size_t i = first; i < count && rc == 0; i++) {
+        if (expected && segments[i].first_lsn != expected) {
+            fprintf(stderr, "WAL: gap before segment %s, stopping replay\n", segments[i].path);
+            break;
+        }
+        expected = segments[i].first_lsn;
+
+        int fd = open(segments[i].path, O_RDONLY);
+        if (fd < 0) {
+            rc = -1;
+            break;
+        }
+        struct stat sb;
+        if (fstat(fd, &sb) < 0) {
+            close(fd);
+            rc = -1;
+            break;
+        }
+        if (sb.st_size == 0) {
+            close(fd);
+            continue;
+        }
+        char *data = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            rc = -1;
+            break;
+        }
+        madvise(data, (size_t)sb.st_size, MADV_SEQUENTIAL);
+
+        size_t size = (size_t)sb.st_size, offset = 0, n;
+        wal_record_t record;
+        while ((n = wal_record_decode(data + offset, size - offset, expected, &record)) > 0) {
+            offset += n;
+            expected = record.lsn + 1;
+            if (record.lsn <= after_lsn)
+                continue;
+            *last_lsn = record.lsn;
+            if ((rc = fn(&record, arg)) != 0)
+                break;
+        }
+        munmap(data, size);
+    }
+
+    free(segments);
+    return rc < 0 ? -1 : 0;
+}
+
+// Recycle every segment whose records all sit at or below the checkpoint.
+// The newest segment is always kept because the writer may still append to it.
+int wal_log_truncate(const char *dir, uint64_t checkpoint_lsn, size_t *removed) {
+    wal_segment_t *segments;
+    size_t count;
+
+    *removed = 0;
+    if (wal_segment_list(dir, &segments, &count) < 0)
+        return -1;
+
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (segments[i + 1].first_lsn > checkpoint_lsn + 1)
+            break;
+        if (recycle_segment(dir, &segments[i]) < 0) {
+            free(segments);
+            return -1;
+        }
+        (*removed)++;
+        FAULT_POINT(FAULT_TRUNCATE_PARTIAL);
+    }
+    free(segments);
+
+    return *removed ? wal_fsync_dir(dir) : 0;
+}
+
+// Remove a directory and the files in it (benchmark scratch logs and stores)
+void wal_log_destroy(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+
+    char path[PATH_MAX];
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
@@ -0,0 +1,48 @@
+#ifndef WALLOG_H
+#define WALLOG_H
+
+#include "main.h"
+#include "walRecord.h"
+#include <limits.h>
+
+// The log is a directory of fixed-size segment files named after the first
+// LSN they hold, plus a checkpoint file. Everything at or below the
+// checkpoint LSN is already in the database, so segments that end before it
+// are deleted and recovery starts replaying right after it.
+// Segments are preallocated and zero-filled, so appends never change the file
+// size. Instead of being deleted, up to WAL_SPARE_SEGMENTS covered segments
+// are zeroed and parked as spares for the writer to rename and reuse.
+#ifndef WAL_SEGMENT_SIZE
+#define WAL_SEGMENT_SIZE (4u * 1024 * 1024)
+#endif
+#define WAL_SPARE_SEGMENTS 4
+#define WAL_SEGMENT_SUFFIX ".seg"
+#define WAL_SPARE_SUFFIX ".spare"
+#define WAL_CHECKPOINT_FILE "checkpoint"
+
+typedef struct wal_segment {
+    uint64_t first_lsn;
+    char path[PATH_MAX];
+} wal_segment_t;
+
+typedef struct wal_checkpoint {
+    uint64_t lsn;           // last LSN made durable in the database
+    uint64_t last_txn_id;   // keeps txn ids monotonic once the log is truncated
+} wal_checkpoint_t;
+
+typedef int (*wal_replay_fn)(const wal_record_t *record, void *arg);
+
+void wal_segment_path(char *path, size_t capacity, const char *dir, uint64_t first_lsn);
+int wal_segment_list(const char *dir, wal_segment_t **segments, size_t *count);
+int wal_fsync_dir(const char *dir);
+int wal_zero_fill(int fd, off_t offset, size_t length);
+int wal_spare_take(const char *dir, const char *segment_path);
+
+int wal_checkpoint_read(const char *dir, wal_checkpoint_t *checkpoint);
+int wal_checkpoint_write(const char *dir, const wal_checkpoint_t *checkpoint);
+
+int wal_log_replay(const char *dir, uint64_t after_lsn, wal_replay_fn fn, void *arg, uint64_t *last_lsn);
+int wal_log_truncate(const char *dir, uint64_t checkpoint_lsn, size_t *removed);
+void wal_log_destroy(const char *dir);
+
+#endif
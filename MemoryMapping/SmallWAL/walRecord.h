@@ -0,0 +1,51 @@
+#ifndef WALRECORD_H
+#define WALRECORD_H
+
+#include "main.h"
+
+// On-disk record: header | key bytes | value bytes | crc32c
+// The CRC covers the header, key and value. Records are packed back to back
+// and carry consecutive LSNs, so the first record that fails its checksum or
+// breaks the LSN sequence marks the end of the log. A transaction is a BEGIN,
+// any number of SET/DELETE records and a COMMIT, all with the same txn id.
+#define WAL_RECORD_BEGIN  1
+#define WAL_RECORD_SET    2
+#define WAL_RECORD_COMMIT 3
+#define WAL_RECORD_DELETE 4
+
+#define WAL_MAX_KEY   (64u * 1024)
+#define WAL_MAX_VALUE (16u * 1024 * 1024)
+
+typedef struct wal_record_header {
+    uint64_t lsn;
+    uint64_t txn_id;
+    uint32_t key_length;
+    uint32_t value_length;
+    uint8_t type;
+    uint8_t reserved[7];
+} wal_record_header_t;
+
+// Decoded view of a record; key and value point into the source buffer
+typedef struct wal_record {
+    uint64_t lsn;
+    uint64_t txn_id;
+    uint8_t type;
+    const char *key;
+    uint32_t key_length;
+    const char *value;
+    uint32_t value_length;
+} wal_record_t;
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t length_b);
+
+size_t wal_record_size(uint32_t key_length, uint32_t value_length);
+size_t wal_record_encode(char *buffer, uint8_t type,
+                         const char *key, uint32_t key_length,
+                         const char *value, uint32_t value_length);
+uint64_t wal_record_stamp(char *buffer, size_t length, uint64_t next_lsn, uint64_t txn_id);
+size_t wal_record_decode(const char *data, size_t size, uint64_t expected_lsn, wal_record_t *record);
+size_t wal_valid_prefix(const char *data, size_t size, uint64_t first_lsn, wal_record_t *last);
+const char *wal_record_type_name(uint8_t type);
+
+#endif
@@ -0,0 +1,242 @@
+#include "walRecovery.h"
+#include "walLog.h"
+#include "memTable.h"
+
+// Committed operations travel to appliers in chunks, each a run of
+// [u8 type][u32 key_length][u32 value_length][key][value] entries. Copying
+// them out of the log lets the reader unmap a segment while appliers are
+// still working through it, and one hand-off per chunk keeps queue locking
+// off the per-record path.
+typedef struct recovery_chunk {
+    struct recovery_chunk *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} recovery_chunk_t;
+
+#define CHUNK_ENTRY_HEADER (1 + 2 * sizeof(uint32_t))
+
+typedef struct applier {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;       // a chunk was queued or the reader finished
+    pthread_cond_t space;       // the queue dropped below WAL_RECOVERY_QUEUE_DEPTH
+    recovery_chunk_t *head;
+    recovery_chunk_t *tail;
+    int queued;
+    int done;
+    int error;                  // errno of the first failed apply
+    recovery_chunk_t *filling;  // reader side only
+    wal_apply_fn fn;
+    void *arg;
+} applier_t;
+
+typedef struct reader_state {
+    applier_t *appliers;
+    int count;
+    int inside_tx;
+    uint64_t current_txn;
+    wal_record_t *ops;          // point into the mapped segment until COMMIT
+    size_t op_count;
+    size_t op_capacity;
+    wal_recovery_t *result;
+} reader_state_t;
+
+static void apply_chunk(applier_t *applier, const recovery_chunk_t *chunk) {
+    size_t offset = 0;
+    while (offset < chunk->used && !applier->error) {
+        const char *p = chunk->data + offset;
+        wal_record_t op;
+        memset(&op, 0, sizeof(op));
+        op.type = (uint8_t)p[0];
+        memcpy(&op.key_length, p + 1, sizeof(uint32_t));
+        memcpy(&op.value_length, p + 1 + sizeof(uint32_t), sizeof(uint32_t));
+        op.key = p + CHUNK_ENTRY_HEADER;
+        op.value = op.key + op.key_length;
+        offset += CHUNK_ENTRY_HEADER + op.key_length + op.value_length;
+
+        if (applier->fn(&op, applier->arg) < 0)
+            applier->error = errno ? errno : EIO;
+    }
+}
+
+// After a failure the applier keeps draining, so the reader never blocks on a full queue
+static void *applier_main(void *arg) {
+    applier_t *applier = arg;
+
+    pthread_mutex_lock(&applier->lock);
+    for (;;) {
+        while (!applier->head && !applier->done)
+            pthread_cond_wait(&applier->ready, &applier->lock);
+        if (!applier->head)
+            break;
+
+        recovery_chunk_t *chunk = applier->head;
+        applier->head = chunk->next;
+        if (!applier->head)
+            applier->tail = NULL;
+        applier->queued--;
+        pthread_cond_signal(&applier->space);
+        pthread_mutex_unlock(&applier->lock);
+
+        apply_chunk(applier, chunk);
+        free(chunk);
+        pthread_mutex_lock(&applier->lock);
+    }
+    pthread_mutex_unlock(&applier->lock);
+    return NULL;
+}
+
+static void push_chunk(applier_t *applier, recovery_chunk_t *chunk) {
+    chunk->next = NULL;
+    pthread_mutex_lock(&applier->lock);
+    while (applier->queued >= WAL_RECOVERY_QUEUE_DEPTH)
+        pthread_cond_wait(&applier->space, &applier->lock);
+    if (applier->tail)
+        applier->tail->next = chunk;
+    else
+        applier->head = chunk;
+    applier->tail = chunk;
+    applier->queued++;
+    pthread_cond_signal(&applier->ready);
+    pthread_mutex_unlock(&applier->lock);
+}
+
+static int dispatch(reader_state_t *state, const wal_record_t *op) {
+    applier_t *applier = &state->appliers[key_hash(op->key, op->key_length) % (uint64_t)state->count];
+    size_t size = CHUNK_ENTRY_HEADER + op->key_length + op->value_length;
+
+    recovery_chunk_t *chunk = applier->filling;
+    if (chunk && chunk->capacity - chunk->used < size) {
+        push_chunk(applier, chunk);
+        chunk = applier->filling = NULL;
+    }
+    if (!chunk) {
+        size_t capacity = size > WAL_RECOVERY_CHUNK_SIZE ? size : WAL_RECOVERY_CHUNK_SIZE;
+        chunk = malloc(sizeof(recovery_chunk_t) + capacity);
+        if (!chunk)
+            return -1;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        applier->filling = chunk;
+    }
+
+    char *p = chunk->data + chunk->used;
+    p[0] = (char)op->type;
+    memcpy(p + 1, &op->key_length, sizeof(uint32_t));
+    memcpy(p + 1 + sizeof(uint32_t), &op->value_length, sizeof(uint32_t));
+    memcpy(p + CHUNK_ENTRY_HEADER, op->key, op->key_length);
+    if (op->value_length)
+        memcpy(p + CHUNK_ENTRY_HEADER + op->key_length, op->value, op->value_length);
+    chunk->used += size;
+    return 0;
+}
+
+// Reader stage: a transaction is handed to the appliers only once its COMMIT
+// is seen, so an incomplete one at the tail is never applied
+static int read_record(const wal_record_t *record, void *arg) {
+    reader_state_t *state = arg;
+    int in_current = state->inside_tx && record->txn_id == state->current_txn;
+
+    if (record->type == WAL_RECORD_BEGIN) {
+        state->inside_tx = 1;
+        state->op_count = 0;
+        state->current_txn = record->txn_id;
+    }
+    else if ((record->type == WAL_RECORD_SET || record->type == WAL_RECORD_DELETE) && in_current) {
+        if (state->op_count == state->op_capacity) {
+            size_t capacity = state->op_capacity ? state->op_capacity * 2 : 16;
+            wal_record_t *grown = realloc(state->ops, sizeof(wal_record_t) * capacity);
+            if (!grown)
+                return -1;
+            state->ops = grown;
+            state->op_capacity = capacity;
+        }
+        state->ops[state->op_count++] = *record;
+    }
+    else if (record->type == WAL_RECORD_COMMIT && in_current) {
+        for (size_t i = 0; i < state->op_count; i++) {
+            if (dispatch(state, &state->ops[i]) < 0)
+                return -1;
+        }
+        wal_recovery_t *result = state->result;
+        result->operations += state->op_count;
+        result->transactions++;
+        result->applied_lsn = record->lsn;
+        if (record->txn_id > result->last_txn_id)
+            result->last_txn_id = record->txn_id;
+        state->inside_tx = 0;
+        state->op_count = 0;
+    }
+    return 0;
+}
+
+// Replay every committed transaction after after_lsn through fn on
+// `appliers` threads. result->applied_lsn and last_txn_id start from the
+// caller's values (typically the checkpoint) and move forward with the log.
+int wal_recover(const char *dir, uint64_t after_lsn, int appliers,
+                wal_apply_fn fn, void *arg, wal_recovery_t *result) {
+    if (appliers < 1)
+        appliers = 1;
+    if (appliers > WAL_RECOVERY_MAX_APPLIERS)
+        appliers = WAL_RECOVERY_MAX_APPLIERS;
+
+    reader_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.result = result;
+    state.appliers = calloc((size_t)appliers, sizeof(applier_t));
+    if (!state.appliers)
+        return -1;
+
+    int started = 0;
+    for (; started < appliers; started++) {
+        applier_t *applier = &state.appliers[started];
+        applier->fn = fn;
+        applier->arg = arg;
+        pthread_mutex_init(&applier->lock, NULL);
+        pthread_cond_init(&applier->ready, NULL);
+        pthread_cond_init(&applier->space, NULL);
+        if (pthread_create(&applier->thread, NULL, applier_main, applier) != 0) {
+            pthread_mutex_destroy(&applier->lock);
+            pthread_cond_destroy(&applier->ready);
+            pthread_cond_destroy(&applier->space);
+            break;
+        }
+    }
+    state.count = started;
+
+    uint64_t last_lsn;
+    int rc = -1;
+    if (started == appliers)
+        rc = wal_log_replay(dir, after_lsn, read_record, &state, &last_lsn);
+    int saved_errno = errno;
+
+    for (int i = 0; i < started; i++) {
+        applier_t *applier = &state.appliers[i];
+        if (applier->filling && rc == 0)
+            push_chunk(applier, applier->filling);
+        else
+            free(applier->filling);
+        pthread_mutex_lock(&applier->lock);
+        applier->done = 1;
+        pthread_cond_signal(&applier->ready);
+        pthread_mutex_unlock(&applier->lock);
+    }
+    for (int i = 0; i < started; i++) {
+        applier_t *applier = &state.appliers[i];
+        pthread_join(applier->thread, NULL);
+        if (applier->error && rc == 0) {
+            rc = -1;
+            saved_errno = applier->error;
+        }
+        pthread_mutex_destroy(&applier->lock);
+        pthread_cond_destroy(&applier->ready);
+        pthread_cond_destroy(&applier->space);
+    }
+
+    result->incomplete = state.inside_tx;
+    free(state.ops);
+    free(state.appliers);
+    errno = saved_errno;
+    return rc;
+}
@@ -0,0 +1,32 @@
+#ifndef WALRECOVERY_H
+#define WALRECOVERY_H
+
+#include "main.h"
+#include "walRecord.h"
+
+// Parallel replay in three stages. One reader walks the log, finds record
+// boundaries and buffers each transaction until its COMMIT. Committed SET and
+// DELETE operations are then routed by key hash to one of N applier threads,
+// so every key is applied in log order by a single thread while different
+// keys proceed in parallel. Nothing is made durable here: the caller flushes
+// and checkpoints once at the end.
+#define WAL_RECOVERY_MAX_APPLIERS 64
+#define WAL_RECOVERY_CHUNK_SIZE (256u * 1024)
+#define WAL_RECOVERY_QUEUE_DEPTH 16     // chunks in flight per applier
+
+typedef struct wal_recovery {
+    uint64_t applied_lsn;       // COMMIT LSN of the last committed transaction
+    uint64_t last_txn_id;
+    uint64_t transactions;
+    uint64_t operations;
+    int incomplete;             // the log ends inside a transaction
+} wal_recovery_t;
+
+// Called on applier threads for SET and DELETE records. lsn and txn_id are
+// not carried across, only type, key and value.
+typedef int (*wal_apply_fn)(const wal_record_t *op, void *arg);
+
+int wal_recover(const char *dir, uint64_t after_lsn, int appliers,
+                wal_apply_fn fn, void *arg, wal_recovery_t *result);
+
+#endif
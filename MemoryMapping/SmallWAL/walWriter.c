@@ -0,0 +1,538 @@
+#include "walWriter.h"
+#include "walRecord.h"
+#include "faultInject.h"
+#include <limits.h>
+#include <sys/mman.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// pwritev until every iovec is on disk, resuming after short writes
+static int pwritev_all(int fd, struct iovec *iov, size_t count, off_t offset) {
+    while (count > 0) {
+        int chunk = count > IOV_MAX ? IOV_MAX : (int)count;
+        ssize_t n = pwritev(fd, iov, chunk, offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        offset += n;
+
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0 && n > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+static double elapsed_us(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static void record_sync(wal_writer_t *writer, double us) {
+    int bucket = 0;
+    while (bucket < WAL_LATENCY_BUCKETS - 1 && us >= (double)(1ull << bucket))
+        bucket++;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->syncs++;
+    writer->sync_histogram[bucket]++;
+    pthread_mutex_unlock(&writer->lock);
+}
+
+// msync only the pages written since the last sync; the page holding the
+// previous end is rewritten because the next batch started inside it
+static int sync_dirty(wal_writer_t *writer) {
+    if (!writer->map || writer->segment_bytes <= writer->synced_bytes)
+        return 0;
+
+    size_t start = writer->synced_bytes & ~(writer->page_size - 1);
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    if (msync(writer->map + start, writer->segment_bytes - start, MS_SYNC) < 0)
+        return -1;
+    record_sync(writer, elapsed_us(&begin));
+    writer->synced_bytes = writer->segment_bytes;
+    return 0;
+}
+
+// Simulated power cut: of the bytes not yet synced keep a random prefix and
+// zero the rest, then push that image to the file before the process dies
+static void tear_unsynced(wal_writer_t *writer) {
+    if (writer->fd < 0 || writer->segment_bytes <= writer->synced_bytes)
+        return;
+    size_t unsynced = writer->segment_bytes - writer->synced_bytes;
+    size_t keep = (size_t)rand() % unsynced;
+    size_t from = writer->synced_bytes + keep;
+
+    fprintf(stderr, "fault: tearing %zu of %zu unsynced bytes\n", unsynced - keep, unsynced);
+    if (writer->map) {
+        memset(writer->map + from, 0, writer->segment_bytes - from);
+        msync(writer->map, writer->segment_bytes, MS_SYNC);
+    }
+    else {
+        wal_zero_fill(writer->fd, (off_t)from, writer->segment_bytes - from);
+    }
+}
+
+static void crash_point(wal_writer_t *writer, const char *point) {
+    if (!fault_should_crash(point))
+        return;
+    if (fault_power_loss())
+        tear_unsynced(writer);
+    fault_crash(point);
+}
+
+// Write only the first `bytes` of a batch, then crash
+static void crash_mid_batch(wal_writer_t *writer, struct iovec *batch, size_t count, size_t bytes) {
+    size_t offset = writer->segment_bytes;
+    for (size_t i = 0; i < count && bytes > 0; i++) {
+        size_t length = batch[i].iov_len < bytes ? batch[i].iov_len : bytes;
+        if (writer->map)
+            memcpy(writer->map + offset, batch[i].iov_base, length);
+        else if (pwrite(writer->fd, batch[i].iov_base, length, (off_t)offset) != (ssize_t)length)
+            break;
+        offset += length;
+        bytes -= length;
+    }
+    writer->segment_bytes = offset;
+    if (fault_power_loss())
+        tear_unsynced(writer);
+    fault_crash(FAULT_WAL_MID_RECORD);
+}
+
+// Size a segment file to capacity with written zeros past `from`
+static int preallocate(int fd, size_t from, size_t capacity) {
+    int rc = posix_fallocate(fd, (off_t)from, (off_t)(capacity - from));
+    if (rc != 0 && rc != EOPNOTSUPP && rc != EINVAL) {
+        errno = rc;
+        return -1;
+    }
+    return wal_zero_fill(fd, (off_t)from, capacity - from);
+}
+
+static int map_segment(wal_writer_t *writer) {
+    if (writer->durability == WAL_SYNC_DSYNC)
+        return 0;
+    writer->map = mmap(NULL, writer->segment_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+    if (writer->map == MAP_FAILED) {
+        writer->map = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int close_segment(wal_writer_t *writer) {
+    int rc = 0;
+    if (writer->fd < 0)
+        return 0;
+    if (writer->durability != WAL_SYNC_NONE)
+        rc = sync_dirty(writer);
+    if (writer->map)
+        munmap(writer->map, writer->segment_capacity);
+    close(writer->fd);
+    writer->map = NULL;
+    writer->fd = -1;
+    return rc;
+}
+
+// Close the full segment and start a new one named after the batch's first
+// LSN, reusing a spare when one is parked. min_size covers a batch larger
+// than a whole segment.
+static int open_segment(wal_writer_t *writer, uint64_t first_lsn, size_t min_size) {
+    char path[PATH_MAX];
+    int flags = O_RDWR | (writer->durability == WAL_SYNC_DSYNC ? O_DSYNC : 0);
+
+    if (close_segment(writer) < 0)
+        return -1;
+    crash_point(writer, FAULT_WAL_ROTATE);
+
+    size_t capacity = min_size > writer->segment_size ? min_size : writer->segment_size;
+    wal_segment_path(path, sizeof(path), writer->dir, first_lsn);
+    int taken = capacity == writer->segment_size ? wal_spare_take(writer->dir, path) : 0;
+    if (taken < 0)
+        return -1;
+
+    writer->fd = open(path, flags | (taken ? 0 : O_CREAT | O_TRUNC), 0644);
+    if (writer->fd < 0)
+        return -1;
+    if (!taken && (preallocate(writer->fd, 0, capacity) < 0 ||
+                   (writer->durability != WAL_SYNC_NONE && fdatasync(writer->fd) < 0)))
+        return -1;
+
+    writer->segment_capacity = capacity;
+    writer->segment_bytes = 0;
+    writer->synced_bytes = 0;
+    if (map_segment(writer) < 0)
+        return -1;
+
+    return writer->durability != WAL_SYNC_NONE ? wal_fsync_dir(writer->dir) : 0;
+}
+
+static int write_batch(wal_writer_t *writer, struct iovec *batch, size_t count, size_t bytes) {
+    if (fault_should_crash(FAULT_WAL_MID_RECORD))
+        crash_mid_batch(writer, batch, count, bytes / 2);
+
+    if (writer->map) {
+        char *p = writer->map + writer->segment_bytes;
+        for (size_t i = 0; i < count; i++) {
+            memcpy(p, batch[i].iov_base, batch[i].iov_len);
+            p += batch[i].iov_len;
+        }
+    }
+    else {
+        // O_DSYNC: the write itself is the sync
+        struct timespec begin;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        if (pwritev_all(writer->fd, batch, count, (off_t)writer->segment_bytes) < 0)
+            return -1;
+        record_sync(writer, elapsed_us(&begin));
+    }
+
+    if (writer->segment_bytes == writer->synced_bytes)
+        clock_gettime(CLOCK_MONOTONIC, &writer->dirty_since);
+    writer->segment_bytes += bytes;
+    if (!writer->map)
+        writer->synced_bytes = writer->segment_bytes;
+    return 0;
+}
+
+static int periodic_due(const wal_writer_t *writer, struct timespec *deadline) {
+    *deadline = writer->dirty_since;
+    deadline->tv_sec += writer->interval_ms / 1000;
+    deadline->tv_nsec += (long)(writer->interval_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec ||
+           (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static void *flusher_main(void *arg) {
+    wal_writer_t *writer = arg;
+    int periodic = writer->durability == WAL_SYNC_PERIODIC;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        // Periodic mode sleeps until new work or until the oldest unsynced
+        // write is interval_ms old
+        while (writer->pending_count == 0 && !writer->stopping) {
+            struct timespec deadline;
+            if (!periodic || writer->segment_bytes == writer->synced_bytes) {
+                pthread_cond_wait(&writer->flush_cond, &writer->lock);
+                continue;
+            }
+            if (!periodic_due(writer, &deadline)) {
+                pthread_cond_timedwait(&writer->flush_cond, &writer->lock, &deadline);
+                continue;
+            }
+            pthread_mutex_unlock(&writer->lock);
+            int err = sync_dirty(writer) < 0 ? errno : 0;
+            pthread_mutex_lock(&writer->lock);
+            if (err && !writer->error)
+                writer->error = err;
+        }
+
+        if (writer->pending_count == 0 && writer->stopping)
+            break;
+
+        // Take the whole queue; committers keep enqueuing into the other array
+        struct iovec *batch = writer->pending;
+        size_t batch_count = writer->pending_count;
+        size_t batch_capacity = writer->pending_capacity;
+        uint64_t batch_end = writer->submitted;
+        uint64_t batch_first_lsn = writer->written_lsn + 1;
+        writer->written_lsn = writer->next_lsn - 1;
+
+        writer->pending = writer->flushing;
+        writer->pending_capacity = writer->flushing_capacity;
+        writer->pending_count = 0;
+        pthread_mutex_unlock(&writer->lock);
+
+        size_t batch_bytes = 0;
+        for (size_t i = 0; i < batch_count; i++)
+            batch_bytes += batch[i].iov_len;
+
+        int err = 0;
+        if ((writer->fd < 0 || writer->segment_bytes + batch_bytes > writer->segment_capacity) &&
+            open_segment(writer, batch_first_lsn, batch_bytes) < 0)
+            err = errno;
+        else if (write_batch(writer, batch, batch_count, batch_bytes) < 0)
+            err = errno;
+        else {
+            crash_point(writer, FAULT_WAL_BEFORE_SYNC);
+            struct timespec deadline;
+            if (writer->durability == WAL_SYNC_COMMIT && sync_dirty(writer) < 0)
+                err = errno;
+            else if (periodic && periodic_due(writer, &deadline) && sync_dirty(writer) < 0)
+                err = errno;
+        }
+        if (!err)
+            crash_point(writer, FAULT_WAL_BEFORE_ACK);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->flushing = batch;
+        writer->flushing_capacity = batch_capacity;
+        writer->batches++;
+        if (err && !writer->error)
+            writer->error = err;
+        writer->flushed = batch_end;
+        pthread_cond_broadcast(&writer->done_cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// Offset just past the last non-zero byte of data[from, size)
+static size_t nonzero_end(const char *data, size_t from, size_t size) {
+    while (size > from && data[size - 1] == 0)
+        size--;
+    return size;
+}
+
+// Find the end of the intact log in a segment. For the newest segment
+// (repair set), whatever a crash left past that end is zeroed and a short
+// segment from before preallocation is grown to full size.
+// *last is the final intact record (lsn 0 if none).
+static int scan_segment(wal_writer_t *writer, int fd, uint64_t first_lsn, int repair,
+                        wal_record_t *last, size_t *valid, size_t *capacity) {
+    struct stat sb;
+    memset(last, 0, sizeof(*last));
+    *valid = 0;
+    if (fstat(fd, &sb) < 0)
+        return -1;
+    *capacity = (size_t)sb.st_size;
+
+    size_t dirty = 0;
+    if (sb.st_size > 0) {
+        char *data = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+            return -1;
+        *valid = wal_valid_prefix(data, (size_t)sb.st_size, first_lsn, last);
+        dirty = nonzero_end(data, *valid, (size_t)sb.st_size);
+        munmap(data, (size_t)sb.st_size);
+    }
+    if (!repair)
+        return 0;
+
+    if (dirty > *valid) {
+        fprintf(stderr, "WAL: zeroing %zu bytes of torn tail\n", dirty - *valid);
+        if (wal_zero_fill(fd, (off_t)*valid, dirty - *valid) < 0)
+            return -1;
+    }
+    if (*capacity < writer->segment_size) {
+        if (preallocate(fd, *capacity, writer->segment_size) < 0)
+            return -1;
+        *capacity = writer->segment_size;
+    }
+    if ((dirty > *valid || *capacity != (size_t)sb.st_size) && fsync(fd) < 0)
+        return -1;
+    return 0;
+}
+
+// Reopen the newest segment, or remember to start one right after the
+// checkpoint. LSNs and transaction ids continue from the last intact record,
+// falling back to the values saved in the checkpoint.
+static int resume_log(wal_writer_t *writer) {
+    wal_segment_t *segments;
+    size_t count;
+    wal_checkpoint_t checkpoint;
+    wal_record_t last;
+    size_t valid, capacity;
+    int flags = O_RDWR | (writer->durability == WAL_SYNC_DSYNC ? O_DSYNC : 0);
+
+    if (wal_checkpoint_read(writer->dir, &checkpoint) < 0)
+        return -1;
+    writer->next_lsn = checkpoint.lsn + 1;
+    writer->last_txn_id = checkpoint.last_txn_id;
+
+    if (wal_segment_list(writer->dir, &segments, &count) < 0)
+        return -1;
+
+    for (size_t i = count; i-- > 0;) {
+        int newest = i == count - 1;
+        int fd = open(segments[i].path, newest ? flags : O_RDONLY);
+        if (fd < 0 || scan_segment(writer, fd, segments[i].first_lsn, newest, &last, &valid, &capacity) < 0) {
+            if (fd >= 0)
+                close(fd);
+            free(segments);
+            return -1;
+        }
+        if (newest) {
+            writer->fd = fd;
+            writer->segment_capacity = capacity;
+            writer->segment_bytes = writer->synced_bytes = valid;
+            if (map_segment(writer) < 0) {
+                free(segments);
+                return -1;
+            }
+        }
+        else {
+            close(fd);
+        }
+
+        // A segment created just before a crash may hold nothing; look further back
+        if (last.lsn > 0) {
+            if (last.lsn + 1 > writer->next_lsn)
+                writer->next_lsn = last.lsn + 1;
+            if (last.txn_id > writer->last_txn_id)
+                writer->last_txn_id = last.txn_id;
+            break;
+        }
+        if (newest && segments[i].first_lsn > writer->next_lsn)
+            writer->next_lsn = segments[i].first_lsn;
+    }
+
+    free(segments);
+    return 0;
+}
+
+static void free_writer(wal_writer_t *writer) {
+    if (writer->map)
+        munmap(writer->map, writer->segment_capacity);
+    if (writer->fd >= 0)
+        close(writer->fd);
+    free(writer->pending);
+    free(writer->flushing);
+    free(writer);
+}
+
+wal_writer_t *wal_writer_open(const char *dir, int durability, int interval_ms) {
+    wal_writer_t *writer = calloc(1, sizeof(wal_writer_t));
+    if (!writer)
+        return NULL;
+
+    snprintf(writer->dir, sizeof(writer->dir), "%s", dir);
+    writer->fd = -1;
+    writer->durability = durability;
+    writer->interval_ms = interval_ms > 0 ? interval_ms : 1;
+    writer->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    writer->segment_size = WAL_SEGMENT_SIZE;
+    if ((mkdir(dir, 0755) < 0 && errno != EEXIST) || resume_log(writer) < 0) {
+        free_writer(writer);
+        return NULL;
+    }
+    writer->written_lsn = writer->next_lsn - 1;
+
+    writer->pending_capacity = writer->flushing_capacity = 64;
+    writer->pending = malloc(sizeof(struct iovec) * writer->pending_capacity);
+    writer->flushing = malloc(sizeof(struct iovec) * writer->flushing_capacity);
+    if (!writer->pending || !writer->flushing) {
+        free_writer(writer);
+        return NULL;
+    }
+
+    // Periodic deadlines are taken from CLOCK_MONOTONIC
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->flush_cond, &attr);
+    pthread_cond_init(&writer->done_cond, NULL);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&writer->flusher, NULL, flusher_main, writer) != 0) {
+        free_writer(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+// Queue one encoded transaction and block until the batch holding it has
+// been written out under the writer's durability mode.
+// LSNs and the transaction id are stamped here, under the lock, so log order
+// matches both LSN and txn id order; the checksums only take in the headers
+// here, the bodies were summed by wal_record_encode. The caller's buffer must stay
+// valid until this returns. *txn_id (optional) receives the assigned id.
+int wal_writer_append(wal_writer_t *writer, void *records, size_t length, uint64_t *txn_id) {
+    pthread_mutex_lock(&writer->lock);
+
+    if (writer->error) {
+        errno = writer->error;
+        pthread_mutex_unlock(&writer->lock);
+        return -1;
+    }
+
+    if (writer->pending_count == writer->pending_capacity) {
+        size_t capacity = writer->pending_capacity * 2;
+        struct iovec *grown = realloc(writer->pending, sizeof(struct iovec) * capacity);
+        if (!grown) {
+            pthread_mutex_unlock(&writer->lock);
+            errno = ENOMEM;
+            return -1;
+        }
+        writer->pending = grown;
+        writer->pending_capacity = capacity;
+    }
+
+    uint64_t id = ++writer->last_txn_id;
+    writer->next_lsn = wal_record_stamp(records, length, writer->next_lsn, id);
+    if (txn_id)
+        *txn_id = id;
+    writer->pending[writer->pending_count].iov_base = records;
+    writer->pending[writer->pending_count].iov_len = length;
+    writer->pending_count++;
+    uint64_t ticket = ++writer->submitted;
+
+    pthread_cond_signal(&writer->flush_cond);
+    while (writer->flushed < ticket)
+        pthread_cond_wait(&writer->done_cond, &writer->lock);
+
+    int err = writer->error;
+    pthread_mutex_unlock(&writer->lock);
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+// Drain the queue, stop the flusher and release the WAL file. Anything still
+// unsynced is synced first, except in WAL_SYNC_NONE.
+void wal_writer_close(wal_writer_t *writer) {
+    if (!writer)
+        return;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = 1;
+    pthread_cond_signal(&writer->flush_cond);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->flusher, NULL);
+
+    close_segment(writer);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->flush_cond);
+    pthread_cond_destroy(&writer->done_cond);
+    free_writer(writer);
+}
+
+const char *wal_durability_name(int durability) {
+    switch (durability) {
+    case WAL_SYNC_COMMIT:
+        return "commit";
+    case WAL_SYNC_PERIODIC:
+        return "periodic";
+    case WAL_SYNC_DSYNC:
+        return "dsync";
+    case WAL_SYNC_NONE:
+        return "none";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef WALWRITER_H
+#define WALWRITER_H
+
+#include "main.h"
+#include "walLog.h"
+
+// Long-lived WAL handle with group commit.
+// Committers queue their records and sleep; one flusher thread copies the
+// whole queue into the current segment and makes it durable according to
+// the durability mode, then wakes every committer of that batch. Opening the
+// handle zeroes any torn tail left by a crash and resumes the LSN sequence;
+// a batch that would overflow the current segment starts a new one.
+//
+// Durability modes:
+//   WAL_SYNC_COMMIT   records are copied into the mapped segment and only the
+//                     dirty range is msync'd before committers are woken
+//   WAL_SYNC_PERIODIC commits return once copied; the flusher msyncs the dirty
+//                     range every interval_ms, bounding what a crash can lose
+//   WAL_SYNC_DSYNC    pwritev through an O_DSYNC descriptor, no mapping
+//   WAL_SYNC_NONE     copied into the mapping, write-back left to the kernel
+#define WAL_SYNC_COMMIT   0
+#define WAL_SYNC_PERIODIC 1
+#define WAL_SYNC_DSYNC    2
+#define WAL_SYNC_NONE     3
+
+#define WAL_LATENCY_BUCKETS 32      // bucket i counts syncs under 2^i us
+
+typedef struct wal_writer {
+    char dir[PATH_MAX];
+    int fd;                     // current segment, -1 until the first batch
+    char *map;                  // current segment mapping, NULL for WAL_SYNC_DSYNC
+    int durability;
+    int interval_ms;            // WAL_SYNC_PERIODIC only
+    size_t page_size;
+    size_t segment_size;        // preallocated size of a new segment
+    size_t segment_capacity;    // size of the current segment file
+    size_t segment_bytes;       // bytes written to the current segment
+    size_t synced_bytes;        // prefix of the current segment known durable
+    struct timespec dirty_since;    // first unsynced write, WAL_SYNC_PERIODIC
+
+    pthread_mutex_t lock;
+    pthread_cond_t flush_cond;  // signalled when work is queued
+    pthread_cond_t done_cond;   // broadcast when a batch is durable
+
+    struct iovec *pending;      // records queued by committers
+    size_t pending_count;
+    size_t pending_capacity;
+    struct iovec *flushing;     // batch owned by the flusher
+    size_t flushing_capacity;
+
+    uint64_t next_lsn;          // LSN handed to the next queued record
+    uint64_t written_lsn;       // last LSN handed to the file system
+    uint64_t last_txn_id;       // ids are monotonic across restarts
+    uint64_t submitted;         // sequence of the last queued record
+    uint64_t flushed;           // sequence of the last record written out
+    int error;                  // sticky errno from the flusher
+    int stopping;
+
+    uint64_t batches;           // number of write rounds
+    uint64_t syncs;
+    uint64_t sync_histogram[WAL_LATENCY_BUCKETS];
+    pthread_t flusher;
+} wal_writer_t;
+
+wal_writer_t *wal_writer_open(const char *dir, int durability, int interval_ms);
+int wal_writer_append(wal_writer_t *writer, void *records, size_t length, uint64_t *txn_id);
+void wal_writer_close(wal_writer_t *writer);
+const char *wal_durability_name(int durability);
+
+#endif